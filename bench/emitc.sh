@@ -0,0 +1,35 @@
+#!/bin/sh
+#####################################
+# emitc.sh - interpreted vs --emit-c compiled workloads
+#
+# Translates each workload that --emit-c supports to C, compiles it
+# with $CC -O2 after checking its output against the interpreter's, and
+# prints both run times in milliseconds.
+# Usage: bench/emitc.sh [interpreter] (default: bin/basicinterp)
+#####################################
+
+BASIC=${1:-bin/basicinterp}
+WORKLOADS="arrays loops strings"
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# run <command...>: print the command's run time in nanoseconds
+run() {
+  start=$(date +%s%N)
+  "$@" > /dev/null 2>&1
+  end=$(date +%s%N)
+  echo $((end - start))
+}
+
+printf "%-10s %12s %12s %11s\n" workload "interp ms" "native ms" speedup
+for w in $WORKLOADS; do
+  if ! "$BASIC" --emit-c "$DIR/$w.c" --check "bench/workloads/$w.bsc" > "$DIR/out" 2>&1; then
+    cat "$DIR/out" >&2
+    exit 1
+  fi
+  i=$(run "$BASIC" "bench/workloads/$w.bsc")
+  n=$(run "$DIR/$w")
+  awk -v w="$w" -v i="$i" -v n="$n" \
+    'BEGIN { if (n <= 0) n = 1;
+             printf "%-10s %12.1f %12.1f %10.0fx\n", w, i / 1e6, n / 1e6, i / n }'
+done
@@ -0,0 +1,59 @@
+#!/bin/sh
+#####################################
+# fileio.sh - READ#/WRITE# throughput
+#
+# Moves a 16 MiB MAPPED array to and from a file with bulk WRITE# and
+# READ#, for each element width, and prints MB/s.
+# Usage: bench/fileio.sh [interpreter] (default: bin/basicinterp)
+#####################################
+
+BASIC=${1:-bin/basicinterp}
+BYTES=16777216
+REPS=8
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# run <script>: print the script's run time in nanoseconds
+run() {
+  start=$(date +%s%N)
+  "$BASIC" "$1" > "$DIR/out" 2>&1
+  end=$(date +%s%N)
+  if grep -q "^Error" "$DIR/out"; then
+    cat "$DIR/out" >&2
+    exit 1
+  fi
+  echo $((end - start))
+}
+
+printf "%-8s %12s %12s\n" type "WRITE# MB/s" "READ# MB/s"
+for spec in UINT8:1 UINT16:2 UINT32:4; do
+  type=${spec%:*}
+  n=$((BYTES / ${spec#*:}))
+
+  cat > "$DIR/write.bsc" <<END
+VAR a[$n] $type MAPPED "$DIR/array.bin" SHARED
+VAR i INT32
+FOR i = 1 TO $REPS
+OPEN 1, "$DIR/data.bin", "w"
+WRITE# 1, a
+CLOSE 1
+NEXT i
+END
+
+  cat > "$DIR/read.bsc" <<END
+VAR a[$n] $type MAPPED "$DIR/array.bin" SHARED
+VAR i INT32
+FOR i = 1 TO $REPS
+OPEN 1, "$DIR/data.bin", "r"
+READ# 1, a
+CLOSE 1
+NEXT i
+END
+
+  # Fault the array and the data file in before timing anything
+  run "$DIR/write.bsc" > /dev/null
+  w=$(run "$DIR/write.bsc")
+  r=$(run "$DIR/read.bsc")
+  awk -v t="$type" -v b=$((BYTES * REPS)) -v w="$w" -v r="$r" \
+    'BEGIN { printf "%-8s %12.1f %12.1f\n", t, b / w * 1000, b / r * 1000 }'
+done
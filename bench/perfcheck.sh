@@ -0,0 +1,101 @@
+#!/bin/sh
+#####################################
+# perfcheck.sh - workload timing against a stored baseline
+#
+# Runs every bench/workloads/*.bsc RUNS times and compares the median
+# run time with bench/baseline.txt. A workload regresses when its median
+# is slower than the baseline's by more than THRESHOLD percent and by
+# more than 3 times the spread (median absolute deviation) of the two
+# sets of runs.
+#
+# Usage: bench/perfcheck.sh [--update] [interpreter]
+#   --update      Store the medians as the new baseline instead
+#   interpreter   Default: bin/basicinterp
+# Environment: RUNS (default 7), THRESHOLD (percent, default 10)
+#####################################
+
+BENCH_DIR=$(dirname "$0")
+BASELINE=$BENCH_DIR/baseline.txt
+RUNS=${RUNS:-7}
+THRESHOLD=${THRESHOLD:-10}
+UPDATE=0
+if [ "$1" = "--update" ]; then
+  UPDATE=1
+  shift
+fi
+BASIC=${1:-bin/basicinterp}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# median: print the median of the numbers on stdin
+median() {
+  sort -n | awk '{ t[NR] = $1 }
+    END { print (NR % 2 ? t[(NR + 1) / 2] : int((t[NR / 2] + t[NR / 2 + 1]) / 2)) }'
+}
+
+# stats <file of times>: print the median and median absolute deviation
+stats() {
+  m=$(median < "$1")
+  mad=$(awk -v m="$m" '{ print ($1 > m ? $1 - m : m - $1) }' "$1" | median)
+  echo "$m $mad"
+}
+
+# Time every workload (microseconds)
+for w in "$BENCH_DIR"/workloads/*.bsc; do
+  name=$(basename "$w" .bsc)
+  : > "$TMP/$name.times"
+  # One untimed run to warm the caches
+  "$BASIC" "$w" > "$TMP/out" 2>&1
+  if grep -q "^Error" "$TMP/out"; then
+    echo "$name:" >&2
+    cat "$TMP/out" >&2
+    exit 1
+  fi
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    start=$(date +%s%N)
+    "$BASIC" "$w" > /dev/null 2>&1
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000)) >> "$TMP/$name.times"
+    i=$((i + 1))
+  done
+  echo "$name $(stats "$TMP/$name.times")" >> "$TMP/current"
+done
+
+if [ $UPDATE -eq 1 ]; then
+  {
+    echo "# workload median_us mad_us (bench/perfcheck.sh --update)"
+    cat "$TMP/current"
+  } > "$BASELINE"
+  echo "Baseline updated: $BASELINE"
+  cat "$TMP/current"
+  exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+  echo "No baseline; run 'make perfbaseline' first" >&2
+  exit 1
+fi
+
+awk -v threshold="$THRESHOLD" '
+  FNR == NR { if ($1 !~ /^#/) { base[$1] = $2; bmad[$1] = $3 } next }
+  FNR == 1 {
+    printf "%-12s %12s %12s %8s  %s\n", "workload", "baseline ms", "current ms", "delta", "status"
+  }
+  {
+    if (!($1 in base)) {
+      printf "%-12s %12s %12.1f %8s  %s\n", $1, "-", $2 / 1000, "-", "new"
+      next
+    }
+    delta = $2 - base[$1]
+    limit = base[$1] * threshold / 100
+    if (3 * (bmad[$1] + $3) > limit) {
+      limit = 3 * (bmad[$1] + $3)
+    }
+    status = (delta > limit ? "REGRESSED" : "ok")
+    failed += (delta > limit)
+    printf "%-12s %12.1f %12.1f %+7.1f%%  %s\n", $1, base[$1] / 1000, $2 / 1000,
+           delta * 100 / base[$1], status
+  }
+  END { exit (failed > 0) }
+' "$BASELINE" "$TMP/current"
@@ -0,0 +1,151 @@
+#!/bin/sh
+#####################################
+# reduce.sh - whole-array SUM/MAX/COUNT/DOT/SORT
+#
+# Times each built-in on a MAPPED array of random elements against the
+# same work done element by element in a FOR loop, for each element
+# width, and prints ns per element. The loop SORT is an exchange sort,
+# so it runs on SORT_N elements only.
+# Usage: bench/reduce.sh [interpreter] (default: bin/basicinterp)
+#####################################
+
+BASIC=${1:-bin/basicinterp}
+N=262144
+SORT_N=1024
+REPS=64
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# run <script>: print the script's run time in nanoseconds
+run() {
+  start=$(date +%s%N)
+  "$BASIC" "$1" > "$DIR/out" 2>&1
+  end=$(date +%s%N)
+  if grep -q "^Error" "$DIR/out"; then
+    cat "$DIR/out" >&2
+    exit 1
+  fi
+  echo $((end - start))
+}
+
+# bench <name> <type> <elements> <loop script> <built-in script>: time
+# both, less the time to start up and map the arrays
+bench() {
+  base=$(run "$DIR/base.bsc")
+  l=$(run "$4")
+  b=$(run "$5")
+  awk -v op="$1" -v t="$2" -v n="$3" -v r=$REPS -v base="$base" -v l="$l" -v b="$b" \
+    'BEGIN { l = (l - base) / n; b = (b - base) / (n * r); if (b <= 0) b = 0.001;
+             printf "%-6s %-8s %12.2f %12.3f %10.0fx\n", op, t, l, b, l / b }'
+}
+
+printf "%-6s %-8s %12s %12s %11s\n" op type "loop ns/el" "built-in" speedup
+for spec in UINT8:1 INT16:2 INT32:4 INT64:8 FLOAT32:4; do
+  type=${spec%:*}
+  acc=INT64
+  [ "$type" = FLOAT32 ] && acc=FLOAT64
+  head -c $((N * ${spec#*:})) /dev/urandom > "$DIR/a.bin"
+  head -c $((N * ${spec#*:})) /dev/urandom > "$DIR/b.bin"
+  decl="VAR a[$N] $type MAPPED \"$DIR/a.bin\"
+VAR b[$N] $type MAPPED \"$DIR/b.bin\"
+VAR i INT32
+VAR s $acc
+VAR m $type
+VAR c INT32"
+
+  cat > "$DIR/base.bsc" <<END
+$decl
+END
+
+  cat > "$DIR/sum_loop.bsc" <<END
+$decl
+FOR i = 0 TO $((N - 1))
+s = s + a[i]
+NEXT i
+END
+  cat > "$DIR/sum.bsc" <<END
+$decl
+FOR i = 1 TO $REPS
+s = SUM(a)
+NEXT i
+END
+  bench SUM $type $N "$DIR/sum_loop.bsc" "$DIR/sum.bsc"
+
+  cat > "$DIR/max_loop.bsc" <<END
+$decl
+m = a[0]
+FOR i = 1 TO $((N - 1))
+IF a[i] > m THEN
+m = a[i]
+END IF
+NEXT i
+END
+  cat > "$DIR/max.bsc" <<END
+$decl
+FOR i = 1 TO $REPS
+m = MAX(a)
+NEXT i
+END
+  bench MAX $type $N "$DIR/max_loop.bsc" "$DIR/max.bsc"
+
+  cat > "$DIR/count_loop.bsc" <<END
+$decl
+m = a[7]
+FOR i = 0 TO $((N - 1))
+IF a[i] == m THEN
+c = c + 1
+END IF
+NEXT i
+END
+  cat > "$DIR/count.bsc" <<END
+$decl
+m = a[7]
+FOR i = 1 TO $REPS
+c = COUNT(a, m)
+NEXT i
+END
+  bench COUNT $type $N "$DIR/count_loop.bsc" "$DIR/count.bsc"
+
+  cat > "$DIR/dot_loop.bsc" <<END
+$decl
+FOR i = 0 TO $((N - 1))
+s = s + a[i] * b[i]
+NEXT i
+END
+  cat > "$DIR/dot.bsc" <<END
+$decl
+FOR i = 1 TO $REPS
+s = DOT(a, b)
+NEXT i
+END
+  bench DOT $type $N "$DIR/dot_loop.bsc" "$DIR/dot.bsc"
+
+  # Sorts write their array, so each run gets a fresh copy
+  cat > "$DIR/sort_loop.bsc" <<END
+VAR a[$SORT_N] $type MAPPED "$DIR/s.bin" SHARED
+VAR i INT32
+VAR j INT32
+VAR m $type
+FOR i = 1 TO $((SORT_N - 1))
+FOR j = i TO 1 STEP -1
+IF a[j - 1] > a[j] THEN
+m = a[j]
+a[j] = a[j - 1]
+a[j - 1] = m
+END IF
+NEXT j
+NEXT i
+END
+  cat > "$DIR/sort.bsc" <<END
+VAR a[$N] $type MAPPED "$DIR/s.bin" SHARED
+SORT a
+END
+  cp "$DIR/a.bin" "$DIR/s.bin"
+  base=$(run "$DIR/base.bsc")
+  l=$(run "$DIR/sort_loop.bsc")
+  cp "$DIR/a.bin" "$DIR/s.bin"
+  b=$(run "$DIR/sort.bsc")
+  awk -v t="$type" -v ln=$SORT_N -v n=$N -v base="$base" -v l="$l" -v b="$b" \
+    'BEGIN { l = (l - base) / ln; b = (b - base) / n; if (b <= 0) b = 0.001;
+             printf "%-6s %-8s %12.2f %12.3f %10.0fx\n", "SORT", t, l, b, l / b }'
+done
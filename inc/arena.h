@@ -0,0 +1,32 @@
+#ifndef __BASIC_ARENA_H__
+#define __BASIC_ARENA_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stddef.h>
+
+/* Defines ------------------------------------------------------------------ */
+#define ARENA_ALIGN           8 // Bytes
+
+// Arena chunk; chunks are chained newest first
+typedef struct arena_chunk {
+  struct arena_chunk *next;
+  size_t        size;
+  size_t        used;
+  char          data[];
+} arena_chunk_t;
+
+// Arena data structure
+typedef struct {
+  arena_chunk_t *head;      // Chunk currently allocated from
+  size_t        min_size;   // Size of the first chunk
+  void         *last;       // Most recent allocation (can grow in place)
+} arena_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+void ArenaInit(arena_t *a, size_t min_size);
+void *ArenaAlloc(arena_t *a, size_t n);
+void *ArenaGrow(arena_t *a, void *p, size_t old_n, size_t new_n);
+void ArenaReset(arena_t *a);
+void ArenaFree(arena_t *a);
+
+#endif /* __BASIC_ARENA_H__ */
@@ -2,30 +2,61 @@
 #define __BASIC_INTERPRETER_H__
 
 /* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
 #include <stdint.h>
 
 /* Defines ------------------------------------------------------------------ */
-#define LINEBUF_LEN           512 // Bytes
+// Front end buffers come from an arena that is reset after every line.
+// These are starting sizes; the buffers grow as needed.
+#define FRONT_ARENA_SIZE      4096 // Bytes
+#define LINEBUF_INIT_LEN      512 // Bytes
 #define STACK_SIZE            512 // Bytes
+// Run-time heap limitations (lives right above the stack)
+#define HEAP_BASE             STACK_SIZE
+#define HEAP_SIZE             8192 // Bytes
+#define MEM_SIZE              (STACK_SIZE + HEAP_SIZE)
+// Program limitations
+#define MAX_LINE_NUMBER       1000000000
 // Variables limitations
 #define MAX_VAR_COUNT         512
 #define VAR_NAME_LEN          64
 // Labels limitations
 #define MAX_LABEL_COUNT       64
 #define LABEL_NAME_LEN        64
-// Tokens limitations
-#define MAX_TOK_COUNT         128 
+// Tokens
+#define TOK_INIT_COUNT        128
+// Block limitations (nested FOR/IF blocks, FOR loops)
+#define MAX_BLOCK_DEPTH       32
+#define MAX_LOOP_DEPTH        16
+// Subroutine limitations (see BasicSetMaxCallDepth())
+#define MAX_SUB_PARAMS        8
+#define DEFAULT_CALL_DEPTH    64
+// Statements run between wall clock reads when there is a time quota
+#define QUOTA_CLOCK_STEP      1024
+// Statements a scheduled script runs before it's switched out (see
+// BasicTaskRun()), unless it YIELDs first
+#define SCHED_DEFAULT_SLICE   1000
+// Assignment limitations (a = b = c = ...)
+#define MAX_ASSIGN_TARGETS    8
 // Expression Nesting limitations
 #define MAX_EXPR_NEST_DEPTH   10
 // Parser limitations
 #define NUM_PARSE_TREE_NODES  128
 // Console definitions
-#define CONSOLEBUF_LEN        LINEBUF_LEN
+#define CONSOLEBUF_INIT_LEN   LINEBUF_INIT_LEN
 // Error message definitions
 #define ERRORBUF_LEN          64
 
 // Array sizes
-#define MAX_ARRAY_DIM         2
+#define MAX_ARRAY_DIM         8
+// MAPPED arrays: open mappings, and where their addresses start (above
+// MEM_SIZE, so a 16-bit pointer can never reach one)
+#define MAX_MAPS              16
+#define MAP_VBASE             0x10000
+// File handles (OPEN 1 .. OPEN MAX_FILES)
+#define MAX_FILES             8
+// Debugging
+#define MAX_WATCHES           8
 
 // Sizes (in bytes) for Variable Types
 #define SIZEOF_PTR            2
@@ -36,6 +67,10 @@
 #define SIZEOF_UINT16         2
 #define SIZEOF_INT32          4
 #define SIZEOF_UINT32         4
+#define SIZEOF_INT64          8
+#define SIZEOF_UINT64         8
+#define SIZEOF_FLOAT32        4
+#define SIZEOF_FLOAT64        8
 #define SIZEOF_CHARPTR        SIZEOF_PTR
 #define SIZEOF_INT8PTR        SIZEOF_PTR
 #define SIZEOF_UINT8PTR       SIZEOF_PTR
@@ -43,15 +78,32 @@
 #define SIZEOF_UINT16PTR      SIZEOF_PTR
 #define SIZEOF_INT32PTR       SIZEOF_PTR
 #define SIZEOF_UINT32PTR      SIZEOF_PTR
-#define NUM_DATA_TYPES        7
+#define SIZEOF_INT64PTR       SIZEOF_PTR
+#define SIZEOF_UINT64PTR      SIZEOF_PTR
+#define SIZEOF_FLOAT32PTR     SIZEOF_PTR
+#define SIZEOF_FLOAT64PTR     SIZEOF_PTR
+#define NUM_DATA_TYPES        11
+
+// String variables: short strings are stored inline in the variable,
+// longer ones live on the heap or refer to an interned literal.
+#define SIZEOF_STRING         16
+#define STR_INLINE_MAX        (SIZEOF_STRING - 1)
+#define STR_TAG_HEAP          0x80
+#define STR_TAG_LITERAL       0x81
 
 // Return types
 #define rSUCCESS        0
 #define rFAILURE        1
 #define rEOF            2
 
-// Debug enable (1) or disable (0)
+// Interpreter state is per thread, so threads can each run an instance of
+// a shared program image at once (see BasicImageLoad())
+#define BASIC_TLS       __thread
+
+// Debug enable (1) or disable (0); the Makefile passes -DDEBUG=$(DEBUG)
+#ifndef DEBUG
 #define DEBUG           1
+#endif
 
 // Keyword Enums
 typedef enum {
@@ -64,6 +116,10 @@ typedef enum {
   UINT16,
   INT32,
   UINT32,
+  INT64,
+  UINT64,
+  FLOAT32,
+  FLOAT64,
   CHARPTR,
   INT8PTR,
   UINT8PTR,
@@ -71,18 +127,62 @@ typedef enum {
   UINT16PTR,
   INT32PTR,
   UINT32PTR,
+  INT64PTR,
+  UINT64PTR,
+  FLOAT32PTR,
+  FLOAT64PTR,
+  STR,          // "STRING" (STRING is taken by token_type_t)
   IF,
   THEN,
   ELSE,
   END,
+  USING,
+  ALLOC,
+  FREE,
+  FOR,
+  TO,
+  STEP,
+  NEXT,
+  SUB,
+  CALL,
+  RETURN,
+  ROWMAJOR,
+  COLMAJOR,
+  MAPPED,
+  SHARED,
+  ADVISE,
+  NORMAL,
+  SEQUENTIAL,
+  RANDOM,
+  WILLNEED,
+  OPEN,
+  CLOSE,
+  READ,         // "READ#"
+  WRITE,        // "WRITE#"
+  YIELD,
+  LEN,
+  MID,
+  SUM,
+  MIN,
+  MAX,
+  COUNT,
+  DOT,
+  SORT,
+  // Command line keywords
+  LIST,
+  RUN,
+  NEW,
+  DELETE,
   // Debug keywords
-  MEMPEEK
+  MEMPEEK,
+  WATCH
 } keyword_t;
 
 // Token Enums
 typedef enum {
   KEYWORD,
   NUMBER,
+  FLOAT_NUMBER,
   STRING,
   OPERATOR,
   PLUS,
@@ -92,6 +192,7 @@ typedef enum {
   DIVIDE,
   MOD,
   COMMA,
+  SEMICOLON,
   OPEN_SQUARE_BRACKET,
   CLOSED_SQUARE_BRACKET,
   OPEN_PARENS,
@@ -111,25 +212,70 @@ typedef enum {
   VAR_UINT16,
   VAR_INT32,
   VAR_UINT32,
+  VAR_INT64,
+  VAR_UINT64,
+  VAR_FLOAT32,
+  VAR_FLOAT64,
   VAR_CHARPTR,
   VAR_INT8PTR,
   VAR_UINT8PTR,
   VAR_INT16PTR,
   VAR_UINT16PTR,
   VAR_INT32PTR,
-  VAR_UINT32PTR
+  VAR_UINT32PTR,
+  VAR_INT64PTR,
+  VAR_UINT64PTR,
+  VAR_FLOAT32PTR,
+  VAR_FLOAT64PTR,
+  VAR_STRING
 } var_type_t;
 
+#define VAR_IS_DATA(t)        ((t) >= VAR_CHAR && (t) <= VAR_FLOAT64)
+#define VAR_IS_PTR(t)         ((t) >= VAR_CHARPTR && (t) <= VAR_FLOAT64PTR)
+// Data wider than 32 bits or floating point; loaded and stored as a
+// num_t (see NumLoad()), everything else fits in a uint32_t
+#define VAR_IS_WIDE(t)        ((t) >= VAR_INT64 && (t) <= VAR_FLOAT64)
+#define VAR_IS_SIGNED(t)      ((t) == VAR_INT8 || (t) == VAR_INT16 \
+                               || (t) == VAR_INT32 || (t) == VAR_INT64)
+
+// Run quotas (see BasicSetQuotas()). A script stopped by one exits with
+// the quota's value.
+typedef enum {
+  QUOTA_NONE = 0,
+  QUOTA_STATEMENTS = 3,
+  QUOTA_MEMORY = 4,
+  QUOTA_TIME = 5
+} quota_t;
+
+// Operator Enums (token_t.aux of OPERATOR tokens)
+typedef enum {
+  OP_NONE = 0,
+  OP_EQ,
+  OP_NE,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_LAND,
+  OP_LOR,
+  OP_BAND,
+  OP_BOR
+} operator_t;
+
 // Variable data structure
 typedef struct {
   char          name[VAR_NAME_LEN];
   uint16_t      addr;
   uint16_t      size_in_bytes;
-  uint16_t      len;
-  uint16_t      cols;
+  uint32_t      len;        // Elements (arrays and ALLOC'd pointers)
+  uint32_t      ndims;      // Indices taken by a dereference
+  uint32_t      dims[MAX_ARRAY_DIM];
+  uint32_t      strides[MAX_ARRAY_DIM]; // Bytes between consecutive indices
   int           var_type;
   int           sub_var_type;
   uint16_t      sub_size_in_bytes;
+  uint8_t       loop_reg;   // Induction variable of an active FOR loop
+  uint8_t       map;        // MAPPED array: index in maps + 1, else 0
 } var_t;
 
 // Token data structure
@@ -137,8 +283,95 @@ typedef struct {
   int           idx1; // Start index (inclusive)
   int           idx2; // End index (exclusive)
   token_type_t  type; // Type of token (see token_type_t)
+  int32_t       aux;  // STRING: literal pool id, FLOAT_NUMBER: pool id of
+                      // the value's bytes, OPERATOR: operator_t,
+                      // KEYWORD: keyword_t, '[': 1 if the index is
+                      // proven in bounds (see ProgramCheckBounds())
 } token_t;
 
+// Active FOR loop. While in_reg is set the induction variable's current
+// value is only in value; var_list storage is updated when it's read and
+// when the loop exits. value and limit are held as the counter's type
+// reads them (signed or unsigned), widened so they compare exactly.
+typedef struct {
+  int           vloc;       // Induction variable in var_list
+  int64_t       value;
+  int64_t       limit;
+  int64_t       step;
+  uint32_t      body;       // Program index of the first line of the body
+  int           in_reg;
+} loop_t;
+
+// SUB call frame. Parameters and locals are pushed above the caller's
+// stack and var_list, and everything above these marks goes on return.
+typedef struct {
+  uint32_t      ret;        // Program index to resume at
+  uint32_t      sp;         // Caller's stack pointer
+  uint32_t      var_base;   // First var_list entry owned by the frame
+  uint32_t      loop_base;  // Caller's loopp
+  uint32_t      block_base; // Caller's blockp
+} frame_t;
+
+// IF branch that has declared variables. They go, like a frame's locals,
+// when the branch ends (at its ELSE or END).
+typedef struct {
+  uint32_t      line;       // Program index of the IF
+  uint32_t      sp;         // Stack pointer before the first declaration
+  uint32_t      var_base;   // First var_list entry owned by the branch
+} block_t;
+
+// Watchpoint on a variable's storage (see StatementWatch())
+typedef struct {
+  uint32_t      addr;       // First byte watched
+  uint32_t      nbytes;
+  uint32_t      elem;       // Bytes per element of an array, 0 for a scalar
+  int           vloc;       // Variable in var_list
+} watch_t;
+
+// Live range of a declared variable (see ProgramPlanSlots())
+typedef struct {
+  uint32_t      line;       // Index of the declaring line in the program
+  uint32_t      tok;        // Index of the declaring VARIABLE token
+  uint32_t      start;      // First line (index) the variable is live
+  uint32_t      end;        // Last line (index) the variable is live
+  uint32_t      size;       // Bytes of stack needed
+  uint32_t      addr;       // Planned stack address
+  int           is_ptr;     // Pointer; may alias another variable's data
+} live_range_t;
+
+// Declaration seen by the bounds-check analysis (see ProgramCheckBounds())
+typedef struct {
+  uint32_t      line;       // Index of the declaring line in the program
+  uint32_t      tok;        // Index of the declaring VARIABLE token
+  int           var_type;   // Element type for arrays
+  int           is_array;
+  int           reassigned; // Array pointer may be changed by the program
+  int           redeclared; // Name declared again (in another block), so
+                            // uses can't tell which one they mean
+  uint32_t      ndims;
+  uint32_t      dims[MAX_ARRAY_DIM];
+  uint32_t      len;
+} bounds_decl_t;
+
+// Script loaded with BasicTaskLoad(); holds its program and, while it's
+// switched out, the part of the interpreter's memory it was using
+typedef struct basic_task basic_task_t;
+
+// Script prepared once with BasicImageLoad(): lexed, analyzed and read-only
+// from then on, so instances of it on any thread can share it
+typedef struct basic_image basic_image_t;
+
+// Value of a variable declared by the host before a run (see
+// BasicImageRun())
+typedef struct {
+  const char   *name;       // Not terminated
+  uint32_t      name_len;
+  int           var_type;   // A data type or VAR_STRING
+  int32_t       value;      // Data types
+  const char   *str;        // VAR_STRING (not terminated)
+  uint32_t      len;
+} basic_bind_t;
+
 // Parser Tree Node
 typedef struct {
   token_t *self;
@@ -148,8 +381,24 @@ typedef struct {
 } parser_node_t;
 
 /* Function Prototypes ------------------------------------------------------ */
+void BasicInit(void);
+void BasicExit(void);
+void BasicSetOutput(FILE *f);
 int BasicCommandLine(void);
 int BasicInterpret(FILE *f);
+int BasicEmitC(FILE *f, FILE *out);
+void BasicSetMaxCallDepth(uint32_t depth);
+const volatile uint32_t *BasicLineCounter(void);
+void BasicSetQuotas(uint64_t statements, uint32_t memory, uint32_t time_ms);
+quota_t BasicQuotaExceeded(void);
+basic_task_t *BasicTaskLoad(FILE *f);
+int BasicTaskRun(basic_task_t *t, uint64_t budget);
+void BasicTaskFree(basic_task_t *t);
+basic_image_t *BasicImageLoad(FILE *f);
+void BasicImageFree(basic_image_t *img);
+basic_task_t *BasicInstanceNew(const basic_image_t *img);
+int BasicImageRun(const basic_image_t *img, const basic_bind_t *binds, uint32_t n);
+void BasicBoundsReport(FILE *f);
 int LexIsEOF(char c);
 int LexIsEndOfLine(char c);
 int LexIsWhiteSpace(char c);
@@ -162,6 +411,8 @@ int LexIsDigit(char c);
 int LexIsBinDigit(char c);
 int LexIsHexDigit(char c);
 int LexIsKeyword(int idx1, int idx2);
+int LexGetKeyword(int idx1, int idx2);
+int LexFindKeyword(const char *name, uint32_t len);
 int LexIsVariable(int idx1, int idx2);
 int LexIsLabel(char *id);
 char *LexGetCurrentLine(void);
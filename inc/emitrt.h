@@ -0,0 +1,10 @@
+#ifndef __BASIC_EMITRT_H__
+#define __BASIC_EMITRT_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+
+/* Function Prototypes ------------------------------------------------------ */
+void EmitRtWrite(FILE *out);
+
+#endif /* __BASIC_EMITRT_H__ */
@@ -0,0 +1,22 @@
+#ifndef __BASIC_FILEIO_H__
+#define __BASIC_FILEIO_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// File opened with OPEN (see StatementOpen())
+typedef struct {
+  int           fd;         // -1 = closed
+  int           readable;
+  int           writable;
+} file_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+void FileInit(file_t *f);
+int FileOpen(file_t *f, const char *path, const char *mode, uint32_t mode_len);
+void FileClose(file_t *f);
+int FileRead(file_t *f, void *buf, uint32_t n, uint32_t *done);
+int FileWrite(file_t *f, const void *buf, uint32_t n);
+
+#endif /* __BASIC_FILEIO_H__ */
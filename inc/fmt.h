@@ -0,0 +1,50 @@
+#ifndef __BASIC_FMT_H__
+#define __BASIC_FMT_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Longest output of a single number conversion (32 binary digits; a
+// FmtFloat() takes at most 24 and its NUL)
+#define FMT_INT_MAX_LEN       32
+// Field limitations
+#define FMT_MAX_WIDTH         64
+#define FMT_MAX_SEGMENTS      32
+// Longest FmtHexDumpLine() output (newline included)
+#define FMT_HEXDUMP_LINE_LEN  80
+
+// Field flags
+#define FMT_FLAG_LEFT         0x01  // '-': left justify
+#define FMT_FLAG_ZERO         0x02  // '0': pad with zeros
+
+// Segment data structure. A segment is either literal text (conv == 0)
+// or one conversion: d, u, x, X, b, c or s.
+typedef struct {
+  char          conv;
+  uint8_t       flags;
+  uint8_t       width;
+  uint16_t      offs;       // Literal text: offset in the format string
+  uint16_t      len;        // Literal text: length
+} fmt_segment_t;
+
+// Compiled PRINT USING template
+typedef struct {
+  uint16_t      nsegments;
+  uint16_t      nfields;
+  fmt_segment_t segments[FMT_MAX_SEGMENTS];
+} fmt_template_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+int FmtCompile(fmt_template_t *t, const char *fmt, uint32_t len, uint32_t *err_idx);
+uint32_t FmtUnsigned(char *out, uint32_t v);
+uint32_t FmtSigned(char *out, int32_t v);
+uint32_t FmtUnsigned64(char *out, uint64_t v);
+uint32_t FmtSigned64(char *out, int64_t v);
+uint32_t FmtFloat(char *out, double v, int single);
+uint32_t FmtHex(char *out, uint32_t v, int upper);
+uint32_t FmtBin(char *out, uint32_t v);
+uint32_t FmtPad(char *out, const char *digits, uint32_t len, const fmt_segment_t *seg);
+uint32_t FmtHexDumpLine(char *out, uint32_t addr, const uint8_t *bytes, uint32_t n);
+
+#endif /* __BASIC_FMT_H__ */
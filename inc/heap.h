@@ -0,0 +1,48 @@
+#ifndef __BASIC_HEAP_H__
+#define __BASIC_HEAP_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Size classes: blocks of HEAP_MIN_BLOCK << n bytes (header included)
+#define HEAP_NUM_CLASSES      10
+#define HEAP_MIN_BLOCK        8 // Bytes
+#define HEAP_MAX_BLOCK        (HEAP_MIN_BLOCK << (HEAP_NUM_CLASSES - 1))
+// Block header holds the requested size and an allocated flag
+#define HEAP_HDR_SIZE         2 // Bytes
+#define HEAP_HDR_ALLOCATED    0x8000
+#define HEAP_MAX_REQUEST      (HEAP_MAX_BLOCK - HEAP_HDR_SIZE)
+// Blocks start on HEAP_MIN_BLOCK granules; one bit per granule of the
+// 16-bit address space
+#define HEAP_MAP_BYTES        ((UINT16_MAX + 1) / HEAP_MIN_BLOCK / 8)
+
+// Per size class bookkeeping
+typedef struct {
+  uint16_t      free_head;  // Address of first free block (0 = empty)
+  uint32_t      carved;     // Blocks carved from the heap for this class
+  uint32_t      in_use;     // Blocks currently allocated
+  uint32_t      requested;  // Payload bytes requested by blocks in use
+} heap_class_t;
+
+// Heap data structure
+typedef struct {
+  uint8_t      *mem;        // Base of the interpreter's memory
+  uint16_t      base;       // First address owned by the heap
+  uint16_t      end;        // One past the last address owned by the heap
+  uint16_t      brk;        // Next address to carve new blocks from
+  uint32_t      alloc_count;
+  uint32_t      free_count;
+  uint32_t      fail_count;
+  heap_class_t  classes[HEAP_NUM_CLASSES];
+  uint8_t       live[HEAP_MAP_BYTES]; // Granules an allocated block starts at
+} heap_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+void HeapInit(heap_t *h, uint8_t *mem, uint16_t base, uint16_t size);
+uint16_t HeapAlloc(heap_t *h, uint16_t nbytes);
+int HeapFree(heap_t *h, uint16_t addr);
+int HeapClassOf(uint16_t nbytes);
+uint16_t HeapClassSize(int c);
+
+#endif /* __BASIC_HEAP_H__ */
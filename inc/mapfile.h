@@ -0,0 +1,29 @@
+#ifndef __BASIC_MAPFILE_H__
+#define __BASIC_MAPFILE_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Access pattern hints (see MapFileAdvise())
+typedef enum {
+  MAP_ADVICE_NORMAL,
+  MAP_ADVICE_SEQUENTIAL,
+  MAP_ADVICE_RANDOM,
+  MAP_ADVICE_WILLNEED
+} map_advice_t;
+
+// File mapped as the backing storage of an array
+typedef struct {
+  uint8_t      *base;       // Start of the mapping (NULL = not mapped)
+  uint32_t      vaddr;      // Interpreter address of the first byte
+  uint32_t      len;        // Bytes mapped
+  int           writable;   // Shared mapping; stores reach the file
+} mapfile_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+int MapFileOpen(mapfile_t *m, const char *path, uint32_t len, int writable);
+void MapFileClose(mapfile_t *m);
+int MapFileAdvise(mapfile_t *m, map_advice_t advice);
+
+#endif /* __BASIC_MAPFILE_H__ */
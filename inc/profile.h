@@ -0,0 +1,50 @@
+#ifndef __BASIC_PROFILE_H__
+#define __BASIC_PROFILE_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include "basic.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define PROF_DEFAULT_HZ       997   // Not a multiple of common loop periods
+#define PROF_TABLE_SIZE       4096  // Distinct (line, phase stack) pairs kept
+
+// Interpreter phases. The active ones form a stack of 4-bit entries in
+// prof_stack, innermost in the low bits.
+typedef enum {
+  PROF_NONE = 0,
+  PROF_LEXER,
+  PROF_PARSER,
+  PROF_EVAL,
+  PROF_PRINT,
+  PROF_ANALYSIS
+} prof_phase_t;
+
+extern BASIC_TLS volatile uint32_t prof_stack;
+
+/**
+ *  @brief  Enter phase (unless it's already the innermost one).
+ *  @return The phase stack to restore with ProfLeave().
+ */
+static inline uint32_t ProfEnter(prof_phase_t phase)
+{
+  uint32_t saved = prof_stack;
+
+  if ((saved & 0xF) != phase) {
+    prof_stack = (saved << 4) | phase;
+  }
+  return saved;
+}
+
+static inline void ProfLeave(uint32_t saved)
+{
+  prof_stack = saved;
+}
+
+/* Function Prototypes ------------------------------------------------------ */
+int ProfileStart(uint32_t hz, const volatile uint32_t *line);
+void ProfileStop(void);
+uint32_t ProfileWrite(FILE *f, const char *root);
+
+#endif /* __BASIC_PROFILE_H__ */
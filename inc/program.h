@@ -0,0 +1,38 @@
+#ifndef __BASIC_PROGRAM_H__
+#define __BASIC_PROGRAM_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include "basic.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define PROG_INIT_LINES       64
+
+// Stored program line. The cached tokens index into text.
+typedef struct {
+  uint32_t      number;     // BASIC line number
+  char         *text;       // Source ('\n' and NUL terminated)
+  uint32_t      len;
+  token_t      *toks;       // Lexer output for text
+  uint32_t      ntoks;
+  uint32_t      jump;       // Matching line of a block statement (see
+                            // ProgramMatchBlocks()), CALL: target SUB,
+                            // VAR: enclosing IF + 1 (0 if there is none)
+} prog_line_t;
+
+// Stored program, kept sorted by line number
+typedef struct {
+  prog_line_t  *lines;
+  uint32_t      count;
+  uint32_t      cap;
+} program_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+void ProgInit(program_t *p);
+void ProgClear(program_t *p);
+prog_line_t *ProgFindLine(const program_t *p, uint32_t number, uint32_t *pos);
+int ProgSetLine(program_t *p, uint32_t number, const char *text, uint32_t len,
+                const token_t *toks, uint32_t ntoks);
+int ProgDeleteLine(program_t *p, uint32_t number);
+
+#endif /* __BASIC_PROGRAM_H__ */
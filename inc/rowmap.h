@@ -0,0 +1,21 @@
+#ifndef __BASIC_ROWMAP_H__
+#define __BASIC_ROWMAP_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Input is read this much at a time; the whole rows of each read are one
+// batch for a worker
+#define ROWMAP_CHUNK_SIZE     (256 * 1024) // Bytes
+// Columns an input file may have
+#define ROWMAP_MAX_COLUMNS    64
+// Worker threads (-j), and batches read ahead per worker
+#define ROWMAP_MAX_JOBS       256
+#define ROWMAP_BATCHES_PER_JOB 2
+
+/* Function Prototypes ------------------------------------------------------ */
+int RowMapRun(FILE *script, FILE *csv, uint32_t jobs, void (*report)(void));
+
+#endif /* __BASIC_ROWMAP_H__ */
@@ -0,0 +1,28 @@
+#ifndef __BASIC_SERVE_H__
+#define __BASIC_SERVE_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Scripts the server holds at once (being received or running); more
+// clients wait in the listen backlog
+#define SERVE_MAX_JOBS        64
+// Largest script accepted, and how much of it is read at a time
+#define SERVE_MAX_SCRIPT      (1024 * 1024) // Bytes
+#define SERVE_READ_CHUNK      4096 // Bytes
+// How long a client has to send its whole script
+#define SERVE_RECV_TIMEOUT    10000 // Milliseconds
+// Output a job can have waiting for its client before it's paused
+#define SERVE_MAX_OUTPUT      (64 * 1024) // Bytes
+// Last byte sent for a job, after its output: how the script ended
+#define SERVE_STATUS_OK       0
+#define SERVE_STATUS_FAILED   1
+#define SERVE_STATUS_FAILED_STR "\001"
+
+/* Function Prototypes ------------------------------------------------------ */
+int ServeRun(const char *path, uint64_t slice);
+int ServeSubmit(const char *path, FILE *script, int *failed);
+
+#endif /* __BASIC_SERVE_H__ */
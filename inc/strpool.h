@@ -0,0 +1,30 @@
+#ifndef __BASIC_STRPOOL_H__
+#define __BASIC_STRPOOL_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+#define STRPOOL_INIT_BUF      256 // Bytes
+#define STRPOOL_INIT_COUNT    16  // Literals
+
+// Literal pool data structure
+typedef struct {
+  char         *buf;        // Literal bytes, stored back to back
+  uint32_t      buf_len;
+  uint32_t      buf_cap;
+  uint32_t     *offs;       // Offset in buf of each literal
+  uint32_t     *lens;       // Length of each literal
+  uint32_t      count;
+  uint32_t      cap;
+  uint32_t     *table;      // Hash table of (id + 1), 0 = empty slot
+  uint32_t      table_cap;  // Power of two, always > 2 * count
+} strpool_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+void StrPoolInit(strpool_t *pool);
+void StrPoolFree(strpool_t *pool);
+int32_t StrPoolIntern(strpool_t *pool, const char *s, uint32_t len);
+const char *StrPoolGet(const strpool_t *pool, int32_t id, uint32_t *len);
+
+#endif /* __BASIC_STRPOOL_H__ */
@@ -0,0 +1,16 @@
+#ifndef __BASIC_UTF8_H__
+#define __BASIC_UTF8_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Bytes checked at a time while they're ASCII
+#define UTF8_BLOCK_SIZE       16
+
+/* Function Prototypes ------------------------------------------------------ */
+uint32_t Utf8Validate(const char *s, uint32_t len);
+uint32_t Utf8Length(const char *s, uint32_t len);
+uint32_t Utf8Offset(const char *s, uint32_t len, uint32_t n);
+
+#endif /* __BASIC_UTF8_H__ */
@@ -0,0 +1,29 @@
+#ifndef __BASIC_VEC_H__
+#define __BASIC_VEC_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Blocks of 16-bit lanes summed in 32 bits before they're folded into the
+// 64-bit total (so the lanes can't overflow)
+#define VEC_FOLD_BLOCKS       4096
+
+// Value of a whole-array operation. Arrays are of a data type (var_type_t),
+// stored little endian like the interpreter's memory; a value is i64 for
+// the signed integer types, u64 for the unsigned ones (CHAR included) and
+// f64 for the floats.
+typedef union {
+  int64_t       i64;
+  uint64_t      u64;
+  double        f64;
+} vec_value_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+void VecSum(const uint8_t *mem, uint32_t n, int type, vec_value_t *sum);
+void VecMinMax(const uint8_t *mem, uint32_t n, int type, int max, vec_value_t *out);
+uint32_t VecCount(const uint8_t *mem, uint32_t n, int type, const vec_value_t *key);
+void VecDot(const uint8_t *a, const uint8_t *b, uint32_t n, int type, vec_value_t *dot);
+int VecSort(uint8_t *mem, uint32_t n, int type);
+
+#endif /* __BASIC_VEC_H__ */
@@ -0,0 +1,110 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define ALIGN_UP(n)   (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Create an empty arena. No memory is allocated until first use.
+ *  @param  min_size  Size of the first chunk
+ */
+void ArenaInit(arena_t *a, size_t min_size)
+{
+  a->head = NULL;
+  a->min_size = min_size;
+  a->last = NULL;
+}
+
+/**
+ *  @brief  Allocate n bytes. A full arena gets a new chunk at least twice
+ *          the size of the current one.
+ *  @return Pointer to the memory, NULL when out of memory.
+ */
+void *ArenaAlloc(arena_t *a, size_t n)
+{
+  arena_chunk_t *c = a->head;
+  size_t size;
+
+  n = ALIGN_UP(n);
+  if (!c || c->size - c->used < n) {
+    size = (c ? c->size * 2 : a->min_size);
+    while (size < n) {
+      size *= 2;
+    }
+    if ((c = malloc(sizeof(arena_chunk_t) + size)) == NULL) {
+      return NULL;
+    }
+    c->size = size;
+    c->used = 0;
+    c->next = a->head;
+    a->head = c;
+  }
+
+  a->last = c->data + c->used;
+  c->used += n;
+  return a->last;
+}
+
+/**
+ *  @brief  Resize an allocation, keeping its contents. The most recent
+ *          allocation is extended in place when its chunk has room.
+ *  @return Pointer to the (possibly moved) memory, NULL when out of memory.
+ */
+void *ArenaGrow(arena_t *a, void *p, size_t old_n, size_t new_n)
+{
+  arena_chunk_t *c = a->head;
+  void *q;
+
+  if (p && p == a->last
+        && (size_t)((char *)p - c->data) + ALIGN_UP(new_n) <= c->size) {
+    c->used = ((char *)p - c->data) + ALIGN_UP(new_n);
+    return p;
+  }
+
+  if ((q = ArenaAlloc(a, new_n)) != NULL && p) {
+    memcpy(q, p, old_n);
+  }
+  return q;
+}
+
+/**
+ *  @brief  Release every allocation at once. Only the largest chunk is
+ *          kept, so once an arena has warmed up a reset frees nothing and
+ *          later allocations never reach malloc.
+ */
+void ArenaReset(arena_t *a)
+{
+  arena_chunk_t *c = a->head, *next;
+
+  if (!c) {
+    return;
+  }
+
+  // The head is always the largest chunk
+  for (next = c->next; next; next = c->next) {
+    c->next = next->next;
+    free(next);
+  }
+  c->used = 0;
+  a->last = NULL;
+}
+
+/**
+ *  @brief  Return all memory owned by the arena.
+ */
+void ArenaFree(arena_t *a)
+{
+  arena_chunk_t *c, *next;
+
+  for (c = a->head; c; c = next) {
+    next = c->next;
+    free(c);
+  }
+  ArenaInit(a, a->min_size);
+}
+
+/**************************************************************** END OF FILE */
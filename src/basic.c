@@ -1,15 +1,30 @@
 
 /* Includes ----------------------------------------------------------------- */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
 #include "basic.h"
+#include "heap.h"
+#include "strpool.h"
+#include "fmt.h"
+#include "arena.h"
+#include "program.h"
+#include "mapfile.h"
+#include "fileio.h"
+#include "profile.h"
+#include "utf8.h"
+#include "vec.h"
+#include "emitrt.h"
 
 /* Defines ------------------------------------------------------------------ */
 #if DEBUG > 0
 char debug_buf[128];
 #define DEBUG_PRINTF(fmt, ...) \
-  do { sprintf(debug_buf, fmt, ##__VA_ARGS__); puts(debug_buf); } while (0);
+  do { snprintf(debug_buf, sizeof(debug_buf), fmt, ##__VA_ARGS__); puts(debug_buf); } while (0);
 #define DEBUG_PRINTBUF()  puts(debug_buf);
 #else
 #define DEBUG_PRINTF(...)
@@ -20,7 +35,7 @@ char debug_buf[128];
   do { strcpy(error_message, msg); col_count = col_num; } while (0);
 
 #define CONSOLE_PRINTF(fmt, ...) \
-  do { printf(fmt, ##__VA_ARGS__); } while (0);
+  do { fprintf(console, fmt, ##__VA_ARGS__); } while (0);
 
 #define CONSOLE_ADD_STRING(str) \
   do { \
@@ -34,50 +49,181 @@ char debug_buf[128];
     consolebuf_idx += s.idx2 - s.idx1; \
   } while (0);
 
+#define CONSOLE_ADD_BYTES(str, len) \
+  do { \
+    memcpy(consolebuf + consolebuf_idx, str, len); \
+    consolebuf_idx += len; \
+  } while (0);
+
 #define CONSOLE_ADD_UNSIGNED_TOK(v) \
   do { \
-    consolebuf_idx += sprintf(consolebuf + consolebuf_idx, "%u", (v)); \
+    consolebuf_idx += FmtUnsigned(consolebuf + consolebuf_idx, (v)); \
   } while (0);
       
 #define CONSOLE_ADD_SIGNED_TOK(v) \
   do { \
-    consolebuf_idx += sprintf(consolebuf + consolebuf_idx, "%d", (v)); \
+    consolebuf_idx += FmtSigned(consolebuf + consolebuf_idx, (v)); \
   } while (0);
       
 #define CONSOLE_ADD_CHAR_TOK(v) \
   do { \
-    consolebuf_idx += sprintf(consolebuf + consolebuf_idx, "%c", (v)); \
+    consolebuf[consolebuf_idx++] = (v); \
   } while (0);
       
 #define CONSOLE_PRINTBUF() \
-  do { puts(consolebuf); } while (0);
+  do { \
+    consolebuf[consolebuf_idx] = '\n'; \
+    fwrite(consolebuf, 1, consolebuf_idx + 1, console); \
+  } while (0);
+
+/* Local Types -------------------------------------------------------------- */
+// Switched out script (see TaskSave()). saved holds, back to back, the
+// stack below sp, the heap below its brk, and the var_list, loops, blocks,
+// maps and watches entries in use.
+struct basic_task {
+  program_t     program;
+  const basic_image_t *image; // Image program belongs to, NULL if it's owned
+  uint32_t      prog_next;
+  uint32_t      sp, stack_peak, stack_unshared;
+  heap_t        heap;
+  uint32_t      varp, loopp, blockp, nmaps, nwatches;
+  file_t        files[MAX_FILES];
+  frame_t      *frames;
+  uint32_t      frame_cap;
+  uint32_t      framep;
+  uint64_t      quota_left;
+  struct timespec quota_start;
+  uint8_t      *saved;
+  uint32_t      saved_cap;
+};
+
+// Script prepared by BasicImageLoad(). Nothing in it is written once it's
+// built: instances run its lines and literals in place.
+struct basic_image {
+  program_t     program;
+  strpool_t     strpool;
+  fmt_template_t **fmt_cache; // Every PRINT USING template that compiles
+  uint32_t      fmt_cache_len;
+  uint32_t      sp;         // Stack taken by the planned variable slots
+};
+
+// Kind of a numeric value, ordered so that the wider of two operands'
+// kinds is what they're both converted to (C's usual conversions)
+typedef enum {
+  NUM_I32 = 0,
+  NUM_U32,
+  NUM_I64,
+  NUM_U64,
+  NUM_F32,
+  NUM_F64
+} num_kind_t;
+
+// Value of a numeric expression. Up to 32 bits it's held in u32 and
+// evaluated as it always was (wrapping, unsigned division, signed
+// comparison); the kind then only says how the value widens.
+typedef struct {
+  num_kind_t    kind;
+  union {
+    uint32_t    u32;
+    int64_t     i64;
+    uint64_t    u64;
+    float       f32;
+    double      f64;
+  } v;
+} num_t;
+
+// C expression made by the emitter (see BasicEmitC()), holding a value
+// of the given kind. Both 32-bit kinds are uint32_t, as in num_t.
+typedef struct {
+  const char   *c;
+  num_kind_t    kind;
+} emit_val_t;
 
 /* Local Variables ---------------------------------------------------------- */
+// Interpreter state is per thread (BASIC_TLS); settings are shared.
+// Per-line front end storage (linebuf, tokens, consolebuf)
+static BASIC_TLS arena_t front_arena;
 // Lexer buffer
-static char linebuf[LINEBUF_LEN];
-static uint32_t linebuf_idx = 0;
+static BASIC_TLS char *linebuf = NULL;
+static BASIC_TLS uint32_t linebuf_idx = 0;
 // Tokens
-static token_t tokens[MAX_TOK_COUNT];
-static uint32_t tokp = 0;
+static BASIC_TLS token_t *tokens = NULL;
+static BASIC_TLS uint32_t tokp = 0;
+static BASIC_TLS uint32_t tok_cap = 0;
 // Line and column trackers
-static uint32_t line_count = 0, col_count = 0;
+static BASIC_TLS uint32_t line_count = 0, col_count = 0;
 // Error message
-static char error_message[ERRORBUF_LEN];
-// Run-Time Stack and Stack Pointer
-static uint8_t stack[STACK_SIZE];
-static uint32_t sp = 0;
-// Run-time Heap (TODO?)
-// ...
+static BASIC_TLS char error_message[ERRORBUF_LEN];
+// Run-Time Stack and Stack Pointer (the heap shares the same memory)
+static BASIC_TLS uint8_t stack[MEM_SIZE];
+static BASIC_TLS uint32_t sp = 0;
+// Stack high-water mark, and what it would be without slot reuse
+static BASIC_TLS uint32_t stack_peak = 0;
+static BASIC_TLS uint32_t stack_unshared = 0;
+// Run-time Heap
+static BASIC_TLS heap_t heap;
+// Files mapped as MAPPED arrays, in the order they were declared
+static BASIC_TLS mapfile_t maps[MAX_MAPS];
+static BASIC_TLS uint32_t nmaps = 0;
+// Files opened with OPEN, by handle - 1
+static BASIC_TLS file_t files[MAX_FILES];
+// Interned STRING literals
+static BASIC_TLS strpool_t strpool;
+// Staging area for inline (short) strings
+static BASIC_TLS char str_scratch[STR_INLINE_MAX];
+// Compiled PRINT USING templates, indexed by literal pool id
+static BASIC_TLS fmt_template_t **fmt_cache = NULL;
+static BASIC_TLS uint32_t fmt_cache_len = 0;
+// Stored program (numbered lines entered at the command line)
+static BASIC_TLS program_t program;
+// Image the stored program is shared from (not owned), if any
+static BASIC_TLS const basic_image_t *image = NULL;
+// Program counter: line being run and the one to run after it
+static BASIC_TLS uint32_t prog_pc = 0, prog_next = 0;
+static BASIC_TLS int prog_running = 0;
+// Set by YIELD; ends the current ProgramStep()
+static BASIC_TLS int prog_yield = 0;
+// Watchpoints; checked on every store while there are any
+static BASIC_TLS watch_t watches[MAX_WATCHES];
+static BASIC_TLS uint32_t nwatches = 0;
+// Active FOR loops
+static BASIC_TLS loop_t loops[MAX_LOOP_DEPTH];
+static BASIC_TLS uint32_t loopp = 0;
+// IF branches with variables to release (each holds one at least)
+static BASIC_TLS block_t blocks[MAX_VAR_COUNT];
+static BASIC_TLS uint32_t blockp = 0;
+// SUB call frames (grown on demand up to max_call_depth)
+static BASIC_TLS frame_t *frames = NULL;
+static BASIC_TLS uint32_t framep = 0, frame_cap = 0;
+static uint32_t max_call_depth = DEFAULT_CALL_DEPTH;
+// Run quotas (0 = unlimited) and the one that stopped the last run
+static uint64_t quota_statements = 0;
+static uint32_t quota_memory = 0, quota_time_ms = 0;
+static BASIC_TLS quota_t quota_exceeded = QUOTA_NONE;
+// Statements left and start time of the run (when there is a time quota)
+static BASIC_TLS uint64_t quota_left = 0;
+static BASIC_TLS struct timespec quota_start;
+// Array index checks: sites found and proven safe by ProgramCheckBounds(),
+// and checks done and skipped at run time
+static BASIC_TLS uint32_t bounds_sites = 0, bounds_removed = 0;
+static BASIC_TLS uint64_t bounds_checked = 0, bounds_skipped = 0;
 // Variables Tracker and Pointer
-static var_t var_list[MAX_VAR_COUNT];
-static uint32_t varp = 0;
+static BASIC_TLS var_t var_list[MAX_VAR_COUNT];
+static BASIC_TLS uint32_t varp = 0;
 // Parse tree (TODO do we need this?)
 //static parser_node_t parse_tree[NUM_PARSE_TREE_NODES];
 // Expression nesting
-static int expr_nest_level = 0;
+static BASIC_TLS int expr_nest_level = 0;
 // Console output
-static int consolebuf_idx = 0;
-static char consolebuf[CONSOLEBUF_LEN];
+static BASIC_TLS uint32_t consolebuf_idx = 0;
+static BASIC_TLS uint32_t consolebuf_cap = 0;
+static BASIC_TLS char *consolebuf = NULL;
+// Where the script's output goes (see BasicSetOutput())
+static BASIC_TLS FILE *console = NULL;
+// C being written by BasicEmitC(): main()'s body, how deeply its blocks
+// are nested, and whether memory ran out
+static BASIC_TLS FILE *emit_body = NULL;
+static BASIC_TLS int emit_depth = 0, emit_oom = 0;
 
 /* Constants ---------------------------------------------------------------- */
 const char *keywords[] = {
@@ -90,6 +236,10 @@ const char *keywords[] = {
   "UINT16",
   "INT32",
   "UINT32",
+  "INT64",
+  "UINT64",
+  "FLOAT32",
+  "FLOAT64",
   "CHARPTR",
   "INT8PTR",
   "UINT8PTR",
@@ -97,12 +247,55 @@ const char *keywords[] = {
   "UINT16PTR",
   "INT32PTR",
   "UINT32PTR",
+  "INT64PTR",
+  "UINT64PTR",
+  "FLOAT32PTR",
+  "FLOAT64PTR",
+  "STRING",
   "IF",
   "THEN",
   "ELSE",
   "END",
+  "USING",
+  "ALLOC",
+  "FREE",
+  "FOR",
+  "TO",
+  "STEP",
+  "NEXT",
+  "SUB",
+  "CALL",
+  "RETURN",
+  "ROWMAJOR",
+  "COLMAJOR",
+  "MAPPED",
+  "SHARED",
+  "ADVISE",
+  "NORMAL",
+  "SEQUENTIAL",
+  "RANDOM",
+  "WILLNEED",
+  "OPEN",
+  "CLOSE",
+  "READ#",
+  "WRITE#",
+  "YIELD",
+  "LEN",
+  "MID",
+  "SUM",
+  "MIN",
+  "MAX",
+  "COUNT",
+  "DOT",
+  "SORT",
+  // Command line keywords
+  "LIST",
+  "RUN",
+  "NEW",
+  "DELETE",
   // Debug keywords
   "MEMPEEK",
+  "WATCH",
   ""
 };
 
@@ -114,38 +307,206 @@ const int var_type_sizes[] = {
   SIZEOF_UINT16,
   SIZEOF_INT32,
   SIZEOF_UINT32,
+  SIZEOF_INT64,
+  SIZEOF_UINT64,
+  SIZEOF_FLOAT32,
+  SIZEOF_FLOAT64,
+  SIZEOF_CHARPTR,
   SIZEOF_INT8PTR,
   SIZEOF_UINT8PTR,
   SIZEOF_INT16PTR,
   SIZEOF_UINT16PTR,
   SIZEOF_INT32PTR,
-  SIZEOF_UINT32PTR
+  SIZEOF_UINT32PTR,
+  SIZEOF_INT64PTR,
+  SIZEOF_UINT64PTR,
+  SIZEOF_FLOAT32PTR,
+  SIZEOF_FLOAT64PTR,
+  SIZEOF_STRING
+};
+
+// num_kind_t of each data type's values (pointers are addresses)
+static const uint8_t var_type_kinds[] = {
+  NUM_I32, NUM_I32, NUM_I32, NUM_I32, NUM_I32, NUM_I32, NUM_U32,
+  NUM_I64, NUM_U64, NUM_F32, NUM_F64,
+  NUM_U32, NUM_U32, NUM_U32, NUM_U32, NUM_U32, NUM_U32, NUM_U32,
+  NUM_U32, NUM_U32, NUM_U32, NUM_U32
 };
 
-const char single_char_operators[] = "()[]=+-*/%:&|!~,";
-const char double_char_operators[] = "==&&||";
+// C types in code made by BasicEmitC(): of each num_kind_t, and of each
+// data type's variables (pointers aren't translated)
+static const char *const emit_kind_types[] = {
+  "uint32_t", "uint32_t", "int64_t", "uint64_t", "float", "double"
+};
+static const char *const emit_var_types[] = {
+  "uint8_t", "int8_t", "uint8_t", "int16_t", "uint16_t", "int32_t",
+  "uint32_t", "int64_t", "uint64_t", "float", "double",
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+  "rt_str_t"
+};
+static const char *const emit_relops[] = {"==", "!=", "<", "<=", ">", ">="};
+
+const char single_char_operators[] = "()[]=+-*/%:&|!~,;<>";
+const char double_char_operators[] = "==!=<=>=&&||";
 
 /* Private Function Prototypes ---------------------------------------------- */
+static int LexReadLine(FILE *f);
 static int LexAnalyzeLine(void);
+static int LexTokenize(void);
+static void LexEndLine(void);
+static int LexIsLineNumber(uint32_t *number);
+static void MemReset(void);
+static uint8_t *MemPtr(uint32_t addr, uint32_t nbytes);
+static int MemIsReadOnly(uint32_t addr);
+static void MapRelease(uint32_t from);
+static void StackCommit(uint32_t addr, uint32_t nbytes);
+static void ProgramSelectLine(uint32_t i);
+static int ProgramLoad(FILE *f);
+static int ProgramRun(void);
+static int ProgramStart(void);
+static void ProgramRewind(void);
+static int ProgramStep(uint64_t budget);
+static void ProgramCompileFormats(void);
+static void TaskDiscard(void);
+static void TaskRestore(basic_task_t *t);
+static int TaskSave(basic_task_t *t);
+static int ProgramMatchBlocks(void);
+static uint32_t ProgramPlanSlots(void);
+static uint32_t ProgramFindRange(live_range_t *ranges, uint32_t *table,
+                                 uint32_t table_cap, uint32_t t);
+static uint32_t ProgramHashToken(uint32_t t);
+static void ProgramCheckBounds(void);
+static uint32_t BoundsFindDecl(bounds_decl_t *decls, uint32_t *table,
+                               uint32_t table_cap, uint32_t t);
+static int BoundsConstant(uint32_t *t, int64_t *value);
+static int BoundsLoopIsClean(uint32_t line, bounds_decl_t *decls,
+                             uint32_t *table, uint32_t table_cap, uint32_t var);
+static int CommandEnterLine(uint32_t number);
+static int CommandList(uint32_t curr_tok);
+static int CommandRun(uint32_t curr_tok);
+static int CommandNew(uint32_t curr_tok);
+static int CommandDelete(uint32_t curr_tok);
+static int ConsoleReserve(uint32_t n);
 static int ParseGetKeyword(uint32_t token_idx);
-static int ParseTokToNumber(uint32_t token_idx);
+static uint64_t ParseTokToNumber(uint32_t token_idx);
 static int StatementPrint(uint32_t curr_tok);
+static int StatementPrintUsing(uint32_t curr_tok);
+static const fmt_template_t *PrintGetTemplate(uint32_t curr_tok);
+static void FmtCacheFree(fmt_template_t **cache, uint32_t len);
+static const strpool_t *Literals(void);
 static int StatementVar(uint32_t curr_tok);
 static int StatementAssignment(uint32_t curr_tok);
 static int StatementExpression(uint32_t *curr_tok, uint32_t *value);
+static int StatementNumber(uint32_t *curr_tok, num_t *value);
+static int ExprEvaluate(uint32_t *curr_tok, num_t *value);
+static int StatementAlloc(uint32_t curr_tok);
+static int StatementFree(uint32_t curr_tok);
 static int StatementMempeek(uint32_t curr_tok);
+static void MemDump(uint32_t addr, const uint8_t *mem, uint32_t nbytes);
+static int StatementWatch(uint32_t curr_tok);
+static void WatchStore(uint32_t addr, int type, const num_t *value);
+static void WatchBulk(uint32_t addr, uint32_t nbytes, const char *what);
+static int StatementAdvise(uint32_t curr_tok);
+static int StatementOpen(uint32_t curr_tok);
+static int StatementClose(uint32_t curr_tok);
+static int StatementFileIO(uint32_t curr_tok, int writing);
+static int FileHandle(uint32_t *curr_tok, file_t **f);
+static int StatementSort(uint32_t curr_tok);
+static int StatementFor(uint32_t curr_tok);
+static int StatementNext(uint32_t curr_tok);
+static int StatementIf(uint32_t curr_tok);
+static int StatementEnd(uint32_t curr_tok);
+static int StatementCall(uint32_t curr_tok);
+static int StatementReturn(uint32_t curr_tok);
+static int SubCheckHeader(uint32_t line);
+static int SubReturn(void);
+static void BlockOpen(uint32_t line);
+static void BlockClose(uint32_t line);
+static int VarAddScalar(const char *name, uint32_t len, int var_type);
+static int VarBind(const basic_bind_t *bind);
+static void VarRelease(uint32_t base);
+static int64_t LoopNormalize(int type, uint32_t value);
+static void LoopSpill(int vloc);
+static void LoopSpillAll(void);
 static int VarIsList(uint32_t *curr_tok);
 static int VarIsDeclaration(uint32_t *curr_tok);
+static int VarIsAccess(uint32_t *curr_tok);
 static int VarIsType(uint32_t *curr_tok, int *type);
+static int VarIsLayout(uint32_t *curr_tok, int *col_major);
+static int VarIsMapping(uint32_t *curr_tok, uint32_t *path_tok, int *shared);
+static int VarMapFile(int vloc, uint32_t path_tok, int shared);
+static uint32_t VarDeclElements(uint32_t curr_tok);
+static int VarSetShape(var_t *var, uint32_t curr_tok, int col_major);
 static int VarLocation(uint32_t curr_tok);
-static int VarGetValue(uint32_t curr_tok, uint32_t vloc);
-static int ExprIsTerm(uint32_t *curr_tok, uint32_t *value);
-static int ExprIsFactor(uint32_t *curr_tok, uint32_t *value);
-static int32_t ConvertHexNumber(int idx1, int idx2);
-static int32_t ConvertBinNumber(int idx1, int idx2);
-static int32_t ConvertDecNumber(int idx1, int idx2);
+static int VarResolve(uint32_t *curr_tok, int vloc, uint32_t *addr, int *type);
+static void VarMoveBounds(int vloc, uint16_t value);
+static int VarArrayData(uint32_t *curr_tok, int *type, uint32_t *addr, uint32_t *n,
+                        uint8_t **mem);
+static int ExprIsLogic(uint32_t *curr_tok, num_t *value);
+static int ExprIsCompare(uint32_t *curr_tok, num_t *value);
+static int ExprIsSum(uint32_t *curr_tok, num_t *value);
+static int ExprIsTerm(uint32_t *curr_tok, num_t *value);
+static int ExprIsFactor(uint32_t *curr_tok, num_t *value);
+static int ExprReduce(uint32_t *curr_tok, num_t *value);
+static int NumSum(num_t *a, int op, num_t *b, uint32_t col);
+static int NumTerm(num_t *a, int op, num_t *b, uint32_t col);
+static uint32_t NumCompare(num_t *a, int op, num_t *b);
+static int NumUnary(num_t *a, int op, uint32_t col);
+static num_kind_t NumPromote(num_t *a, num_t *b);
+static void NumConvert(num_t *n, num_kind_t kind);
+static int NumIsTrue(const num_t *n);
+static uint32_t NumToU32(const num_t *n);
+static int64_t NumToI64(const num_t *n);
+static uint64_t NumToU64(const num_t *n);
+static double NumToF64(const num_t *n);
+static uint32_t NumFormat(char *out, const num_t *n);
+static num_t NumLoad(uint32_t addr, int type);
+static void NumStore(uint32_t addr, int type, const num_t *value);
+static uint64_t ConvertHexNumber(int idx1, int idx2);
+static uint64_t ConvertBinNumber(int idx1, int idx2);
+static uint64_t ConvertDecNumber(int idx1, int idx2);
 static int32_t GetHexValue(char ch);
+static int LexGetOperator(int idx);
+static uint32_t MemLoad(uint32_t addr, int type);
+static void MemStore(uint32_t addr, int type, uint32_t value);
+static int StrIsOperand(uint32_t curr_tok);
+static int StrOperand(uint32_t *curr_tok, const char **str, uint32_t *len);
+static int StrMid(uint32_t *curr_tok, const char **str, uint32_t *len);
+static int StrLen(uint32_t *curr_tok, uint32_t *value);
+static void StrLoad(uint32_t addr, const char **str, uint32_t *len);
+static int StrConcat(uint32_t *curr_tok, uint32_t dst);
+static int StrCopy(uint32_t dst, uint32_t src);
+static char *StrBegin(uint32_t len, uint16_t *heap_addr);
+static void StrEnd(uint32_t dst, uint32_t len, uint16_t heap_addr);
+static void StrRelease(uint32_t addr);
 static uint16_t GetPointerValue(int vloc);
+static void SetPointerValue(int vloc, uint16_t addr);
+static int EmitLine(void);
+static int EmitVar(uint32_t curr_tok);
+static void EmitBlockClose(uint32_t line);
+static int EmitPrint(uint32_t curr_tok);
+static int EmitAssignment(uint32_t curr_tok);
+static int EmitFor(uint32_t curr_tok);
+static int EmitNext(uint32_t curr_tok);
+static int EmitIf(uint32_t curr_tok);
+static int EmitNumber(uint32_t *curr_tok, emit_val_t *value);
+static int EmitLogic(uint32_t *curr_tok, emit_val_t *value);
+static int EmitCompare(uint32_t *curr_tok, emit_val_t *value);
+static int EmitSum(uint32_t *curr_tok, emit_val_t *value);
+static int EmitTerm(uint32_t *curr_tok, emit_val_t *value);
+static int EmitFactor(uint32_t *curr_tok, emit_val_t *value);
+static int EmitArith(emit_val_t *a, char op, emit_val_t *b, uint32_t col);
+static const char *EmitConvert(const emit_val_t *value, num_kind_t kind);
+static const char *EmitStore(const emit_val_t *value, int type);
+static int EmitAccess(uint32_t *curr_tok, const char **name, const char **offs,
+                      int *type);
+static int EmitStrOperand(uint32_t *curr_tok, const char **str);
+static int EmitStrMid(uint32_t *curr_tok, const char **str);
+static int EmitStrLen(uint32_t *curr_tok, const char **value);
+static const char *EmitLiteral(const char *str, uint32_t len);
+static const char *EmitFormat(const char *fmt, ...);
+static void EmitStatement(const char *fmt, ...);
+static int EmitUnsupported(uint32_t tok);
 
 #if DEBUG >= 1
 static void debug_print_type(token_type_t type);
@@ -154,28 +515,138 @@ static void debug_print_type(token_type_t type);
 #endif
 
 /* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Reset the interpreter's run-time memory.
+ */
+void BasicInit(void)
+{
+  int i;
+
+  for (i = 0; i < MAX_FILES; i++) {
+    FileInit(&files[i]);
+  }
+  MemReset();
+  ArenaInit(&front_arena, FRONT_ARENA_SIZE);
+  ProgInit(&program);
+  console = stdout;
+}
+
+/**
+ *  @brief  Release what the interpreter holds for the calling thread
+ *          (before the thread ends; BasicInit() starts it over).
+ */
+void BasicExit(void)
+{
+  TaskDiscard();
+  ArenaFree(&front_arena);
+  StrPoolFree(&strpool);
+  FmtCacheFree(fmt_cache, fmt_cache_len);
+  fmt_cache = NULL;
+  fmt_cache_len = 0;
+}
+
+/**
+ *  @brief  Send the output of scripts run on this thread to f (stdout
+ *          until this is called).
+ */
+void BasicSetOutput(FILE *f)
+{
+  console = f;
+}
+
+/**
+ *  @brief  Where the number of the line being run is kept; the sampling
+ *          profiler reads it from its signal handler.
+ */
+const volatile uint32_t *BasicLineCounter(void)
+{
+  return &line_count;
+}
+
+/**
+ *  @brief  Limit each program run to a number of statements, a stack
+ *          high-water mark (bytes) and a wall time (milliseconds).
+ *          0 means no limit.
+ */
+void BasicSetQuotas(uint64_t statements, uint32_t memory, uint32_t time_ms)
+{
+  quota_statements = statements;
+  quota_memory = memory;
+  quota_time_ms = time_ms;
+}
+
+/**
+ *  @brief  The quota that stopped the last program run, if any.
+ */
+quota_t BasicQuotaExceeded(void)
+{
+  return quota_exceeded;
+}
+
+/**
+ *  @brief  Limit SUB calls to depth nested frames (recursion included).
+ */
+void BasicSetMaxCallDepth(uint32_t depth)
+{
+  max_call_depth = depth;
+}
+
+/**
+ *  @brief  Print how many array index checks were removed, statically and
+ *          at run time, for the last program run.
+ */
+void BasicBoundsReport(FILE *f)
+{
+  fprintf(f, "Bounds checks: %u of %u index sites removed; "
+          "%llu checks run, %llu skipped\n", bounds_removed, bounds_sites,
+          (unsigned long long)bounds_checked, (unsigned long long)bounds_skipped);
+}
+
 /**
  *  @brief  Interpret incoming lines entered by user.
+ *          Lines starting with a number are stored in the program (an
+ *          empty numbered line deletes it), anything else runs at once.
+ *  @return rEOF once stdin is exhausted.
  */
 int BasicCommandLine(void)
 {
-  tokp = 0;
+  int result;
+  uint32_t number;
+
+  // Release the previous line (kept until now for error reporting)
+  LexEndLine();
+
   CONSOLE_PRINTF(">> ");
-  if (fgets(linebuf, LINEBUF_LEN, stdin)) {
-    // LexAnalyzeLine the line
-    if (LexAnalyzeLine() == rFAILURE) {
-      return rFAILURE;
-    }
+  if ((result = LexReadLine(stdin)) != rSUCCESS) {
+    return result;
+  }
+  line_count = 0;
 
-    if (ParseLine() == rFAILURE) {
-      return rFAILURE;
-    }
-    memset(linebuf, 0, LINEBUF_LEN);
-  } else {
+  if (LexIsLineNumber(&number)) {
+    return CommandEnterLine(number);
+  }
+
+  // LexAnalyzeLine the line
+  if (LexAnalyzeLine() == rFAILURE) {
     return rFAILURE;
   }
 
-  return rSUCCESS;
+  if (tokp > 0 && tokens[0].type == KEYWORD) {
+    switch (tokens[0].aux) {
+      case LIST:
+        return CommandList(1);
+      case RUN:
+        return CommandRun(1);
+      case NEW:
+        return CommandNew(1);
+      case DELETE:
+        return CommandDelete(1);
+      default:
+        break;
+    }
+  }
+
+  return ParseLine();
 }
 
 /**
@@ -184,49 +655,246 @@ int BasicCommandLine(void)
  */
 int BasicInterpret(FILE *f)
 {
-  char ch;
-  line_count = 1;
+  int result;
 
-  do {
-    // Initialize
-    tokp = 0;
+  if ((result = ProgramLoad(f)) != rSUCCESS) {
+    return result;
+  }
 
-    // Get the entire line
-    do {
-      ch = fgetc(f);
-      if (ch != EOF) {
-        linebuf[linebuf_idx++] = ch;
-      }
-    } while ((ch != '\n') && (ch != EOF) && (linebuf_idx < LINEBUF_LEN));
+  return ProgramRun();
+}
 
-    // 
-    if (linebuf_idx == LINEBUF_LEN && ch != '\n') {
-      THROW_ERROR("Line length exceeded", LINEBUF_LEN);
-      return rFAILURE;
-    }
+/**
+ *  @brief  Load a script to run in turns with others (see BasicTaskRun()).
+ *          Whatever the interpreter had loaded before is discarded.
+ *  @return The script, NULL if it could not be loaded (the error is
+ *          reported like BasicInterpret()'s).
+ */
+basic_task_t *BasicTaskLoad(FILE *f)
+{
+  basic_task_t *t;
 
-    //
-    DEBUG_PRINTF("Line #%d: %s", line_count, linebuf);
+  TaskDiscard();
+  if ((t = calloc(1, sizeof(basic_task_t))) == NULL) {
+    THROW_ERROR("Out of memory", 0);
+    return NULL;
+  }
+  if (ProgramLoad(f) != rSUCCESS || ProgramStart() != rSUCCESS
+        || TaskSave(t) != rSUCCESS) {
+    free(t->saved);
+    free(t);
+    return NULL;
+  }
 
-    // LexAnalyzeLine the line
-    if (LexAnalyzeLine() == rFAILURE) {
-      return rFAILURE;
-    }
+  return t;
+}
 
-    if (ParseLine() == rFAILURE) {
-      return rFAILURE;
+/**
+ *  @brief  Switch t in and run it until it YIELDs or has run budget
+ *          statements, then switch it out again.
+ *  @return rSUCCESS if t has more to run, rEOF once it has finished, and
+ *          rFAILURE on an error (reported like BasicInterpret()'s).
+ */
+int BasicTaskRun(basic_task_t *t, uint64_t budget)
+{
+  int result;
+
+  TaskRestore(t);
+  result = ProgramStep(budget);
+  if (TaskSave(t) != rSUCCESS) {
+    result = rFAILURE;
+  }
+
+  return result;
+}
+
+/**
+ *  @brief  Release a script, closing its files and mappings.
+ */
+void BasicTaskFree(basic_task_t *t)
+{
+  TaskRestore(t);
+  TaskDiscard();
+  free(t->saved);
+  free(t);
+}
+
+/**
+ *  @brief  Load and analyze a script once, into an image that any number
+ *          of instances (see BasicInstanceNew()) can run, on any threads
+ *          that have called BasicInit(). Whatever the calling thread had
+ *          loaded before is discarded.
+ *  @return The image, NULL if the script could not be loaded (the error is
+ *          reported like BasicInterpret()'s).
+ */
+basic_image_t *BasicImageLoad(FILE *f)
+{
+  basic_image_t *img;
+  // The image gets a literal pool (and templates) of its own
+  strpool_t own_pool = strpool;
+  fmt_template_t **own_cache = fmt_cache;
+  uint32_t own_cache_len = fmt_cache_len;
+
+  TaskDiscard();
+  if ((img = calloc(1, sizeof(basic_image_t))) == NULL) {
+    THROW_ERROR("Out of memory", 0);
+    return NULL;
+  }
+  StrPoolInit(&strpool);
+  fmt_cache = NULL;
+  fmt_cache_len = 0;
+
+  if (ProgramLoad(f) == rSUCCESS && ProgramStart() == rSUCCESS) {
+    ProgramCompileFormats();
+    img->program = program;
+    img->strpool = strpool;
+    img->fmt_cache = fmt_cache;
+    img->fmt_cache_len = fmt_cache_len;
+    img->sp = sp;
+    ProgInit(&program);
+    MemReset();
+  } else {
+    // The program stays loaded so the error can be reported
+    StrPoolFree(&strpool);
+    FmtCacheFree(fmt_cache, fmt_cache_len);
+    free(img);
+    img = NULL;
+  }
+
+  strpool = own_pool;
+  fmt_cache = own_cache;
+  fmt_cache_len = own_cache_len;
+  return img;
+}
+
+/**
+ *  @brief  Release an image. Every instance of it must have been freed.
+ */
+void BasicImageFree(basic_image_t *img)
+{
+  ProgClear(&img->program);
+  StrPoolFree(&img->strpool);
+  FmtCacheFree(img->fmt_cache, img->fmt_cache_len);
+  free(img);
+}
+
+/**
+ *  @brief  New instance of img: fresh memory, ready to run from the top
+ *          with BasicTaskRun() and freed with BasicTaskFree(). An instance
+ *          is a task that shares its program with img instead of owning
+ *          it, so it's cheap to make and runs on whichever thread calls
+ *          BasicTaskRun(), one thread at a time.
+ */
+basic_task_t *BasicInstanceNew(const basic_image_t *img)
+{
+  basic_task_t *t;
+
+  TaskDiscard();
+  if ((t = calloc(1, sizeof(basic_task_t))) == NULL) {
+    THROW_ERROR("Out of memory", 0);
+    return NULL;
+  }
+  image = img;
+  program = img->program;
+  sp = img->sp;
+  ProgramRewind();
+  if (TaskSave(t) != rSUCCESS) {
+    free(t->saved);
+    free(t);
+    return NULL;
+  }
+
+  return t;
+}
+
+/**
+ *  @brief  Run an instance of img to the end on the calling thread, with
+ *          the n variables in binds declared (as globals) first. Nothing
+ *          is kept from one run to the next, so this is the cheap way to
+ *          run a script many times over different inputs.
+ *  @return rSUCCESS, or rFAILURE on an error (reported like
+ *          BasicInterpret()'s).
+ */
+int BasicImageRun(const basic_image_t *img, const basic_bind_t *binds, uint32_t n)
+{
+  int result = rSUCCESS;
+  uint32_t i;
+
+  TaskDiscard();
+  image = img;
+  program = img->program;
+  sp = img->sp;
+  for (i = 0; i < n && result == rSUCCESS; i++) {
+    result = VarBind(&binds[i]);
+  }
+  if (result == rSUCCESS) {
+    ProgramRewind();
+    while ((result = ProgramStep(UINT64_MAX)) == rSUCCESS) {
     }
+    result = (result == rEOF ? rSUCCESS : result);
+  } else {
+    linebuf = (char *)"";
+    line_count = 0;
+  }
 
-    // Reset line buffer
-    linebuf_idx = 0;
-    memset(linebuf, 0, LINEBUF_LEN);
+  // The next run mustn't see this one's values
+  memset(stack, 0, stack_peak);
+  memset(stack + HEAP_BASE, 0, heap.brk - HEAP_BASE);
+  TaskDiscard();
+  return result;
+}
 
-    // Update the line count
-    line_count++;
+/**
+ *  @brief  Translate the script in f to a C program written to out, for
+ *          a C compiler to build natively. Variables keep their types and
+ *          the program prints what the interpreter would; run-time errors
+ *          end it with the interpreter's message. VAR (but not MAPPED or
+ *          pointers), assignment, PRINT (but not USING), IF and FOR are
+ *          translated, with expressions that don't use reductions.
+ *  @return rSUCCESS, or rFAILURE on an error or something that can't be
+ *          translated (reported like BasicInterpret()'s).
+ */
+int BasicEmitC(FILE *f, FILE *out)
+{
+  char *body = NULL;
+  size_t body_len;
+  int result;
+  uint32_t i;
 
-  } while (ch != EOF);
+  if ((result = ProgramLoad(f)) != rSUCCESS || (result = ProgramStart()) != rSUCCESS) {
+    return result;
+  }
 
-  return rSUCCESS;
+  emit_body = open_memstream(&body, &body_len);
+  emit_depth = 1;
+  emit_oom = (emit_body == NULL);
+  for (i = 0; i < program.count && !emit_oom; i++) {
+    ProgramSelectLine(i);
+    prog_pc = i;
+    result = EmitLine();
+    ArenaReset(&front_arena);
+    if (result != rSUCCESS) {
+      break;
+    }
+  }
+  if (emit_body) {
+    emit_oom |= (fclose(emit_body) != 0);
+  }
+  if (emit_oom && result == rSUCCESS) {
+    THROW_ERROR("Out of memory", 0);
+    result = rFAILURE;
+  }
+
+  if (result == rSUCCESS) {
+    EmitRtWrite(out);
+    fputs("\nint main(void)\n{\n", out);
+    fputs(body, out);
+    fputs("  return 0;\n}\n", out);
+  }
+  free(body);
+  LexEndLine();
+  MemReset();
+  return result;
 }
 
 /**
@@ -277,6 +945,43 @@ int LexIsInteger(int *idx1, int *idx2)
   return 1;
 }
 
+/**
+ *  @brief  After a decimal integer, take its fraction and/or exponent if
+ *          it has them ("1.5", "1e9", "2.5e-3"), making it a float.
+ *  @param  idx1  Start index of the integer in linebuf
+ *  @param  idx2  End index of the integer; moved past the float
+ */
+int LexIsFloat(int idx1, int *idx2)
+{
+  int i = *idx2;
+
+  while (idx1 < *idx2 && LexIsDigit(linebuf[idx1])) {
+    idx1++;
+  }
+  if (idx1 != *idx2) {
+    // Hex or binary
+    return 0;
+  }
+
+  if (linebuf[i] == '.' && LexIsDigit(linebuf[i + 1])) {
+    for (i++; LexIsDigit(linebuf[i]); i++) {
+    }
+  }
+  if ((linebuf[i] == 'e' || linebuf[i] == 'E')
+        && (LexIsDigit(linebuf[i + 1])
+            || ((linebuf[i + 1] == '+' || linebuf[i + 1] == '-')
+                && LexIsDigit(linebuf[i + 2])))) {
+    for (i += 2; LexIsDigit(linebuf[i]); i++) {
+    }
+  }
+  if (i == *idx2) {
+    return 0;
+  }
+
+  *idx2 = linebuf_idx = i;
+  return 1;
+}
+
 /**
  *  @brief  Helps lexical analyzer determine if the given
  *          character is a EOF character or not.
@@ -423,15 +1128,33 @@ int LexIsHexDigit(char c)
  *  @param  
  */
 int LexIsKeyword(int idx1, int idx2)
+{
+  return (LexGetKeyword(idx1, idx2) >= 0);
+}
+
+/**
+ *  @brief  Get the keyword_t of the given identifier.
+ *  @return The keyword, -1 if the identifier is not a keyword.
+ */
+int LexGetKeyword(int idx1, int idx2)
+{
+  return LexFindKeyword(linebuf + idx1, idx2 - idx1);
+}
+
+/**
+ *  @brief  Get the keyword_t of the len characters at name.
+ *  @return The keyword, -1 if they are not a keyword.
+ */
+int LexFindKeyword(const char *name, uint32_t len)
 {
   int i;
   for (i = 0; keywords[i][0]; i++) {
-    if (memcmp(linebuf + idx1, keywords[i], idx2 - idx1) == 0) {
-      return 1;
+    if (strncmp(name, keywords[i], len) == 0 && keywords[i][len] == '\0') {
+      return i;
     }
   }
 
-  return 0;
+  return -1;
 }
 
 /**
@@ -484,7 +1207,7 @@ int ParseLine(void)
 #endif
 
   int result = rSUCCESS;
-  uint32_t curr_tok = 0;
+  uint32_t curr_tok = 0, prof = ProfEnter(PROF_PARSER), prof_print;
 
   if (tokp == 0) {
     // No need to do anything, we accept these.
@@ -494,13 +1217,104 @@ int ParseLine(void)
     // PRINT, VAR, IF, WHILE, etc.
     switch (ParseGetKeyword(curr_tok++)) {
       case PRINT:
+        prof_print = ProfEnter(PROF_PRINT);
         result = StatementPrint(curr_tok);
+        ProfLeave(prof_print);
         break;
       case VAR:
         result = StatementVar(curr_tok);
         break;
+      case ALLOC:
+        result = StatementAlloc(curr_tok);
+        break;
+      case FREE:
+        result = StatementFree(curr_tok);
+        break;
       case MEMPEEK:
         result = StatementMempeek(curr_tok);
+        break;
+      case WATCH:
+        result = StatementWatch(curr_tok);
+        break;
+      case ADVISE:
+        result = StatementAdvise(curr_tok);
+        break;
+      case OPEN:
+        result = StatementOpen(curr_tok);
+        break;
+      case CLOSE:
+        result = StatementClose(curr_tok);
+        break;
+      case READ:
+      case WRITE:
+        result = StatementFileIO(curr_tok, tokens[0].aux == WRITE);
+        break;
+      case SORT:
+        result = StatementSort(curr_tok);
+        break;
+      case FOR:
+      case NEXT:
+      case IF:
+      case ELSE:
+      case END:
+      case SUB:
+      case CALL:
+      case RETURN:
+      case YIELD:
+        if (!prog_running) {
+          THROW_ERROR("Statement is only valid in a program", tokens[0].idx1 + 1);
+          result = rFAILURE;
+          break;
+        }
+        switch (tokens[0].aux) {
+          case FOR:
+            result = StatementFor(curr_tok);
+            break;
+          case NEXT:
+            result = StatementNext(curr_tok);
+            break;
+          case IF:
+            result = StatementIf(curr_tok);
+            break;
+          case ELSE:
+            // End of the THEN part; carry on after END
+            if (curr_tok < tokp) {
+              THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+              result = rFAILURE;
+            }
+            BlockClose(program.lines[program.lines[prog_pc].jump].jump);
+            prog_next = program.lines[prog_pc].jump + 1;
+            break;
+          case END:
+            result = StatementEnd(curr_tok);
+            break;
+          case SUB:
+            // Definitions only run when called
+            prog_next = program.lines[prog_pc].jump + 1;
+            break;
+          case CALL:
+            result = StatementCall(curr_tok);
+            break;
+          case RETURN:
+            result = StatementReturn(curr_tok);
+            break;
+          case YIELD:
+            // Let the next scheduled script run (see BasicTaskRun())
+            if (curr_tok < tokp) {
+              THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+              result = rFAILURE;
+            }
+            prog_yield = 1;
+            break;
+        }
+        break;
+      case LIST:
+      case RUN:
+      case NEW:
+      case DELETE:
+        THROW_ERROR("Command is only valid at the prompt", tokens[0].idx1 + 1);
+        result = rFAILURE;
+        break;
       default:
         break;
     }
@@ -510,9 +1324,12 @@ int ParseLine(void)
     uint32_t val;
     result = StatementExpression(curr_tok, &val);
 #else
-    uint32_t value;
-    if ((result = StatementAssignment(curr_tok)) == rSUCCESS) {
-            
+    uint32_t value, eq;
+    // Any '=' makes it an assignment, whose errors are final
+    for (eq = curr_tok; eq < tokp && tokens[eq].type != EQUALS; eq++) {
+    }
+    if (eq < tokp) {
+      result = StatementAssignment(curr_tok);
     } else if ((result = StatementExpression(&curr_tok, &value)) == rSUCCESS) {
       // Uhhh... Sure. But this doesn't actually do anything :)
       puts("Pointless epxression, my friend:)");
@@ -521,914 +1338,6400 @@ int ParseLine(void)
 #endif
   }
 
+  ProfLeave(prof);
   return result;
 }
 
 /* Local Function Definitions ----------------------------------------------- */
-static int LexAnalyzeLine(void)
+/**
+ *  @brief  Read the next line of f into linebuf (NUL terminated). The
+ *          buffer comes from the front end arena and grows as needed.
+ *  @return rEOF if there was nothing left to read.
+ */
+static int LexReadLine(FILE *f)
 {
-  char ch;
-  int idx1 = 0, idx2 = 0;
+  uint32_t len = 0, cap = LINEBUF_INIT_LEN;
+  int ch;
 
-  // Reset index
-  linebuf_idx = 0;
+  if ((linebuf = ArenaAlloc(&front_arena, cap)) == NULL) {
+    THROW_ERROR("Out of memory", 0);
+    return rFAILURE;
+  }
 
-  //
-  while (!LexIsEndOfLine(linebuf[linebuf_idx])) {
-    ch = linebuf[linebuf_idx];
-    if (LexIsWhiteSpace(ch)) {
-      // Ignore white spaces
-      linebuf_idx++;
-    } else if (LexIsInlineComment(ch)) {
-      // Ignore comments
-      DEBUG_PRINTF("Comment: %s", linebuf + linebuf_idx + 1);
+  while ((ch = getc(f)) != EOF) {
+    if (len + 1 == cap) {
+      if ((linebuf = ArenaGrow(&front_arena, linebuf, len, cap * 2)) == NULL) {
+        THROW_ERROR("Out of memory", 0);
+        return rFAILURE;
+      }
+      cap *= 2;
+    }
+    linebuf[len++] = ch;
+    if (ch == '\n') {
       break;
-    } else if (LexIsDigit(ch) && LexIsInteger(&idx1, &idx2)) {
-      // Save token name and type as NUMBER
-      tokens[tokp].idx1 = idx1;
-      tokens[tokp].idx2 = idx2;
-      tokens[tokp].type = NUMBER;
-      tokp++;
-    } else if (LexIsDoubleQuote(ch)) {
-      // TODO Change where we store STRING literals.
-      // Check for string literals
-      idx1 = linebuf_idx + 1;
-      do {
-        // Make sure string is properly terminated
-        ch = linebuf[linebuf_idx++];
-        if (LexIsEndOfLine(ch)) {
-          THROW_ERROR("Invalid string", linebuf_idx);
-          return rFAILURE;
+    }
+  }
+  linebuf[len] = '\0';
+
+  return (len == 0 && ch == EOF ? rEOF : rSUCCESS);
+}
+
+/**
+ *  @brief  Release the front end storage used by the current line.
+ */
+static void LexEndLine(void)
+{
+  ArenaReset(&front_arena);
+  tokens = NULL;
+  tok_cap = 0;
+  tokp = 0;
+  consolebuf = NULL;
+  consolebuf_cap = 0;
+  consolebuf_idx = 0;
+}
+
+/**
+ *  @brief  Check if linebuf starts with a line number; if so, skip it
+ *          (and the white space after it). One too large to be a line
+ *          number reads as MAX_LINE_NUMBER and is left in place for the
+ *          error report.
+ */
+static int LexIsLineNumber(uint32_t *number)
+{
+  uint32_t idx = 0, n = 0;
+
+  while (linebuf[idx] == ' ' || linebuf[idx] == '\t') {
+    idx++;
+  }
+  if (!LexIsDigit(linebuf[idx])) {
+    return 0;
+  }
+  for (; LexIsDigit(linebuf[idx]); idx++) {
+    n = (n < MAX_LINE_NUMBER / 10 ? n * 10 + linebuf[idx] - '0' : MAX_LINE_NUMBER);
+  }
+  while (LexIsWhiteSpace(linebuf[idx]) && !LexIsEndOfLine(linebuf[idx])) {
+    idx++;
+  }
+
+  linebuf += (n < MAX_LINE_NUMBER ? idx : 0);
+  *number = n;
+  return 1;
+}
+
+/**
+ *  @brief  Reset the run-time memory: variables, stack and heap, along
+ *          with mapped and opened files.
+ */
+static void MemReset(void)
+{
+  int i;
+
+  for (i = 0; i < MAX_FILES; i++) {
+    FileClose(&files[i]);
+  }
+  sp = 0;
+  stack_peak = 0;
+  stack_unshared = 0;
+  varp = 0;
+  loopp = 0;
+  blockp = 0;
+  framep = 0;
+  nwatches = 0;
+  HeapInit(&heap, stack, HEAP_BASE, HEAP_SIZE);
+  MapRelease(0);
+}
+
+/**
+ *  @brief  Host address of nbytes of interpreter memory at addr: the
+ *          stack and heap, or a MAPPED array's file.
+ *  @return NULL if the range isn't all in one of them.
+ */
+static uint8_t *MemPtr(uint32_t addr, uint32_t nbytes)
+{
+  uint32_t i;
+
+  if (addr < MEM_SIZE) {
+    return (nbytes <= MEM_SIZE - addr ? stack + addr : NULL);
+  }
+  for (i = 0; i < nmaps; i++) {
+    if (addr - maps[i].vaddr < maps[i].len) {
+      return (nbytes <= maps[i].len - (addr - maps[i].vaddr)
+              ? maps[i].base + (addr - maps[i].vaddr) : NULL);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ *  @brief  Whether addr is in a MAPPED array that was mapped read-only.
+ */
+static int MemIsReadOnly(uint32_t addr)
+{
+  uint32_t i;
+
+  for (i = 0; i < nmaps; i++) {
+    if (addr - maps[i].vaddr < maps[i].len) {
+      return !maps[i].writable;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ *  @brief  Unmap the files of maps[from] and up.
+ */
+static void MapRelease(uint32_t from)
+{
+  while (nmaps > from) {
+    MapFileClose(&maps[--nmaps]);
+  }
+}
+
+/**
+ *  @brief  Account for nbytes of variable storage placed at addr.
+ */
+static void StackCommit(uint32_t addr, uint32_t nbytes)
+{
+  if (addr >= sp) {
+    sp = addr + nbytes;
+  }
+  if (addr + nbytes > stack_peak) {
+    stack_peak = addr + nbytes;
+  }
+  stack_unshared += nbytes;
+}
+
+/**
+ *  @brief  Make stored line i the current line (linebuf, tokens, ...).
+ */
+static void ProgramSelectLine(uint32_t i)
+{
+  prog_line_t *line = &program.lines[i];
+
+  linebuf = line->text;
+  tokens = line->toks;
+  tokp = tok_cap = line->ntoks;
+  line_count = line->number;
+}
+
+/**
+ *  @brief  Read and lex a whole program into the program store, numbering
+ *          lines by their position in the file.
+ */
+static int ProgramLoad(FILE *f)
+{
+  int result;
+  line_count = 1;
+
+  // Load the whole program first so it can be analyzed before it runs.
+  ProgClear(&program);
+  while ((result = LexReadLine(f)) == rSUCCESS) {
+    //
+    DEBUG_PRINTF("Line #%d: %s", line_count, linebuf);
+
+    // LexAnalyzeLine the line
+    if (LexAnalyzeLine() == rFAILURE) {
+      return rFAILURE;
+    }
+
+    // Keep it, numbered by its position in the file
+    if (tokp > 0 && ProgSetLine(&program, line_count, linebuf,
+                                strlen(linebuf), tokens, tokp) != rSUCCESS) {
+      THROW_ERROR("Out of memory", 0);
+      return rFAILURE;
+    }
+
+    // Reset line buffer, tokens and console buffer
+    LexEndLine();
+
+    // Update the line count
+    line_count++;
+  }
+
+  return (result == rEOF ? rSUCCESS : result);
+}
+
+/**
+ *  @brief  Run the stored program from the top with fresh memory.
+ */
+static int ProgramRun(void)
+{
+  int result;
+
+  if ((result = ProgramStart()) != rSUCCESS) {
+    return result;
+  }
+  while ((result = ProgramStep(UINT64_MAX)) == rSUCCESS) {
+    // YIELD has nothing to switch to
+  }
+
+  return (result == rEOF ? rSUCCESS : result);
+}
+
+/**
+ *  @brief  Get the stored program ready to run from the top: fresh
+ *          memory, analysis passes and quotas.
+ */
+static int ProgramStart(void)
+{
+  uint32_t prof;
+
+  MemReset();
+  prof = ProfEnter(PROF_ANALYSIS);
+  if (ProgramMatchBlocks() != rSUCCESS) {
+    ProfLeave(prof);
+    return rFAILURE;
+  }
+  sp = ProgramPlanSlots();
+  ProgramCheckBounds();
+  ProfLeave(prof);
+  ProgramRewind();
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Point the stored program back at its first line and start its
+ *          quotas over. Memory is left as it is.
+ */
+static void ProgramRewind(void)
+{
+  prog_next = 0;
+  quota_exceeded = QUOTA_NONE;
+  quota_left = (quota_statements ? quota_statements : UINT64_MAX);
+  if (quota_time_ms) {
+    clock_gettime(CLOCK_MONOTONIC, &quota_start);
+  }
+}
+
+/**
+ *  @brief  Run the stored program from prog_next until it YIELDs, has run
+ *          budget statements, or ends.
+ *  @return rSUCCESS if there is more to run, rEOF at the end of the
+ *          program.
+ */
+static int ProgramStep(uint64_t budget)
+{
+  int result = rSUCCESS;
+  // Quotas are plain counters checked between statements; the clock is
+  // only read every QUOTA_CLOCK_STEP statements.
+  uint32_t memory = (quota_memory ? quota_memory : UINT32_MAX);
+  struct timespec now;
+
+  prog_running = 1;
+  prog_yield = 0;
+  for (prog_pc = prog_next; prog_pc < program.count; prog_pc = prog_next) {
+    if (prog_yield || budget-- == 0) {
+      break;
+    }
+    LexEndLine();
+    ProgramSelectLine(prog_pc);
+    prog_next = prog_pc + 1;
+    if (quota_left-- == 0) {
+      quota_exceeded = QUOTA_STATEMENTS;
+      THROW_ERROR("Statement limit exceeded", 1);
+      result = rFAILURE;
+      break;
+    }
+    if (quota_time_ms && quota_left % QUOTA_CLOCK_STEP == 0) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if ((now.tv_sec - quota_start.tv_sec) * 1000
+            + (now.tv_nsec - quota_start.tv_nsec) / 1000000 >= quota_time_ms) {
+        quota_exceeded = QUOTA_TIME;
+        THROW_ERROR("Time limit exceeded", 1);
+        result = rFAILURE;
+        break;
+      }
+    }
+    if ((result = ParseLine()) != rSUCCESS) {
+      break;
+    }
+    if (stack_peak > memory) {
+      quota_exceeded = QUOTA_MEMORY;
+      THROW_ERROR("Memory limit exceeded", 1);
+      result = rFAILURE;
+      break;
+    }
+  }
+  prog_running = 0;
+
+  return (result == rSUCCESS && prog_next >= program.count ? rEOF : result);
+}
+
+/**
+ *  @brief  Compile the template of every PRINT USING line of the stored
+ *          program ahead of time. Invalid ones are left for
+ *          PrintGetTemplate() to report if they're ever run.
+ */
+static void ProgramCompileFormats(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    if (tokp > 2 && tokens[0].type == KEYWORD && tokens[0].aux == PRINT
+          && tokens[1].type == KEYWORD && tokens[1].aux == USING
+          && tokens[2].type == STRING) {
+      PrintGetTemplate(2);
+    }
+  }
+  LexEndLine();
+}
+
+/**
+ *  @brief  Drop whatever program and memory the interpreter has loaded.
+ */
+static void TaskDiscard(void)
+{
+  LexEndLine();
+  MemReset();
+  if (image) {
+    ProgInit(&program);
+    image = NULL;
+  } else {
+    ProgClear(&program);
+  }
+  free(frames);
+  frames = NULL;
+  frame_cap = 0;
+}
+
+/**
+ *  @brief  Switch t in, discarding what was loaded before.
+ */
+static void TaskRestore(basic_task_t *t)
+{
+  uint8_t *p = t->saved;
+  uint32_t heap_len = t->heap.brk - HEAP_BASE;
+
+  TaskDiscard();
+  program = t->program;
+  image = t->image;
+  prog_next = t->prog_next;
+  memcpy(stack, p, t->sp);
+  p += t->sp;
+  memcpy(stack + HEAP_BASE, p, heap_len);
+  p += heap_len;
+  memcpy(var_list, p, t->varp * sizeof(var_t));
+  p += t->varp * sizeof(var_t);
+  memcpy(loops, p, t->loopp * sizeof(loop_t));
+  p += t->loopp * sizeof(loop_t);
+  memcpy(blocks, p, t->blockp * sizeof(block_t));
+  p += t->blockp * sizeof(block_t);
+  memcpy(maps, p, t->nmaps * sizeof(mapfile_t));
+  p += t->nmaps * sizeof(mapfile_t);
+  memcpy(watches, p, t->nwatches * sizeof(watch_t));
+  sp = t->sp;
+  stack_peak = t->stack_peak;
+  stack_unshared = t->stack_unshared;
+  heap = t->heap;
+  varp = t->varp;
+  loopp = t->loopp;
+  blockp = t->blockp;
+  nmaps = t->nmaps;
+  nwatches = t->nwatches;
+  memcpy(files, t->files, sizeof(files));
+  frames = t->frames;
+  frame_cap = t->frame_cap;
+  framep = t->framep;
+  quota_left = t->quota_left;
+  quota_start = t->quota_start;
+}
+
+/**
+ *  @brief  Switch the loaded program out into t. Only the memory in use is
+ *          kept, and it's cleared behind it so the next script can't see
+ *          it. If that fails (out of memory) the program is dropped.
+ */
+static int TaskSave(basic_task_t *t)
+{
+  int i, result = rSUCCESS;
+  uint32_t heap_len = heap.brk - HEAP_BASE;
+  uint32_t len = sp + heap_len + varp * sizeof(var_t) + loopp * sizeof(loop_t)
+                 + blockp * sizeof(block_t) + nmaps * sizeof(mapfile_t)
+                 + nwatches * sizeof(watch_t);
+  uint8_t *p;
+
+  if (!t->saved || len > t->saved_cap) {
+    if ((p = realloc(t->saved, len + 1)) == NULL) {
+      // Save an empty program instead
+      TaskDiscard();
+      heap_len = 0;
+      linebuf = (char *)"";
+      THROW_ERROR("Out of memory", 0);
+      result = rFAILURE;
+    } else {
+      t->saved = p;
+      t->saved_cap = len;
+    }
+  }
+
+  p = t->saved;
+  memcpy(p, stack, sp);
+  p += sp;
+  memcpy(p, stack + HEAP_BASE, heap_len);
+  p += heap_len;
+  memcpy(p, var_list, varp * sizeof(var_t));
+  p += varp * sizeof(var_t);
+  memcpy(p, loops, loopp * sizeof(loop_t));
+  p += loopp * sizeof(loop_t);
+  memcpy(p, blocks, blockp * sizeof(block_t));
+  p += blockp * sizeof(block_t);
+  memcpy(p, maps, nmaps * sizeof(mapfile_t));
+  p += nmaps * sizeof(mapfile_t);
+  memcpy(p, watches, nwatches * sizeof(watch_t));
+  t->program = program;
+  t->image = image;
+  t->prog_next = prog_next;
+  t->sp = sp;
+  t->stack_peak = stack_peak;
+  t->stack_unshared = stack_unshared;
+  t->heap = heap;
+  t->varp = varp;
+  t->loopp = loopp;
+  t->blockp = blockp;
+  t->nmaps = nmaps;
+  t->nwatches = nwatches;
+  memcpy(t->files, files, sizeof(files));
+  t->frames = frames;
+  t->frame_cap = frame_cap;
+  t->framep = framep;
+  t->quota_left = quota_left;
+  t->quota_start = quota_start;
+
+  // t owns all of it now; the lexer mustn't write into its lines either
+  LexEndLine();
+  memset(stack, 0, stack_peak);
+  memset(stack + HEAP_BASE, 0, heap_len);
+  for (i = 0; i < MAX_FILES; i++) {
+    FileInit(&files[i]);
+  }
+  nmaps = 0;
+  ProgInit(&program);
+  image = NULL;
+  frames = NULL;
+  frame_cap = 0;
+  MemReset();
+
+  return result;
+}
+
+/**
+ *  @brief  Pair up block statements once, before the program runs, so
+ *          nothing has to search for the other end at run time:
+ *            FOR     -> its NEXT         NEXT  -> its FOR
+ *            IF      -> its ELSE or END  ELSE  -> its END
+ *            SUB     -> its END          END   -> its IF or SUB
+ *            CALL    -> the SUB it calls
+ */
+static int ProgramMatchBlocks(void)
+{
+  uint32_t open[MAX_BLOCK_DEPTH], otherwise[MAX_BLOCK_DEPTH];
+  uint32_t i, j, len, depth = 0, nloops = 0, in_sub = 0;
+  prog_line_t *sub;
+  int kind;
+
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    if (tokens[0].type != KEYWORD) {
+      continue;
+    }
+    switch ((kind = tokens[0].aux)) {
+      case FOR:
+      case IF:
+        if (depth == MAX_BLOCK_DEPTH
+              || (kind == FOR && nloops == MAX_LOOP_DEPTH)) {
+          THROW_ERROR("Too many nested blocks", tokens[0].idx1 + 1);
+          return rFAILURE;
+        }
+        nloops += (kind == FOR);
+        otherwise[depth] = 0;
+        open[depth++] = i;
+        break;
+      case NEXT:
+        if (depth == 0 || program.lines[open[depth - 1]].toks[0].aux != FOR) {
+          THROW_ERROR("NEXT without FOR", tokens[0].idx1 + 1);
+          return rFAILURE;
+        }
+        depth--;
+        nloops--;
+        program.lines[i].jump = open[depth];
+        program.lines[open[depth]].jump = i;
+        break;
+      case ELSE:
+        if (depth == 0 || program.lines[open[depth - 1]].toks[0].aux != IF
+              || otherwise[depth - 1]) {
+          THROW_ERROR("ELSE without IF", tokens[0].idx1 + 1);
+          return rFAILURE;
+        }
+        otherwise[depth - 1] = i;
+        break;
+      case END:
+        // END [ IF | SUB ]
+        if (depth > 0) {
+          kind = program.lines[open[depth - 1]].toks[0].aux;
+        } else {
+          kind = (in_sub ? SUB : END);
+        }
+        if (kind == END || kind == FOR || (tokp > 1 && (tokens[1].type != KEYWORD
+              || tokens[1].aux != kind || tokp > 2))) {
+          THROW_ERROR(kind == FOR ? "FOR without NEXT" : "END without IF or SUB",
+                      tokens[0].idx1 + 1);
+          return rFAILURE;
+        }
+        if (kind == IF) {
+          depth--;
+          program.lines[open[depth]].jump = (otherwise[depth] ? otherwise[depth] : i);
+          if (otherwise[depth]) {
+            program.lines[otherwise[depth]].jump = i;
+          }
+          program.lines[i].jump = open[depth];
+        } else {
+          program.lines[i].jump = in_sub - 1;
+          program.lines[in_sub - 1].jump = i;
+          in_sub = 0;
+        }
+        break;
+      case SUB:
+        if (depth > 0 || in_sub) {
+          THROW_ERROR("SUB must be at the top level", tokens[0].idx1 + 1);
+          return rFAILURE;
+        }
+        if (SubCheckHeader(i) != rSUCCESS) {
+          return rFAILURE;
+        }
+        in_sub = i + 1;
+        break;
+      case RETURN:
+        if (!in_sub) {
+          THROW_ERROR("RETURN outside SUB", tokens[0].idx1 + 1);
+          return rFAILURE;
+        }
+        break;
+      case VAR:
+        // The declaration would run on every iteration.
+        if (nloops > 0) {
+          THROW_ERROR("VAR is not allowed inside a loop", tokens[0].idx1 + 1);
+          return rFAILURE;
+        }
+        // Variables declared in an IF branch go when it ends
+        program.lines[i].jump = (depth > 0 ? open[depth - 1] + 1 : 0);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (depth > 0 || in_sub) {
+    ProgramSelectLine(depth > 0 ? open[depth - 1] : in_sub - 1);
+    THROW_ERROR(tokens[0].aux == FOR ? "FOR without NEXT" : "Missing END",
+                tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // Resolve CALL targets
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    if (tokens[0].type != KEYWORD || tokens[0].aux != CALL) {
+      continue;
+    }
+    if (tokp < 2 || (tokens[1].type != VARIABLE && tokens[1].type != LABEL)) {
+      THROW_ERROR("Expecting SUB name", tokens[0].idx2 + 1);
+      return rFAILURE;
+    }
+    tokens[1].type = LABEL;
+    len = tokens[1].idx2 - tokens[1].idx1;
+    for (j = 0; j < program.count; j++) {
+      sub = &program.lines[j];
+      if (sub->toks[0].type == KEYWORD && sub->toks[0].aux == SUB
+            && sub->toks[1].idx2 - sub->toks[1].idx1 == len
+            && memcmp(sub->text + sub->toks[1].idx1, linebuf + tokens[1].idx1, len) == 0) {
+        break;
+      }
+    }
+    if (j == program.count) {
+      THROW_ERROR("Undefined SUB", tokens[1].idx1 + 1);
+      return rFAILURE;
+    }
+    program.lines[i].jump = j;
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Check a SUB header on program line line (the current line):
+ *            SUB :== 'SUB' NAME [ '(' [ PARAM {, PARAM} ] ')' ]
+ *            PARAM :== VARIABLE VAR_TYPE
+ *          The name becomes a LABEL token and each parameter token keeps
+ *          its var_type_t in aux for StatementCall().
+ */
+static int SubCheckHeader(uint32_t line)
+{
+  uint32_t t = 2, p, nparams = 0, len;
+  int var_type;
+
+  if (tokp < 2 || (tokens[1].type != VARIABLE && tokens[1].type != LABEL)) {
+    THROW_ERROR("Expecting SUB name", tokens[0].idx2 + 1);
+    return rFAILURE;
+  }
+  tokens[1].type = LABEL;
+
+  if (t < tokp && tokens[t].type == OPEN_PARENS) {
+    t++;
+    while (t < tokp && tokens[t].type == VARIABLE) {
+      if (nparams == MAX_SUB_PARAMS) {
+        THROW_ERROR("Too many parameters", tokens[t].idx1 + 1);
+        return rFAILURE;
+      }
+      len = tokens[t].idx2 - tokens[t].idx1;
+      if (len >= VAR_NAME_LEN) {
+        THROW_ERROR("Variable name too long", tokens[t].idx1 + 1);
+        return rFAILURE;
+      }
+      for (p = 2; p < t; p++) {
+        if (tokens[p].type == VARIABLE && tokens[p].idx2 - tokens[p].idx1 == len
+              && memcmp(linebuf + tokens[p].idx1, linebuf + tokens[t].idx1, len) == 0) {
+          THROW_ERROR("Duplicate parameter", tokens[t].idx1 + 1);
+          return rFAILURE;
+        }
+      }
+      p = t++;
+      if (t >= tokp || VarIsType(&t, &var_type) != rSUCCESS) {
+        THROW_ERROR("Expecting VAR_TYPE", tokens[t - 1].idx2 + 1);
+        return rFAILURE;
+      }
+      if (var_type == VAR_STRING) {
+        THROW_ERROR("STRING parameters are not supported", tokens[t - 1].idx1 + 1);
+        return rFAILURE;
+      }
+      tokens[p].aux = var_type;
+      nparams++;
+      if (t < tokp && tokens[t].type == COMMA) {
+        t++;
+      } else {
+        break;
+      }
+    }
+    if (t >= tokp || tokens[t].type != CLOSED_PARENS) {
+      THROW_ERROR("Missing close parenthesis", tokens[t - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    t++;
+  }
+
+  if (t < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[t].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // Names must be unique among SUBs
+  len = tokens[1].idx2 - tokens[1].idx1;
+  for (p = 0; p < line; p++) {
+    if (program.lines[p].toks[0].type == KEYWORD && program.lines[p].toks[0].aux == SUB
+          && program.lines[p].toks[1].idx2 - program.lines[p].toks[1].idx1 == len
+          && memcmp(program.lines[p].text + program.lines[p].toks[1].idx1,
+                    linebuf + tokens[1].idx1, len) == 0) {
+      THROW_ERROR("SUB already defined", tokens[1].idx1 + 1);
+      return rFAILURE;
+    }
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Liveness analysis over the whole program. A variable is live
+ *          from its VAR line to the last line that mentions it (at most
+ *          to the end of the IF branch declaring it), and variables whose
+ *          live ranges don't intersect share stack.
+ *          Slots are picked first-fit by address and cached in the
+ *          declaring VARIABLE token (aux) for StatementVar().
+ *  @return Bytes of stack reserved for the planned slots.
+ */
+static uint32_t ProgramPlanSlots(void)
+{
+  live_range_t *ranges = NULL, *r;
+  uint32_t *table = NULL, *active = NULL, (*aliases)[2] = NULL, (*hidden)[3] = NULL;
+  uint32_t nranges = 0, nactive = 0, naliases = 0, nhidden = 0, table_cap = 16;
+  uint32_t loop_depth = 0, loop_end = 0;
+  uint32_t i, j, t, e, h, k, len, addr, path_tok, peak = 0;
+  int var_type, col_major, shared, changed;
+
+  // Count declarations (and forget the previous plan)
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    if (tokens[0].type == KEYWORD && tokens[0].aux == VAR) {
+      for (t = 1; t < tokp; t++) {
+        if (tokens[t].type == VARIABLE) {
+          tokens[t].aux = -1;
+          nranges++;
+        }
+      }
+    } else if (tokens[0].type == VARIABLE) {
+      naliases += tokp;
+    }
+  }
+  while (table_cap < 2 * nranges) {
+    table_cap *= 2;
+  }
+
+  ranges = malloc(nranges * sizeof(live_range_t) + 1);
+  active = malloc(nranges * sizeof(uint32_t) + 1);
+  aliases = malloc(naliases * sizeof(*aliases) + 1);
+  hidden = malloc(nranges * sizeof(*hidden) + 1);
+  table = calloc(table_cap, sizeof(uint32_t));
+  if (!ranges || !active || !aliases || !hidden || !table) {
+    // No plan: every variable goes on top of the stack.
+    nranges = 0;
+    goto done;
+  }
+
+  // Find live ranges. The table maps names to (range index + 1).
+  nranges = naliases = 0;
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    if (tokens[0].type == KEYWORD && tokens[0].aux == SUB) {
+      // Parameters and locals live in call frames
+      i = program.lines[i].jump;
+      continue;
+    }
+    if (tokens[0].type == KEYWORD && tokens[0].aux == VAR) {
+      t = 1;
+      if (VarIsList(&t) != rSUCCESS || t >= tokp
+            || VarIsType(&t, &var_type) != rSUCCESS
+            || VarIsLayout(&t, &col_major) != rSUCCESS
+            || VarIsMapping(&t, &path_tok, &shared) != rSUCCESS || t != tokp) {
+        continue;
+      }
+      for (t = 1; t < tokp; t++) {
+        if (tokens[t].type != VARIABLE) {
+          continue;
+        }
+        r = &ranges[nranges];
+        r->line = i;
+        r->tok = t;
+        r->start = r->end = i;
+        r->is_ptr = 0;
+        if (t + 1 < tokp && tokens[t + 1].type == OPEN_SQUARE_BRACKET) {
+          // A MAPPED array's data is in its file
+          len = (path_tok ? 0 : VarDeclElements(t));
+          r->size = SIZEOF_PTR + len * var_type_sizes[var_type];
+        } else {
+          r->size = var_type_sizes[var_type];
+          r->is_ptr = VAR_IS_PTR(var_type);
+        }
+        if (var_type == VAR_STRING) {
+          // Strings may own heap blocks; never hand their slot over.
+          r->end = UINT32_MAX;
+        }
+
+        // A redeclaration hides the earlier variable from here on (until
+        // the end of the IF branch it's in, if any: see hidden)
+        h = ProgramFindRange(ranges, table, table_cap, t);
+        if (program.lines[i].jump) {
+          hidden[nhidden][0] = program.lines[i].jump - 1;
+          hidden[nhidden][1] = h;
+          hidden[nhidden++][2] = table[h];
+        }
+        table[h] = ++nranges;
+      }
+      continue;
+    }
+
+    // The end of an IF branch ends its variables (their strings are
+    // released, so even those slots can be handed over)
+    if (tokens[0].type == KEYWORD && (tokens[0].aux == ELSE || tokens[0].aux == END)) {
+      j = program.lines[i].jump;
+      j = (tokens[0].aux == ELSE ? program.lines[j].jump : j);
+      while (nhidden > 0 && hidden[nhidden - 1][0] == j) {
+        nhidden--;
+        r = &ranges[table[hidden[nhidden][1]] - 1];
+        if (r->end > i) {
+          r->end = i;
+        }
+        table[hidden[nhidden][1]] = hidden[nhidden][2];
+      }
+    }
+
+    // Anything used inside a loop is live until the outermost loop ends
+    if (tokens[0].type == KEYWORD && tokens[0].aux == FOR) {
+      if (loop_depth++ == 0) {
+        loop_end = program.lines[i].jump;
+      }
+    } else if (tokens[0].type == KEYWORD && tokens[0].aux == NEXT) {
+      loop_depth--;
+    }
+
+    // Uses extend live ranges
+    for (t = 0, e = tokp; t < tokp; t++) {
+      if (tokens[t].type == EQUALS) {
+        e = t;
+      }
+      if (tokens[t].type != VARIABLE) {
+        continue;
+      }
+      h = ProgramFindRange(ranges, table, table_cap, t);
+      tokens[t].aux = (int32_t)table[h] - 1;
+      j = (loop_depth > 0 ? loop_end : i);
+      if (tokens[0].type == KEYWORD && tokens[0].aux == WATCH) {
+        // Watched storage can't be handed to another variable
+        j = UINT32_MAX;
+      }
+      if (table[h] && ranges[table[h] - 1].end < j) {
+        ranges[table[h] - 1].end = j;
+      }
+    }
+
+    // A pointer assigned from other variables (p = q) may point into
+    // their storage, so they must stay live as long as the pointer.
+    if (tokens[0].type == VARIABLE && e < tokp) {
+      for (t = 0; t < e; t++) {
+        if (tokens[t].type != VARIABLE || tokens[t].aux < 0
+              || tokens[t + 1].type != EQUALS || !ranges[tokens[t].aux].is_ptr) {
+          continue;
+        }
+        for (j = e + 1; j < tokp; j++) {
+          if (tokens[j].type == VARIABLE && tokens[j].aux >= 0) {
+            aliases[naliases][0] = tokens[j].aux;
+            aliases[naliases++][1] = tokens[t].aux;
+          }
+        }
+      }
+    }
+    for (t = 0; t < tokp; t++) {
+      if (tokens[t].type == VARIABLE) {
+        tokens[t].aux = -1;
+      }
+    }
+  }
+
+  // A SUB may run at any time, so the globals it uses stay live.
+  for (i = 0; i < program.count; i++) {
+    if (program.lines[i].toks[0].type != KEYWORD
+          || program.lines[i].toks[0].aux != SUB) {
+      continue;
+    }
+    for (j = i + 1; j < program.lines[i].jump; j++) {
+      ProgramSelectLine(j);
+      for (t = 0; t < tokp; t++) {
+        if (tokens[t].type == VARIABLE) {
+          h = ProgramFindRange(ranges, table, table_cap, t);
+          if (table[h]) {
+            ranges[table[h] - 1].end = UINT32_MAX;
+          }
+        }
+      }
+    }
+    i = j;
+  }
+
+  do {
+    changed = 0;
+    for (k = 0; k < naliases; k++) {
+      if (ranges[aliases[k][0]].end < ranges[aliases[k][1]].end) {
+        ranges[aliases[k][0]].end = ranges[aliases[k][1]].end;
+        changed = 1;
+      }
+    }
+  } while (changed);
+
+  // Assign addresses. Declarations are already ordered by start line;
+  // active holds the live ones sorted by address.
+  for (k = 0; k < nranges; k++) {
+    r = &ranges[k];
+    for (i = j = 0; i < nactive; i++) {
+      if (ranges[active[i]].end >= r->start) {
+        active[j++] = active[i];
+      }
+    }
+    nactive = j;
+
+    // First gap that fits
+    for (addr = 0, i = 0; i < nactive; i++) {
+      if (ranges[active[i]].addr >= addr + r->size) {
+        break;
+      }
+      if (ranges[active[i]].addr + ranges[active[i]].size > addr) {
+        addr = ranges[active[i]].addr + ranges[active[i]].size;
+      }
+    }
+    memmove(&active[i + 1], &active[i], (nactive - i) * sizeof(uint32_t));
+    active[i] = k;
+    nactive++;
+
+    r->addr = addr;
+    if (addr + r->size > peak) {
+      peak = addr + r->size;
+    }
+    program.lines[r->line].toks[r->tok].aux = addr;
+  }
+
+done:
+  free(ranges);
+  free(active);
+  free(aliases);
+  free(hidden);
+  free(table);
+  return peak;
+}
+
+/**
+ *  @brief  Probe the name table for the variable named by token t of the
+ *          current line.
+ *  @return Table slot holding its range, or the empty slot to insert at.
+ */
+static uint32_t ProgramFindRange(live_range_t *ranges, uint32_t *table,
+                                 uint32_t table_cap, uint32_t t)
+{
+  const char *name = linebuf + tokens[t].idx1;
+  uint32_t len = tokens[t].idx2 - tokens[t].idx1;
+  uint32_t h = ProgramHashToken(t);
+  token_t *decl;
+
+  for (h &= table_cap - 1; table[h]; h = (h + 1) & (table_cap - 1)) {
+    decl = &program.lines[ranges[table[h] - 1].line].toks[ranges[table[h] - 1].tok];
+    if (decl->idx2 - decl->idx1 == len && memcmp(name,
+          program.lines[ranges[table[h] - 1].line].text + decl->idx1, len) == 0) {
+      break;
+    }
+  }
+  return h;
+}
+
+/**
+ *  @brief  FNV-1a hash of the text of token t of the current line.
+ */
+static uint32_t ProgramHashToken(uint32_t t)
+{
+  uint32_t h = 2166136261u;
+  int i;
+
+  for (i = tokens[t].idx1; i < tokens[t].idx2; i++) {
+    h = (h ^ (uint8_t)linebuf[i]) * 16777619u;
+  }
+  return h;
+}
+
+/**
+ *  @brief  Range analysis for array indices, run before the program.
+ *          An index is proven in bounds when it is a constant, or a FOR
+ *          counter (plus or minus a constant) whose constant bounds keep
+ *          it in range and whose loop body can't change it. The '[' of a
+ *          proven index gets aux = 1 and VarResolve() skips its check.
+ *          SUB bodies are left checked, since their names may be locals.
+ */
+static void ProgramCheckBounds(void)
+{
+  bounds_decl_t *decls = NULL, *d;
+  struct {
+    uint32_t    var;        // Declaration of the counter (index + 1), 0: none
+    int64_t     lo, hi;     // Values the counter takes in the body
+  } loop[MAX_LOOP_DEPTH];
+  uint32_t *table = NULL, ndecls = 0, table_cap = 16, depth = 0;
+  uint32_t i, t, u, h, l, close, ngroups, group[MAX_ARRAY_DIM + 1], k, bound, n;
+  uint32_t path_tok;
+  int64_t lo, hi, step, offs;
+  int var_type, col_major, shared, in_sub = 0;
+
+  bounds_sites = bounds_removed = 0;
+  bounds_checked = bounds_skipped = 0;
+
+  // Everything is checked until proven otherwise
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    for (t = 0; t < tokp; t++) {
+      if (tokens[t].type == OPEN_SQUARE_BRACKET) {
+        tokens[t].aux = 0;
+      }
+      ndecls += (tokens[t].type == VARIABLE);
+    }
+  }
+  while (table_cap < 2 * ndecls) {
+    table_cap *= 2;
+  }
+  decls = malloc(ndecls * sizeof(bounds_decl_t) + 1);
+  table = calloc(table_cap, sizeof(uint32_t));
+  if (!decls || !table) {
+    goto done;
+  }
+
+  // Top level declarations
+  ndecls = 0;
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    if (tokens[0].type == KEYWORD && tokens[0].aux == SUB) {
+      i = program.lines[i].jump;
+      continue;
+    }
+    if (tokens[0].type != KEYWORD || tokens[0].aux != VAR) {
+      continue;
+    }
+    t = 1;
+    if (VarIsList(&t) != rSUCCESS || t >= tokp
+          || VarIsType(&t, &var_type) != rSUCCESS
+          || VarIsLayout(&t, &col_major) != rSUCCESS
+          || VarIsMapping(&t, &path_tok, &shared) != rSUCCESS || t != tokp) {
+      continue;
+    }
+    for (t = 1; t < tokp; t++) {
+      if (tokens[t].type != VARIABLE) {
+        continue;
+      }
+      d = &decls[ndecls];
+      memset(d, 0, sizeof(bounds_decl_t));
+      d->line = i;
+      d->tok = t;
+      d->var_type = var_type;
+      d->len = 1;
+      for (u = t + 1; u + 1 < tokp && tokens[u].type == OPEN_SQUARE_BRACKET
+            && d->ndims < MAX_ARRAY_DIM; u += 3) {
+        d->dims[d->ndims] = ParseTokToNumber(u + 1);
+        d->len = (d->len * (uint64_t)d->dims[d->ndims] > UINT32_MAX
+                  ? 0 : d->len * d->dims[d->ndims]);
+        d->ndims++;
+      }
+      d->is_array = (d->ndims > 0);
+      // Each IF branch may declare its own (see ProgramPlanSlots())
+      h = BoundsFindDecl(decls, table, table_cap, t);
+      d->redeclared = (table[h] != 0);
+      table[h] = ++ndecls;
+    }
+  }
+
+  // Arrays the program can re-point (anywhere, SUBs included)
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    for (t = 0; t < tokp; t++) {
+      if (tokens[t].type == VARIABLE
+            && ((t + 1 < tokp && tokens[t + 1].type == EQUALS)
+                || (t == 1 && tokens[0].type == KEYWORD
+                    && (tokens[0].aux == ALLOC || tokens[0].aux == FREE)))
+            && (h = table[BoundsFindDecl(decls, table, table_cap, t)])) {
+        decls[h - 1].reassigned = 1;
+      }
+    }
+  }
+
+  // Find index sites and try to prove them
+  for (i = 0; i < program.count; i++) {
+    ProgramSelectLine(i);
+    if (tokens[0].type == KEYWORD) {
+      switch (tokens[0].aux) {
+        case VAR:
+          continue;
+        case SUB:
+          in_sub = 1;
+          break;
+        case END:
+          in_sub = (in_sub && program.lines[program.lines[i].jump].toks[0].aux != SUB);
+          break;
+        case FOR:
+          if (in_sub) {
+            break;
+          }
+          // FOR VARIABLE '=' CONST 'TO' CONST [ 'STEP' CONST ]
+          loop[depth].var = 0;
+          t = 3;
+          step = 1;
+          if (tokp > 3 && BoundsConstant(&t, &lo) == rSUCCESS
+                && t < tokp && tokens[t].type == KEYWORD && tokens[t].aux == TO
+                && (t++, BoundsConstant(&t, &hi) == rSUCCESS)
+                && (t == tokp || (tokens[t].type == KEYWORD && tokens[t].aux == STEP
+                    && (t++, BoundsConstant(&t, &step) == rSUCCESS) && t == tokp))
+                && (h = table[BoundsFindDecl(decls, table, table_cap, 1)])
+                && !decls[h - 1].is_array && !decls[h - 1].redeclared
+                && VAR_IS_DATA(decls[h - 1].var_type)
+                && LoopNormalize(decls[h - 1].var_type, lo) == lo
+                && LoopNormalize(decls[h - 1].var_type, hi) == hi
+                && BoundsLoopIsClean(i, decls, table, table_cap, h)) {
+            loop[depth].var = h;
+            loop[depth].lo = (step > 0 ? lo : hi);
+            loop[depth].hi = (step > 0 ? hi : lo);
+          }
+          ProgramSelectLine(i);
+          depth++;
+          break;
+        case NEXT:
+          if (!in_sub) {
+            depth--;
+          }
+          break;
+        default:
+          break;
+      }
+    }
+
+    for (t = 0; t < tokp; t++) {
+      if (tokens[t].type != VARIABLE || t + 1 >= tokp
+            || tokens[t + 1].type != OPEN_SQUARE_BRACKET) {
+        continue;
+      }
+
+      // Split the access into its index groups
+      for (ngroups = 0, u = t + 1; u < tokp && tokens[u].type == OPEN_SQUARE_BRACKET
+            && ngroups < MAX_ARRAY_DIM; ngroups++) {
+        group[ngroups] = u;
+        for (k = 0; u < tokp; u++) {
+          if (tokens[u].type == OPEN_SQUARE_BRACKET) {
+            k++;
+          } else if (tokens[u].type == CLOSED_SQUARE_BRACKET && --k == 0) {
+            break;
+          }
+        }
+        u++;
+      }
+      group[ngroups] = u;
+      bounds_sites += ngroups;
+
+      h = (in_sub ? 0 : table[BoundsFindDecl(decls, table, table_cap, t)]);
+      if (!h || !decls[h - 1].is_array || decls[h - 1].reassigned
+            || decls[h - 1].redeclared || (ngroups != decls[h - 1].ndims && ngroups != 1)) {
+        continue;
+      }
+      d = &decls[h - 1];
+
+      for (k = 0; k < ngroups; k++) {
+        bound = (ngroups == d->ndims ? d->dims[k] : d->len);
+        u = group[k] + 1;
+        close = group[k + 1] - 1;
+        if (close == u + 1 && tokens[u].type == NUMBER) {
+          // Constant index
+          if ((uint32_t)ParseTokToNumber(u) < bound) {
+            tokens[group[k]].aux = 1;
+            bounds_removed++;
+          }
+          continue;
+        }
+
+        // Counter [ '+' | '-' CONST ]
+        if (tokens[u].type != VARIABLE) {
+          continue;
+        }
+        offs = 0;
+        if (close == u + 3 && tokens[u + 2].type == NUMBER
+              && (tokens[u + 1].type == PLUS || tokens[u + 1].type == MINUS)) {
+          offs = (int32_t)ParseTokToNumber(u + 2);
+          offs = (tokens[u + 1].type == MINUS ? -offs : offs);
+        } else if (close != u + 1) {
+          continue;
+        }
+        n = table[BoundsFindDecl(decls, table, table_cap, u)];
+        for (l = depth; n && l-- > 0; ) {
+          if (loop[l].var == n) {
+            if (loop[l].lo + offs >= 0 && loop[l].hi + offs < bound) {
+              tokens[group[k]].aux = 1;
+              bounds_removed++;
+            }
+            break;
+          }
+        }
+      }
+    }
+  }
+
+done:
+  free(decls);
+  free(table);
+}
+
+static uint32_t BoundsFindDecl(bounds_decl_t *decls, uint32_t *table,
+                               uint32_t table_cap, uint32_t t)
+{
+  uint32_t len = tokens[t].idx2 - tokens[t].idx1;
+  uint32_t h = ProgramHashToken(t) & (table_cap - 1);
+  const prog_line_t *line;
+  const token_t *decl;
+
+  for (; table[h]; h = (h + 1) & (table_cap - 1)) {
+    line = &program.lines[decls[table[h] - 1].line];
+    decl = &line->toks[decls[table[h] - 1].tok];
+    if (decl->idx2 - decl->idx1 == len
+          && memcmp(line->text + decl->idx1, linebuf + tokens[t].idx1, len) == 0) {
+      break;
+    }
+  }
+  return h;
+}
+
+/**
+ *  @brief  CONST :== [ '-' ] NUMBER
+ */
+static int BoundsConstant(uint32_t *t, int64_t *value)
+{
+  int neg = 0;
+
+  if (*t < tokp && tokens[*t].type == MINUS) {
+    neg = 1;
+    (*t)++;
+  }
+  if (*t >= tokp || tokens[*t].type != NUMBER) {
+    return rFAILURE;
+  }
+  *value = (uint32_t)ParseTokToNumber((*t)++);
+  *value = (neg ? -*value : *value);
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Check that nothing in the body of the FOR loop on program line
+ *          line can change its counter (declaration var, index + 1): no
+ *          assignment to it, no CALL and no store through a pointer that
+ *          isn't a bounds-checked array.
+ */
+static int BoundsLoopIsClean(uint32_t line, bounds_decl_t *decls,
+                             uint32_t *table, uint32_t table_cap, uint32_t var)
+{
+  uint32_t i, t, end, h;
+
+  for (i = line + 1; i < program.lines[line].jump; i++) {
+    ProgramSelectLine(i);
+    if (tokens[0].type == KEYWORD && tokens[0].aux == CALL) {
+      return 0;
+    }
+    if (tokens[0].type == KEYWORD && tokens[0].aux == SORT
+          && (tokp < 2 || tokens[1].type != VARIABLE
+              || !(h = table[BoundsFindDecl(decls, table, table_cap, 1)])
+              || !decls[h - 1].is_array)) {
+      // SORT stores to its array
+      return 0;
+    }
+    if (tokens[0].type == KEYWORD && tokens[0].aux == READ) {
+      // READ# stores to its array (after the handle) and its TO variable
+      for (t = 1; t < tokp && tokens[t].type != COMMA; t++) {
+      }
+      h = (++t < tokp && tokens[t].type == VARIABLE
+           ? table[BoundsFindDecl(decls, table, table_cap, t)] : 0);
+      if (!h || !decls[h - 1].is_array) {
+        return 0;
+      }
+      for (; t + 1 < tokp; t++) {
+        if (tokens[t].type == KEYWORD && tokens[t].aux == TO
+              && tokens[t + 1].type == VARIABLE
+              && table[BoundsFindDecl(decls, table, table_cap, t + 1)] == var) {
+          return 0;
+        }
+      }
+    }
+    for (t = 0; t < tokp; t++) {
+      if (tokens[t].type != VARIABLE) {
+        continue;
+      }
+      end = t;
+      if (VarIsAccess(&end) != rSUCCESS || end >= tokp
+            || tokens[end].type != EQUALS) {
+        continue;
+      }
+      h = table[BoundsFindDecl(decls, table, table_cap, t)];
+      if (h == var || (end > t + 1 && (!h || !decls[h - 1].is_array))) {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+/**
+ *  @brief  Store (or delete, if empty) program line number.
+ *          Only this line is lexed; the rest keep their cached tokens.
+ */
+static int CommandEnterLine(uint32_t number)
+{
+  uint32_t len;
+
+  if (number >= MAX_LINE_NUMBER) {
+    THROW_ERROR("Line number too large", 1);
+    return rFAILURE;
+  }
+  line_count = number;
+  if (LexAnalyzeLine() == rFAILURE) {
+    return rFAILURE;
+  }
+
+  if (tokp == 0) {
+    ProgDeleteLine(&program, number);
+    return rSUCCESS;
+  }
+
+  // Store the line '\n' terminated so error reports look like file lines
+  len = strlen(linebuf);
+  if (len == 0 || linebuf[len - 1] != '\n') {
+    linebuf[len++] = '\n';
+  }
+  if (ProgSetLine(&program, number, linebuf, len, tokens, tokp) != rSUCCESS) {
+    THROW_ERROR("Out of memory", 0);
+    return rFAILURE;
+  }
+
+  return rSUCCESS;
+}
+
+static int CommandList(uint32_t curr_tok)
+{
+  // LIST Syntax
+  // LIST :== 'LIST'
+  uint32_t i;
+
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax; Usage: LIST", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  for (i = 0; i < program.count; i++) {
+    CONSOLE_PRINTF("%u %s", program.lines[i].number, program.lines[i].text);
+  }
+  return rSUCCESS;
+}
+
+static int CommandRun(uint32_t curr_tok)
+{
+  // RUN Syntax
+  // RUN :== 'RUN'
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax; Usage: RUN", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // Every line was lexed when it was entered, so start right away.
+  return ProgramRun();
+}
+
+static int CommandNew(uint32_t curr_tok)
+{
+  // NEW Syntax
+  // NEW :== 'NEW'
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax; Usage: NEW", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  ProgClear(&program);
+  MemReset();
+  return rSUCCESS;
+}
+
+static int CommandDelete(uint32_t curr_tok)
+{
+  // DELETE Syntax
+  // DELETE :== 'DELETE' NUMBER
+  if (curr_tok + 1 != tokp || tokens[curr_tok].type != NUMBER) {
+    THROW_ERROR("Invalid syntax; Usage: DELETE line", 0);
+    return rFAILURE;
+  }
+
+  if (ProgDeleteLine(&program, ParseTokToNumber(curr_tok)) != rSUCCESS) {
+    THROW_ERROR("No such line", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Make room for n more characters (plus a NUL) in consolebuf.
+ */
+static int ConsoleReserve(uint32_t n)
+{
+  uint32_t cap = (consolebuf_cap ? consolebuf_cap : CONSOLEBUF_INIT_LEN);
+  char *buf;
+
+  if (consolebuf_idx + n < consolebuf_cap) {
+    return rSUCCESS;
+  }
+
+  while (consolebuf_idx + n >= cap) {
+    cap *= 2;
+  }
+  if ((buf = ArenaGrow(&front_arena, consolebuf, consolebuf_idx, cap)) == NULL) {
+    THROW_ERROR("Out of memory", 0);
+    return rFAILURE;
+  }
+  consolebuf = buf;
+  consolebuf_cap = cap;
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Split linebuf into tokens.
+ */
+static int LexAnalyzeLine(void)
+{
+  uint32_t prof = ProfEnter(PROF_LEXER);
+  int result = LexTokenize();
+
+  ProfLeave(prof);
+  return result;
+}
+
+static int LexTokenize(void)
+{
+  char ch;
+  int idx1 = 0, idx2 = 0;
+  uint32_t bad;
+
+  // Reset index
+  linebuf_idx = 0;
+  tokp = 0;
+
+  //
+  while (!LexIsEndOfLine(linebuf[linebuf_idx])) {
+    // Each pass adds at most one token
+    if (tokp == tok_cap) {
+      uint32_t cap = (tok_cap ? tok_cap * 2 : TOK_INIT_COUNT);
+      token_t *toks = ArenaGrow(&front_arena, tokens, tok_cap * sizeof(token_t),
+                                cap * sizeof(token_t));
+      if (!toks) {
+        THROW_ERROR("Out of memory", linebuf_idx + 1);
+        return rFAILURE;
+      }
+      tokens = toks;
+      tok_cap = cap;
+    }
+
+    ch = linebuf[linebuf_idx];
+    if (LexIsWhiteSpace(ch)) {
+      // Ignore white spaces
+      linebuf_idx++;
+    } else if (LexIsInlineComment(ch)) {
+      // Ignore comments
+      DEBUG_PRINTF("Comment: %s", linebuf + linebuf_idx + 1);
+      break;
+    } else if (LexIsDigit(ch) && LexIsInteger(&idx1, &idx2)) {
+      // Save token name and type as NUMBER
+      tokens[tokp].idx1 = idx1;
+      tokens[tokp].type = NUMBER;
+      if (LexIsFloat(idx1, &idx2)) {
+        // Floats are converted once; the double is interned like a
+        // STRING literal
+        double d = strtod(linebuf + idx1, NULL);
+        tokens[tokp].type = FLOAT_NUMBER;
+        tokens[tokp].aux = StrPoolIntern(&strpool, (const char *)&d, sizeof(d));
+        if (tokens[tokp].aux < 0) {
+          THROW_ERROR("Out of memory", idx1 + 1);
+          return rFAILURE;
+        }
+      }
+      tokens[tokp].idx2 = idx2;
+      tokp++;
+    } else if (LexIsDoubleQuote(ch)) {
+      // Check for string literals
+      idx1 = linebuf_idx + 1;
+      do {
+        // Make sure string is properly terminated
+        ch = linebuf[linebuf_idx++];
+        if (LexIsEndOfLine(ch) || LexIsEOF(ch)) {
+          THROW_ERROR("Invalid string", linebuf_idx);
+          return rFAILURE;
+        }
+      } while (linebuf[linebuf_idx] != '"');
+      idx2 = linebuf_idx++;
+
+      // Literals must be well-formed UTF-8
+      if ((bad = Utf8Validate(linebuf + idx1, idx2 - idx1)) < idx2 - idx1) {
+        THROW_ERROR("Invalid UTF-8 in string", idx1 + bad + 1);
+        return rFAILURE;
+      }
+
+      // Save token name and type as STRING. The literal itself is
+      // interned so it outlives linebuf.
+      tokens[tokp].idx1 = idx1;
+      tokens[tokp].idx2 = idx2;
+      tokens[tokp].type = STRING;
+      tokens[tokp].aux = StrPoolIntern(&strpool, linebuf + idx1, idx2 - idx1);
+      if (tokens[tokp].aux < 0) {
+        THROW_ERROR("Out of memory", idx1);
+        return rFAILURE;
+      }
+      tokp++;
+    } else if (LexIsOperator(ch)) {
+      // Operators
+      // Check two-character operators first
+      int o;
+      idx1 = linebuf_idx;
+      for (o = 0; o < strlen(double_char_operators); o += 2) {
+        if (ch == double_char_operators[o] &&
+                  linebuf[idx1 + 1] == double_char_operators[o + 1]) {
+          tokens[tokp].idx1 = idx1;
+          tokens[tokp].idx2 = idx1 + 2;
+          tokens[tokp].aux = LexGetOperator(idx1);
+          tokens[tokp++].type = OPERATOR;
+          linebuf_idx += 2;
+          o = -1;
+          break;
+        }
+      }
+
+      if (o > 0) {
+        tokens[tokp].idx1 = idx1;
+        tokens[tokp].idx2 = idx1 + 1;
+        tokens[tokp].aux = -1;
+        switch (ch) {
+          case '+':
+            tokens[tokp].type = PLUS;
+            break;
+          case '-':
+            tokens[tokp].type = MINUS;
+            break;
+          case '=':
+            tokens[tokp].type = EQUALS;
+            break;
+          case '*':
+            tokens[tokp].type = ASTERISK;
+            break;
+          case '/':
+            tokens[tokp].type = DIVIDE;
+            break;
+          case '%':
+            tokens[tokp].type = MOD;
+            break;
+          case ',':
+            tokens[tokp].type = COMMA;
+            break;
+          case ';':
+            tokens[tokp].type = SEMICOLON;
+            break;
+          case '[':
+            tokens[tokp].type = OPEN_SQUARE_BRACKET;
+            break;
+          case ']':
+            tokens[tokp].type = CLOSED_SQUARE_BRACKET;
+            break;
+          case '(':
+            tokens[tokp].type = OPEN_PARENS;
+            break;
+          case ')':
+            tokens[tokp].type = CLOSED_PARENS;
+            break;
+          case '!':
+            tokens[tokp].type = EXCLAIMATION;
+            break;
+          case '~':
+            tokens[tokp].type = TILDA;
+            break;
+          default:
+            tokens[tokp].type = OPERATOR;
+            tokens[tokp].aux = LexGetOperator(idx1);
+            break;
+        }
+        tokp++;
+        linebuf_idx++;
+      }
+    } else if (LexIsAlpha(ch)) {
+      idx1 = linebuf_idx;
+      while (LexIsAlpha(ch) || LexIsDigit(ch)) {
+        ch = linebuf[++linebuf_idx];
+        if (LexIsEndOfLine(ch) || LexIsWhiteSpace(ch)) {
+          break;
+        }
+      }
+      idx2 = linebuf_idx;
+
+      // Save token name 
+      tokens[tokp].idx1 = idx1;
+      tokens[tokp].idx2 = idx2;
+
+      // Determine if they are keywords, labels, or variables
+      tokens[tokp].aux = LexGetKeyword(tokens[tokp].idx1, tokens[tokp].idx2);
+      if (tokens[tokp].aux < 0 && linebuf[idx2] == '#'
+            && LexGetKeyword(idx1, idx2 + 1) >= 0) {
+        // READ#, WRITE#: the '#' isn't a comment here
+        tokens[tokp].idx2 = ++linebuf_idx;
+        tokens[tokp].aux = LexGetKeyword(idx1, idx2 + 1);
+      }
+      if (tokens[tokp].aux >= 0) {
+        // Keyword (resolved once here, see ParseGetKeyword())
+        tokens[tokp].type = KEYWORD;
+      } else {
+        // Check if we have a label
+        if (linebuf[linebuf_idx] == ':') {
+          // Label
+          tokens[tokp].type = LABEL;
+          linebuf_idx++;
+        } else {
+          // Variable
+          tokens[tokp].type = VARIABLE;
+        }
+      }
+      tokp++;
+    } else if (LexIsEOF(ch)) {
+      return rSUCCESS;
+    } else {
+      // Error: unrecognized token
+      THROW_ERROR("Invalid token", linebuf_idx);
+      return rFAILURE;
+    }
+  }
+
+#if (DEBUG == 1)
+  int i;
+  for (i = 0; i < tokp; i++) {
+    printf("Token %d: %.*s, type:", i, tokens[i].idx2 - tokens[i].idx1,
+           linebuf + tokens[i].idx1);
+    debug_print_type(tokens[i].type);
+    puts("");
+  }
+  puts("");
+#endif
+
+  return rSUCCESS;
+}
+
+static int ParseGetKeyword(uint32_t token_idx)
+{
+  return tokens[token_idx].aux;
+}
+// TODO
+static uint64_t ParseTokToNumber(uint32_t token_idx)
+{
+  char ch1, ch2;
+  int idx1 = tokens[token_idx].idx1, idx2 = tokens[token_idx].idx2;
+  uint64_t result;
+
+  ch1 = linebuf[idx1];
+  ch2 = linebuf[idx1 + 1];
+  if ((ch1 == '0') && ((ch2 == 'x') || (ch2 == 'X'))) {
+    result = ConvertHexNumber(idx1 + 2, idx2);
+  } else if (ch1 == '0' && ((ch2 == 'b') || (ch2 == 'B'))) {
+    result = ConvertBinNumber(idx1 + 2, idx2);
+  } else {
+    result = ConvertDecNumber(idx1, idx2);
+  }
+
+  return result;
+}
+
+static int StatementPrint(uint32_t curr_tok)
+{
+  // PRINT Syntax
+  // PRINT      :== 'PRINT' [PRINT_OBJ] { '+' PRINT_OBJ }* | PRINT_USING
+  // PRINT_OBJ  :== STRING | MID | LEN | REDUCTION | VAR_DECLARATION
+  int vloc, var_type;
+  uint32_t vval, ctok, addr, len;
+  const char *str;
+  num_t num;
+
+  if (curr_tok < tokp && tokens[curr_tok].type == KEYWORD
+        && ParseGetKeyword(curr_tok) == USING) {
+    return StatementPrintUsing(curr_tok + 1);
+  }
+
+  consolebuf_idx = 0;
+  if (ConsoleReserve(0) != rSUCCESS) {
+    return rFAILURE;
+  }
+
+  if (curr_tok < tokp) {
+    while (curr_tok < tokp) {
+      ctok = curr_tok;
+      if (tokens[curr_tok].type == STRING || tokens[curr_tok].type == KEYWORD
+            || (VarIsAccess(&ctok) == rSUCCESS)) {
+        if (tokens[curr_tok].type == STRING
+              || (tokens[curr_tok].type == KEYWORD && ParseGetKeyword(curr_tok) == MID)) {
+          if (StrOperand(&curr_tok, &str, &len) != rSUCCESS
+                || ConsoleReserve(len) != rSUCCESS) {
+            return rFAILURE;
+          }
+          CONSOLE_ADD_BYTES(str, len);
+        } else if (tokens[curr_tok].type == KEYWORD
+                     && tokens[curr_tok].aux >= SUM && tokens[curr_tok].aux <= DOT) {
+          if (ExprReduce(&curr_tok, &num) != rSUCCESS
+                || ConsoleReserve(FMT_INT_MAX_LEN) != rSUCCESS) {
+            return rFAILURE;
+          }
+          consolebuf_idx += NumFormat(consolebuf + consolebuf_idx, &num);
+        } else if (tokens[curr_tok].type == KEYWORD) {
+          if (ParseGetKeyword(curr_tok) != LEN) {
+            THROW_ERROR("Invalid syntax: Bad token.", tokens[curr_tok].idx1 + 1);
+            return rFAILURE;
+          }
+          if (StrLen(&curr_tok, &vval) != rSUCCESS
+                || ConsoleReserve(FMT_INT_MAX_LEN) != rSUCCESS) {
+            return rFAILURE;
+          }
+          CONSOLE_ADD_SIGNED_TOK((int32_t)vval);
+        } else {
+          if ((vloc = VarLocation(curr_tok)) >= 0) {
+            if (VarResolve(&curr_tok, vloc, &addr, &var_type) != rSUCCESS) {
+              return rFAILURE;
+            }
+
+            // Strings are appended straight from their storage.
+            if (var_type == VAR_STRING) {
+              StrLoad(addr, &str, &len);
+              if (ConsoleReserve(len) != rSUCCESS) {
+                return rFAILURE;
+              }
+              CONSOLE_ADD_BYTES(str, len);
+              var_type = -1;
+            } else if (ConsoleReserve(FMT_INT_MAX_LEN) != rSUCCESS) {
+              return rFAILURE;
+            } else if (VAR_IS_WIDE(var_type)) {
+              num = NumLoad(addr, var_type);
+              consolebuf_idx += NumFormat(consolebuf + consolebuf_idx, &num);
+              var_type = -1;
+            } else {
+              vval = MemLoad(addr, var_type);
+            }
+
+            switch (var_type) {
+              case VAR_CHAR:
+                CONSOLE_ADD_CHAR_TOK((char)vval);
+                break;
+              case VAR_INT8:
+                CONSOLE_ADD_SIGNED_TOK((int8_t)vval);
+                break;
+              case VAR_UINT8:
+                CONSOLE_ADD_UNSIGNED_TOK((uint8_t)vval);
+                break;
+              case VAR_INT16:
+                CONSOLE_ADD_SIGNED_TOK((int16_t)vval);
+                break;
+              case VAR_UINT16:
+                CONSOLE_ADD_UNSIGNED_TOK((uint16_t)vval);
+                break;
+              case VAR_INT32:
+                CONSOLE_ADD_SIGNED_TOK((int32_t)vval);
+                break;
+              case VAR_UINT32:
+                CONSOLE_ADD_UNSIGNED_TOK((uint32_t)vval);
+                break;
+              default:
+                // Pointers (e.g. arrays of pointers) print as addresses
+                if (VAR_IS_PTR(var_type)) {
+                  CONSOLE_ADD_UNSIGNED_TOK((uint16_t)vval);
+                }
+                break;
+            }
+          } else {
+            THROW_ERROR("Undefined variable.", tokens[curr_tok].idx1 + 1);
+            return rFAILURE;
+          }
+        }
+
+        if (curr_tok < tokp && (tokens[curr_tok].type == PLUS)) {
+          if (curr_tok + 1 < tokp) {
+            curr_tok++;
+          } else {
+            THROW_ERROR("Invalid syntax: Missing token",
+                        tokens[curr_tok].idx1 + 1);
+            return rFAILURE;
+          }
+        } else if (curr_tok == tokp) {
+          break;
+        } else {
+          THROW_ERROR("Invalid syntax: '+' missing?",
+                      tokens[curr_tok].idx1);
+          return rFAILURE;
+        }
+      } else {
+        THROW_ERROR("Invalid syntax: Bad token.",
+                    tokens[curr_tok].idx1 + 1);
+        return rFAILURE;
+      }
+    }
+  }
+
+  CONSOLE_PRINTBUF();
+  return rSUCCESS;
+}
+
+static int StatementPrintUsing(uint32_t curr_tok)
+{
+  // PRINT USING Syntax
+  // PRINT_USING :== 'PRINT' 'USING' STRING [ ';' ARG { ',' ARG }* ]
+  // ARG         :== EXPRESSION | STR_OBJ (for %s fields)
+  const fmt_template_t *t;
+  const fmt_segment_t *seg;
+  const char *fmt, *str;
+  char digits[FMT_INT_MAX_LEN + 1];
+  uint32_t i, len, fmt_len, value, fmt_tok = curr_tok;
+  int field = 0;
+  num_t num;
+
+  if (curr_tok >= tokp || tokens[curr_tok].type != STRING) {
+    THROW_ERROR("Expecting format STRING", 0);
+    return rFAILURE;
+  }
+
+  if ((t = PrintGetTemplate(curr_tok)) == NULL) {
+    return rFAILURE;
+  }
+
+  if (++curr_tok < tokp) {
+    if (tokens[curr_tok].type != SEMICOLON) {
+      THROW_ERROR("Invalid syntax: ';' missing?", tokens[curr_tok].idx1 + 1);
+      return rFAILURE;
+    }
+    curr_tok++;
+  }
+
+  consolebuf_idx = 0;
+  if (ConsoleReserve(0) != rSUCCESS) {
+    return rFAILURE;
+  }
+  for (i = 0; i < t->nsegments; i++) {
+    seg = &t->segments[i];
+    if (seg->conv == 0) {
+      // Literal text (re-fetched: the pool may have moved)
+      fmt = StrPoolGet(Literals(), tokens[fmt_tok].aux, &fmt_len);
+      if (ConsoleReserve(seg->len) != rSUCCESS) {
+        return rFAILURE;
+      }
+      CONSOLE_ADD_BYTES(fmt + seg->offs, seg->len);
+      continue;
+    }
+
+    // Fields are separated by commas
+    if (field++ > 0) {
+      if (curr_tok >= tokp || tokens[curr_tok].type != COMMA) {
+        THROW_ERROR("Not enough arguments for format",
+                    tokens[curr_tok - 1].idx2 + 1);
+        return rFAILURE;
+      }
+      curr_tok++;
+    }
+    if (curr_tok >= tokp) {
+      THROW_ERROR("Not enough arguments for format",
+                  tokens[curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+
+    if (seg->conv == 's') {
+      if (StrOperand(&curr_tok, &str, &len) != rSUCCESS) {
+        return rFAILURE;
+      }
+    } else {
+      expr_nest_level = 0;
+      if (StatementNumber(&curr_tok, &num) != rSUCCESS) {
+        return rFAILURE;
+      }
+      // Fields are integers. Wider values keep all their digits in %d
+      // and %u (floats rounded toward zero); the rest take 32 bits.
+      value = NumToU32(&num);
+      switch (seg->conv) {
+        case 'd':
+          len = (num.kind > NUM_U32 ? FmtSigned64(digits, NumToI64(&num))
+                 : FmtSigned(digits, (int32_t)value));
+          break;
+        case 'u':
+          len = (num.kind > NUM_U32 ? FmtUnsigned64(digits, NumToU64(&num))
+                 : FmtUnsigned(digits, value));
+          break;
+        case 'x':
+        case 'X':
+          len = FmtHex(digits, value, seg->conv == 'X');
+          break;
+        case 'b':
+          len = FmtBin(digits, value);
+          break;
+        default:
+          digits[0] = (char)value;
+          len = 1;
+          break;
+      }
+      str = digits;
+    }
+
+    if (ConsoleReserve(len + seg->width) != rSUCCESS) {
+      return rFAILURE;
+    }
+    consolebuf_idx += FmtPad(consolebuf + consolebuf_idx, str, len, seg);
+  }
+
+  if (curr_tok < tokp) {
+    THROW_ERROR("Too many arguments for format", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  CONSOLE_PRINTBUF();
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Get the compiled template of the format STRING at curr_tok.
+ *          Templates are compiled the first time a literal is used as a
+ *          format and cached by literal pool id.
+ */
+static const fmt_template_t *PrintGetTemplate(uint32_t curr_tok)
+{
+  int32_t id = tokens[curr_tok].aux;
+  uint32_t len, err_idx, n;
+  const char *fmt;
+  fmt_template_t scratch;
+
+  if (image) {
+    // An image's templates were all compiled with it (and are shared), so
+    // a missing one is invalid: compile it here only to say where
+    if (id < image->fmt_cache_len && image->fmt_cache[id]) {
+      return image->fmt_cache[id];
+    }
+    fmt = StrPoolGet(&image->strpool, id, &len);
+    FmtCompile(&scratch, fmt, len, &err_idx);
+    THROW_ERROR("Invalid format", tokens[curr_tok].idx1 + 1 + err_idx);
+    return NULL;
+  }
+
+  if (id < fmt_cache_len && fmt_cache[id]) {
+    return fmt_cache[id];
+  }
+
+  if (id >= fmt_cache_len) {
+    n = (fmt_cache_len ? fmt_cache_len : 16);
+    while (n <= id) {
+      n *= 2;
+    }
+    fmt_template_t **cache = realloc(fmt_cache, n * sizeof(fmt_template_t *));
+    if (!cache) {
+      THROW_ERROR("Out of memory", tokens[curr_tok].idx1 + 1);
+      return NULL;
+    }
+    memset(cache + fmt_cache_len, 0, (n - fmt_cache_len) * sizeof(fmt_template_t *));
+    fmt_cache = cache;
+    fmt_cache_len = n;
+  }
+
+  if ((fmt_cache[id] = malloc(sizeof(fmt_template_t))) == NULL) {
+    THROW_ERROR("Out of memory", tokens[curr_tok].idx1 + 1);
+    return NULL;
+  }
+
+  fmt = StrPoolGet(Literals(), id, &len);
+  if (FmtCompile(fmt_cache[id], fmt, len, &err_idx) != rSUCCESS) {
+    free(fmt_cache[id]);
+    fmt_cache[id] = NULL;
+    THROW_ERROR("Invalid format", tokens[curr_tok].idx1 + 1 + err_idx);
+    return NULL;
+  }
+
+  return fmt_cache[id];
+}
+
+static void FmtCacheFree(fmt_template_t **cache, uint32_t len)
+{
+  uint32_t i;
+
+  for (i = 0; i < len; i++) {
+    free(cache[i]);
+  }
+  free(cache);
+}
+
+/**
+ *  @brief  Literal pool of the stored program: its image's if it has one,
+ *          else the one the lexer interns into.
+ */
+static const strpool_t *Literals(void)
+{
+  return (image ? &image->strpool : &strpool);
+}
+
+static int StatementVar(uint32_t curr_tok)
+{
+  // VAR Syntax
+  // VAR              :== 'VAR' VAR_LIST VAR_TYPE
+  // VAR_LIST         :== VAR_DECLARATION {, VAR_DECLARATION}*
+  // VAR_DECLARATION  :== VARIABLE { '[' NUMBER ']' }
+  // VAR_TYPE         :== TYPE [ 'ROWMAJOR' | 'COLMAJOR' ]
+  //                      [ 'MAPPED' STRING [ 'SHARED' ] ]
+  int var_type, sub_var_type, col_major, shared;
+  uint16_t temp, size_in_bytes, sub_size_in_bytes;
+  uint32_t addr, nbytes, path_tok;
+  if (curr_tok < tokp) {
+    // Check VAR_LIST
+    if (VarIsList(&curr_tok) == rSUCCESS) {
+      if (VarIsType(&curr_tok, &var_type) == rSUCCESS
+            && VarIsLayout(&curr_tok, &col_major) == rSUCCESS
+            && VarIsMapping(&curr_tok, &path_tok, &shared) == rSUCCESS) {
+        // Statement must end here.
+        if (curr_tok < tokp) {
+          THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+          return rFAILURE;
+        }
+        // A file backs exactly one array
+        if (path_tok) {
+          for (temp = 0, addr = 1; addr < path_tok; addr++) {
+            temp += (tokens[addr].type == VARIABLE);
+          }
+          if (temp != 1 || tokens[2].type != OPEN_SQUARE_BRACKET) {
+            THROW_ERROR("MAPPED takes a single array", tokens[1].idx1 + 1);
+            return rFAILURE;
+          }
+        }
+
+        // Once we have a valid statement, we must interpret it properly.
+        // Save the variable size and type
+        if (var_type < sizeof(var_type_sizes) / sizeof(var_type_sizes[0])) {
+          size_in_bytes = var_type_sizes[var_type];
+          if (VAR_IS_PTR(var_type)) {
+            sub_var_type = var_type - NUM_DATA_TYPES;
+            sub_size_in_bytes = var_type_sizes[sub_var_type];
+          } else {
+            sub_var_type = -1;
+            sub_size_in_bytes = 0;
+          }
+        } else {
+          THROW_ERROR("Unknown error", 0);
+          return rFAILURE;
+        }
+
+        // Go through all the VARIABLE tokens and see if they
+        // need to be added to the stack (if they don't exist).
+        // Throw an error if they already do!
+        for (curr_tok = 0; curr_tok < tokp; curr_tok++) {
+          if (tokens[curr_tok].type == VARIABLE) {
+            // Make sure it doesn't exist (locals may shadow globals).
+            if ((temp = VarLocation(curr_tok)) != (uint16_t)-1
+                && (framep == 0 || temp >= frames[framep - 1].var_base)) {
+              THROW_ERROR("Variable already defined",
+                          tokens[curr_tok].idx1 + 1);
+              return rFAILURE;
+            }
+
+            if (varp == MAX_VAR_COUNT) {
+              THROW_ERROR("Too many variables", tokens[curr_tok].idx1 + 1);
+              return rFAILURE;
+            }
+            // Inside an IF it's the branch's (see BlockClose())
+            if (prog_running && program.lines[prog_pc].jump) {
+              BlockOpen(program.lines[prog_pc].jump - 1);
+            }
+
+            // Add it!
+            // 1. Save the name and sub_var_type
+            temp = tokens[curr_tok].idx2 - tokens[curr_tok].idx1;
+            if (temp >= VAR_NAME_LEN) {
+              THROW_ERROR("Variable name too long", tokens[curr_tok].idx1 + 1);
+              return rFAILURE;
+            }
+            memcpy(var_list[varp].name, linebuf + tokens[curr_tok].idx1, temp);
+            var_list[varp].name[temp] = '\0';
+            var_list[varp].loop_reg = 0;
+            var_list[varp].map = 0;
+            // 2. Add to the stack
+            //  i) Save location on stack to idx: the slot picked by
+            //     ProgramPlanSlots() if there is one, else the top of stack
+            addr = (tokens[curr_tok].aux >= 0 ? tokens[curr_tok].aux : sp);
+            var_list[varp].addr = addr;
+            //  ii) Update stack based on variable size
+            if (curr_tok + 1 < tokp
+                  && tokens[curr_tok + 1].type == OPEN_SQUARE_BRACKET) {
+              if (var_type == VAR_STRING) {
+                THROW_ERROR("Arrays of STRING are not supported",
+                            tokens[curr_tok].idx1 + 1);
+                return rFAILURE;
+              }
+
+              // Push pointer to stack and have it point to start of array data
+              if (VAR_IS_DATA(var_type)) {
+                var_list[varp].var_type = var_type + NUM_DATA_TYPES;
+                var_list[varp].sub_var_type = var_type;
+              } else {
+                var_list[varp].var_type = var_type;
+                var_list[varp].sub_var_type = var_type;
+              }
+              var_list[varp].size_in_bytes = SIZEOF_PTR;
+              var_list[varp].sub_size_in_bytes =
+                                      var_type_sizes[var_list[varp].sub_var_type];
+              if (VarSetShape(&var_list[varp], curr_tok, col_major) != rSUCCESS) {
+                return rFAILURE;
+              }
+              if (path_tok) {
+                // The data stays in the file; the pointer is never used
+                nbytes = SIZEOF_PTR;
+              } else {
+                nbytes = SIZEOF_PTR
+                          + var_list[varp].len * var_list[varp].sub_size_in_bytes;
+              }
+              if ((!path_tok && (uint64_t)var_list[varp].len
+                                  * var_list[varp].sub_size_in_bytes > STACK_SIZE)
+                    || addr + nbytes > STACK_SIZE) {
+                THROW_ERROR("Out of stack memory", tokens[curr_tok].idx1 + 1);
+                return rFAILURE;
+              }
+              if (path_tok) {
+                stack[addr] = stack[addr + 1] = 0;
+                if (VarMapFile(varp, path_tok, shared) != rSUCCESS) {
+                  return rFAILURE;
+                }
+              } else {
+                stack[addr] = (addr + SIZEOF_PTR) & 0xFF;
+                stack[addr + 1] = ((addr + SIZEOF_PTR) >> 8) & 0xFF;
+                // The slot may have been another variable's
+                memset(stack + addr + SIZEOF_PTR, 0, nbytes - SIZEOF_PTR);
+              }
+
+              // Now push the array data
+              StackCommit(addr, nbytes);
+              varp++;
+            } else {
+              var_list[varp].len = 1;
+              // A pointer takes one index, stepping over whole elements
+              var_list[varp].ndims = VAR_IS_PTR(var_type);
+              var_list[varp].dims[0] = 0;
+              var_list[varp].strides[0] = sub_size_in_bytes;
+              if (addr + size_in_bytes > STACK_SIZE) {
+                THROW_ERROR("Out of stack memory", tokens[curr_tok].idx1 + 1);
+                return rFAILURE;
+              }
+              // Start out zeroed (a STRING as an empty inline string), as
+              // the slot may have been another variable's
+              memset(stack + addr, 0, size_in_bytes);
+              StackCommit(addr, size_in_bytes);
+              var_list[varp].var_type = var_type;
+              var_list[varp].sub_var_type = sub_var_type;
+              var_list[varp].size_in_bytes = size_in_bytes;
+              var_list[varp].sub_size_in_bytes = sub_size_in_bytes;
+              varp++;
+            }
+          }
+        }
+      } else {
+        return rFAILURE;
+      }
+    } else {
+      return rFAILURE;
+    }
+  } else {
+    return rFAILURE;
+  }
+
+  return rSUCCESS;
+}
+
+static int StatementAssignment(uint32_t curr_tok)
+{
+  int i, vloc, ntargets = 0;
+  int types[MAX_ASSIGN_TARGETS], moved[MAX_ASSIGN_TARGETS];
+  uint32_t ctok;
+  uint32_t targets[MAX_ASSIGN_TARGETS], addrs[MAX_ASSIGN_TARGETS];
+  num_t value;
+
+  // ASSIGNMENT Syntax
+  // ASSIGNMENT :== { VAR_ACCESS '=' }+ EXPRESSION
+  if (curr_tok >= tokp) {
+    THROW_ERROR("Missing tokens", 0);
+    return rFAILURE;
+  }
+
+  while (curr_tok < tokp && tokens[curr_tok].type == VARIABLE) {
+    ctok = curr_tok;
+    if (VarIsAccess(&ctok) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (ctok < tokp && tokens[ctok].type == EQUALS) {
+      if (ntargets == MAX_ASSIGN_TARGETS) {
+        THROW_ERROR("Too many assignment targets", tokens[ctok].idx1 + 1);
+        return rFAILURE;
+      }
+      targets[ntargets++] = curr_tok;
+      curr_tok = ctok + 1;
+      if (curr_tok >= tokp) {
+        THROW_ERROR("Missing expression", tokens[ctok].idx2 + 1);
+        return rFAILURE;
+      }
+    } else {
+      break;
+    }
+  }
+
+  if (ntargets == 0) {
+    THROW_ERROR("Expecting type VARIABLE", tokens[curr_tok].idx1);
+    return rFAILURE;
+  }
+
+  // Find where each target lives
+  for (i = 0; i < ntargets; i++) {
+    ctok = targets[i];
+    if ((vloc = VarLocation(ctok)) < 0) {
+      THROW_ERROR("Undefined variable", tokens[ctok].idx1 + 1);
+      return rFAILURE;
+    }
+    if (VarResolve(&ctok, vloc, &addrs[i], &types[i]) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (MemIsReadOnly(addrs[i])) {
+      THROW_ERROR("MAPPED array is read-only", tokens[targets[i]].idx1 + 1);
+      return rFAILURE;
+    }
+    // The pointer itself is assigned (moved)
+    moved[i] = (VAR_IS_PTR(var_list[vloc].var_type) && ctok == targets[i] + 1 ? vloc : -1);
+    if ((types[i] == VAR_STRING) != (types[0] == VAR_STRING)) {
+      THROW_ERROR("Type mismatch", tokens[targets[i]].idx1 + 1);
+      return rFAILURE;
+    }
+  }
+
+  if (types[0] == VAR_STRING) {
+    // Build the result once, then copy it to any other targets.
+    if (StrConcat(&curr_tok, addrs[0]) != rSUCCESS) {
+      return rFAILURE;
+    }
+  } else {
+    expr_nest_level = 0;
+    if (StatementNumber(&curr_tok, &value) != rSUCCESS) {
+      return rFAILURE;
+    }
+  }
+
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // Bounds are looked up while the targets still hold their old values
+  for (i = 0; i < ntargets; i++) {
+    if (moved[i] >= 0) {
+      VarMoveBounds(moved[i], (uint16_t)NumToU32(&value));
+    }
+  }
+
+  for (i = 0; i < ntargets; i++) {
+    if (types[0] == VAR_STRING) {
+      if (i > 0 && StrCopy(addrs[i], addrs[0]) != rSUCCESS) {
+        THROW_ERROR("Out of heap memory", tokens[targets[i]].idx1 + 1);
+        return rFAILURE;
+      }
+    } else {
+      NumStore(addrs[i], types[i], &value);
+    }
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Evaluate an EXPRESSION where a 32-bit integer is wanted (an
+ *          index, a count, a condition...). Wider values are truncated
+ *          and floats rounded toward zero.
+ */
+static int StatementExpression(uint32_t *curr_tok, uint32_t *value)
+{
+  num_t num;
+
+  if (StatementNumber(curr_tok, &num) != rSUCCESS) {
+    return rFAILURE;
+  }
+  *value = NumToU32(&num);
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Evaluate an EXPRESSION to a value of whatever kind it has.
+ */
+static int StatementNumber(uint32_t *curr_tok, num_t *value)
+{
+  uint32_t prof = ProfEnter(PROF_EVAL);
+  int result = ExprEvaluate(curr_tok, value);
+
+  ProfLeave(prof);
+  return result;
+}
+
+static int ExprEvaluate(uint32_t *curr_tok, num_t *value)
+{
+  // EXPRESSION Syntax
+  // EXPRESSION :== LOGIC { '||' LOGIC }
+  // LOGIC     :== COMPARE { '&&' COMPARE }
+  // COMPARE   :== SUM [ RELOP SUM ] | STR_OBJ RELOP STR_OBJ
+  // SUM       :== TERM { [+,-,&,|] TERM }
+  // TERM      :== FACTOR | FACTOR { [*,/,%] FACTOR }
+  // FACTOR    :== NUMBER | [+,-] NUMBER | VARIABLE | [+,-] VARIABLE | '(' EXPRESSION ')'
+  // RELOP     :== '==' | '!=' | '<' | '<=' | '>' | '>='
+  
+  num_t logic_value;
+
+  // Check nesting level
+  expr_nest_level++;
+DEBUG_PRINTF("Expression Evaluation: level = %d", expr_nest_level);
+  if (expr_nest_level >= MAX_EXPR_NEST_DEPTH) {
+    THROW_ERROR("Too many nested expressions", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (*curr_tok >= tokp) {
+    return rFAILURE;
+  }
+
+  // Check LOGIC { '||' LOGIC }
+  if (ExprIsLogic(curr_tok, value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  while (*curr_tok < tokp && tokens[*curr_tok].type == OPERATOR
+          && tokens[*curr_tok].aux == OP_LOR) {
+    (*curr_tok)++;
+    if (ExprIsLogic(curr_tok, &logic_value) != rSUCCESS) {
+      return rFAILURE;
+    }
+    value->v.u32 = (NumIsTrue(value) || NumIsTrue(&logic_value));
+    value->kind = NUM_I32;
+  }
+
+  // 
+  expr_nest_level--;
+  DEBUG_PRINTF("final value: %d, 0x%x", value->v.u32, value->v.u32);
+  return rSUCCESS;
+}
+
+static int StatementAlloc(uint32_t curr_tok)
+{
+  // ALLOC Syntax
+  // ALLOC :== 'ALLOC' VARIABLE ',' EXPRESSION
+  int vloc;
+  uint32_t count, nbytes, vtok = curr_tok;
+  uint16_t addr;
+
+  if (curr_tok >= tokp || tokens[curr_tok].type != VARIABLE) {
+    THROW_ERROR("Invalid syntax; Usage: ALLOC ptr, count", 0);
+    return rFAILURE;
+  }
+
+  if ((vloc = VarLocation(curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (VAR_IS_DATA(var_list[vloc].var_type)) {
+    THROW_ERROR("ALLOC expects a pointer variable", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (var_list[vloc].map) {
+    THROW_ERROR("MAPPED arrays have no address", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (++curr_tok >= tokp || tokens[curr_tok].type != COMMA) {
+    THROW_ERROR("Invalid syntax; Usage: ALLOC ptr, count",
+                tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+
+  expr_nest_level = 0;
+  if (StatementExpression(&curr_tok, &count) != rSUCCESS) {
+    return rFAILURE;
+  }
+
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // Checked before it's worked out in 32 bits, which could wrap
+  nbytes = ((uint64_t)count * var_list[vloc].sub_size_in_bytes > HEAP_MAX_REQUEST
+            ? 0 : count * var_list[vloc].sub_size_in_bytes);
+  if (nbytes == 0 || (addr = HeapAlloc(&heap, nbytes)) == 0) {
+    THROW_ERROR("Out of heap memory", tokens[vtok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  SetPointerValue(vloc, addr);
+  var_list[vloc].len = count;
+  var_list[vloc].ndims = 1;
+  var_list[vloc].dims[0] = count;
+  var_list[vloc].strides[0] = var_list[vloc].sub_size_in_bytes;
+
+  return rSUCCESS;
+}
+
+static int StatementFree(uint32_t curr_tok)
+{
+  // FREE Syntax
+  // FREE :== 'FREE' VARIABLE
+  int vloc;
+
+  if (curr_tok + 1 != tokp || tokens[curr_tok].type != VARIABLE) {
+    THROW_ERROR("Invalid syntax; Usage: FREE ptr", 0);
+    return rFAILURE;
+  }
+
+  if ((vloc = VarLocation(curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (VAR_IS_DATA(var_list[vloc].var_type)
+        || HeapFree(&heap, GetPointerValue(vloc)) != rSUCCESS) {
+    THROW_ERROR("FREE of a non-heap pointer", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  SetPointerValue(vloc, 0);
+  var_list[vloc].len = 0;
+  var_list[vloc].dims[0] = 0;
+
+  return rSUCCESS;
+}
+
+static int StatementAdvise(uint32_t curr_tok)
+{
+  // ADVISE Syntax
+  // ADVISE :== 'ADVISE' VARIABLE ( 'NORMAL' | 'SEQUENTIAL' | 'RANDOM'
+  //                                | 'WILLNEED' )
+  int vloc;
+  map_advice_t advice;
+
+  if (curr_tok + 2 != tokp || tokens[curr_tok].type != VARIABLE
+        || tokens[curr_tok + 1].type != KEYWORD) {
+    THROW_ERROR("Invalid syntax; Usage: ADVISE array SEQUENTIAL|RANDOM|...", 0);
+    return rFAILURE;
+  }
+
+  if ((vloc = VarLocation(curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (!var_list[vloc].map) {
+    THROW_ERROR("Not a MAPPED array", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  switch (ParseGetKeyword(curr_tok + 1)) {
+    case NORMAL:
+      advice = MAP_ADVICE_NORMAL;
+      break;
+    case SEQUENTIAL:
+      advice = MAP_ADVICE_SEQUENTIAL;
+      break;
+    case RANDOM:
+      advice = MAP_ADVICE_RANDOM;
+      break;
+    case WILLNEED:
+      advice = MAP_ADVICE_WILLNEED;
+      break;
+    default:
+      THROW_ERROR("Unknown access pattern", tokens[curr_tok + 1].idx1 + 1);
+      return rFAILURE;
+  }
+
+  // Only a hint: a kernel that ignores it changes nothing
+  MapFileAdvise(&maps[var_list[vloc].map - 1], advice);
+  return rSUCCESS;
+}
+
+static int StatementOpen(uint32_t curr_tok)
+{
+  // OPEN Syntax
+  // OPEN :== 'OPEN' EXPRESSION ',' STR_OBJ ',' STR_OBJ
+  // The mode is "r", "w", "a" or "r+" (see FileOpen()).
+  file_t *f;
+  const char *str, *mode;
+  char path[256];
+  uint32_t len, mode_len, path_tok;
+
+  if (FileHandle(&curr_tok, &f) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (f->fd >= 0) {
+    THROW_ERROR("File handle already open", tokens[1].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (curr_tok + 1 >= tokp || tokens[curr_tok].type != COMMA) {
+    THROW_ERROR("Invalid syntax; Usage: OPEN n, file, mode", 0);
+    return rFAILURE;
+  }
+  path_tok = ++curr_tok;
+  if (StrOperand(&curr_tok, &str, &len) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (len == 0 || len >= sizeof(path)) {
+    THROW_ERROR("Invalid file name", tokens[path_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  memcpy(path, str, len);
+  path[len] = '\0';
+
+  if (curr_tok + 1 >= tokp || tokens[curr_tok].type != COMMA) {
+    THROW_ERROR("Invalid syntax; Usage: OPEN n, file, mode", 0);
+    return rFAILURE;
+  }
+  curr_tok++;
+  if (StrOperand(&curr_tok, &mode, &mode_len) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (FileOpen(f, path, mode, mode_len) != rSUCCESS) {
+    THROW_ERROR("Cannot open file", tokens[path_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  return rSUCCESS;
+}
+
+static int StatementClose(uint32_t curr_tok)
+{
+  // CLOSE Syntax
+  // CLOSE :== 'CLOSE' EXPRESSION
+  file_t *f;
+
+  if (FileHandle(&curr_tok, &f) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (f->fd < 0) {
+    THROW_ERROR("File not open", tokens[1].idx1 + 1);
+    return rFAILURE;
+  }
+
+  FileClose(f);
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  READ# and WRITE#: move a range of an array's elements to or
+ *          from a file with one system call. Elements are stored in the
+ *          file exactly as in memory (little-endian, sub_size_in_bytes
+ *          each), so the bytes go straight between the file and the
+ *          array's storage, a MAPPED one included.
+ */
+static int StatementFileIO(uint32_t curr_tok, int writing)
+{
+  // READ# Syntax
+  // READ#  :== 'READ#' EXPRESSION ',' VARIABLE [ ',' EXPRESSION ',' EXPRESSION ]
+  //            [ 'TO' VARIABLE ]
+  // WRITE# :== 'WRITE#' EXPRESSION ',' VARIABLE [ ',' EXPRESSION ',' EXPRESSION ]
+  // The range is first, count in elements; the default is the whole array.
+  // A read that ends early stores the elements read in the TO variable,
+  // and is an error without one.
+  file_t *f;
+  const var_t *var;
+  uint8_t *mem;
+  uint32_t first = 0, count, addr, nbytes, done, to_addr = 0, atok, ctok;
+  int vloc, to_type = -1;
+  num_t num;
+
+  if (FileHandle(&curr_tok, &f) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (curr_tok + 1 >= tokp || tokens[curr_tok].type != COMMA
+        || tokens[curr_tok + 1].type != VARIABLE) {
+    THROW_ERROR(writing ? "Invalid syntax; Usage: WRITE# n, array [, first, count]"
+                        : "Invalid syntax; Usage: READ# n, array [, first, count]", 0);
+    return rFAILURE;
+  }
+  atok = ++curr_tok;
+  if ((vloc = VarLocation(atok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+  var = &var_list[vloc];
+  if (!VAR_IS_PTR(var->var_type)) {
+    THROW_ERROR("Expecting an array", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+
+  count = var->len;
+  if (curr_tok < tokp && tokens[curr_tok].type == COMMA) {
+    curr_tok++;
+    expr_nest_level = 0;
+    if (StatementExpression(&curr_tok, &first) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (curr_tok >= tokp || tokens[curr_tok].type != COMMA) {
+      THROW_ERROR("Expecting count", tokens[curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    curr_tok++;
+    expr_nest_level = 0;
+    if (StatementExpression(&curr_tok, &count) != rSUCCESS) {
+      return rFAILURE;
+    }
+  } else if (var->len == 0) {
+    THROW_ERROR("Array length unknown; give first, count", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (!writing && curr_tok < tokp && tokens[curr_tok].type == KEYWORD
+        && tokens[curr_tok].aux == TO) {
+    ctok = ++curr_tok;
+    if (curr_tok >= tokp || tokens[curr_tok].type != VARIABLE) {
+      THROW_ERROR("Expecting VARIABLE", tokens[curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    if ((vloc = VarLocation(curr_tok)) < 0) {
+      THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+      return rFAILURE;
+    }
+    if (VarResolve(&curr_tok, vloc, &to_addr, &to_type) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (to_type == VAR_STRING || MemIsReadOnly(to_addr)) {
+      THROW_ERROR("Invalid TO variable", tokens[ctok].idx1 + 1);
+      return rFAILURE;
+    }
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (var->len && (uint64_t)first + count > var->len) {
+    THROW_ERROR("Index out of bounds", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+  if ((uint64_t)count * var->sub_size_in_bytes > UINT32_MAX) {
+    THROW_ERROR("Invalid memory access", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+  nbytes = count * var->sub_size_in_bytes;
+  addr = (var->map ? maps[var->map - 1].vaddr : GetPointerValue(vloc))
+          + first * var->sub_size_in_bytes;
+  if ((mem = MemPtr(addr, nbytes)) == NULL) {
+    THROW_ERROR("Invalid memory access", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (f->fd < 0) {
+    THROW_ERROR("File not open", tokens[1].idx1 + 1);
+    return rFAILURE;
+  }
+  if (writing ? !f->writable : !f->readable) {
+    THROW_ERROR(writing ? "File not open for writing" : "File not open for reading",
+                tokens[1].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // The transfer may read or overwrite any loop variable's storage
+  if (loopp > 0) {
+    LoopSpillAll();
+  }
+
+  if (writing) {
+    if (FileWrite(f, mem, nbytes) != rSUCCESS) {
+      THROW_ERROR("Write error", tokens[0].idx1 + 1);
+      return rFAILURE;
+    }
+    return rSUCCESS;
+  }
+
+  if (MemIsReadOnly(addr)) {
+    THROW_ERROR("MAPPED array is read-only", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (FileRead(f, mem, nbytes, &done) != rSUCCESS) {
+    THROW_ERROR("Read error", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+  if (nwatches > 0) {
+    WatchBulk(addr, done, "READ#");
+  }
+  if (to_type >= 0) {
+    num.kind = NUM_U32;
+    num.v.u32 = done / var->sub_size_in_bytes;
+    NumStore(to_addr, to_type, &num);
+  } else if (done < nbytes) {
+    THROW_ERROR("Unexpected end of file", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Evaluate the file handle EXPRESSION at *curr_tok.
+ */
+static int FileHandle(uint32_t *curr_tok, file_t **f)
+{
+  uint32_t handle;
+
+  if (*curr_tok >= tokp) {
+    THROW_ERROR("Expecting file handle", tokens[*curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  expr_nest_level = 0;
+  if (StatementExpression(curr_tok, &handle) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (handle < 1 || handle > MAX_FILES) {
+    THROW_ERROR("Bad file handle", tokens[1].idx1 + 1);
+    return rFAILURE;
+  }
+
+  *f = &files[handle - 1];
+  return rSUCCESS;
+}
+
+static int StatementSort(uint32_t curr_tok)
+{
+  // SORT Syntax
+  // SORT :== 'SORT' VARIABLE
+  // Sorts a whole numeric array in place, in ascending order.
+  uint32_t addr, n, atok = curr_tok;
+  uint8_t *mem;
+  int type;
+
+  if (curr_tok + 1 != tokp || tokens[curr_tok].type != VARIABLE) {
+    THROW_ERROR("Invalid syntax; Usage: SORT array", 0);
+    return rFAILURE;
+  }
+  if (VarArrayData(&curr_tok, &type, &addr, &n, &mem) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (MemIsReadOnly(addr)) {
+    THROW_ERROR("MAPPED array is read-only", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // The elements may include a loop variable's storage
+  if (loopp > 0) {
+    LoopSpillAll();
+  }
+  if (VecSort(mem, n, type) != rSUCCESS) {
+    THROW_ERROR("Out of memory", tokens[atok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (nwatches > 0) {
+    WatchBulk(addr, n * var_type_sizes[type], "SORT");
+  }
+
+  return rSUCCESS;
+}
+
+static int StatementMempeek(uint32_t curr_tok)
+{
+  // MEMPEEK Syntax
+  // MEMPEEK :== 'MEMPEEK' [ VARIABLE | EXPRESSION ',' EXPRESSION ]
+  // With no arguments it shows a summary of memory use, otherwise a
+  // hexdump of a variable's storage or of len bytes at start.
+  const var_t *var;
+  const uint8_t *mem;
+  uint32_t i, d, start, len, ctok = curr_tok;
+  int vloc;
+
+  // Memory must be current before it's shown
+  LoopSpillAll();
+
+  if (curr_tok + 1 == tokp && tokens[curr_tok].type == VARIABLE) {
+    if ((vloc = VarLocation(curr_tok)) < 0) {
+      THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+      return rFAILURE;
+    }
+    var = &var_list[vloc];
+    if (VAR_IS_PTR(var->var_type) && var->len && var->dims[0]) {
+      // Array elements
+      start = (var->map ? maps[var->map - 1].vaddr : GetPointerValue(vloc));
+      len = var->len * var->sub_size_in_bytes;
+    } else {
+      start = var->addr;
+      len = var->size_in_bytes;
+    }
+  } else if (curr_tok < tokp) {
+    expr_nest_level = 0;
+    if (StatementExpression(&ctok, &start) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (ctok >= tokp || tokens[ctok].type != COMMA) {
+      THROW_ERROR("Invalid syntax; Usage: MEMPEEK [var | start, len]",
+                  tokens[ctok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    ctok++;
+    expr_nest_level = 0;
+    if (StatementExpression(&ctok, &len) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (ctok < tokp) {
+      THROW_ERROR("Invalid syntax", tokens[ctok].idx1 + 1);
+      return rFAILURE;
+    }
+  } else {
+    start = len = 0;
+  }
+
+  if (curr_tok < tokp) {
+    if ((mem = MemPtr(start, len)) == NULL) {
+      THROW_ERROR("Invalid memory access", tokens[curr_tok].idx1 + 1);
+      return rFAILURE;
+    }
+    MemDump(start, mem, len);
+    return rSUCCESS;
+  }
+
+  // Summary: stack, one line per variable, mapped files, heap
+  CONSOLE_PRINTF("Stack Size: %d\n", sp);
+  CONSOLE_PRINTF("Stack Peak: %u (without slot reuse: %u)\n",
+                 stack_peak, stack_unshared);
+  CONSOLE_PRINTF("Var List Size: %d\n", varp);
+  for (i = 0; i < varp; i++) {
+    var = &var_list[i];
+    CONSOLE_PRINTF("  %-16s @%-6u %s", var->name, var->addr,
+                   keywords[CHAR + var->var_type]);
+    if (var->ndims && var->len && var->dims[0]) {
+      for (d = 0; d < var->ndims; d++) {
+        CONSOLE_PRINTF("[%u]", var->dims[d]);
+      }
+    }
+    CONSOLE_PRINTF("%s%s\n", var->map ? " MAPPED" : "",
+                   var->loop_reg ? " (loop)" : "");
+  }
+  for (i = 0; i < nmaps; i++) {
+    CONSOLE_PRINTF("map[%d] = %u bytes at 0x%x (%s)\n", i, maps[i].len,
+                   maps[i].vaddr, maps[i].writable ? "shared" : "read-only");
+  }
+  for (i = 0; i < nwatches; i++) {
+    CONSOLE_PRINTF("watch[%d] = %s\n", i, var_list[watches[i].vloc].name);
+  }
+
+  // Show heap usage and fragmentation.
+  uint32_t used = 0, requested = 0, cached = 0, untouched, bsize;
+  CONSOLE_PRINTF("Heap Size: %d (allocs: %u, frees: %u, failed: %u)\n",
+                 HEAP_SIZE, heap.alloc_count, heap.free_count, heap.fail_count);
+  for (i = 0; i < HEAP_NUM_CLASSES; i++) {
+    if (heap.classes[i].carved == 0) {
+      continue;
+    }
+    bsize = HeapClassSize(i);
+    CONSOLE_PRINTF("heap.class[%u] carved = %u, in use = %u, free = %u\n",
+                   bsize, heap.classes[i].carved, heap.classes[i].in_use,
+                   heap.classes[i].carved - heap.classes[i].in_use);
+    used += heap.classes[i].in_use * bsize;
+    requested += heap.classes[i].requested;
+    cached += (heap.classes[i].carved - heap.classes[i].in_use) * bsize;
+  }
+  untouched = heap.end - heap.brk;
+  CONSOLE_PRINTF("Heap In Use: %u (requested: %u, internal frag: %u%%)\n",
+                 used, requested, used ? (used - requested) * 100 / used : 0);
+  CONSOLE_PRINTF("Heap Free: %u (free lists: %u, untouched: %u, external frag: %u%%)\n",
+                 cached + untouched, cached, untouched,
+                 cached + untouched ? cached * 100 / (cached + untouched) : 0);
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Hexdump nbytes of interpreter memory at addr (host copy at
+ *          mem), 16 bytes to a line.
+ */
+static void MemDump(uint32_t addr, const uint8_t *mem, uint32_t nbytes)
+{
+  char buf[FMT_HEXDUMP_LINE_LEN * 64];
+  uint32_t len = 0, n;
+
+  for (; nbytes > 0; addr += n, mem += n, nbytes -= n) {
+    n = (nbytes < 16 ? nbytes : 16);
+    len += FmtHexDumpLine(buf + len, addr, mem, n);
+    if (len > sizeof(buf) - FMT_HEXDUMP_LINE_LEN) {
+      fwrite(buf, 1, len, console);
+      len = 0;
+    }
+  }
+  fwrite(buf, 1, len, console);
+}
+
+static int StatementWatch(uint32_t curr_tok)
+{
+  // WATCH Syntax
+  // WATCH :== 'WATCH' VARIABLE
+  // Every later store to the variable (any element of an array) prints
+  // the line, the old value and the new one.
+  const var_t *var;
+  watch_t *w;
+  uint32_t i;
+  int vloc;
+
+  if (curr_tok + 1 != tokp || tokens[curr_tok].type != VARIABLE) {
+    THROW_ERROR("Invalid syntax; Usage: WATCH var", 0);
+    return rFAILURE;
+  }
+  if ((vloc = VarLocation(curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  var = &var_list[vloc];
+  if (var->var_type == VAR_STRING) {
+    THROW_ERROR("Can't WATCH a STRING", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  for (i = 0; i < nwatches; i++) {
+    if (watches[i].vloc == vloc) {
+      return rSUCCESS;
+    }
+  }
+  if (nwatches == MAX_WATCHES) {
+    THROW_ERROR("Too many watchpoints", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // A FOR counter in a register has to be in memory to be seen. It's
+  // spilled before the watchpoint is set: the value was written earlier
+  // (by FOR or NEXT), not by this line.
+  if (var->loop_reg) {
+    LoopSpill(vloc);
+  }
+
+  w = &watches[nwatches++];
+  w->vloc = vloc;
+  if (VAR_IS_PTR(var->var_type) && var->len && var->dims[0]) {
+    w->addr = (var->map ? maps[var->map - 1].vaddr : GetPointerValue(vloc));
+    w->elem = var->sub_size_in_bytes;
+    w->nbytes = var->len * w->elem;
+  } else {
+    w->addr = var->addr;
+    w->elem = 0;
+    w->nbytes = var->size_in_bytes;
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Report a store of value (as type) to addr that hits a
+ *          watchpoint. Called by MemStore() before the store.
+ */
+static void WatchStore(uint32_t addr, int type, const num_t *value)
+{
+  const watch_t *w;
+  const var_t *var;
+  char old[FMT_INT_MAX_LEN + 1], new[FMT_INT_MAX_LEN + 1];
+  num_t n;
+  uint32_t i, d;
+
+  for (i = 0; i < nwatches; i++) {
+    w = &watches[i];
+    if (addr - w->addr >= w->nbytes) {
+      continue;
+    }
+    n = NumLoad(addr, type);
+    old[NumFormat(old, &n)] = '\0';
+    n = *value;
+    if (!VAR_IS_WIDE(type)) {
+      n.v.u32 = LoopNormalize(type, NumToU32(&n));
+      n.kind = var_type_kinds[type];
+    }
+    new[NumFormat(new, &n)] = '\0';
+    var = &var_list[w->vloc];
+    CONSOLE_PRINTF("WATCH %s", var->name);
+    for (d = 0; w->elem && d < var->ndims; d++) {
+      CONSOLE_PRINTF("[%u]", (addr - w->addr) / var->strides[d] % var->dims[d]);
+    }
+    CONSOLE_PRINTF(": line %u: ", line_count);
+    CONSOLE_PRINTF("%s -> %s\n", old, new);
+  }
+}
+
+/**
+ *  @brief  Report a statement that wrote nbytes at addr in one go.
+ */
+static void WatchBulk(uint32_t addr, uint32_t nbytes, const char *what)
+{
+  const watch_t *w;
+  uint32_t i;
+
+  for (i = 0; i < nwatches; i++) {
+    w = &watches[i];
+    if (addr < w->addr + w->nbytes && w->addr < addr + nbytes) {
+      CONSOLE_PRINTF("WATCH %s: line %u: written by %s\n",
+                     var_list[w->vloc].name, line_count, what);
+    }
+  }
+}
+
+static int StatementFor(uint32_t curr_tok)
+{
+  // FOR Syntax
+  // FOR :== 'FOR' VARIABLE '=' EXPRESSION 'TO' EXPRESSION [ 'STEP' EXPRESSION ]
+  // The bounds are evaluated once, when the loop is entered.
+  loop_t *loop;
+  uint32_t value, limit, step = 1;
+  int64_t first, last;
+  int vloc, type;
+
+  if (curr_tok >= tokp || tokens[curr_tok].type != VARIABLE) {
+    THROW_ERROR("Expecting VARIABLE", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  if ((vloc = VarLocation(curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  type = var_list[vloc].var_type;
+  if (!VAR_IS_DATA(type)) {
+    THROW_ERROR("Loop variable must be an integer", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (VAR_IS_WIDE(type)) {
+    // Loops count in 32-bit registers (see loop_t)
+    THROW_ERROR("Loop variable must be 32 bits or narrower", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (var_list[vloc].loop_reg) {
+    THROW_ERROR("Loop variable already in use", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+
+  if (curr_tok >= tokp || tokens[curr_tok].type != EQUALS) {
+    THROW_ERROR("Expecting '='", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+  expr_nest_level = 0;
+  if (StatementExpression(&curr_tok, &value) != rSUCCESS) {
+    return rFAILURE;
+  }
+
+  if (curr_tok >= tokp || tokens[curr_tok].type != KEYWORD
+        || tokens[curr_tok].aux != TO) {
+    THROW_ERROR("Expecting TO", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+  expr_nest_level = 0;
+  if (StatementExpression(&curr_tok, &limit) != rSUCCESS) {
+    return rFAILURE;
+  }
+
+  if (curr_tok < tokp && tokens[curr_tok].type == KEYWORD
+        && tokens[curr_tok].aux == STEP) {
+    curr_tok++;
+    expr_nest_level = 0;
+    if (StatementExpression(&curr_tok, &step) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (step == 0) {
+      THROW_ERROR("STEP must be non-zero", tokens[curr_tok - 1].idx1 + 1);
+      return rFAILURE;
+    }
+  }
+
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // An unsigned counter reads its limit as unsigned too, so it can count
+  // past INT32_MAX
+  first = LoopNormalize(type, value);
+  last = VAR_IS_SIGNED(type) ? (int32_t)limit : (int64_t)limit;
+  if ((int32_t)step > 0 ? first > last : first < last) {
+    // Zero trips; skip the body
+    MemStore(var_list[vloc].addr, type, value);
+    prog_next = program.lines[prog_pc].jump + 1;
+    return rSUCCESS;
+  }
+
+  if (loopp == MAX_LOOP_DEPTH) {
+    THROW_ERROR("Too many nested loops", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+  loop = &loops[loopp++];
+  loop->vloc = vloc;
+  loop->value = first;
+  loop->limit = last;
+  loop->step = (int32_t)step;
+  loop->body = prog_pc + 1;
+  loop->in_reg = 1;
+  var_list[vloc].loop_reg = 1;
+  if (nwatches > 0) {
+    // Watchpoints only see values that reach memory
+    LoopSpill(vloc);
+  }
+
+  return rSUCCESS;
+}
+
+static int StatementNext(uint32_t curr_tok)
+{
+  // NEXT Syntax
+  // NEXT :== 'NEXT' [ VARIABLE ]
+  loop_t *loop;
+  var_t *var;
+  int64_t next;
+
+  if (loopp == 0) {
+    THROW_ERROR("NEXT without FOR", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+  loop = &loops[loopp - 1];
+  var = &var_list[loop->vloc];
+
+  if (curr_tok < tokp) {
+    if (tokens[curr_tok].type != VARIABLE || VarLocation(curr_tok) != loop->vloc) {
+      THROW_ERROR("NEXT does not match FOR", tokens[curr_tok].idx1 + 1);
+      return rFAILURE;
+    }
+    curr_tok++;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // The body may have written the variable since it was spilled
+  if (!loop->in_reg) {
+    loop->value = LoopNormalize(var->var_type, MemLoad(var->addr, var->var_type));
+    loop->in_reg = 1;
+  }
+
+  // Test the exact sum so a narrow variable wrapping around still exits
+  next = (int64_t)loop->value + loop->step;
+  loop->value = LoopNormalize(var->var_type, (uint32_t)next);
+  if (loop->step > 0 ? next <= loop->limit : next >= loop->limit) {
+    prog_next = loop->body;
+    if (nwatches > 0) {
+      LoopSpill(loop->vloc);
+    }
+  } else {
+    MemStore(var->addr, var->var_type, loop->value);
+    var->loop_reg = 0;
+    loopp--;
+  }
+
+  return rSUCCESS;
+}
+
+static int StatementIf(uint32_t curr_tok)
+{
+  // IF Syntax
+  // IF :== 'IF' EXPRESSION 'THEN' [':'] ... [ 'ELSE' ... ] 'END' [ 'IF' ]
+  uint32_t value;
+
+  expr_nest_level = 0;
+  if (StatementExpression(&curr_tok, &value) != rSUCCESS) {
+    return rFAILURE;
+  }
+
+  if (curr_tok >= tokp || tokens[curr_tok].type != KEYWORD
+        || tokens[curr_tok].aux != THEN) {
+    THROW_ERROR("Expecting THEN", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+  if (curr_tok < tokp && tokens[curr_tok].type == OPERATOR
+        && linebuf[tokens[curr_tok].idx1] == ':') {
+    curr_tok++;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (!value) {
+    // Past ELSE, or past END if there is none
+    prog_next = program.lines[prog_pc].jump + 1;
+  }
+
+  return rSUCCESS;
+}
+
+static int StatementEnd(uint32_t curr_tok)
+{
+  // END Syntax (checked by ProgramMatchBlocks())
+  // END :== 'END' [ 'IF' | 'SUB' ]
+  uint32_t opener = program.lines[prog_pc].jump;
+
+  if (program.lines[opener].toks[0].aux == SUB) {
+    return SubReturn();
+  }
+  BlockClose(opener);
+
+  return rSUCCESS;
+}
+
+static int StatementCall(uint32_t curr_tok)
+{
+  // CALL Syntax
+  // CALL :== 'CALL' NAME [ '(' [ EXPRESSION {, EXPRESSION} ] ')' ]
+  uint32_t nargs = 0, nparams = 0, sub, t;
+  num_t args[MAX_SUB_PARAMS];
+  const prog_line_t *def;
+  frame_t *frame;
+
+  // Resolved by ProgramMatchBlocks()
+  sub = program.lines[prog_pc].jump;
+  curr_tok++;
+
+  // Arguments are evaluated in the caller's scope
+  if (curr_tok < tokp && tokens[curr_tok].type == OPEN_PARENS) {
+    curr_tok++;
+    while (curr_tok < tokp && tokens[curr_tok].type != CLOSED_PARENS) {
+      if (nargs == MAX_SUB_PARAMS) {
+        THROW_ERROR("Too many arguments", tokens[curr_tok].idx1 + 1);
+        return rFAILURE;
+      }
+      expr_nest_level = 0;
+      if (StatementNumber(&curr_tok, &args[nargs++]) != rSUCCESS) {
+        return rFAILURE;
+      }
+      if (curr_tok < tokp && tokens[curr_tok].type == COMMA) {
+        curr_tok++;
+      } else {
+        break;
+      }
+    }
+    if (curr_tok >= tokp || tokens[curr_tok].type != CLOSED_PARENS) {
+      THROW_ERROR("Missing close parenthesis", tokens[curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    curr_tok++;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  if (framep == max_call_depth) {
+    THROW_ERROR("Call depth limit exceeded", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+  if (framep == frame_cap) {
+    t = (frame_cap ? frame_cap * 2 : 8);
+    if ((frame = realloc(frames, t * sizeof(frame_t))) == NULL) {
+      THROW_ERROR("Out of memory", tokens[0].idx1 + 1);
+      return rFAILURE;
+    }
+    frames = frame;
+    frame_cap = t;
+  }
+  frame = &frames[framep];
+  frame->ret = prog_pc + 1;
+  frame->sp = sp;
+  frame->var_base = varp;
+  frame->loop_base = loopp;
+  frame->block_base = blockp;
+
+  // Bind the arguments to the parameters (typed in SubCheckHeader())
+  def = &program.lines[sub];
+  for (t = 2; t < def->ntoks; t++) {
+    if (def->toks[t].type != VARIABLE) {
+      continue;
+    }
+    if (nparams == nargs) {
+      break;
+    }
+    if (VarAddScalar(def->text + def->toks[t].idx1,
+                     def->toks[t].idx2 - def->toks[t].idx1,
+                     def->toks[t].aux) != rSUCCESS) {
+      varp = frame->var_base;
+      sp = frame->sp;
+      return rFAILURE;
+    }
+    NumStore(var_list[varp - 1].addr, def->toks[t].aux, &args[nparams++]);
+  }
+  if (nparams != nargs || t < def->ntoks) {
+    varp = frame->var_base;
+    sp = frame->sp;
+    THROW_ERROR("Wrong number of arguments", tokens[1].idx1 + 1);
+    return rFAILURE;
+  }
+
+  framep++;
+  prog_next = sub + 1;
+  return rSUCCESS;
+}
+
+static int StatementReturn(uint32_t curr_tok)
+{
+  // RETURN Syntax
+  // RETURN :== 'RETURN'
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax; Usage: RETURN", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  return SubReturn();
+}
+
+/**
+ *  @brief  Pop the innermost call frame and resume after its CALL.
+ */
+static int SubReturn(void)
+{
+  frame_t *frame;
+  uint32_t i;
+
+  if (framep == 0) {
+    THROW_ERROR("RETURN without CALL", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+  frame = &frames[--framep];
+
+  // Loops left open by the SUB
+  for (i = frame->loop_base; i < loopp; i++) {
+    LoopSpill(loops[i].vloc);
+    var_list[loops[i].vloc].loop_reg = 0;
+  }
+  loopp = frame->loop_base;
+
+  VarRelease(frame->var_base);
+  blockp = frame->block_base;
+  sp = frame->sp;
+
+  prog_next = frame->ret;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Make the IF branch at program line line own the variables
+ *          declared from here on, unless it already does.
+ */
+static void BlockOpen(uint32_t line)
+{
+  uint32_t base = (framep > 0 ? frames[framep - 1].block_base : 0);
+
+  // At most one per variable, so there's always room
+  if (blockp > base && blocks[blockp - 1].line == line) {
+    return;
+  }
+  blocks[blockp].line = line;
+  blocks[blockp].sp = sp;
+  blocks[blockp].var_base = varp;
+  blockp++;
+}
+
+/**
+ *  @brief  End the branch of the IF at program line line: the variables
+ *          it declared (if any) go, and so does their stack.
+ */
+static void BlockClose(uint32_t line)
+{
+  uint32_t base = (framep > 0 ? frames[framep - 1].block_base : 0);
+
+  if (blockp > base && blocks[blockp - 1].line == line) {
+    blockp--;
+    VarRelease(blocks[blockp].var_base);
+    sp = blocks[blockp].sp;
+  }
+}
+
+/**
+ *  @brief  Value as it would read back after storing it in a variable of
+ *          the given type.
+ */
+static int64_t LoopNormalize(int type, uint32_t value)
+{
+  switch (type) {
+    case VAR_INT8:
+      return (int8_t)value;
+    case VAR_CHAR:
+    case VAR_UINT8:
+      return (uint8_t)value;
+    case VAR_INT16:
+      return (int16_t)value;
+    case VAR_UINT16:
+      return (uint16_t)value;
+    case VAR_UINT32:
+      return value;
+    default:
+      return (int32_t)value;
+  }
+}
+
+/**
+ *  @brief  Write the register copy of a loop variable back to var_list
+ *          storage; NEXT reloads it from there.
+ */
+static void LoopSpill(int vloc)
+{
+  uint32_t i;
+
+  for (i = loopp; i-- > 0; ) {
+    if (loops[i].vloc == vloc) {
+      if (loops[i].in_reg) {
+        MemStore(var_list[vloc].addr, var_list[vloc].var_type, loops[i].value);
+        loops[i].in_reg = 0;
+      }
+      return;
+    }
+  }
+}
+
+static void LoopSpillAll(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < loopp; i++) {
+    LoopSpill(loops[i].vloc);
+  }
+}
+
+/**
+ *  @brief  Push a scalar variable on top of the stack (SUB parameters).
+ */
+static int VarAddScalar(const char *name, uint32_t len, int var_type)
+{
+  var_t *var = &var_list[varp];
+
+  if (varp == MAX_VAR_COUNT) {
+    THROW_ERROR("Too many variables", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+  if (sp + var_type_sizes[var_type] > STACK_SIZE) {
+    THROW_ERROR("Out of stack memory", tokens[0].idx1 + 1);
+    return rFAILURE;
+  }
+
+  memcpy(var->name, name, len);
+  var->name[len] = '\0';
+  var->addr = sp;
+  var->len = 1;
+  var->var_type = var_type;
+  var->size_in_bytes = var_type_sizes[var_type];
+  if (VAR_IS_PTR(var_type)) {
+    var->sub_var_type = var_type - NUM_DATA_TYPES;
+    var->sub_size_in_bytes = var_type_sizes[var->sub_var_type];
+    var->ndims = 1;
+    var->dims[0] = 0;
+    var->strides[0] = var->sub_size_in_bytes;
+  } else {
+    var->ndims = 0;
+    var->sub_var_type = -1;
+    var->sub_size_in_bytes = 0;
+  }
+  var->loop_reg = 0;
+  var->map = 0;
+  StackCommit(sp, var->size_in_bytes);
+  varp++;
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Declare bind's variable on top of the stack and store its value
+ *          (see BasicImageRun()).
+ */
+static int VarBind(const basic_bind_t *bind)
+{
+  uint32_t addr = sp;
+  uint16_t heap_addr;
+  char *out;
+  num_t num;
+
+  if (bind->name_len == 0 || bind->name_len >= VAR_NAME_LEN
+        || !(VAR_IS_DATA(bind->var_type) || bind->var_type == VAR_STRING)) {
+    THROW_ERROR("Invalid variable binding", 0);
+    return rFAILURE;
+  }
+  if (varp == MAX_VAR_COUNT) {
+    THROW_ERROR("Too many variables", 0);
+    return rFAILURE;
+  }
+  if (sp + var_type_sizes[bind->var_type] > STACK_SIZE) {
+    THROW_ERROR("Out of stack memory", 0);
+    return rFAILURE;
+  }
+  VarAddScalar(bind->name, bind->name_len, bind->var_type);
+
+  if (bind->var_type != VAR_STRING) {
+    num.kind = NUM_I32;
+    num.v.u32 = bind->value;
+    NumStore(addr, bind->var_type, &num);
+    return rSUCCESS;
+  }
+  if ((out = StrBegin(bind->len, &heap_addr)) == NULL) {
+    THROW_ERROR("Out of heap memory", 0);
+    return rFAILURE;
+  }
+  memcpy(out, bind->str, bind->len);
+  StrEnd(addr, bind->len, heap_addr);
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Drop the var_list entries from base up (a returning SUB's
+ *          locals, or the variables of an IF branch that has ended).
+ */
+static void VarRelease(uint32_t base)
+{
+  uint32_t i;
+
+  // They may own heap strings and mapped files (always mapped after the
+  // older variables', so unmapping from the first one frees just theirs).
+  // A string's slot still holds its header and heap address, so it's
+  // cleared before anything else can be given it.
+  for (i = base; i < varp; i++) {
+    if (var_list[i].var_type == VAR_STRING) {
+      StrRelease(var_list[i].addr);
+      memset(stack + var_list[i].addr, 0, var_list[i].size_in_bytes);
+    } else if (var_list[i].map) {
+      MapRelease(var_list[i].map - 1);
+    }
+  }
+  // Watches on them go with them
+  for (i = 0; i < nwatches; ) {
+    if (watches[i].vloc >= base) {
+      watches[i] = watches[--nwatches];
+    } else {
+      i++;
+    }
+  }
+  varp = base;
+}
+
+static int VarIsList(uint32_t *curr_tok)
+{
+  // VAR_LIST :== VAR_DECLARATION {, VAR_DECLARATION}*
+  while ((*curr_tok) < tokp) {
+    if (VarIsDeclaration(curr_tok) == rSUCCESS) {
+      if ((*curr_tok) < tokp && tokens[*curr_tok].type == COMMA) {
+        (*curr_tok)++;
+        if ((*curr_tok) >= tokp) {
+          THROW_ERROR("Missing VARIABLE token", tokens[*curr_tok - 1].idx2 + 1);
+          return rFAILURE;
+        }
+      } else {
+        break;
+      }
+    } else {
+      return rFAILURE;
+    }
+  }
+
+  return rSUCCESS;
+}
+
+static int VarIsDeclaration(uint32_t *curr_tok)
+{
+DEBUG_PRINTF("VarIsDeclaration");
+  // VAR_DECLARATION :== VARIABLE { '[' NUMBER ']' } (up to MAX_ARRAY_DIM)
+  uint32_t ctok = *curr_tok;
+  int dim = 0;
+
+  if (tokens[ctok++].type == VARIABLE) {
+    while (dim < MAX_ARRAY_DIM) {
+      if (ctok < tokp && tokens[ctok].type == OPEN_SQUARE_BRACKET) {
+        ctok++;
+        if (ctok < tokp && tokens[ctok].type == NUMBER) {
+          ctok++;
+          if (ctok < tokp && tokens[ctok].type == CLOSED_SQUARE_BRACKET) {
+            ctok++;
+          } else {
+            return rFAILURE;
+          }
+        } else {
+          return rFAILURE;
+        }
+        dim++;
+      } else {
+        break;
+      }
+    }
+  } else {
+    THROW_ERROR("Invalid VARIABLE token", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  //
+  *curr_tok = ctok;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  VAR_ACCESS :== VARIABLE { '[' EXPRESSION ']' }
+ *          Only finds where the access ends; VarResolve() evaluates the
+ *          indices.
+ */
+static int VarIsAccess(uint32_t *curr_tok)
+{
+  uint32_t ctok = *curr_tok, depth;
+
+  if (tokens[ctok++].type != VARIABLE) {
+    THROW_ERROR("Invalid VARIABLE token", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  while (ctok < tokp && tokens[ctok].type == OPEN_SQUARE_BRACKET) {
+    for (depth = 0; ctok < tokp; ctok++) {
+      if (tokens[ctok].type == OPEN_SQUARE_BRACKET) {
+        depth++;
+      } else if (tokens[ctok].type == CLOSED_SQUARE_BRACKET && --depth == 0) {
+        break;
+      }
+    }
+    if (ctok == tokp) {
+      THROW_ERROR("Missing ']'", tokens[tokp - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    ctok++;
+  }
+
+  *curr_tok = ctok;
+  return rSUCCESS;
+}
+
+static int VarIsType(uint32_t *curr_tok, int *type)
+{
+  int var_type;
+
+  if (tokens[*curr_tok].type != KEYWORD) {
+    THROW_ERROR("Expecting VAR_TYPE", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  switch ((var_type = ParseGetKeyword((*curr_tok)++))) {
+    case CHAR:
+      *type = (int)VAR_CHAR;
+      break;
+    case INT8:
+      *type = (int)VAR_INT8;
+      break;
+    case UINT8:
+      *type = (int)VAR_UINT8;
+      break;
+    case INT16:
+      *type = (int)VAR_INT16;
+      break;
+    case UINT16:
+      *type = (int)VAR_UINT16;
+      break;
+    case INT32:
+      *type = (int)VAR_INT32;
+      break;
+    case UINT32:
+      *type = (int)VAR_UINT32;
+      break;
+    case INT64:
+      *type = (int)VAR_INT64;
+      break;
+    case UINT64:
+      *type = (int)VAR_UINT64;
+      break;
+    case FLOAT32:
+      *type = (int)VAR_FLOAT32;
+      break;
+    case FLOAT64:
+      *type = (int)VAR_FLOAT64;
+      break;
+    case CHARPTR:
+      *type = (int)VAR_CHARPTR;
+      break;
+    case INT8PTR:
+      *type = (int)VAR_INT8PTR;
+      break;
+    case UINT8PTR:
+      *type = (int)VAR_UINT8PTR;
+      break;
+    case INT16PTR:
+      *type = (int)VAR_INT16PTR;
+      break;
+    case UINT16PTR:
+      *type = (int)VAR_UINT16PTR;
+      break;
+    case INT32PTR:
+      *type = (int)VAR_INT32PTR;
+      break;
+    case UINT32PTR:
+      *type = (int)VAR_UINT32PTR;
+      break;
+    case INT64PTR:
+      *type = (int)VAR_INT64PTR;
+      break;
+    case UINT64PTR:
+      *type = (int)VAR_UINT64PTR;
+      break;
+    case FLOAT32PTR:
+      *type = (int)VAR_FLOAT32PTR;
+      break;
+    case FLOAT64PTR:
+      *type = (int)VAR_FLOAT64PTR;
+      break;
+    case STR:
+      *type = (int)VAR_STRING;
+      break;
+    default:
+      THROW_ERROR("Invalid VAR_TYPE", tokens[*curr_tok].idx1 + 1);
+      return rFAILURE;
+  }
+
+  return rSUCCESS;
+}
+
+static int VarIsLayout(uint32_t *curr_tok, int *col_major)
+{
+  // LAYOUT :== [ 'ROWMAJOR' | 'COLMAJOR' ]
+  *col_major = 0;
+  if (*curr_tok < tokp && tokens[*curr_tok].type == KEYWORD) {
+    switch (ParseGetKeyword(*curr_tok)) {
+      case COLMAJOR:
+        *col_major = 1;
+        (*curr_tok)++;
+        break;
+      case ROWMAJOR:
+        (*curr_tok)++;
+        break;
+      default:
+        break;
+    }
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Number of elements in the array declared at curr_tok
+ *          (VARIABLE { '[' NUMBER ']' }), saturating at UINT32_MAX.
+ */
+static uint32_t VarDeclElements(uint32_t curr_tok)
+{
+  uint64_t len = 1;
+
+  for (curr_tok++; curr_tok + 1 < tokp
+        && tokens[curr_tok].type == OPEN_SQUARE_BRACKET; curr_tok += 3) {
+    len *= (uint32_t)ParseTokToNumber(curr_tok + 1);
+    if (len > UINT32_MAX) {
+      return UINT32_MAX;
+    }
+  }
+
+  return len;
+}
+
+/**
+ *  @brief  Set the dimensions of the array declared at curr_tok and work
+ *          out its strides, so element [i0]..[in] is at
+ *          base + i0 * strides[0] + ... + in * strides[n].
+ *  @param  col_major  Lay the first index out contiguously instead of
+ *                     the last
+ */
+static int VarSetShape(var_t *var, uint32_t curr_tok, int col_major)
+{
+  uint32_t n, stride = var->sub_size_in_bytes;
+  uint64_t len = 1;
+
+  for (n = 0, curr_tok++; curr_tok + 1 < tokp
+        && tokens[curr_tok].type == OPEN_SQUARE_BRACKET; n++, curr_tok += 3) {
+    var->dims[n] = ParseTokToNumber(curr_tok + 1);
+    if (var->dims[n] == 0) {
+      THROW_ERROR("Array length must be non-zero", tokens[curr_tok + 1].idx1 + 1);
+      return rFAILURE;
+    }
+    len *= var->dims[n];
+    if (len * stride > UINT32_MAX) {
+      THROW_ERROR("Array too large", tokens[curr_tok + 1].idx1 + 1);
+      return rFAILURE;
+    }
+  }
+  var->ndims = n;
+  var->len = len;
+
+  if (col_major) {
+    for (n = 0; n < var->ndims; n++) {
+      var->strides[n] = stride;
+      stride *= var->dims[n];
+    }
+  } else {
+    for (n = var->ndims; n-- > 0; ) {
+      var->strides[n] = stride;
+      stride *= var->dims[n];
+    }
+  }
+
+  return rSUCCESS;
+}
+
+static int VarIsMapping(uint32_t *curr_tok, uint32_t *path_tok, int *shared)
+{
+  // MAPPING :== [ 'MAPPED' STRING [ 'SHARED' ] ]
+  *path_tok = 0;
+  *shared = 0;
+  if (*curr_tok < tokp && tokens[*curr_tok].type == KEYWORD
+        && ParseGetKeyword(*curr_tok) == MAPPED) {
+    if (++(*curr_tok) >= tokp || tokens[*curr_tok].type != STRING) {
+      THROW_ERROR("Expecting file name", tokens[*curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    *path_tok = (*curr_tok)++;
+    if (*curr_tok < tokp && tokens[*curr_tok].type == KEYWORD
+          && ParseGetKeyword(*curr_tok) == SHARED) {
+      *shared = 1;
+      (*curr_tok)++;
+    }
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Make the file named by the STRING at path_tok the storage of
+ *          array var_list[vloc], read-only or (shared) writable. Each
+ *          file gets a window of addresses starting on a 64K boundary
+ *          after the previous one, so element addresses work just like
+ *          stack ones.
+ */
+static int VarMapFile(int vloc, uint32_t path_tok, int shared)
+{
+  var_t *var = &var_list[vloc];
+  mapfile_t *m = &maps[nmaps];
+  char path[256];
+  const char *str;
+  uint32_t len, nbytes;
+  uint64_t vaddr;
+
+  str = StrPoolGet(Literals(), tokens[path_tok].aux, &len);
+  if (len == 0 || len >= sizeof(path)) {
+    THROW_ERROR("Invalid file name", tokens[path_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  memcpy(path, str, len);
+  path[len] = '\0';
+
+  if (nmaps == MAX_MAPS) {
+    THROW_ERROR("Too many MAPPED arrays", tokens[path_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  nbytes = var->len * var->sub_size_in_bytes;
+  vaddr = (nmaps ? ((uint64_t)m[-1].vaddr + m[-1].len + 0xFFFF) & ~(uint64_t)0xFFFF
+                 : MAP_VBASE);
+  if (vaddr + nbytes > UINT32_MAX) {
+    THROW_ERROR("Out of address space", tokens[path_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (MapFileOpen(m, path, nbytes, shared) != rSUCCESS) {
+    THROW_ERROR("Cannot map file", tokens[path_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  m->vaddr = vaddr;
+  var->map = ++nmaps;
+
+  return rSUCCESS;
+}
+
+static int VarLocation(uint32_t curr_tok)
+{
+  int v, lo, hi, globals = 0;
+  int len = tokens[curr_tok].idx2 - tokens[curr_tok].idx1;
+  if (len >= VAR_NAME_LEN) {
+    return -1;
+  }
+  // Locals of the running SUB first, then globals (but not those of the
+  // IF branches the first CALL was made from)
+  if (framep > 0) {
+    lo = frames[framep - 1].var_base;
+    globals = (frames[0].block_base > 0 ? blocks[0].var_base : frames[0].var_base);
+  } else {
+    lo = 0;
+  }
+  for (hi = varp; ; hi = globals, lo = 0) {
+    for (v = lo; v < hi; v++) {
+      if (memcmp(linebuf + tokens[curr_tok].idx1, var_list[v].name, len) == 0
+          && var_list[v].name[len] == '\0') {
+        return v;
+      }
+    }
+    if (lo == 0) {
+      break;
+    }
+  }
+ 
+  return -1;
+}
+
+/**
+ *  @brief  Resolve the VAR_DECLARATION at *curr_tok to a memory address.
+ *          A pointer without an index resolves to the pointer itself.
+ *  @param  vloc  Location of the variable in var_list
+ *  @param  addr  Receives the address of the value
+ *  @param  type  Receives the var_type_t of the value
+ */
+static int VarResolve(uint32_t *curr_tok, int vloc, uint32_t *addr, int *type)
+{
+  uint32_t ctok = *curr_tok + 1, offs, index[MAX_ARRAY_DIM], open[MAX_ARRAY_DIM];
+  uint32_t n, k, bound, stride;
+  const var_t *var = &var_list[vloc];
+
+  if (var_list[vloc].loop_reg) {
+    LoopSpill(vloc);
+  }
+
+  if (ctok < tokp && tokens[ctok].type == OPEN_SQUARE_BRACKET) {
+    // Memory may be read through the pointer
+    if (loopp > 0) {
+      LoopSpillAll();
+    }
+
+    if (!VAR_IS_PTR(var_list[vloc].var_type)) {
+      THROW_ERROR("Variable is not a pointer", tokens[ctok].idx1 + 1);
+      return rFAILURE;
+    }
+
+    // Pointer Dereference
+    for (n = 0; ctok < tokp && tokens[ctok].type == OPEN_SQUARE_BRACKET; n++) {
+      if (n == var->ndims) {
+        THROW_ERROR("Too many indices", tokens[ctok].idx1 + 1);
+        return rFAILURE;
+      }
+      open[n] = ctok++;
+      if (StatementExpression(&ctok, &index[n]) != rSUCCESS) {
+        return rFAILURE;
+      }
+      if (ctok >= tokp || tokens[ctok].type != CLOSED_SQUARE_BRACKET) {
+        THROW_ERROR("Missing ']'", tokens[ctok - 1].idx2 + 1);
+        return rFAILURE;
+      }
+      ctok++;
+    }
+    if (n != var->ndims && n != 1) {
+      THROW_ERROR("Wrong number of indices", tokens[ctok - 1].idx1 + 1);
+      return rFAILURE;
+    }
+
+    // One multiply-add per index with the strides worked out when the
+    // array was declared. A single index addresses the elements of a
+    // multi-dimensional array in storage order. Indices are checked
+    // against known bounds unless proven safe before the run.
+    for (offs = 0, k = 0; k < n; k++) {
+      bound = (n == var->ndims ? var->dims[k] : var->len);
+      stride = (n == var->ndims ? var->strides[k] : var->sub_size_in_bytes);
+      if (tokens[open[k]].aux == 1) {
+        bounds_skipped++;
+      } else if (bound) {
+        bounds_checked++;
+        if (index[k] >= bound) {
+          THROW_ERROR("Index out of bounds", tokens[open[k] + 1].idx1 + 1);
+          return rFAILURE;
+        }
+      }
+      offs += index[k] * stride;
+    }
+    *addr = (var->map ? maps[var->map - 1].vaddr : GetPointerValue(vloc)) + offs;
+    *type = var_list[vloc].sub_var_type;
+  } else if (VAR_IS_PTR(var_list[vloc].var_type)) {
+    // Pointer value
+    if (var->map) {
+      THROW_ERROR("MAPPED arrays have no address", tokens[*curr_tok].idx1 + 1);
+      return rFAILURE;
+    }
+    *addr = var_list[vloc].addr;
+    *type = VAR_UINT16;
+  } else {
+    *addr = var_list[vloc].addr;
+    *type = var_list[vloc].var_type;
+  }
+
+  if (MemPtr(*addr, var_type_sizes[*type]) == NULL) {
+    THROW_ERROR("Invalid memory access", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  *curr_tok = ctok;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Bounds for a pointer about to be moved to value: those of the
+ *          array or heap block that starts there, viewed as the pointer's
+ *          element type. Anywhere else, its indices go unchecked.
+ */
+static void VarMoveBounds(int vloc, uint16_t value)
+{
+  var_t *var = &var_list[vloc];
+  const var_t *from = NULL;
+  uint32_t i;
+
+  for (i = varp; i-- > 0; ) {
+    if (VAR_IS_PTR(var_list[i].var_type) && !var_list[i].map && var_list[i].len > 0
+          && GetPointerValue(i) == value) {
+      from = &var_list[i];
+      break;
+    }
+  }
+
+  if (from == var) {
+    return;
+  }
+  if (from == NULL) {
+    memset(var->dims, 0, sizeof(var->dims));
+    var->len = 0;
+  } else if (from->sub_size_in_bytes == var->sub_size_in_bytes) {
+    var->ndims = from->ndims;
+    memcpy(var->dims, from->dims, sizeof(var->dims));
+    memcpy(var->strides, from->strides, sizeof(var->strides));
+    var->len = from->len;
+  } else {
+    var->ndims = 1;
+    var->len = from->len * from->sub_size_in_bytes / var->sub_size_in_bytes;
+    var->dims[0] = var->len;
+    var->strides[0] = var->sub_size_in_bytes;
+  }
+}
+
+/**
+ *  @brief  The elements of the whole numeric array named at *curr_tok:
+ *          their type, address, number and host memory.
+ */
+static int VarArrayData(uint32_t *curr_tok, int *type, uint32_t *addr, uint32_t *n,
+                        uint8_t **mem)
+{
+  const var_t *var;
+  int vloc;
+
+  if (*curr_tok >= tokp || tokens[*curr_tok].type != VARIABLE) {
+    THROW_ERROR("Expecting an array", tokens[*curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  if ((vloc = VarLocation(*curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  var = &var_list[vloc];
+  if (!VAR_IS_PTR(var->var_type)) {
+    THROW_ERROR("Expecting an array", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (var->len == 0) {
+    THROW_ERROR("Array length unknown", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (!VAR_IS_DATA(var->sub_var_type)) {
+    THROW_ERROR("Expecting a numeric array", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  *type = var->sub_var_type;
+  *n = var->len;
+  *addr = (var->map ? maps[var->map - 1].vaddr : GetPointerValue(vloc));
+  if ((uint64_t)*n * var->sub_size_in_bytes > UINT32_MAX
+        || (*mem = MemPtr(*addr, *n * var->sub_size_in_bytes)) == NULL) {
+    THROW_ERROR("Invalid memory access", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  (*curr_tok)++;
+  return rSUCCESS;
+}
+
+static int ExprIsLogic(uint32_t *curr_tok, num_t *value)
+{
+  // LOGIC :== COMPARE { '&&' COMPARE }
+  num_t temp_val;
+
+  if (ExprIsCompare(curr_tok, value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  while (*curr_tok < tokp && tokens[*curr_tok].type == OPERATOR
+          && tokens[*curr_tok].aux == OP_LAND) {
+    (*curr_tok)++;
+    if (ExprIsCompare(curr_tok, &temp_val) != rSUCCESS) {
+      return rFAILURE;
+    }
+    value->v.u32 = (NumIsTrue(value) && NumIsTrue(&temp_val));
+    value->kind = NUM_I32;
+  }
+
+  return rSUCCESS;
+}
+
+static int ExprIsCompare(uint32_t *curr_tok, num_t *value)
+{
+  // COMPARE :== SUM [ RELOP SUM ] | STR_OBJ RELOP STR_OBJ
+  const char *s1, *s2;
+  uint32_t l1, l2;
+  num_t rhs;
+  int32_t cmp;
+  int op;
+
+  if (StrIsOperand(*curr_tok)) {
+    // String comparison (lexicographic)
+    if (StrOperand(curr_tok, &s1, &l1) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (*curr_tok >= tokp || tokens[*curr_tok].type != OPERATOR
+          || tokens[*curr_tok].aux < OP_EQ || tokens[*curr_tok].aux > OP_GE) {
+      THROW_ERROR("Expecting comparison operator",
+                  tokens[*curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    op = tokens[(*curr_tok)++].aux;
+    if (*curr_tok >= tokp || StrOperand(curr_tok, &s2, &l2) != rSUCCESS) {
+      THROW_ERROR("Expecting STRING", tokens[*curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    cmp = memcmp(s1, s2, l1 < l2 ? l1 : l2);
+    if (cmp == 0) {
+      cmp = (int32_t)l1 - (int32_t)l2;
+    }
+  } else {
+    if (ExprIsSum(curr_tok, value) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (*curr_tok >= tokp || tokens[*curr_tok].type != OPERATOR
+          || tokens[*curr_tok].aux < OP_EQ || tokens[*curr_tok].aux > OP_GE) {
+      return rSUCCESS;
+    }
+    op = tokens[(*curr_tok)++].aux;
+    if (ExprIsSum(curr_tok, &rhs) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (value->kind > NUM_U32 || rhs.kind > NUM_U32) {
+      value->v.u32 = NumCompare(value, op, &rhs);
+      value->kind = NUM_I32;
+      return rSUCCESS;
+    }
+    if (value->kind == NUM_U32 || rhs.kind == NUM_U32) {
+      // An INT32 against a UINT32 converts to unsigned, as in C
+      cmp = (value->v.u32 > rhs.v.u32) - (value->v.u32 < rhs.v.u32);
+    } else {
+      cmp = ((int32_t)value->v.u32 > (int32_t)rhs.v.u32)
+              - ((int32_t)value->v.u32 < (int32_t)rhs.v.u32);
+    }
+  }
+
+  switch (op) {
+    case OP_EQ:
+      value->v.u32 = (cmp == 0);
+      break;
+    case OP_NE:
+      value->v.u32 = (cmp != 0);
+      break;
+    case OP_LT:
+      value->v.u32 = (cmp < 0);
+      break;
+    case OP_LE:
+      value->v.u32 = (cmp <= 0);
+      break;
+    case OP_GT:
+      value->v.u32 = (cmp > 0);
+      break;
+    default:
+      value->v.u32 = (cmp >= 0);
+      break;
+  }
+  value->kind = NUM_I32;
+
+  return rSUCCESS;
+}
+
+static int ExprIsSum(uint32_t *curr_tok, num_t *value)
+{
+  // SUM :== TERM | TERM { [+,-,&,|] TERM }
+  num_t term_value;
+  int prev_type = -1;
+  uint32_t op_tok = 0;
+
+  // 
+  if (*curr_tok < tokp) {
+    // Check TERM(s)
+    do {
+      if (ExprIsTerm(curr_tok, &term_value) == rSUCCESS) {
+        if (prev_type < 0) {
+          *value = term_value;
+        } else if (value->kind > NUM_U32 || term_value.kind > NUM_U32) {
+          if (NumSum(value, prev_type, &term_value,
+                     tokens[op_tok].idx1 + 1) != rSUCCESS) {
+            return rFAILURE;
+          }
+        } else {
+          // Perform OPERATION (32 bits)
+          switch (prev_type) {
+            case PLUS:
+              value->v.u32 += term_value.v.u32;
+              break;
+            case MINUS:
+              value->v.u32 -= term_value.v.u32;
+              break;
+            case OP_BAND:
+              value->v.u32 &= term_value.v.u32;
+              break;
+            default:
+              value->v.u32 |= term_value.v.u32;
+              break;
+          }
+          value->kind |= term_value.kind; // U32 if either is
+        }
+
+        // Check [+,-,&,|] TERM
+        if (*curr_tok < tokp) {
+          int type = tokens[*curr_tok].type;
+          if (type == PLUS || type == MINUS) {
+            prev_type = type;
+            op_tok = (*curr_tok)++;
+          } else if (type == OPERATOR && (tokens[*curr_tok].aux == OP_BAND
+                      || tokens[*curr_tok].aux == OP_BOR)) {
+            prev_type = tokens[*curr_tok].aux;
+            op_tok = (*curr_tok)++;
+          } else {
+            break;
+          }
+        }
+      } else {
+        return rFAILURE; 
+      }
+    } while (*curr_tok < tokp);
+  } else {
+    return rFAILURE;
+  }
+
+  return rSUCCESS;
+}
+
+static int ExprIsTerm(uint32_t *curr_tok, num_t *value)
+{
+DEBUG_PRINTF("ExprIsTerm: curr_tok = %d", *curr_tok);
+
+  num_t temp_val;
+  int prev_type = -1;
+
+  // TERM :== FACTOR | FACTOR { [*,/,%] FACTOR }
+  if (*curr_tok < tokp) {
+    do {
+      if (ExprIsFactor(curr_tok, &temp_val) == rSUCCESS) {
+        if (prev_type < 0) {
+          *value = temp_val;
+        } else if (value->kind > NUM_U32 || temp_val.kind > NUM_U32) {
+          if (NumTerm(value, prev_type, &temp_val,
+                      tokens[*curr_tok - 1].idx1 + 1) != rSUCCESS) {
+            return rFAILURE;
+          }
+        } else {
+          switch (prev_type) {
+            case ASTERISK:
+              value->v.u32 *= temp_val.v.u32;
+              break;
+            default:
+              if (temp_val.v.u32 == 0) {
+                THROW_ERROR("Division by zero", tokens[*curr_tok - 1].idx1 + 1);
+                return rFAILURE;
+              }
+              if (prev_type == DIVIDE) {
+                value->v.u32 /= temp_val.v.u32;
+              } else {
+                value->v.u32 %= temp_val.v.u32;
+              }
+              break;
+          }
+          value->kind |= temp_val.kind; // U32 if either is
         }
-      } while (linebuf[linebuf_idx] != '"');
-      idx2 = linebuf_idx++;
 
-      // Save token name and type as STRING
-      tokens[tokp].idx1 = idx1;
-      tokens[tokp].idx2 = idx2;
-      tokens[tokp].type = STRING;
-      tokp++;
-    } else if (LexIsOperator(ch)) {
-      // Operators
-      // Check two-character operators first
-      int o;
-      idx1 = linebuf_idx;
-      for (o = 0; o < strlen(double_char_operators); o += 2) {
-        if (ch == double_char_operators[o] &&
-                  linebuf[idx1 + 1] == double_char_operators[o + 1]) {
-          tokens[tokp].idx1 = idx1;
-          tokens[tokp].idx2 = idx1 + 2;
-          tokens[tokp++].type = OPERATOR;
-          linebuf_idx += 2;
-          o = -1;
-          break;
-        }
+        // Check [*,/,%] FACTOR
+        if (*curr_tok < tokp) {
+          if (tokens[*curr_tok].type == ASTERISK) {
+            (*curr_tok)++;
+            prev_type = ASTERISK;
+          } else if (tokens[*curr_tok].type == DIVIDE) {
+            (*curr_tok)++;
+            prev_type = DIVIDE;
+          } else if (tokens[*curr_tok].type == MOD) {
+            (*curr_tok)++;
+            prev_type = MOD;
+          } else {
+            break;
+          }
+        }
+      } else {
+        //THROW_ERROR("Invalid factor??", tokens[*curr_tok].idx1);
+        return rFAILURE;
+      }
+    } while (*curr_tok < tokp);
+  }
+
+DEBUG_PRINTF("term val: %d", value->v.u32);
+  return rSUCCESS;
+}
+
+static int ExprIsFactor(uint32_t *curr_tok, num_t *value)
+{
+DEBUG_PRINTF("ExprIsFactor: curr_tok = %d", *curr_tok);
+
+  // FACTOR :== NUMBER | [+,-] NUMBER | VARIABLE | [+,-] VARIABLE | '(' EXPRESSION ')'
+  //            | LEN | REDUCTION
+  // (NUMBER includes FLOAT_NUMBER)
+  uint32_t ctok = *curr_tok, temp, len;
+  uint64_t number;
+  int op_type = OPERATOR;
+
+  switch (tokens[ctok].type) {
+    case PLUS:
+    case MINUS:
+    case EXCLAIMATION:
+    case TILDA:
+      op_type = tokens[ctok].type;
+      ctok++;
+      break;
+    default:
+      break;
+  }
+
+  if (ctok < tokp) {
+    int type = tokens[ctok].type;
+    temp = ctok;
+    if (type == NUMBER) {
+      // INT32 if it fits, else INT64 (UINT64 past that), as C types
+      // unsuffixed decimal constants
+      number = ParseTokToNumber(ctok);
+      if (number <= INT32_MAX) {
+        value->kind = NUM_I32;
+        value->v.u32 = (uint32_t)number;
+      } else {
+        value->kind = (number <= INT64_MAX ? NUM_I64 : NUM_U64);
+        value->v.u64 = number;
+      }
+      ctok++;
+    } else if (type == FLOAT_NUMBER) {
+      value->kind = NUM_F64;
+      memcpy(&value->v.f64, StrPoolGet(Literals(), tokens[ctok].aux, &len),
+             sizeof(double));
+      ctok++;
+    } else if (type == KEYWORD && ParseGetKeyword(ctok) == LEN) {
+      if (StrLen(&ctok, &value->v.u32) != rSUCCESS) {
+        return rFAILURE;
+      }
+      value->kind = NUM_I32;
+    } else if (type == KEYWORD && tokens[ctok].aux >= SUM && tokens[ctok].aux <= DOT) {
+      if (ExprReduce(&ctok, value) != rSUCCESS) {
+        return rFAILURE;
+      }
+    } else if (VarIsAccess(&temp) == rSUCCESS) {
+      int var_loc, var_type;
+      uint32_t addr;
+      if ((var_loc = VarLocation(ctok)) >= 0) {
+        if (VarResolve(&ctok, var_loc, &addr, &var_type) != rSUCCESS) {
+          return rFAILURE;
+        }
+        if (var_type == VAR_STRING) {
+          THROW_ERROR("Type mismatch: STRING in numeric expression",
+                      tokens[temp - 1].idx1 + 1);
+          return rFAILURE;
+        }
+        if (VAR_IS_WIDE(var_type)) {
+          *value = NumLoad(addr, var_type);
+        } else {
+          value->kind = var_type_kinds[var_type];
+          value->v.u32 = MemLoad(addr, var_type);
+        }
+      } else {
+        THROW_ERROR("Undefined variable", tokens[ctok].idx1 + 1);
+        return rFAILURE;
+      }
+    } else if (type == OPEN_PARENS) {
+      ctok++;
+      if (StatementNumber(&ctok, value) == rSUCCESS) {
+        if (tokens[ctok].type == CLOSED_PARENS) {
+          ctok++;
+        } else {
+          THROW_ERROR("Missing close parenthesis", tokens[ctok].idx1 + 1);
+          return rFAILURE;
+        }
+      } else {
+        return rFAILURE;
+      }
+    } else {
+      THROW_ERROR("Expecting NUMBER, VARIABLE, or EXPRESSION", tokens[ctok].idx1 + 1);
+      return rFAILURE;
+    }
+  } else {
+    THROW_ERROR("Missing NUMBER, VARIABLE, or EXPRESSION", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+
+  if (op_type != OPERATOR) {
+    if (value->kind > NUM_U32) {
+      if (NumUnary(value, op_type, tokens[*curr_tok].idx1 + 1) != rSUCCESS) {
+        return rFAILURE;
+      }
+    } else {
+      switch (op_type) {
+        case MINUS:
+          value->v.u32 = -value->v.u32;
+          break;
+        case EXCLAIMATION:
+          value->v.u32 = !value->v.u32;
+          value->kind = NUM_I32;
+          break;
+        case TILDA:
+          value->v.u32 = ~value->v.u32;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  *curr_tok = ctok;
+DEBUG_PRINTF("factor val: %d", value->v.u32);
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Whole-array reductions. SUM and DOT are 64-bit (UINT64 for
+ *          unsigned arrays, FLOAT64 for float ones), MIN and MAX are of the
+ *          element type, and COUNT is the number of elements equal to the
+ *          value.
+ */
+static int ExprReduce(uint32_t *curr_tok, num_t *value)
+{
+  // REDUCTION :== ( 'SUM' | 'MIN' | 'MAX' ) '(' VARIABLE ')'
+  //             | 'COUNT' '(' VARIABLE ',' EXPRESSION ')'
+  //             | 'DOT' '(' VARIABLE ',' VARIABLE ')'
+  uint32_t ctok = *curr_tok + 1, addr, n, n2, atok, shift;
+  uint8_t *mem, *mem2 = NULL;
+  int op = tokens[*curr_tok].aux, type, type2;
+  vec_value_t result;
+  num_t key, elem;
+
+  if (ctok + 1 >= tokp || tokens[ctok].type != OPEN_PARENS) {
+    THROW_ERROR("Expecting (", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  atok = ++ctok;
+  if (VarArrayData(&ctok, &type, &addr, &n, &mem) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (op == COUNT || op == DOT) {
+    if (ctok >= tokp || tokens[ctok].type != COMMA) {
+      THROW_ERROR("Expecting ,", tokens[ctok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    ctok++;
+    if (op == COUNT) {
+      if (StatementNumber(&ctok, &key) != rSUCCESS) {
+        return rFAILURE;
+      }
+    } else {
+      if (VarArrayData(&ctok, &type2, &addr, &n2, &mem2) != rSUCCESS) {
+        return rFAILURE;
+      }
+      if (type2 != type || n2 != n) {
+        THROW_ERROR("Type mismatch: arrays differ in type or length",
+                    tokens[atok].idx1 + 1);
+        return rFAILURE;
+      }
+    }
+  }
+  if (ctok >= tokp || tokens[ctok].type != CLOSED_PARENS) {
+    THROW_ERROR("Missing close parenthesis", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+
+  // Memory must be current before it's read
+  if (loopp > 0) {
+    LoopSpillAll();
+  }
+
+  switch (op) {
+    case SUM:
+    case DOT:
+      if (op == SUM) {
+        VecSum(mem, n, type, &result);
+      } else {
+        VecDot(mem, mem2, n, type, &result);
+      }
+      if (type == VAR_FLOAT32 || type == VAR_FLOAT64) {
+        value->kind = NUM_F64;
+        value->v.f64 = result.f64;
+      } else {
+        value->kind = (VAR_IS_SIGNED(type) ? NUM_I64 : NUM_U64);
+        value->v.u64 = result.u64;
+      }
+      break;
+    case MIN:
+    case MAX:
+      VecMinMax(mem, n, type, op == MAX, &result);
+      value->kind = var_type_kinds[type];
+      if (type == VAR_FLOAT32) {
+        value->v.f32 = (float)result.f64;
+      } else if (VAR_IS_WIDE(type)) {
+        value->v.u64 = result.u64;
+      } else {
+        value->v.u32 = (uint32_t)result.u64;
+      }
+      break;
+    default:
+      // The value as an element: floats are rounded to the element's
+      // precision, but an integer the conversion changes equals no element
+      value->kind = NUM_I32;
+      if (type == VAR_FLOAT32 || type == VAR_FLOAT64) {
+        result.f64 = NumToF64(&key);
+        if (type == VAR_FLOAT32) {
+          result.f64 = (float)result.f64;
+        }
+        value->v.u32 = VecCount(mem, n, type, &result);
+        break;
+      }
+      shift = 64 - 8 * var_type_sizes[type];
+      if (type == VAR_INT8 || type == VAR_INT16 || type == VAR_INT32
+            || type == VAR_INT64) {
+        elem.kind = NUM_I64;
+        elem.v.i64 = (int64_t)((uint64_t)NumToI64(&key) << shift) >> shift;
+      } else {
+        elem.kind = NUM_U64;
+        elem.v.u64 = (NumToU64(&key) << shift) >> shift;
+      }
+      result.u64 = elem.v.u64;
+      value->v.u32 = (NumCompare(&elem, OP_EQ, &key) ? VecCount(mem, n, type, &result) : 0);
+      break;
+  }
+
+  *curr_tok = ctok + 1;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  a = a op b (op: PLUS, MINUS, OP_BAND or OP_BOR) where either is
+ *          wider than 32 bits. 64-bit integers wrap around.
+ *  @param  col Column of the operator, for errors
+ */
+static int NumSum(num_t *a, int op, num_t *b, uint32_t col)
+{
+  switch (NumPromote(a, b)) {
+    case NUM_F32:
+    case NUM_F64:
+      if (op != PLUS && op != MINUS) {
+        THROW_ERROR("Type mismatch: bitwise operator on a float", col);
+        return rFAILURE;
+      }
+      if (a->kind == NUM_F32) {
+        a->v.f32 = (op == PLUS ? a->v.f32 + b->v.f32 : a->v.f32 - b->v.f32);
+      } else {
+        a->v.f64 = (op == PLUS ? a->v.f64 + b->v.f64 : a->v.f64 - b->v.f64);
+      }
+      break;
+    default:
+      switch (op) {
+        case PLUS:
+          a->v.u64 += b->v.u64;
+          break;
+        case MINUS:
+          a->v.u64 -= b->v.u64;
+          break;
+        case OP_BAND:
+          a->v.u64 &= b->v.u64;
+          break;
+        default:
+          a->v.u64 |= b->v.u64;
+          break;
+      }
+      break;
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  a = a op b (op: ASTERISK, DIVIDE or MOD) where either is wider
+ *          than 32 bits. A float divided by zero is an infinity (or NaN).
+ *  @param  col Column of b, for errors
+ */
+static int NumTerm(num_t *a, int op, num_t *b, uint32_t col)
+{
+  switch (NumPromote(a, b)) {
+    case NUM_F32:
+    case NUM_F64:
+      if (op == MOD) {
+        THROW_ERROR("Type mismatch: '%' on a float", col);
+        return rFAILURE;
+      }
+      if (a->kind == NUM_F32) {
+        a->v.f32 = (op == ASTERISK ? a->v.f32 * b->v.f32 : a->v.f32 / b->v.f32);
+      } else {
+        a->v.f64 = (op == ASTERISK ? a->v.f64 * b->v.f64 : a->v.f64 / b->v.f64);
+      }
+      return rSUCCESS;
+    default:
+      break;
+  }
+
+  if (op == ASTERISK) {
+    a->v.u64 *= b->v.u64;
+    return rSUCCESS;
+  }
+  if (b->v.u64 == 0) {
+    THROW_ERROR("Division by zero", col);
+    return rFAILURE;
+  }
+  if (a->kind == NUM_U64) {
+    a->v.u64 = (op == DIVIDE ? a->v.u64 / b->v.u64 : a->v.u64 % b->v.u64);
+  } else if (b->v.i64 == -1) {
+    // INT64_MIN / -1 overflows; like the other operators it wraps
+    a->v.u64 = (op == DIVIDE ? 0 - a->v.u64 : 0);
+  } else {
+    a->v.i64 = (op == DIVIDE ? a->v.i64 / b->v.i64 : a->v.i64 % b->v.i64);
+  }
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  a RELOP b (op: OP_EQ .. OP_GE) where either is wider than 32
+ *          bits. Comparisons with a NaN are false, except '!='.
+ *  @return 1 if it holds, else 0.
+ */
+static uint32_t NumCompare(num_t *a, int op, num_t *b)
+{
+  int lt, gt;
+
+  switch (NumPromote(a, b)) {
+    case NUM_I64:
+      lt = (a->v.i64 < b->v.i64);
+      gt = (a->v.i64 > b->v.i64);
+      break;
+    case NUM_U64:
+      lt = (a->v.u64 < b->v.u64);
+      gt = (a->v.u64 > b->v.u64);
+      break;
+    case NUM_F32:
+      lt = (a->v.f32 < b->v.f32);
+      gt = (a->v.f32 > b->v.f32);
+      if (a->v.f32 != a->v.f32 || b->v.f32 != b->v.f32) {
+        return (op == OP_NE);
+      }
+      break;
+    default:
+      lt = (a->v.f64 < b->v.f64);
+      gt = (a->v.f64 > b->v.f64);
+      if (a->v.f64 != a->v.f64 || b->v.f64 != b->v.f64) {
+        return (op == OP_NE);
+      }
+      break;
+  }
+
+  switch (op) {
+    case OP_EQ:
+      return (!lt && !gt);
+    case OP_NE:
+      return (lt || gt);
+    case OP_LT:
+      return lt;
+    case OP_LE:
+      return !gt;
+    case OP_GT:
+      return gt;
+    default:
+      return !lt;
+  }
+}
+
+/**
+ *  @brief  a = op a (op: MINUS, EXCLAIMATION or TILDA) where a is wider
+ *          than 32 bits.
+ *  @param  col Column of the operator, for errors
+ */
+static int NumUnary(num_t *a, int op, uint32_t col)
+{
+  switch (op) {
+    case MINUS:
+      if (a->kind == NUM_F32) {
+        a->v.f32 = -a->v.f32;
+      } else if (a->kind == NUM_F64) {
+        a->v.f64 = -a->v.f64;
+      } else {
+        a->v.u64 = 0 - a->v.u64;
+      }
+      break;
+    case EXCLAIMATION:
+      a->v.u32 = !NumIsTrue(a);
+      a->kind = NUM_I32;
+      break;
+    case TILDA:
+      if (a->kind >= NUM_F32) {
+        THROW_ERROR("Type mismatch: '~' on a float", col);
+        return rFAILURE;
+      }
+      a->v.u64 = ~a->v.u64;
+      break;
+    default:
+      break;
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Convert a and b to the wider of their kinds.
+ *  @return The kind they now have.
+ */
+static num_kind_t NumPromote(num_t *a, num_t *b)
+{
+  num_kind_t kind = (a->kind > b->kind ? a->kind : b->kind);
+
+  NumConvert(a, kind);
+  NumConvert(b, kind);
+  return kind;
+}
+
+static void NumConvert(num_t *n, num_kind_t kind)
+{
+  if (n->kind == kind) {
+    return;
+  }
+
+  switch (kind) {
+    case NUM_I64:
+      n->v.i64 = NumToI64(n);
+      break;
+    case NUM_U64:
+      n->v.u64 = NumToU64(n);
+      break;
+    case NUM_F32:
+      n->v.f32 = (n->kind == NUM_U64 ? (float)n->v.u64 : (float)NumToF64(n));
+      break;
+    case NUM_F64:
+      n->v.f64 = NumToF64(n);
+      break;
+    default:
+      n->v.u32 = NumToU32(n);
+      break;
+  }
+  n->kind = kind;
+}
+
+static int NumIsTrue(const num_t *n)
+{
+  switch (n->kind) {
+    case NUM_I32:
+    case NUM_U32:
+      return (n->v.u32 != 0);
+    case NUM_F32:
+      return (n->v.f32 != 0);
+    case NUM_F64:
+      return (n->v.f64 != 0);
+    default:
+      return (n->v.u64 != 0);
+  }
+}
+
+/**
+ *  @brief  The value as a 32-bit integer: wider integers are truncated,
+ *          floats rounded toward zero first (see NumToI64()).
+ */
+static uint32_t NumToU32(const num_t *n)
+{
+  if (n->kind <= NUM_U32) {
+    return n->v.u32;
+  }
+  return (uint32_t)NumToI64(n);
+}
+
+/**
+ *  @brief  The value as a signed 64-bit integer. 32-bit values widen by
+ *          their kind; floats are rounded toward zero and saturate (NaN
+ *          is 0).
+ */
+static int64_t NumToI64(const num_t *n)
+{
+  double d;
+
+  switch (n->kind) {
+    case NUM_I32:
+      return (int32_t)n->v.u32;
+    case NUM_U32:
+      return n->v.u32;
+    case NUM_I64:
+    case NUM_U64:
+      return n->v.i64;
+    default:
+      d = (n->kind == NUM_F32 ? n->v.f32 : n->v.f64);
+      if (d != d) {
+        return 0;
       }
-
-      if (o > 0) {
-        tokens[tokp].idx1 = idx1;
-        tokens[tokp].idx2 = idx1 + 1;
-        switch (ch) {
-          case '+':
-            tokens[tokp].type = PLUS;
-            break;
-          case '-':
-            tokens[tokp].type = MINUS;
-            break;
-          case '=':
-            tokens[tokp].type = EQUALS;
-            break;
-          case '*':
-            tokens[tokp].type = ASTERISK;
-            break;
-          case '/':
-            tokens[tokp].type = DIVIDE;
-            break;
-          case '%':
-            tokens[tokp].type = MOD;
-            break;
-          case ',':
-            tokens[tokp].type = COMMA;
-            break;
-          case '[':
-            tokens[tokp].type = OPEN_SQUARE_BRACKET;
-            break;
-          case ']':
-            tokens[tokp].type = CLOSED_SQUARE_BRACKET;
-            break;
-          case '(':
-            tokens[tokp].type = OPEN_PARENS;
-            break;
-          case ')':
-            tokens[tokp].type = CLOSED_PARENS;
-            break;
-          case '!':
-            tokens[tokp].type = EXCLAIMATION;
-            break;
-          case '~':
-            tokens[tokp].type = TILDA;
-            break;
-          default:
-            tokens[tokp].type = OPERATOR;
-            break;
-        }
-        tokp++;
-        linebuf_idx++;
+      if (d >= 9223372036854775808.0) {
+        return INT64_MAX;
       }
-    } else if (LexIsAlpha(ch)) {
-      idx1 = linebuf_idx;
-      while (LexIsAlpha(ch) || LexIsDigit(ch)) {
-        ch = linebuf[++linebuf_idx];
-        if (LexIsEndOfLine(ch) || LexIsWhiteSpace(ch)) {
-          break;
-        }
+      if (d < -9223372036854775808.0) {
+        return INT64_MIN;
       }
-      idx2 = linebuf_idx;
+      return (int64_t)d;
+  }
+}
 
-      // Save token name 
-      tokens[tokp].idx1 = idx1;
-      tokens[tokp].idx2 = idx2;
+/**
+ *  @brief  NumToI64() for an unsigned result: floats saturate at 0 and
+ *          UINT64_MAX instead.
+ */
+static uint64_t NumToU64(const num_t *n)
+{
+  double d;
+
+  if (n->kind < NUM_F32) {
+    return (uint64_t)NumToI64(n);
+  }
+  d = (n->kind == NUM_F32 ? n->v.f32 : n->v.f64);
+  if (!(d > 0)) {
+    return 0;
+  }
+  if (d >= 18446744073709551616.0) {
+    return UINT64_MAX;
+  }
+  return (uint64_t)d;
+}
+
+static double NumToF64(const num_t *n)
+{
+  switch (n->kind) {
+    case NUM_I32:
+      return (int32_t)n->v.u32;
+    case NUM_U32:
+      return n->v.u32;
+    case NUM_I64:
+      return n->v.i64;
+    case NUM_U64:
+      return n->v.u64;
+    case NUM_F32:
+      return n->v.f32;
+    default:
+      return n->v.f64;
+  }
+}
+
+/**
+ *  @brief  Write the value in decimal (see FmtFloat() for floats).
+ *  @return Number of characters written (at most FMT_INT_MAX_LEN).
+ */
+static uint32_t NumFormat(char *out, const num_t *n)
+{
+  switch (n->kind) {
+    case NUM_I32:
+      return FmtSigned(out, (int32_t)n->v.u32);
+    case NUM_U32:
+      return FmtUnsigned(out, n->v.u32);
+    case NUM_I64:
+      return FmtSigned64(out, n->v.i64);
+    case NUM_U64:
+      return FmtUnsigned64(out, n->v.u64);
+    case NUM_F32:
+      return FmtFloat(out, n->v.f32, 1);
+    default:
+      return FmtFloat(out, n->v.f64, 0);
+  }
+}
+
+static uint64_t ConvertHexNumber(int idx1, int idx2)
+{
+  uint64_t result = 0;
+  int shift_amt = 0;
+  while (idx2-- != idx1 && shift_amt < 64) {
+    result += (uint64_t)GetHexValue(linebuf[idx2]) << shift_amt;
+    shift_amt += 4;
+  }
+  return result;
+}
+
+static uint64_t ConvertBinNumber(int idx1, int idx2)
+{
+  uint64_t result = 0;
+  int shift_amt = 0;
+  while (idx2-- != idx1 && shift_amt < 64) {
+    result += (uint64_t)(linebuf[idx2] - '0') << shift_amt;
+    shift_amt++;
+  }
+  return result;
+}
+
+static uint64_t ConvertDecNumber(int idx1, int idx2)
+{
+  uint64_t result = 0;
+  uint64_t mult = 1;
+  while (idx2-- != idx1) {
+    result += (linebuf[idx2] - '0') * mult;
+    mult *= 10;
+  }
+
+  return result;
+}
+
+static int32_t GetHexValue(char ch)
+{
+  if (LexIsDigit(ch)) {
+    return ch - '0';
+  } else {
+    if ('A' <= ch && ch <= 'F') {
+      return ch - 'A' + 10;
+    } else {
+      return ch - 'a' + 10;
+    }
+  }
+}
+
+static int LexGetOperator(int idx)
+{
+  char ch = linebuf[idx], ch1 = linebuf[idx + 1];
+
+  if (ch1 == '=') {
+    switch (ch) {
+      case '=': return OP_EQ;
+      case '!': return OP_NE;
+      case '<': return OP_LE;
+      case '>': return OP_GE;
+      default: break;
+    }
+  }
+
+  switch (ch) {
+    case '&': return (ch1 == '&' ? OP_LAND : OP_BAND);
+    case '|': return (ch1 == '|' ? OP_LOR : OP_BOR);
+    case '<': return OP_LT;
+    case '>': return OP_GT;
+    default: break;
+  }
+
+  return OP_NONE;
+}
+
+/**
+ *  @brief  Read a value of the given type from memory.
+ *          Signed types are sign extended. Not for VAR_IS_WIDE() types
+ *          (see NumLoad()).
+ */
+static uint32_t MemLoad(uint32_t addr, int type)
+{
+  int i, size = var_type_sizes[type];
+  const uint8_t *mem = MemPtr(addr, size);
+  uint32_t vval = 0;
+
+  for (i = 0; i < size; i++) {
+    vval |= (uint32_t)mem[i] << (i << 3);
+  }
+
+  switch (type) {
+    case VAR_INT8:
+      return (uint32_t)(int32_t)(int8_t)vval;
+    case VAR_INT16:
+      return (uint32_t)(int32_t)(int16_t)vval;
+    default:
+      return vval;
+  }
+}
+
+/**
+ *  @brief  Write a value of the given type to memory (truncating it).
+ *          Not for VAR_IS_WIDE() types (see NumStore()).
+ */
+static void MemStore(uint32_t addr, int type, uint32_t value)
+{
+  int i, size = var_type_sizes[type];
+  uint8_t *mem = MemPtr(addr, size);
+  num_t num;
+
+  if (nwatches > 0) {
+    num.kind = NUM_U32;
+    num.v.u32 = value;
+    WatchStore(addr, type, &num);
+  }
+  for (i = 0; i < size; i++) {
+    mem[i] = (value >> (i << 3)) & 0xFF;
+  }
+}
+
+/**
+ *  @brief  Read a value of any data or pointer type from memory (little
+ *          endian, floats in IEEE 754 format).
+ */
+static num_t NumLoad(uint32_t addr, int type)
+{
+  int i, size = var_type_sizes[type];
+  const uint8_t *mem;
+  uint64_t bits = 0;
+  uint32_t bits32;
+  num_t n;
+
+  n.kind = var_type_kinds[type];
+  if (!VAR_IS_WIDE(type)) {
+    n.v.u32 = MemLoad(addr, type);
+    return n;
+  }
+
+  mem = MemPtr(addr, size);
+  for (i = 0; i < size; i++) {
+    bits |= (uint64_t)mem[i] << (i << 3);
+  }
+  if (type == VAR_FLOAT32) {
+    bits32 = (uint32_t)bits;
+    memcpy(&n.v.f32, &bits32, sizeof(float));
+  } else {
+    n.v.u64 = bits;
+  }
+  return n;
+}
+
+/**
+ *  @brief  Convert value to the given data or pointer type and write it to
+ *          memory.
+ */
+static void NumStore(uint32_t addr, int type, const num_t *value)
+{
+  int i, size = var_type_sizes[type];
+  uint8_t *mem;
+  uint64_t bits;
+  uint32_t bits32;
+  num_t n;
+
+  if (!VAR_IS_WIDE(type)) {
+    MemStore(addr, type, NumToU32(value));
+    return;
+  }
+
+  n = *value;
+  NumConvert(&n, var_type_kinds[type]);
+  if (nwatches > 0) {
+    WatchStore(addr, type, &n);
+  }
+  if (type == VAR_FLOAT32) {
+    memcpy(&bits32, &n.v.f32, sizeof(float));
+    bits = bits32;
+  } else {
+    bits = n.v.u64;
+  }
+  mem = MemPtr(addr, size);
+  for (i = 0; i < size; i++) {
+    mem[i] = (bits >> (i << 3)) & 0xFF;
+  }
+}
+
+/**
+ *  @brief  Check if the token starts a STR_OBJ.
+ */
+static int StrIsOperand(uint32_t curr_tok)
+{
+  int vloc;
+
+  if (tokens[curr_tok].type == STRING
+        || (tokens[curr_tok].type == KEYWORD && ParseGetKeyword(curr_tok) == MID)) {
+    return 1;
+  }
+
+  return (tokens[curr_tok].type == VARIABLE
+          && (vloc = VarLocation(curr_tok)) >= 0
+          && var_list[vloc].var_type == VAR_STRING);
+}
+
+/**
+ *  @brief  Get the characters of the STR_OBJ at *curr_tok.
+ *  @param  str   Receives a pointer to the characters (not NUL terminated)
+ *  @param  len   Receives the number of characters
+ */
+static int StrOperand(uint32_t *curr_tok, const char **str, uint32_t *len)
+{
+  // STR_OBJ :== STRING | VARIABLE | MID
+  int vloc;
+
+  if (tokens[*curr_tok].type == KEYWORD && ParseGetKeyword(*curr_tok) == MID) {
+    return StrMid(curr_tok, str, len);
+  } else if (tokens[*curr_tok].type == STRING) {
+    *str = StrPoolGet(Literals(), tokens[*curr_tok].aux, len);
+  } else if (tokens[*curr_tok].type == VARIABLE
+              && (vloc = VarLocation(*curr_tok)) >= 0
+              && var_list[vloc].var_type == VAR_STRING) {
+    StrLoad(var_list[vloc].addr, str, len);
+  } else {
+    THROW_ERROR("Expecting STRING", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  (*curr_tok)++;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  MID(s, start [, count]): count characters of s from character
+ *          start (1 based), or all of the rest. Characters are UTF-8
+ *          sequences. The result points into s's storage.
+ */
+static int StrMid(uint32_t *curr_tok, const char **str, uint32_t *len)
+{
+  // MID :== 'MID' '(' STR_OBJ ',' EXPRESSION [ ',' EXPRESSION ] ')'
+  uint32_t ctok = *curr_tok + 1, start, count = 0, skip;
+  int has_count = 0;
+
+  if (ctok + 1 >= tokp || tokens[ctok].type != OPEN_PARENS) {
+    THROW_ERROR("Expecting (", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  ctok++;
+  if (StrOperand(&ctok, str, len) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (ctok >= tokp || tokens[ctok].type != COMMA) {
+    THROW_ERROR("Expecting ,", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  ctok++;
+  if (StatementExpression(&ctok, &start) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (ctok < tokp && tokens[ctok].type == COMMA) {
+    ctok++;
+    has_count = 1;
+    if (StatementExpression(&ctok, &count) != rSUCCESS) {
+      return rFAILURE;
+    }
+  }
+  if (ctok >= tokp || tokens[ctok].type != CLOSED_PARENS) {
+    THROW_ERROR("Missing close parenthesis", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  if ((int32_t)start < 1 || (int32_t)count < 0) {
+    THROW_ERROR("MID argument out of range", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  skip = Utf8Offset(*str, *len, start - 1);
+  *str += skip;
+  *len -= skip;
+  if (has_count) {
+    *len = Utf8Offset(*str, *len, count);
+  }
+  *curr_tok = ctok + 1;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  LEN(s): the number of characters (UTF-8 sequences) in s.
+ */
+static int StrLen(uint32_t *curr_tok, uint32_t *value)
+{
+  // LEN :== 'LEN' '(' STR_OBJ ')'
+  uint32_t ctok = *curr_tok + 1, len;
+  const char *str;
+
+  if (ctok + 1 >= tokp || tokens[ctok].type != OPEN_PARENS) {
+    THROW_ERROR("Expecting (", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  ctok++;
+  if (StrOperand(&ctok, &str, &len) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (ctok >= tokp || tokens[ctok].type != CLOSED_PARENS) {
+    THROW_ERROR("Missing close parenthesis", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+
+  *value = Utf8Length(str, len);
+  *curr_tok = ctok + 1;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Get the characters of the string variable stored at addr.
+ */
+static void StrLoad(uint32_t addr, const char **str, uint32_t *len)
+{
+  uint8_t tag = stack[addr];
+
+  if (tag <= STR_INLINE_MAX) {
+    *len = tag;
+    *str = (const char *)stack + addr + 1;
+  } else if (tag == STR_TAG_HEAP) {
+    *len = MemLoad(addr + 1, VAR_UINT16);
+    *str = (const char *)stack + MemLoad(addr + 3, VAR_UINT16);
+  } else {
+    *str = StrPoolGet(Literals(), MemLoad(addr + 1, VAR_UINT32), len);
+  }
+}
 
-      // Determine if they are keywords, labels, or variables
-      if (LexIsKeyword(tokens[tokp].idx1, tokens[tokp].idx2)) {
-        // Keyword
-        tokens[tokp].type = KEYWORD;
-      } else {
-        // Check if we have a label
-        if (linebuf[linebuf_idx] == ':') {
-          // Label
-          tokens[tokp].type = LABEL;
-          linebuf_idx++;
-        } else {
-          // Variable
-          tokens[tokp].type = VARIABLE;
-        }
+/**
+ *  @brief  Evaluate STR_EXPR at *curr_tok into the string variable at dst.
+ *          The result length is measured first so it is built with at
+ *          most one allocation and no intermediate copies.
+ */
+static int StrConcat(uint32_t *curr_tok, uint32_t dst)
+{
+  // STR_EXPR :== STR_OBJ { '+' STR_OBJ }*
+  uint32_t ctok = *curr_tok, len, total = 0, n = 0, i;
+  uint16_t heap_addr;
+  const char *str;
+  char *out;
+
+  // Pass 1: Check syntax and measure
+  while (1) {
+    if (StrOperand(&ctok, &str, &len) != rSUCCESS) {
+      return rFAILURE;
+    }
+    total += len;
+    n++;
+    if (ctok < tokp && tokens[ctok].type == PLUS) {
+      if (++ctok >= tokp) {
+        THROW_ERROR("Invalid syntax: Missing token", tokens[ctok - 1].idx1 + 1);
+        return rFAILURE;
       }
-      tokp++;
-    } else if (LexIsEOF(ch)) {
-      return rSUCCESS;
     } else {
-      // Error: unrecognized token
-      THROW_ERROR("Invalid token", linebuf_idx);
-      return rFAILURE;
+      break;
     }
   }
 
-#if (DEBUG == 1)
-  int i;
-  char buf[512];
-  for (i = 0; i < tokp; i++) {
-    memset(buf, 0, 512);
-    memcpy(buf, linebuf + tokens[i].idx1, tokens[i].idx2 - tokens[i].idx1);
-    printf("Token %d: %s, type:", i, buf);
-    debug_print_type(tokens[i].type);
-    puts("");
+  // A lone literal that doesn't fit inline is referenced, not copied.
+  if (n == 1 && tokens[*curr_tok].type == STRING && total > STR_INLINE_MAX) {
+    StrRelease(dst);
+    stack[dst] = STR_TAG_LITERAL;
+    MemStore(dst + 1, VAR_UINT32, tokens[*curr_tok].aux);
+    *curr_tok = ctok;
+    return rSUCCESS;
   }
-  puts("");
-#endif
 
+  if ((out = StrBegin(total, &heap_addr)) == NULL) {
+    THROW_ERROR("Out of heap memory", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  // Pass 2: Copy the pieces
+  for (i = 0; i < n; i++) {
+    StrOperand(curr_tok, &str, &len);
+    memcpy(out, str, len);
+    out += len;
+    (*curr_tok)++;
+  }
+  *curr_tok = ctok;
+
+  StrEnd(dst, total, heap_addr);
   return rSUCCESS;
 }
 
-static int ParseGetKeyword(uint32_t token_idx)
+/**
+ *  @brief  Copy the string variable at src into the one at dst.
+ */
+static int StrCopy(uint32_t dst, uint32_t src)
 {
-  int i;
-  int idx1 = tokens[token_idx].idx1, idx2 = tokens[token_idx].idx2;
-  for (i = 0; keywords[i]; i++) {
-    if (memcmp(linebuf + idx1, keywords[i], idx2 - idx1) == 0) {
-      break;
-    }
+  uint16_t heap_addr;
+  const char *str;
+  uint32_t len;
+  char *out;
+
+  if (stack[src] == STR_TAG_LITERAL) {
+    // Literals are shared
+    StrRelease(dst);
+    memcpy(stack + dst, stack + src, SIZEOF_STRING);
+    return rSUCCESS;
   }
 
-  if (keywords[i] == NULL) {
-    return -1;
+  StrLoad(src, &str, &len);
+  if ((out = StrBegin(len, &heap_addr)) == NULL) {
+    return rFAILURE;
   }
-
-  return i;
+  memcpy(out, str, len);
+  StrEnd(dst, len, heap_addr);
+  return rSUCCESS;
 }
 
-// TODO
-static int ParseTokToNumber(uint32_t token_idx)
+/**
+ *  @brief  Get a buffer for a new string value of len characters.
+ *  @param  heap_addr Receives the heap block, or 0 if stored inline
+ *  @return Where to write the characters, NULL when out of memory.
+ */
+static char *StrBegin(uint32_t len, uint16_t *heap_addr)
 {
-  char ch1, ch2;
-  int idx1 = tokens[token_idx].idx1, idx2 = tokens[token_idx].idx2;
-  int32_t result;
+  if (len <= STR_INLINE_MAX) {
+    *heap_addr = 0;
+    return str_scratch;
+  }
 
-  ch1 = linebuf[idx1];
-  ch2 = linebuf[idx1 + 1];
-  if ((ch1 == '0') && ((ch2 == 'x') || (ch2 == 'X'))) {
-    result = ConvertHexNumber(idx1 + 2, idx2);
-  } else if (ch1 == '0' && ((ch2 == 'b') || (ch2 == 'B'))) {
-    result = ConvertBinNumber(idx1 + 2, idx2);
+  if (len > HEAP_MAX_REQUEST || (*heap_addr = HeapAlloc(&heap, len)) == 0) {
+    return NULL;
+  }
+
+  return (char *)stack + *heap_addr;
+}
+
+/**
+ *  @brief  Install a value built with StrBegin() into the variable at dst,
+ *          releasing its previous value.
+ */
+static void StrEnd(uint32_t dst, uint32_t len, uint16_t heap_addr)
+{
+  StrRelease(dst);
+  if (heap_addr == 0) {
+    stack[dst] = len;
+    memcpy(stack + dst + 1, str_scratch, len);
   } else {
-    result = ConvertDecNumber(idx1, idx2);
+    stack[dst] = STR_TAG_HEAP;
+    MemStore(dst + 1, VAR_UINT16, len);
+    MemStore(dst + 3, VAR_UINT16, heap_addr);
   }
+}
 
-  return result;
+static void StrRelease(uint32_t addr)
+{
+  if (stack[addr] == STR_TAG_HEAP) {
+    HeapFree(&heap, MemLoad(addr + 3, VAR_UINT16));
+  }
 }
 
-static int StatementPrint(uint32_t curr_tok)
+static uint16_t GetPointerValue(int vloc)
 {
-  // PRINT Syntax
-  // PRINT      :== 'PRINT' [PRINT_OBJ] { '+' PRINT_OBJ }*
-  // PRINT_OBJ  :== STRING | VARIABLE
-  int i, j, size, vloc, var_type, addr;
-  uint32_t vval, ctok, offs;
-  consolebuf_idx = 0;
-  memset(consolebuf, 0, CONSOLEBUF_LEN);
+  uint16_t addr;
 
-  if (curr_tok < tokp) {
-    while (curr_tok < tokp) {
-      ctok = curr_tok;
-      if (tokens[curr_tok].type == STRING ||
-            (VarIsDeclaration(&ctok) == rSUCCESS)) {
-        if (tokens[curr_tok].type == STRING) {
-          CONSOLE_ADD_STRING_TOK(tokens[curr_tok]);
-          curr_tok++;
-        } else {
-          if ((vloc = VarLocation(curr_tok)) >= 0) {
-            if (var_list[vloc].var_type <= VAR_UINT32) {
-              // Data type (non-pointer)
-              size = var_type_sizes[var_list[vloc].var_type];
-              i = 0;
-              vval = 0;
-              while (size--) {
-                vval |= (stack[var_list[vloc].addr + i] & 0xFF) << (i << 3);
-                i++;
-              }
-              var_type = var_list[vloc].var_type;
-            } else {
-              if (ctok - curr_tok > 1) {
-                // Pointer Dereference
-                offs = ParseTokToNumber(curr_tok + 2);
-                if (ctok - curr_tok > 4) {
-                  offs *= var_list[vloc].cols;
-                  offs += ParseTokToNumber(curr_tok + 5);
-                }
+  addr = stack[var_list[vloc].addr] & 0xFF;
+  addr += (stack[var_list[vloc].addr + 1] << 8) & 0xFF00;
+  
+  return addr;
+}
 
-                if (var_list[vloc].sub_var_type <= VAR_UINT32) {
-                  size = var_list[vloc].sub_size_in_bytes;
-                  addr = GetPointerValue(vloc);
-                  i = 0;
-                  j = size;
-                  vval = 0;
-                  while (j--) {
-                    vval |= (stack[addr + (offs * size) + i] & 0xFF)
-                              << (i << 3);
-                    i++;
-                  }
-                  var_type = var_list[vloc].sub_var_type;
-                } else {
-                  // Pointer Dereference resulting in a pointer
-                  // TODO
-                  puts("TODO: PRINT Array of pointers");
-                  return rFAILURE;
-                }
-              } else {
-                // Pointer value
-                vval = var_list[vloc].addr;
-                vval = stack[var_list[vloc].addr] & 0xFF;
-                vval |= (stack[var_list[vloc].addr + 1] << 8) & 0xFF00;
-                var_type = VAR_UINT16;
-              }
-            }
+static void SetPointerValue(int vloc, uint16_t addr)
+{
+  stack[var_list[vloc].addr] = addr & 0xFF;
+  stack[var_list[vloc].addr + 1] = (addr >> 8) & 0xFF;
+}
 
-            switch (var_type) {
-              case VAR_CHAR:
-                CONSOLE_ADD_CHAR_TOK((char)vval);
-                break;
-              case VAR_INT8:
-                CONSOLE_ADD_SIGNED_TOK((int8_t)vval);
-                break;
-              case VAR_UINT8:
-                CONSOLE_ADD_UNSIGNED_TOK((uint8_t)vval);
-                break;
-              case VAR_INT16:
-                CONSOLE_ADD_SIGNED_TOK((int16_t)vval);
-                break;
-              case VAR_UINT16:
-                CONSOLE_ADD_UNSIGNED_TOK((uint16_t)vval);
-                break;
-              case VAR_INT32:
-                CONSOLE_ADD_SIGNED_TOK((int16_t)vval);
-                break;
-              case VAR_UINT32:
-                CONSOLE_ADD_UNSIGNED_TOK((uint32_t)vval);
-                break;
-              default:
-                break;
-            }
-          } else {
-            THROW_ERROR("Undefined variable.", tokens[curr_tok].idx1 + 1);
-            return rFAILURE;
-          }
-          curr_tok = ctok;
-        }
+/**
+ *  @brief  Translate the current program line to C (see BasicEmitC()).
+ */
+static int EmitLine(void)
+{
+  uint32_t eq;
 
-        if (curr_tok < tokp && (tokens[curr_tok].type == PLUS)) {
-          if (curr_tok + 1 < tokp) {
-            curr_tok++;
-          } else {
-            THROW_ERROR("Invalid syntax: Missing token",
-                        tokens[curr_tok].idx1 + 1);
-            return rFAILURE;
-          }
-        } else if (curr_tok == tokp) {
-          break;
-        } else {
-          THROW_ERROR("Invalid syntax: '+' missing?",
-                      tokens[curr_tok].idx1);
-          return rFAILURE;
-        }
-      } else {
-        THROW_ERROR("Invalid syntax: Bad token.",
-                    tokens[curr_tok].idx1 + 1);
-        return rFAILURE;
-      }
+  expr_nest_level = 0;
+  if (tokens[0].type != KEYWORD) {
+    // Assignments only; a bare expression has nothing to translate to
+    for (eq = 0; eq < tokp && tokens[eq].type != EQUALS; eq++) {
     }
+    return (eq < tokp ? EmitAssignment(0) : EmitUnsupported(0));
   }
 
-  CONSOLE_PRINTBUF();
-  return rSUCCESS;
+  switch (tokens[0].aux) {
+    case PRINT:
+      return EmitPrint(1);
+    case VAR:
+      return EmitVar(1);
+    case FOR:
+      return EmitFor(1);
+    case NEXT:
+      return EmitNext(1);
+    case IF:
+      return EmitIf(1);
+    case ELSE:
+      if (tokp > 1) {
+        THROW_ERROR("Invalid syntax", tokens[1].idx1 + 1);
+        return rFAILURE;
+      }
+      EmitBlockClose(program.lines[program.lines[prog_pc].jump].jump);
+      emit_depth--;
+      EmitStatement("} else {");
+      emit_depth++;
+      return rSUCCESS;
+    case END:
+      // END IF (SUB is never translated)
+      EmitBlockClose(program.lines[prog_pc].jump);
+      emit_depth--;
+      EmitStatement("}");
+      return rSUCCESS;
+    case LIST:
+    case RUN:
+    case NEW:
+    case DELETE:
+      THROW_ERROR("Command is only valid at the prompt", tokens[0].idx1 + 1);
+      return rFAILURE;
+    default:
+      return EmitUnsupported(0);
+  }
 }
 
-static int StatementVar(uint32_t curr_tok)
+/**
+ *  @brief  VAR: declared by StatementVar() (for its checks, and the
+ *          shapes it works out), then as zeroed C variables right there,
+ *          so an IF branch's are local to its C block.
+ */
+static int EmitVar(uint32_t curr_tok)
 {
-  // VAR Syntax
-  // VAR              :== 'VAR' VAR_LIST VAR_TYPE
-  // VAR_LIST         :== VAR_DECLARATION {, VAR_DECLARATION}*
-  // VAR_DECLARATION  :== VARIABLE [ '[' NUMBER ']' ]
-  int var_type, sub_var_type;
-  uint16_t temp, size_in_bytes, sub_size_in_bytes;
-  if (curr_tok < tokp) {
-    // Check VAR_LIST
-    if (VarIsList(&curr_tok) == rSUCCESS) {
-      if (VarIsType(&curr_tok, &var_type) == rSUCCESS) {
-        // Statement must end here.
-        if (curr_tok < tokp) {
-          THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
-          return rFAILURE;
-        }
+  uint32_t t, v;
+  const var_t *var;
 
-        // Once we have a valid statement, we must interpret it properly.
-        // Save the variable size and type
-        if (var_type < sizeof(var_type_sizes)) {
-          size_in_bytes = var_type_sizes[var_type];
-          if (var_type > (int)VAR_UINT32) {
-            sub_var_type = var_type - NUM_DATA_TYPES;
-            sub_size_in_bytes = var_type_sizes[sub_var_type];
-          } else {
-            sub_var_type = -1;
-            sub_size_in_bytes = 0;
-          }
-        } else {
-          THROW_ERROR("Unknown error", 0);
-          return rFAILURE;
-        }
+  for (t = curr_tok; t < tokp; t++) {
+    if (tokens[t].type == KEYWORD && tokens[t].aux == MAPPED) {
+      return EmitUnsupported(t);
+    }
+  }
+  // Scoped as when it runs (see StatementVar())
+  if (program.lines[prog_pc].jump && varp < MAX_VAR_COUNT) {
+    BlockOpen(program.lines[prog_pc].jump - 1);
+  }
+  v = varp;
+  if (StatementVar(curr_tok) != rSUCCESS) {
+    return rFAILURE;
+  }
 
-        // Go through all the VARIABLE tokens and see if they
-        // need to be added to the stack (if they don't exist).
-        // Throw an error if they already do!
-        for (curr_tok = 0; curr_tok < tokp; curr_tok++) {
-          if (tokens[curr_tok].type == VARIABLE) {
-            // Make sure it doesn't exist.
-            if (VarLocation(curr_tok) >= 0) {
-              THROW_ERROR("Variable already defined",
-                          tokens[curr_tok].idx1 + 1);
-              return rFAILURE;
-            }
+  for (t = curr_tok; t < tokp; t++) {
+    if (tokens[t].type != VARIABLE) {
+      continue;
+    }
+    var = &var_list[v++];
+    if (VAR_IS_PTR(var->var_type)) {
+      // Only arrays of data; pointers have no C counterpart here
+      if (var->dims[0] == 0 || !VAR_IS_DATA(var->sub_var_type)) {
+        return EmitUnsupported(t);
+      }
+      EmitStatement("%s v_%s[%u] = {0};", emit_var_types[var->sub_var_type],
+                    var->name, var->len);
+    } else {
+      EmitStatement("%s v_%s = %s;", emit_var_types[var->var_type], var->name,
+                    var->var_type == VAR_STRING ? "{0}" : "0");
+    }
+  }
 
-            // Add it!
-            // 1. Save the name and sub_var_type
-            temp = tokens[curr_tok].idx2 - tokens[curr_tok].idx1;
-            memcpy(var_list[varp].name, linebuf + tokens[curr_tok].idx1, temp);
-            // 2. Add to the stack
-            //  i) Save location on stack to idx
-            var_list[varp].addr = sp;
-            //  ii) Update stack based on variable size
-            if (curr_tok + 3 < tokp && tokens[curr_tok + 2].type == NUMBER) {
-              var_list[varp].len = ParseTokToNumber(curr_tok + 2);
-              if (curr_tok + 6 < tokp && tokens[curr_tok + 5].type == NUMBER) {
-                var_list[varp].cols = ParseTokToNumber(curr_tok + 5);
-                var_list[varp].len *= var_list[varp].cols;
-              } else {
-                var_list[varp].cols = 1;
-              }
+  return rSUCCESS;
+}
 
-              if (var_list[varp].len == 0) {
-                THROW_ERROR("Array length must be non-zero",
-                            tokens[curr_tok + 2].idx1 + 1);
-                return rFAILURE;
-              }
+/**
+ *  @brief  End of a branch of the IF at program line line (see
+ *          BlockClose()). Its strings are freed before the C block ends.
+ */
+static void EmitBlockClose(uint32_t line)
+{
+  uint32_t i;
 
-              // Push pointer to stack and have it point to start of array data
-              if (var_type <= (int)VAR_UINT32) {
-                var_list[varp].var_type = var_type + NUM_DATA_TYPES;
-                var_list[varp].sub_var_type = var_type;
-              } else {
-                var_list[varp].var_type = var_type;
-                var_list[varp].sub_var_type = var_type;
-              }
-              var_list[varp].size_in_bytes = SIZEOF_PTR;
-              var_list[varp].sub_size_in_bytes =
-                                      var_type_sizes[var_list[varp].sub_var_type];
-              sp += SIZEOF_PTR;
-              stack[sp - SIZEOF_PTR] = sp & 0xFF;
-              stack[sp + 1 - SIZEOF_PTR] = (sp >> 8) & 0xFF;
+  if (blockp > 0 && blocks[blockp - 1].line == line) {
+    for (i = blocks[blockp - 1].var_base; i < varp; i++) {
+      if (var_list[i].var_type == VAR_STRING) {
+        EmitStatement("free((char *)v_%s.p);", var_list[i].name);
+      }
+    }
+  }
+  BlockClose(line);
+}
 
-              // Now push the array data
-              sp += var_list[varp].len * var_list[varp].sub_size_in_bytes;
-              varp++;
-            } else {
-              var_list[varp].len = 1;
-              sp += size_in_bytes;
-              var_list[varp].var_type = var_type;
-              var_list[varp].sub_var_type = sub_var_type;
-              var_list[varp].size_in_bytes = size_in_bytes;
-              var_list[varp].sub_size_in_bytes = sub_size_in_bytes;
-              varp++;
-            }
-          }
-        }
-      } else {
+/**
+ *  @brief  PRINT (see StatementPrint()). The line is built by the rt_put
+ *          functions and written by rt_put_end(), so an error part way
+ *          through prints nothing, as in the interpreter.
+ */
+static int EmitPrint(uint32_t curr_tok)
+{
+  const char *str, *name, *offs;
+  uint32_t ctok;
+  int type;
+
+  if (curr_tok < tokp && tokens[curr_tok].type == KEYWORD
+        && tokens[curr_tok].aux == USING) {
+    return EmitUnsupported(curr_tok);
+  }
+
+  while (curr_tok < tokp) {
+    ctok = curr_tok;
+    if (tokens[curr_tok].type != STRING && tokens[curr_tok].type != KEYWORD
+          && VarIsAccess(&ctok) != rSUCCESS) {
+      THROW_ERROR("Invalid syntax: Bad token.", tokens[curr_tok].idx1 + 1);
+      return rFAILURE;
+    }
+
+    if (StrIsOperand(curr_tok)) {
+      if (EmitStrOperand(&curr_tok, &str) != rSUCCESS) {
+        return rFAILURE;
+      }
+      EmitStatement("rt_put(%s);", str);
+    } else if (tokens[curr_tok].type == KEYWORD) {
+      if (tokens[curr_tok].aux >= SUM && tokens[curr_tok].aux <= DOT) {
+        return EmitUnsupported(curr_tok);
+      }
+      if (tokens[curr_tok].aux != LEN) {
+        THROW_ERROR("Invalid syntax: Bad token.", tokens[curr_tok].idx1 + 1);
         return rFAILURE;
       }
+      if (EmitStrLen(&curr_tok, &str) != rSUCCESS) {
+        return rFAILURE;
+      }
+      EmitStatement("rt_put_int((int32_t)%s);", str);
     } else {
+      if (EmitAccess(&curr_tok, &name, &offs, &type) != rSUCCESS) {
+        return rFAILURE;
+      }
+      if (offs) {
+        name = EmitFormat("%s[%s]", name, offs);
+      }
+      switch (type) {
+        case VAR_CHAR:
+          EmitStatement("rt_put_char(%s);", name);
+          break;
+        case VAR_UINT8:
+        case VAR_UINT16:
+        case VAR_UINT32:
+        case VAR_UINT64:
+          EmitStatement("rt_put_uint(%s);", name);
+          break;
+        case VAR_FLOAT32:
+        case VAR_FLOAT64:
+          EmitStatement("rt_put_float(%s, %d);", name, type == VAR_FLOAT32);
+          break;
+        default:
+          EmitStatement("rt_put_int(%s);", name);
+          break;
+      }
+    }
+
+    if (curr_tok < tokp && tokens[curr_tok].type == PLUS) {
+      if (++curr_tok == tokp) {
+        THROW_ERROR("Invalid syntax: Missing token", tokens[curr_tok - 1].idx1 + 1);
+        return rFAILURE;
+      }
+    } else if (curr_tok < tokp) {
+      THROW_ERROR("Invalid syntax: '+' missing?", tokens[curr_tok].idx1);
       return rFAILURE;
     }
-  } else {
-    return rFAILURE;
   }
 
+  EmitStatement("rt_put_end();");
   return rSUCCESS;
 }
 
-static int StatementAssignment(uint32_t curr_tok)
+/**
+ *  @brief  Assignment (see StatementAssignment()). With more than one
+ *          target their indices are worked out before the value, as in
+ *          the interpreter.
+ */
+static int EmitAssignment(uint32_t curr_tok)
 {
-  int result;
-  uint32_t value, expr_tok;
-
-  // ASSIGNMENT Syntax
-  // ASSIGNMENT :== { VAR_DECLARATION '=' }* EXPRESSION
-  // VAR_DECLARATION :== VARIABLE [ '[' NUMBER ']' ]
-  if (curr_tok < tokp) {
-    do {
-      if (VarIsDeclaration(&curr_tok) == rSUCCESS) {
-        if (curr_tok < tokp && tokens[curr_tok].type == EQUALS) {
-          curr_tok++;
-          if (curr_tok >= tokp) {
-            THROW_ERROR("Missing expression", tokens[curr_tok - 1].idx2 + 1);
-            return rFAILURE;
-          }
-        } else {
-          curr_tok--;
-          break;
-        }
-      } else {
-        THROW_ERROR("Expecting type VARIABLE", tokens[curr_tok].idx1);
+  const char *names[MAX_ASSIGN_TARGETS], *offs[MAX_ASSIGN_TARGETS];
+  const char *parts = "", *str;
+  int i, types[MAX_ASSIGN_TARGETS], ntargets = 0, nparts = 0;
+  uint32_t ctok, targets[MAX_ASSIGN_TARGETS];
+  emit_val_t value;
+
+  while (curr_tok < tokp && tokens[curr_tok].type == VARIABLE) {
+    ctok = curr_tok;
+    if (VarIsAccess(&ctok) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (ctok < tokp && tokens[ctok].type == EQUALS) {
+      if (ntargets == MAX_ASSIGN_TARGETS) {
+        THROW_ERROR("Too many assignment targets", tokens[ctok].idx1 + 1);
         return rFAILURE;
       }
-    } while (tokens[curr_tok].type == VARIABLE);
-  } else {
-    THROW_ERROR("Missing tokens", 0);
+      targets[ntargets++] = curr_tok;
+      curr_tok = ctok + 1;
+      if (curr_tok >= tokp) {
+        THROW_ERROR("Missing expression", tokens[ctok].idx2 + 1);
+        return rFAILURE;
+      }
+    } else {
+      break;
+    }
+  }
+  if (ntargets == 0) {
+    THROW_ERROR("Expecting type VARIABLE", tokens[curr_tok].idx1);
     return rFAILURE;
   }
 
-  // Check EXPRESSION
-  expr_tok = curr_tok;
-  expr_nest_level = 0;
-  result = StatementExpression(&curr_tok, &value);
-
-  // Finish assignment once we've determined the
-  // value of the expression.
-  // TODO
-  return result;
-}
-
-static int StatementExpression(uint32_t *curr_tok, uint32_t *value)
-{
-  // EXPRESSION Syntax
-  // EXPRESSION :== TERM | TERM { [+,-,&,|] TERM }
-  // TERM      :== FACTOR | FACTOR { [*,/,%] FACTOR }
-  // FACTOR    :== NUMBER | [+,-] NUMBER | VARIABLE | [+,-] VARIABLE | '(' EXPRESSION ')'
-  
-  uint32_t term_value = 0;
-  int prev_type = -1;
-
-  // Check nesting level
-  expr_nest_level++;
-DEBUG_PRINTF("Expression Evaluation: level = %d", expr_nest_level);
-  if (expr_nest_level >= MAX_EXPR_NEST_DEPTH) {
-    THROW_ERROR("Too many nested expressions", tokens[*curr_tok].idx1 + 1);
-    return rFAILURE;
+  for (i = 0; i < ntargets; i++) {
+    ctok = targets[i];
+    if (EmitAccess(&ctok, &names[i], &offs[i], &types[i]) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if ((types[i] == VAR_STRING) != (types[0] == VAR_STRING)) {
+      THROW_ERROR("Type mismatch", tokens[targets[i]].idx1 + 1);
+      return rFAILURE;
+    }
   }
 
-  // 
-  if (*curr_tok < tokp) {
-    // Check TERM(s)
+  if (types[0] == VAR_STRING) {
+    // STR_EXPR :== STR_OBJ { '+' STR_OBJ }*
     do {
-      if (ExprIsTerm(curr_tok, &term_value) == rSUCCESS) {
-        // Perform OPERATION if 
-        switch (prev_type) {
-          case PLUS:
-            *value += term_value;
-            break;
-          case MINUS:
-            *value -= term_value;
-            break;
-          default:
-            *value = term_value;
-            break;
-        }
+      if (nparts > 0 && ++curr_tok >= tokp) {
+        THROW_ERROR("Invalid syntax: Missing token", tokens[curr_tok - 1].idx1 + 1);
+        return rFAILURE;
+      }
+      if (EmitStrOperand(&curr_tok, &str) != rSUCCESS) {
+        return rFAILURE;
+      }
+      parts = EmitFormat("%s, %s", parts, str);
+      nparts++;
+    } while (curr_tok < tokp && tokens[curr_tok].type == PLUS);
+  } else if (EmitNumber(&curr_tok, &value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
 
-        // Check [+,-] TERM
-        if (*curr_tok < tokp) {
-          // TODO refactor this if statement
-          int type = tokens[*curr_tok].type;
-          if (type == PLUS) {
-            prev_type = type;
-            (*curr_tok)++;
-          } else if (type == MINUS) {
-            prev_type = type;
-            (*curr_tok)++;
-          } else {
-            break;
-          }
-        }
+  if (ntargets > 1) {
+    EmitStatement("{");
+    emit_depth++;
+    for (i = 0; i < ntargets; i++) {
+      if (offs[i]) {
+        EmitStatement("uint32_t offs%d = %s;", i, offs[i]);
+        offs[i] = EmitFormat("offs%d", i);
+      }
+    }
+    if (types[0] != VAR_STRING) {
+      EmitStatement("%s value = %s;", emit_kind_types[value.kind], value.c);
+      value.c = "value";
+    }
+  }
+  for (i = 0; i < ntargets; i++) {
+    if (offs[i]) {
+      names[i] = EmitFormat("%s[%s]", names[i], offs[i]);
+    }
+    if (types[0] == VAR_STRING) {
+      if (i == 0) {
+        EmitStatement("rt_set(&%s, %d%s);", names[0], nparts, parts);
       } else {
-        return rFAILURE; 
+        EmitStatement("rt_set(&%s, 1, %s);", names[i], names[0]);
       }
-    } while (*curr_tok < tokp);
-  } else {
-    return rFAILURE;
+    } else {
+      EmitStatement("%s = %s;", names[i], EmitStore(&value, types[i]));
+    }
+  }
+  if (ntargets > 1) {
+    emit_depth--;
+    EmitStatement("}");
   }
 
-  // 
-  expr_nest_level--;
-  DEBUG_PRINTF("final value: %d, 0x%x", *value, *value);
   return rSUCCESS;
 }
 
-static int StatementMempeek(uint32_t curr_tok)
+/**
+ *  @brief  FOR (see StatementFor()): a block holding the bounds, which are
+ *          evaluated once, and a do-while loop that EmitNext() closes.
+ */
+static int EmitFor(uint32_t curr_tok)
 {
-  // MEMPEEK Syntax
-  // MEMPEEK :== 'MEMPEEK'
-  int i;
-  if (curr_tok < tokp) {
-    THROW_ERROR("Invalid syntax; Usage: MEMPEEK", tokens[curr_tok].idx1 + 1);
+  emit_val_t value, limit, step;
+  const char *name;
+  int vloc, type, has_step = 0;
+
+  if (curr_tok >= tokp || tokens[curr_tok].type != VARIABLE) {
+    THROW_ERROR("Expecting VARIABLE", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  if ((vloc = VarLocation(curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  type = var_list[vloc].var_type;
+  if (!VAR_IS_DATA(type)) {
+    THROW_ERROR("Loop variable must be an integer", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (VAR_IS_WIDE(type)) {
+    THROW_ERROR("Loop variable must be 32 bits or narrower", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  if (var_list[vloc].loop_reg) {
+    THROW_ERROR("Loop variable already in use", tokens[curr_tok].idx1 + 1);
     return rFAILURE;
   }
+  curr_tok++;
 
-  // Show stack, var_list info.
-  CONSOLE_PRINTF("Stack Size: %d\n", sp);
-  for (i = 0; i < sp; i++) {
-    CONSOLE_PRINTF("stack[%d] = %d\n", i, stack[i]);
+  if (curr_tok >= tokp || tokens[curr_tok].type != EQUALS) {
+    THROW_ERROR("Expecting '='", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
   }
-  CONSOLE_PRINTF("Var List Size: %d\n", varp);
-  for (i = 0; i < varp; i++) {
-    CONSOLE_PRINTF("var_list[%d].name = %s\n", i, var_list[i].name);
-    CONSOLE_PRINTF("var_list[%d].addr = %u\n", i, var_list[i].addr);
-    CONSOLE_PRINTF("var_list[%d].size = %u\n", i, var_list[i].size_in_bytes);
-    CONSOLE_PRINTF("var_list[%d].len = %u\n", i, var_list[i].len);
-    CONSOLE_PRINTF("var_list[%d].type = %u\n", i, var_list[i].var_type);
-    CONSOLE_PRINTF("var_list[%d].subtype = %d\n", i, var_list[i].sub_var_type);
-    CONSOLE_PRINTF("var_list[%d].sub_size = %d\n", i, var_list[i].sub_size_in_bytes);
+  curr_tok++;
+  if (EmitNumber(&curr_tok, &value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (curr_tok >= tokp || tokens[curr_tok].type != KEYWORD
+        || tokens[curr_tok].aux != TO) {
+    THROW_ERROR("Expecting TO", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+  expr_nest_level = 0;
+  if (EmitNumber(&curr_tok, &limit) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (curr_tok < tokp && tokens[curr_tok].type == KEYWORD
+        && tokens[curr_tok].aux == STEP) {
+    curr_tok++;
+    expr_nest_level = 0;
+    if (EmitNumber(&curr_tok, &step) != rSUCCESS) {
+      return rFAILURE;
+    }
+    has_step = 1;
+  } else {
+    step.c = "1u";
+    step.kind = NUM_I32;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  loops[loopp++].vloc = vloc;
+  var_list[vloc].loop_reg = 1;
+  name = var_list[vloc].name;
+
+  EmitStatement("{");
+  emit_depth++;
+  EmitStatement("uint32_t for_value = %s;", EmitConvert(&value, NUM_U32));
+  // Bounds compare in 64 bits, the limit with the counter's signedness
+  EmitStatement("int64_t for_limit = (%s)%s;", VAR_IS_SIGNED(type) ? "int32_t" : "uint32_t",
+                EmitConvert(&limit, NUM_U32));
+  EmitStatement("int64_t for_step = (int32_t)%s;", EmitConvert(&step, NUM_U32));
+  EmitStatement("int64_t for_next;");
+  if (has_step) {
+    EmitStatement("if (for_step == 0) {");
+    EmitStatement("  rt_error(%u, \"STEP must be non-zero\");", line_count);
+    EmitStatement("}");
   }
+  EmitStatement("v_%s = (%s)for_value;", name, emit_var_types[type]);
+  EmitStatement("if (for_step > 0 ? (int64_t)v_%s <= for_limit : (int64_t)v_%s >= for_limit) {",
+                name, name);
+  emit_depth++;
+  EmitStatement("do {");
+  emit_depth++;
+
   return rSUCCESS;
 }
 
-static int VarIsList(uint32_t *curr_tok)
+/**
+ *  @brief  NEXT (see StatementNext()): step the variable of the innermost
+ *          FOR and close its loop.
+ */
+static int EmitNext(uint32_t curr_tok)
 {
-  // VAR_LIST :== VAR_DECLARATION {, VAR_DECLARATION}*
-  while ((*curr_tok) < tokp) {
-    if (VarIsDeclaration(curr_tok) == rSUCCESS) {
-      if ((*curr_tok) < tokp && tokens[*curr_tok].type == COMMA) {
-        (*curr_tok)++;
-        if ((*curr_tok) >= tokp) {
-          THROW_ERROR("Missing VARIABLE token", tokens[*curr_tok - 1].idx2 + 1);
-          return rFAILURE;
-        }
-      } else {
-        break;
-      }
-    } else {
+  int vloc = loops[loopp - 1].vloc;
+  const char *name = var_list[vloc].name;
+
+  if (curr_tok < tokp) {
+    if (tokens[curr_tok].type != VARIABLE || VarLocation(curr_tok) != vloc) {
+      THROW_ERROR("NEXT does not match FOR", tokens[curr_tok].idx1 + 1);
       return rFAILURE;
     }
+    curr_tok++;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
+    return rFAILURE;
   }
 
+  // The exact sum is tested so a narrow variable wrapping around exits
+  EmitStatement("for_next = (int64_t)v_%s + for_step;", name);
+  EmitStatement("v_%s = (%s)for_next;", name, emit_var_types[var_list[vloc].var_type]);
+  emit_depth--;
+  EmitStatement("} while (for_step > 0 ? for_next <= for_limit : for_next >= for_limit);");
+  emit_depth--;
+  EmitStatement("}");
+  emit_depth--;
+  EmitStatement("}");
+
+  var_list[vloc].loop_reg = 0;
+  loopp--;
   return rSUCCESS;
 }
 
-static int VarIsDeclaration(uint32_t *curr_tok)
+/**
+ *  @brief  IF (see StatementIf()); ELSE and END IF close its blocks.
+ */
+static int EmitIf(uint32_t curr_tok)
 {
-puts("VarIsDeclaraion");
-  // VAR_DECLARATION :== VARIABLE, [ '[', NUMBER, ']' ], [ '[', NUMBER, ']' ]
-  uint32_t ctok = *curr_tok;
-  int dim = 0;
+  emit_val_t value;
 
-  if (tokens[ctok++].type == VARIABLE) {
-    while (dim < MAX_ARRAY_DIM) {
-      if (ctok < tokp && tokens[ctok].type == OPEN_SQUARE_BRACKET) {
-        ctok++;
-        if (ctok < tokp && tokens[ctok].type == NUMBER) {
-          ctok++;
-          if (ctok < tokp && tokens[ctok].type == CLOSED_SQUARE_BRACKET) {
-            ctok++;
-          } else {
-            return rFAILURE;
-          }
-        } else {
-          return rFAILURE;
-        }
-        dim++;
-      } else {
-        break;
-      }
-    }
-  } else {
-    THROW_ERROR("Invalid VARIABLE token", tokens[*curr_tok].idx1 + 1);
+  if (EmitNumber(&curr_tok, &value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (curr_tok >= tokp || tokens[curr_tok].type != KEYWORD
+        || tokens[curr_tok].aux != THEN) {
+    THROW_ERROR("Expecting THEN", tokens[curr_tok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  curr_tok++;
+  if (curr_tok < tokp && tokens[curr_tok].type == OPERATOR
+        && linebuf[tokens[curr_tok].idx1] == ':') {
+    curr_tok++;
+  }
+  if (curr_tok < tokp) {
+    THROW_ERROR("Invalid syntax", tokens[curr_tok].idx1 + 1);
     return rFAILURE;
   }
 
-  //
-  *curr_tok = ctok;
+  EmitStatement("if (%s != 0) {", EmitConvert(&value, NUM_U32));
+  emit_depth++;
   return rSUCCESS;
 }
 
-static int VarIsType(uint32_t *curr_tok, int *type)
+/**
+ *  @brief  EXPRESSION (see ExprEvaluate()) as C.
+ */
+static int EmitNumber(uint32_t *curr_tok, emit_val_t *value)
 {
-  int var_type;
+  emit_val_t rhs;
 
-  if (tokens[*curr_tok].type != KEYWORD) {
-    THROW_ERROR("Expecting VAR_TYPE", tokens[*curr_tok].idx1 + 1);
+  if (++expr_nest_level >= MAX_EXPR_NEST_DEPTH) {
+    THROW_ERROR("Too many nested expressions", tokens[*curr_tok].idx1 + 1);
     return rFAILURE;
   }
-
-  switch ((var_type = ParseGetKeyword((*curr_tok)++))) {
-    case CHAR:
-      *type = (int)VAR_CHAR;
-      break;
-    case INT8:
-      *type = (int)VAR_INT8;
-      break;
-    case UINT8:
-      *type = (int)VAR_UINT8;
-      break;
-    case INT16:
-      *type = (int)VAR_INT16;
-      break;
-    case UINT16:
-      *type = (int)VAR_UINT16;
-      break;
-    case INT32:
-      *type = (int)VAR_INT32;
-      break;
-    case UINT32:
-      *type = (int)VAR_UINT32;
-      break;
-    case CHARPTR:
-      *type = (int)VAR_CHARPTR;
-      break;
-    case INT8PTR:
-      *type = (int)VAR_INT8PTR;
-      break;
-    case UINT8PTR:
-      *type = (int)VAR_UINT8PTR;
-      break;
-    case INT16PTR:
-      *type = (int)VAR_INT16PTR;
-      break;
-    case UINT16PTR:
-      *type = (int)VAR_UINT16PTR;
-      break;
-    case INT32PTR:
-      *type = (int)VAR_INT32PTR;
-      break;
-    case UINT32PTR:
-      *type = (int)VAR_UINT32PTR;
-      break;
-    default:
-      THROW_ERROR("Invalid VAR_TYPE", tokens[*curr_tok].idx1 + 1);
+  if (*curr_tok >= tokp || EmitLogic(curr_tok, value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  while (*curr_tok < tokp && tokens[*curr_tok].type == OPERATOR
+          && tokens[*curr_tok].aux == OP_LOR) {
+    (*curr_tok)++;
+    if (EmitLogic(curr_tok, &rhs) != rSUCCESS) {
       return rFAILURE;
+    }
+    // Both sides are always evaluated
+    value->c = EmitFormat("((uint32_t)((%s != 0) | (%s != 0)))", value->c, rhs.c);
+    value->kind = NUM_I32;
   }
 
+  expr_nest_level--;
   return rSUCCESS;
 }
 
-static int VarLocation(uint32_t curr_tok)
+static int EmitLogic(uint32_t *curr_tok, emit_val_t *value)
 {
-  int v;
-  for (v = 0; v < varp; v++) {
-    if (memcmp(linebuf + tokens[curr_tok].idx1, var_list[v].name,
-        tokens[curr_tok].idx2 - tokens[curr_tok].idx1) == 0) {
-      return v;
+  // LOGIC :== COMPARE { '&&' COMPARE }
+  emit_val_t rhs;
+
+  if (EmitCompare(curr_tok, value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  while (*curr_tok < tokp && tokens[*curr_tok].type == OPERATOR
+          && tokens[*curr_tok].aux == OP_LAND) {
+    (*curr_tok)++;
+    if (EmitCompare(curr_tok, &rhs) != rSUCCESS) {
+      return rFAILURE;
     }
+    value->c = EmitFormat("((uint32_t)((%s != 0) & (%s != 0)))", value->c, rhs.c);
+    value->kind = NUM_I32;
   }
- 
-  return -1;
+
+  return rSUCCESS;
 }
 
-static int VarGetValue(uint32_t curr_tok, uint32_t vloc)
+static int EmitCompare(uint32_t *curr_tok, emit_val_t *value)
 {
-  int i, vval, size;
-  if (var_list[vloc].var_type <= VAR_UINT32) {
-    // Data type (non-pointer)
-    size = var_type_sizes[var_list[vloc].var_type];
-    i = 0;
-    vval = 0;
-    while (size--) {
-      vval |= (stack[var_list[vloc].addr + i] & 0xFF) << (i << 3);
-      i++;
+  // COMPARE :== SUM [ RELOP SUM ] | STR_OBJ RELOP STR_OBJ
+  const char *s1, *s2, *cast;
+  num_kind_t kind;
+  emit_val_t rhs;
+  int op;
+
+  if (StrIsOperand(*curr_tok)) {
+    if (EmitStrOperand(curr_tok, &s1) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (*curr_tok >= tokp || tokens[*curr_tok].type != OPERATOR
+          || tokens[*curr_tok].aux < OP_EQ || tokens[*curr_tok].aux > OP_GE) {
+      THROW_ERROR("Expecting comparison operator",
+                  tokens[*curr_tok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    op = tokens[(*curr_tok)++].aux;
+    if (*curr_tok >= tokp || EmitStrOperand(curr_tok, &s2) != rSUCCESS) {
+      THROW_ERROR("Expecting STRING", tokens[*curr_tok - 1].idx2 + 1);
+      return rFAILURE;
     }
+    value->c = EmitFormat("((uint32_t)(rt_cmp(%s, %s) %s 0))", s1, s2,
+                          emit_relops[op - OP_EQ]);
+    value->kind = NUM_I32;
+    return rSUCCESS;
+  }
+
+  if (EmitSum(curr_tok, value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (*curr_tok >= tokp || tokens[*curr_tok].type != OPERATOR
+        || tokens[*curr_tok].aux < OP_EQ || tokens[*curr_tok].aux > OP_GE) {
+    return rSUCCESS;
+  }
+  op = tokens[(*curr_tok)++].aux;
+  if (EmitSum(curr_tok, &rhs) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (value->kind > NUM_U32 || rhs.kind > NUM_U32) {
+    // C's comparisons with a NaN are NumCompare()'s
+    kind = (value->kind > rhs.kind ? value->kind : rhs.kind);
+    value->c = EmitFormat("((uint32_t)(%s %s %s))", EmitConvert(value, kind),
+                          emit_relops[op - OP_EQ], EmitConvert(&rhs, kind));
   } else {
-    vval = 0;
+    // Unsigned if either side is, as in ExprIsCompare()
+    cast = (value->kind == NUM_U32 || rhs.kind == NUM_U32 ? "uint32_t" : "int32_t");
+    value->c = EmitFormat("((uint32_t)((%s)%s %s (%s)%s))", cast, value->c,
+                          emit_relops[op - OP_EQ], cast, rhs.c);
   }
+  value->kind = NUM_I32;
 
-  return vval;
+  return rSUCCESS;
 }
 
-static int ExprIsTerm(uint32_t *curr_tok, uint32_t *value)
+static int EmitSum(uint32_t *curr_tok, emit_val_t *value)
 {
-DEBUG_PRINTF("ExprIsTerm: curr_tok = %d", *curr_tok);
+  // SUM :== TERM { [+,-,&,|] TERM }
+  emit_val_t rhs;
+  uint32_t op_tok;
+  char op;
 
-  uint32_t temp_val;
-  int prev_type = -1;
+  if (EmitTerm(curr_tok, value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  while (*curr_tok < tokp) {
+    op_tok = *curr_tok;
+    if (tokens[op_tok].type == PLUS || tokens[op_tok].type == MINUS
+          || (tokens[op_tok].type == OPERATOR && (tokens[op_tok].aux == OP_BAND
+                || tokens[op_tok].aux == OP_BOR))) {
+      op = linebuf[tokens[op_tok].idx1];
+    } else {
+      break;
+    }
+    (*curr_tok)++;
+    if (EmitTerm(curr_tok, &rhs) != rSUCCESS
+          || EmitArith(value, op, &rhs, tokens[op_tok].idx1 + 1) != rSUCCESS) {
+      return rFAILURE;
+    }
+  }
 
-  // TERM :== FACTOR | FACTOR { [*,/,%] FACTOR }
-  if (*curr_tok < tokp) {
-    do {
-      if (ExprIsFactor(curr_tok, &temp_val) == rSUCCESS) {
-        switch (prev_type) {
-          case ASTERISK:
-            *value *= temp_val;
-            break;
-          case DIVIDE:
-            *value /= temp_val;
-            break;
-          case MOD:
-            *value %= temp_val;
-            break;
-          default:
-            *value = temp_val;
-            break;
-        }
+  return rSUCCESS;
+}
 
-        // Check [*,/,%] FACTOR
-        if (*curr_tok < tokp) {
-          if (tokens[*curr_tok].type == ASTERISK) {
-            (*curr_tok)++;
-            prev_type = ASTERISK;
-          } else if (tokens[*curr_tok].type == DIVIDE) {
-            (*curr_tok)++;
-            prev_type = DIVIDE;
-          } else if (tokens[*curr_tok].type == MOD) {
-            (*curr_tok)++;
-            prev_type = MOD;
-          } else {
-            break;
-          }
-        }
-      } else {
-        //THROW_ERROR("Invalid factor??", tokens[*curr_tok].idx1);
-        return rFAILURE;
-      }
-    } while (*curr_tok < tokp);
+static int EmitTerm(uint32_t *curr_tok, emit_val_t *value)
+{
+  // TERM :== FACTOR { [*,/,%] FACTOR }
+  emit_val_t rhs;
+  char op;
+
+  if (EmitFactor(curr_tok, value) != rSUCCESS) {
+    return rFAILURE;
+  }
+  while (*curr_tok < tokp && (tokens[*curr_tok].type == ASTERISK
+          || tokens[*curr_tok].type == DIVIDE || tokens[*curr_tok].type == MOD)) {
+    op = linebuf[tokens[(*curr_tok)++].idx1];
+    if (EmitFactor(curr_tok, &rhs) != rSUCCESS
+          || EmitArith(value, op, &rhs, tokens[*curr_tok - 1].idx1 + 1) != rSUCCESS) {
+      return rFAILURE;
+    }
   }
 
-printf("term val: %d\n", *value);
   return rSUCCESS;
 }
 
-static int ExprIsFactor(uint32_t *curr_tok, uint32_t *value)
+static int EmitFactor(uint32_t *curr_tok, emit_val_t *value)
 {
-DEBUG_PRINTF("ExprIsFactor: curr_tok = %d", *curr_tok);
-
-  // FACTOR :== NUMBER | [+,-] NUMBER | VARIABLE | [+,-] VARIABLE | '(' EXPRESSION ')'
-  uint32_t ctok = *curr_tok, temp;
-  int op_type = OPERATOR;
+  // FACTOR (see ExprIsFactor())
+  uint32_t ctok = *curr_tok, temp, len;
+  const char *name, *offs, *type_name;
+  uint64_t number;
+  int op_type = OPERATOR, type;
+  double d;
 
   switch (tokens[ctok].type) {
     case PLUS:
     case MINUS:
     case EXCLAIMATION:
     case TILDA:
-      op_type = tokens[ctok].type;
-      ctok++;
+      op_type = tokens[ctok++].type;
       break;
     default:
       break;
   }
+  if (ctok >= tokp) {
+    THROW_ERROR("Missing NUMBER, VARIABLE, or EXPRESSION", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
 
-  if (ctok < tokp) {
-    int type = tokens[ctok].type;
-    temp = ctok;
-    if (type == NUMBER) {
-      *value = ParseTokToNumber(ctok);
-      ctok++;
-    } else if (VarIsDeclaration(&temp) == rSUCCESS) {
-      int var_loc;
-      if ((var_loc = VarLocation(ctok)) >= 0) {
-        *value = VarGetValue(ctok, var_loc);
-        ctok = temp;
-      } else {
-        THROW_ERROR("Undefined variable", tokens[ctok].idx1 + 1);
-        return rFAILURE;
-      }
-    } else if (type == OPEN_PARENS) {
-      ctok++;
-      if (StatementExpression(&ctok, value) == rSUCCESS) {
-        if (tokens[ctok].type == CLOSED_PARENS) {
-          ctok++;
-        } else {
-          THROW_ERROR("Missing close parenthesis", tokens[ctok].idx1 + 1);
-          return rFAILURE;
-        }
-      } else {
-        return rFAILURE;
-      }
+  type = tokens[ctok].type;
+  temp = ctok;
+  if (type == NUMBER) {
+    // Typed as in ExprIsFactor()
+    number = ParseTokToNumber(ctok++);
+    if (number <= INT32_MAX) {
+      value->kind = NUM_I32;
+      value->c = EmitFormat("%uu", (uint32_t)number);
     } else {
-      THROW_ERROR("Expecting NUMBER, VARIABLE, or EXPRESSION", tokens[ctok].idx1 + 1);
+      value->kind = (number <= INT64_MAX ? NUM_I64 : NUM_U64);
+      value->c = EmitFormat("%s(%llu)", number <= INT64_MAX ? "INT64_C" : "UINT64_C",
+                            (unsigned long long)number);
+    }
+  } else if (type == FLOAT_NUMBER) {
+    // Written in hex so it reads back exactly
+    memcpy(&d, StrPoolGet(Literals(), tokens[ctok++].aux, &len), sizeof(double));
+    value->kind = NUM_F64;
+    value->c = (isinf(d) ? "HUGE_VAL" : EmitFormat("%a", d));
+  } else if (type == KEYWORD && tokens[ctok].aux == LEN) {
+    if (EmitStrLen(&ctok, &value->c) != rSUCCESS) {
+      return rFAILURE;
+    }
+    value->kind = NUM_I32;
+  } else if (type == KEYWORD && tokens[ctok].aux >= SUM && tokens[ctok].aux <= DOT) {
+    return EmitUnsupported(ctok);
+  } else if (VarIsAccess(&temp) == rSUCCESS) {
+    if (EmitAccess(&ctok, &name, &offs, &type) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (type == VAR_STRING) {
+      THROW_ERROR("Type mismatch: STRING in numeric expression",
+                  tokens[temp - 1].idx1 + 1);
+      return rFAILURE;
+    }
+    if (offs) {
+      name = EmitFormat("%s[%s]", name, offs);
+    }
+    // Narrow values widen to uint32_t (sign extended if signed)
+    value->kind = var_type_kinds[type];
+    value->c = (VAR_IS_WIDE(type) ? name : EmitFormat("((uint32_t)%s)", name));
+  } else if (type == OPEN_PARENS) {
+    ctok++;
+    if (EmitNumber(&ctok, value) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (ctok >= tokp || tokens[ctok].type != CLOSED_PARENS) {
+      THROW_ERROR("Missing close parenthesis", tokens[ctok < tokp ? ctok : tokp - 1].idx1 + 1);
       return rFAILURE;
     }
+    ctok++;
   } else {
-    THROW_ERROR("Missing NUMBER, VARIABLE, or EXPRESSION", tokens[ctok - 1].idx2 + 1);
+    THROW_ERROR("Expecting NUMBER, VARIABLE, or EXPRESSION", tokens[ctok].idx1 + 1);
     return rFAILURE;
   }
 
+  type_name = emit_kind_types[value->kind];
   switch (op_type) {
     case MINUS:
-      *value = -(*value);
+      if (value->kind >= NUM_F32) {
+        value->c = EmitFormat("(-%s)", value->c);
+      } else {
+        value->c = EmitFormat("((%s)(0 - (uint64_t)%s))", type_name, value->c);
+      }
       break;
     case EXCLAIMATION:
-      *value = !(*value);
+      value->c = EmitFormat("((uint32_t)!%s)", value->c);
+      value->kind = NUM_I32;
       break;
     case TILDA:
-      *value = ~(*value);
+      if (value->kind >= NUM_F32) {
+        THROW_ERROR("Type mismatch: '~' on a float", tokens[*curr_tok].idx1 + 1);
+        return rFAILURE;
+      }
+      value->c = EmitFormat("((%s)~(uint64_t)%s)", type_name, value->c);
       break;
     default:
       break;
   }
 
   *curr_tok = ctok;
-printf("factor val: %d\n", *value);
   return rSUCCESS;
 }
 
-static int32_t ConvertHexNumber(int idx1, int idx2)
+/**
+ *  @brief  a = a op b in C (op: + - & | * / or %), following ExprIsSum()
+ *          and ExprIsTerm() up to 32 bits and NumSum() and NumTerm() past
+ *          them.
+ *  @param  col Column for errors
+ */
+static int EmitArith(emit_val_t *a, char op, emit_val_t *b, uint32_t col)
 {
-  int result = 0;
-  int shift_amt = 0;
-  while (idx2-- != idx1) {
-    result += GetHexValue(linebuf[idx2]) << shift_amt;
-    shift_amt += 4;
+  num_kind_t kind;
+
+  if (a->kind <= NUM_U32 && b->kind <= NUM_U32) {
+    if (op == '/' || op == '%') {
+      a->c = EmitFormat("rt_%s32(%s, %s, %u)", op == '/' ? "div" : "mod",
+                        a->c, b->c, line_count);
+    } else {
+      a->c = EmitFormat("((uint32_t)(%s %c %s))", a->c, op, b->c);
+    }
+    a->kind |= b->kind; // U32 if either is
+    return rSUCCESS;
   }
-  return result;
+
+  kind = (a->kind > b->kind ? a->kind : b->kind);
+  if (kind >= NUM_F32) {
+    if (op == '%') {
+      THROW_ERROR("Type mismatch: '%' on a float", col);
+      return rFAILURE;
+    }
+    if (op == '&' || op == '|') {
+      THROW_ERROR("Type mismatch: bitwise operator on a float", col);
+      return rFAILURE;
+    }
+    a->c = EmitFormat("((%s)(%s %c %s))", emit_kind_types[kind], EmitConvert(a, kind),
+                      op, EmitConvert(b, kind));
+  } else if (op == '/' || op == '%') {
+    a->c = EmitFormat("rt_div%s64(%s, %s, %d, %u)", kind == NUM_U64 ? "u" : "i",
+                      EmitConvert(a, kind), EmitConvert(b, kind), op == '%', line_count);
+  } else {
+    // Integers wrap
+    a->c = EmitFormat("((%s)((uint64_t)%s %c (uint64_t)%s))", emit_kind_types[kind],
+                      EmitConvert(a, kind), op, EmitConvert(b, kind));
+  }
+  a->kind = kind;
+
+  return rSUCCESS;
 }
 
-static int32_t ConvertBinNumber(int idx1, int idx2)
+/**
+ *  @brief  NumConvert() in C: value's expression as one of kind. The
+ *          32-bit kinds are both uint32_t.
+ */
+static const char *EmitConvert(const emit_val_t *value, num_kind_t kind)
 {
-  int result = 0;
-  int shift_amt = 0;
-  while (idx2-- != idx1) {
-    result += (linebuf[idx2] - '0') << shift_amt;
-    shift_amt++;
+  num_kind_t from = value->kind;
+  const char *c = value->c;
+
+  if (from == kind || (from <= NUM_U32 && kind <= NUM_U32)) {
+    return c;
+  }
+
+  switch (kind) {
+    case NUM_I64:
+    case NUM_U64:
+      if (from >= NUM_F32) {
+        return EmitFormat("rt_f2%s64(%s)", kind == NUM_I64 ? "i" : "u", c);
+      }
+      return EmitFormat("((%s)%s%s)", emit_kind_types[kind],
+                        from == NUM_I32 ? "(int32_t)" : "", c);
+    case NUM_F32:
+    case NUM_F64:
+      // I64 to FLOAT32 goes by way of FLOAT64, as NumConvert() does
+      return EmitFormat("((%s)%s%s)", emit_kind_types[kind], from == NUM_I32
+                        ? "(int32_t)" : (kind == NUM_F32 && from == NUM_I64)
+                        ? "(double)" : "", c);
+    default:
+      if (from >= NUM_F32) {
+        return EmitFormat("((uint32_t)rt_f2i64(%s))", c);
+      }
+      return EmitFormat("((uint32_t)%s)", c);
   }
-  return result;
 }
 
-static int32_t ConvertDecNumber(int idx1, int idx2)
+/**
+ *  @brief  NumStore() in C: value as the type of the variable it's stored
+ *          in.
+ */
+static const char *EmitStore(const emit_val_t *value, int type)
 {
-  int result = 0;
-  int mult = 1;
-  while (idx2-- != idx1) {
-    result += (linebuf[idx2] - '0') * mult;
-    mult *= 10;
+  if (VAR_IS_WIDE(type)) {
+    return EmitConvert(value, var_type_kinds[type]);
   }
+  return EmitFormat("(%s)%s", emit_var_types[type], EmitConvert(value, NUM_U32));
+}
 
-  return result;
+/**
+ *  @brief  VarResolve() for the emitter: the C variable the VAR_ACCESS at
+ *          *curr_tok names, and for an array element its offset in
+ *          elements (else NULL). Indices are checked by rt_index() unless
+ *          ProgramCheckBounds() proved them.
+ *  @param  type  Receives the var_type_t of the value
+ */
+static int EmitAccess(uint32_t *curr_tok, const char **name, const char **offs,
+                      int *type)
+{
+  uint32_t ctok = *curr_tok + 1, open[MAX_ARRAY_DIM], n, k, bound, stride;
+  const char *index[MAX_ARRAY_DIM], *term;
+  const var_t *var;
+  emit_val_t value;
+  int vloc;
+
+  if ((vloc = VarLocation(*curr_tok)) < 0) {
+    THROW_ERROR("Undefined variable", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+  var = &var_list[vloc];
+  *name = EmitFormat("v_%s", var->name);
+  *offs = NULL;
+  *type = var->var_type;
+
+  if (ctok >= tokp || tokens[ctok].type != OPEN_SQUARE_BRACKET) {
+    // An array's address has no C counterpart
+    if (VAR_IS_PTR(var->var_type)) {
+      return EmitUnsupported(*curr_tok);
+    }
+    *curr_tok = ctok;
+    return rSUCCESS;
+  }
+  if (!VAR_IS_PTR(var->var_type)) {
+    THROW_ERROR("Variable is not a pointer", tokens[ctok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  for (n = 0; ctok < tokp && tokens[ctok].type == OPEN_SQUARE_BRACKET; n++) {
+    if (n == var->ndims) {
+      THROW_ERROR("Too many indices", tokens[ctok].idx1 + 1);
+      return rFAILURE;
+    }
+    open[n] = ctok++;
+    if (EmitNumber(&ctok, &value) != rSUCCESS) {
+      return rFAILURE;
+    }
+    if (ctok >= tokp || tokens[ctok].type != CLOSED_SQUARE_BRACKET) {
+      THROW_ERROR("Missing ']'", tokens[ctok - 1].idx2 + 1);
+      return rFAILURE;
+    }
+    index[n] = EmitConvert(&value, NUM_U32);
+    ctok++;
+  }
+  if (n != var->ndims && n != 1) {
+    THROW_ERROR("Wrong number of indices", tokens[ctok - 1].idx1 + 1);
+    return rFAILURE;
+  }
+
+  for (k = 0; k < n; k++) {
+    bound = (n == var->ndims ? var->dims[k] : var->len);
+    stride = (n == var->ndims ? var->strides[k] : var->sub_size_in_bytes)
+               / var->sub_size_in_bytes;
+    term = index[k];
+    if (tokens[open[k]].aux != 1) {
+      term = EmitFormat("rt_index(%s, %uu, %u)", term, bound, line_count);
+    }
+    if (stride != 1) {
+      term = EmitFormat("%s * %uu", term, stride);
+    }
+    *offs = (k == 0 ? term : EmitFormat("%s + %s", *offs, term));
+  }
+  *type = var->sub_var_type;
+
+  *curr_tok = ctok;
+  return rSUCCESS;
 }
 
-static int32_t GetHexValue(char ch)
+/**
+ *  @brief  STR_OBJ (see StrOperand()) as an rt_str_t expression.
+ */
+static int EmitStrOperand(uint32_t *curr_tok, const char **str)
 {
-  if (LexIsDigit(ch)) {
-    return ch - '0';
+  const char *lit;
+  uint32_t len;
+  int vloc;
+
+  if (tokens[*curr_tok].type == KEYWORD && tokens[*curr_tok].aux == MID) {
+    return EmitStrMid(curr_tok, str);
+  } else if (tokens[*curr_tok].type == STRING) {
+    lit = StrPoolGet(Literals(), tokens[*curr_tok].aux, &len);
+    *str = EmitFormat("rt_lit(%s, %u)", EmitLiteral(lit, len), len);
+  } else if (tokens[*curr_tok].type == VARIABLE
+              && (vloc = VarLocation(*curr_tok)) >= 0
+              && var_list[vloc].var_type == VAR_STRING) {
+    *str = EmitFormat("v_%s", var_list[vloc].name);
   } else {
-    if ('A' <= ch && ch <= 'F') {
-      return ch - 'A' + 10;
+    THROW_ERROR("Expecting STRING", tokens[*curr_tok].idx1 + 1);
+    return rFAILURE;
+  }
+
+  (*curr_tok)++;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  MID (see StrMid()) as an rt_str_t expression.
+ */
+static int EmitStrMid(uint32_t *curr_tok, const char **str)
+{
+  // MID :== 'MID' '(' STR_OBJ ',' EXPRESSION [ ',' EXPRESSION ] ')'
+  uint32_t ctok = *curr_tok + 1;
+  const char *count = "0u";
+  emit_val_t start, value;
+  int has_count = 0;
+
+  if (ctok + 1 >= tokp || tokens[ctok].type != OPEN_PARENS) {
+    THROW_ERROR("Expecting (", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  ctok++;
+  if (EmitStrOperand(&ctok, str) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (ctok >= tokp || tokens[ctok].type != COMMA) {
+    THROW_ERROR("Expecting ,", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  ctok++;
+  if (EmitNumber(&ctok, &start) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (ctok < tokp && tokens[ctok].type == COMMA) {
+    ctok++;
+    has_count = 1;
+    if (EmitNumber(&ctok, &value) != rSUCCESS) {
+      return rFAILURE;
+    }
+    count = EmitConvert(&value, NUM_U32);
+  }
+  if (ctok >= tokp || tokens[ctok].type != CLOSED_PARENS) {
+    THROW_ERROR("Missing close parenthesis", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+
+  *str = EmitFormat("rt_mid(%s, %s, %d, %s, %u)", *str, EmitConvert(&start, NUM_U32),
+                    has_count, count, line_count);
+  *curr_tok = ctok + 1;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  LEN (see StrLen()) as a uint32_t expression.
+ */
+static int EmitStrLen(uint32_t *curr_tok, const char **value)
+{
+  // LEN :== 'LEN' '(' STR_OBJ ')'
+  uint32_t ctok = *curr_tok + 1;
+  const char *str;
+
+  if (ctok + 1 >= tokp || tokens[ctok].type != OPEN_PARENS) {
+    THROW_ERROR("Expecting (", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+  ctok++;
+  if (EmitStrOperand(&ctok, &str) != rSUCCESS) {
+    return rFAILURE;
+  }
+  if (ctok >= tokp || tokens[ctok].type != CLOSED_PARENS) {
+    THROW_ERROR("Missing close parenthesis", tokens[ctok - 1].idx2 + 1);
+    return rFAILURE;
+  }
+
+  *value = EmitFormat("rt_len(%s)", str);
+  *curr_tok = ctok + 1;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  The len bytes at str as a C string literal. Anything but
+ *          printable ASCII is escaped in octal.
+ */
+static const char *EmitLiteral(const char *str, uint32_t len)
+{
+  char *out, *p;
+  uint32_t i;
+  uint8_t ch;
+
+  if ((out = p = ArenaAlloc(&front_arena, 4 * (size_t)len + 3)) == NULL) {
+    emit_oom = 1;
+    return "\"\"";
+  }
+  *p++ = '"';
+  for (i = 0; i < len; i++) {
+    ch = str[i];
+    if (ch == '"' || ch == '\\' || ch == '?') {
+      // '?' so no trigraph is formed
+      *p++ = '\\';
+      *p++ = ch;
+    } else if (ch >= ' ' && ch <= '~') {
+      *p++ = ch;
     } else {
-      return ch - 'a' + 10;
+      p += sprintf(p, "\\%03o", ch);
     }
   }
+  *p++ = '"';
+  *p = '\0';
+  return out;
 }
 
-static uint16_t GetPointerValue(int vloc)
+/**
+ *  @brief  printf() into the front end arena (reset after every line).
+ *          On running out of memory it's "", and emit_oom is set.
+ */
+static const char *EmitFormat(const char *fmt, ...)
 {
-  uint16_t addr;
+  va_list ap;
+  char *out;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  if ((out = ArenaAlloc(&front_arena, len + 1)) == NULL) {
+    emit_oom = 1;
+    return "";
+  }
+  va_start(ap, fmt);
+  vsnprintf(out, len + 1, fmt, ap);
+  va_end(ap);
+  return out;
+}
 
-  addr = stack[var_list[vloc].addr] & 0xFF;
-  addr += (stack[var_list[vloc].addr + 1] << 8) & 0xFF00;
-  
-  return addr;
+/**
+ *  @brief  Write a line of main()'s body, indented to the block depth.
+ */
+static void EmitStatement(const char *fmt, ...)
+{
+  va_list ap;
+
+  fprintf(emit_body, "%*s", 2 * emit_depth, "");
+  va_start(ap, fmt);
+  vfprintf(emit_body, fmt, ap);
+  va_end(ap);
+  fputc('\n', emit_body);
+}
+
+static int EmitUnsupported(uint32_t tok)
+{
+  THROW_ERROR("Not supported by --emit-c", tokens[tok].idx1 + 1);
+  return rFAILURE;
 }
 
 #if DEBUG >= 1
@@ -1438,6 +7741,9 @@ static void debug_print_type(token_type_t type)
     case NUMBER:
       printf("Number");
       break;
+    case FLOAT_NUMBER:
+      printf("Float");
+      break;
     case STRING:
       printf("String");
       break;
@@ -1465,6 +7771,9 @@ static void debug_print_type(token_type_t type)
     case COMMA:
       printf("Comma");
       break;
+    case SEMICOLON:
+      printf("Semicolon");
+      break;
     case OPEN_SQUARE_BRACKET:
       printf("Open Square Bracket");
       break;
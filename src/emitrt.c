@@ -0,0 +1,270 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+#include "emitrt.h"
+
+/* Constants ---------------------------------------------------------------- */
+// Support code every translated script starts with. Values follow the
+// interpreter's: 32-bit arithmetic wraps in uint32_t, errors end the
+// program with the interpreter's message, and PRINT builds its line
+// before writing any of it.
+static const char emit_runtime[] =
+  "#include <math.h>\n"
+  "#include <stdarg.h>\n"
+  "#include <stdint.h>\n"
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "#include <string.h>\n"
+  "\n"
+  "#if defined(__GNUC__)\n"
+  "#define RT static __attribute__((unused))\n"
+  "#else\n"
+  "#define RT static\n"
+  "#endif\n"
+  "\n"
+  "/* STRING value: len bytes at p (not NUL terminated) */\n"
+  "typedef struct {\n"
+  "  const char *p;\n"
+  "  uint32_t len;\n"
+  "} rt_str_t;\n"
+  "\n"
+  "/* Output of the PRINT statement being run; written at its end */\n"
+  "static char *rt_out;\n"
+  "static uint32_t rt_out_len, rt_out_cap;\n"
+  "\n"
+  "RT void rt_error(int line, const char *msg)\n"
+  "{\n"
+  "  fflush(stdout);\n"
+  "  if (line) {\n"
+  "    fprintf(stderr, \"Error: Line: %d: %s\\n\", line, msg);\n"
+  "  } else {\n"
+  "    fprintf(stderr, \"Error: %s\\n\", msg);\n"
+  "  }\n"
+  "  exit(1);\n"
+  "}\n"
+  "\n"
+  "RT char *rt_reserve(uint32_t n)\n"
+  "{\n"
+  "  while (rt_out_len + n > rt_out_cap) {\n"
+  "    rt_out_cap = (rt_out_cap ? rt_out_cap * 2 : 256);\n"
+  "    if ((rt_out = realloc(rt_out, rt_out_cap)) == NULL) {\n"
+  "      rt_error(0, \"Out of memory\");\n"
+  "    }\n"
+  "  }\n"
+  "  return rt_out + rt_out_len;\n"
+  "}\n"
+  "\n"
+  "RT void rt_put(rt_str_t s)\n"
+  "{\n"
+  "  if (s.len) {\n"
+  "    memcpy(rt_reserve(s.len), s.p, s.len);\n"
+  "    rt_out_len += s.len;\n"
+  "  }\n"
+  "}\n"
+  "\n"
+  "RT void rt_put_char(uint8_t c)\n"
+  "{\n"
+  "  *rt_reserve(1) = (char)c;\n"
+  "  rt_out_len++;\n"
+  "}\n"
+  "\n"
+  "RT void rt_put_int(int64_t v)\n"
+  "{\n"
+  "  rt_out_len += sprintf(rt_reserve(24), \"%lld\", (long long)v);\n"
+  "}\n"
+  "\n"
+  "RT void rt_put_uint(uint64_t v)\n"
+  "{\n"
+  "  rt_out_len += sprintf(rt_reserve(24), \"%llu\", (unsigned long long)v);\n"
+  "}\n"
+  "\n"
+  "/* Shortest %g that reads back as the same value (as PRINT does) */\n"
+  "RT void rt_put_float(double v, int single)\n"
+  "{\n"
+  "  int prec = (single ? 6 : 15), last = (single ? 9 : 17), len;\n"
+  "  char *out = rt_reserve(33);\n"
+  "\n"
+  "  for (;; prec++) {\n"
+  "    len = snprintf(out, 33, \"%.*g\", prec, v);\n"
+  "    if (prec == last || (single ? (float)strtod(out, NULL) == (float)v\n"
+  "                                : strtod(out, NULL) == v)) {\n"
+  "      break;\n"
+  "    }\n"
+  "  }\n"
+  "  rt_out_len += len;\n"
+  "}\n"
+  "\n"
+  "RT void rt_put_end(void)\n"
+  "{\n"
+  "  *rt_reserve(1) = '\\n';\n"
+  "  fwrite(rt_out, 1, rt_out_len + 1, stdout);\n"
+  "  rt_out_len = 0;\n"
+  "}\n"
+  "\n"
+  "RT uint32_t rt_div32(uint32_t a, uint32_t b, int line)\n"
+  "{\n"
+  "  if (b == 0) {\n"
+  "    rt_error(line, \"Division by zero\");\n"
+  "  }\n"
+  "  return a / b;\n"
+  "}\n"
+  "\n"
+  "RT uint32_t rt_mod32(uint32_t a, uint32_t b, int line)\n"
+  "{\n"
+  "  if (b == 0) {\n"
+  "    rt_error(line, \"Division by zero\");\n"
+  "  }\n"
+  "  return a % b;\n"
+  "}\n"
+  "\n"
+  "/* INT64 division; INT64_MIN / -1 wraps */\n"
+  "RT int64_t rt_divi64(int64_t a, int64_t b, int mod, int line)\n"
+  "{\n"
+  "  if (b == 0) {\n"
+  "    rt_error(line, \"Division by zero\");\n"
+  "  }\n"
+  "  if (b == -1) {\n"
+  "    return (mod ? 0 : (int64_t)(0 - (uint64_t)a));\n"
+  "  }\n"
+  "  return (mod ? a % b : a / b);\n"
+  "}\n"
+  "\n"
+  "RT uint64_t rt_divu64(uint64_t a, uint64_t b, int mod, int line)\n"
+  "{\n"
+  "  if (b == 0) {\n"
+  "    rt_error(line, \"Division by zero\");\n"
+  "  }\n"
+  "  return (mod ? a % b : a / b);\n"
+  "}\n"
+  "\n"
+  "/* Float to integer: rounded toward zero, saturating, NaN is 0 */\n"
+  "RT int64_t rt_f2i64(double d)\n"
+  "{\n"
+  "  if (d != d) {\n"
+  "    return 0;\n"
+  "  }\n"
+  "  if (d >= 9223372036854775808.0) {\n"
+  "    return INT64_MAX;\n"
+  "  }\n"
+  "  if (d < -9223372036854775808.0) {\n"
+  "    return INT64_MIN;\n"
+  "  }\n"
+  "  return (int64_t)d;\n"
+  "}\n"
+  "\n"
+  "RT uint64_t rt_f2u64(double d)\n"
+  "{\n"
+  "  if (!(d > 0)) {\n"
+  "    return 0;\n"
+  "  }\n"
+  "  if (d >= 18446744073709551616.0) {\n"
+  "    return UINT64_MAX;\n"
+  "  }\n"
+  "  return (uint64_t)d;\n"
+  "}\n"
+  "\n"
+  "RT uint32_t rt_index(uint32_t i, uint32_t bound, int line)\n"
+  "{\n"
+  "  if (i >= bound) {\n"
+  "    rt_error(line, \"Index out of bounds\");\n"
+  "  }\n"
+  "  return i;\n"
+  "}\n"
+  "\n"
+  "RT rt_str_t rt_lit(const char *p, uint32_t len)\n"
+  "{\n"
+  "  rt_str_t s;\n"
+  "\n"
+  "  s.p = p;\n"
+  "  s.len = len;\n"
+  "  return s;\n"
+  "}\n"
+  "\n"
+  "/* dst = the n rt_str_t arguments joined (they may include dst) */\n"
+  "RT void rt_set(rt_str_t *dst, int n, ...)\n"
+  "{\n"
+  "  va_list ap;\n"
+  "  rt_str_t s;\n"
+  "  uint32_t len = 0;\n"
+  "  char *p;\n"
+  "  int i;\n"
+  "\n"
+  "  va_start(ap, n);\n"
+  "  for (i = 0; i < n; i++) {\n"
+  "    len += va_arg(ap, rt_str_t).len;\n"
+  "  }\n"
+  "  va_end(ap);\n"
+  "  if ((p = malloc(len + 1)) == NULL) {\n"
+  "    rt_error(0, \"Out of memory\");\n"
+  "  }\n"
+  "  va_start(ap, n);\n"
+  "  for (len = 0, i = 0; i < n; i++) {\n"
+  "    if ((s = va_arg(ap, rt_str_t)).len) {\n"
+  "      memcpy(p + len, s.p, s.len);\n"
+  "      len += s.len;\n"
+  "    }\n"
+  "  }\n"
+  "  va_end(ap);\n"
+  "  free((char *)dst->p);\n"
+  "  dst->p = p;\n"
+  "  dst->len = len;\n"
+  "}\n"
+  "\n"
+  "/* Characters are UTF-8 sequences: bytes that aren't 10xxxxxx start one */\n"
+  "RT uint32_t rt_utf8_offset(rt_str_t s, uint32_t n)\n"
+  "{\n"
+  "  uint32_t i;\n"
+  "\n"
+  "  for (i = 0; i < s.len; i++) {\n"
+  "    if ((s.p[i] & 0xC0) != 0x80 && n-- == 0) {\n"
+  "      return i;\n"
+  "    }\n"
+  "  }\n"
+  "  return s.len;\n"
+  "}\n"
+  "\n"
+  "RT uint32_t rt_len(rt_str_t s)\n"
+  "{\n"
+  "  uint32_t i, n = 0;\n"
+  "\n"
+  "  for (i = 0; i < s.len; i++) {\n"
+  "    n += ((s.p[i] & 0xC0) != 0x80);\n"
+  "  }\n"
+  "  return n;\n"
+  "}\n"
+  "\n"
+  "RT rt_str_t rt_mid(rt_str_t s, uint32_t start, int has_count, uint32_t count,\n"
+  "                   int line)\n"
+  "{\n"
+  "  uint32_t skip;\n"
+  "\n"
+  "  if ((int32_t)start < 1 || (int32_t)count < 0) {\n"
+  "    rt_error(line, \"MID argument out of range\");\n"
+  "  }\n"
+  "  skip = rt_utf8_offset(s, start - 1);\n"
+  "  s.p += skip;\n"
+  "  s.len -= skip;\n"
+  "  if (has_count) {\n"
+  "    s.len = rt_utf8_offset(s, count);\n"
+  "  }\n"
+  "  return s;\n"
+  "}\n"
+  "\n"
+  "RT int32_t rt_cmp(rt_str_t a, rt_str_t b)\n"
+  "{\n"
+  "  uint32_t n = (a.len < b.len ? a.len : b.len);\n"
+  "  int32_t cmp = (n ? memcmp(a.p, b.p, n) : 0);\n"
+  "\n"
+  "  return (cmp ? cmp : (int32_t)a.len - (int32_t)b.len);\n"
+  "}\n";
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Write the run-time support code to out.
+ */
+void EmitRtWrite(FILE *out)
+{
+  fputs(emit_runtime, out);
+}
+
+/**************************************************************** END OF FILE */
@@ -0,0 +1,113 @@
+
+/* Includes ----------------------------------------------------------------- */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "basic.h"
+#include "fileio.h"
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Make f a closed file.
+ */
+void FileInit(file_t *f)
+{
+  f->fd = -1;
+  f->readable = f->writable = 0;
+}
+
+/**
+ *  @brief  Open a file. The mode is one of "r" (read), "w" (write,
+ *          created or emptied), "a" (append, created) or "r+" (read and
+ *          write an existing file).
+ *  @param  mode_len  Length of mode (it needn't be NUL terminated)
+ *  @return rFAILURE if the mode is unknown or the file can't be opened.
+ */
+int FileOpen(file_t *f, const char *path, const char *mode, uint32_t mode_len)
+{
+  static const struct {
+    const char *name;
+    int         flags;
+  } modes[] = {
+    { "r",  O_RDONLY },
+    { "w",  O_WRONLY | O_CREAT | O_TRUNC },
+    { "a",  O_WRONLY | O_CREAT | O_APPEND },
+    { "r+", O_RDWR }
+  };
+  uint32_t i;
+
+  FileInit(f);
+  for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+    if (strlen(modes[i].name) == mode_len
+          && memcmp(modes[i].name, mode, mode_len) == 0) {
+      break;
+    }
+  }
+  if (i == sizeof(modes) / sizeof(modes[0])
+        || (f->fd = open(path, modes[i].flags, 0644)) < 0) {
+    return rFAILURE;
+  }
+
+  f->readable = ((modes[i].flags & O_ACCMODE) != O_WRONLY);
+  f->writable = ((modes[i].flags & O_ACCMODE) != O_RDONLY);
+  return rSUCCESS;
+}
+
+void FileClose(file_t *f)
+{
+  if (f->fd >= 0) {
+    close(f->fd);
+  }
+  FileInit(f);
+}
+
+/**
+ *  @brief  Read n bytes straight into buf. The whole range is asked for
+ *          at once; the kernel only splits it up near the end of the file
+ *          (or for a pipe).
+ *  @param  done  Receives the bytes read, less than n at the end of file
+ */
+int FileRead(file_t *f, void *buf, uint32_t n, uint32_t *done)
+{
+  ssize_t r;
+
+  for (*done = 0; *done < n; *done += r) {
+    if ((r = read(f->fd, (char *)buf + *done, n - *done)) < 0) {
+      if (errno == EINTR) {
+        r = 0;
+        continue;
+      }
+      return rFAILURE;
+    }
+    if (r == 0) {
+      break;
+    }
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Write n bytes from buf, in as few calls as the kernel allows.
+ */
+int FileWrite(file_t *f, const void *buf, uint32_t n)
+{
+  ssize_t r;
+  uint32_t done;
+
+  for (done = 0; done < n; done += r) {
+    if ((r = write(f->fd, (const char *)buf + done, n - done)) < 0) {
+      if (errno == EINTR) {
+        r = 0;
+        continue;
+      }
+      return rFAILURE;
+    }
+  }
+
+  return rSUCCESS;
+}
+
+/**************************************************************** END OF FILE */
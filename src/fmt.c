@@ -0,0 +1,264 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "basic.h"
+#include "fmt.h"
+
+/* Constants ---------------------------------------------------------------- */
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Parse a PRINT USING format string into a template.
+ *          Fields are %[-][0][width]conv where conv is one of
+ *          d (signed), u (unsigned), x/X (hex), b (binary), c (char)
+ *          or s (STRING); %% is a literal percent sign.
+ *  @param  t       Receives the compiled template
+ *  @param  fmt     Format string (not NUL terminated)
+ *  @param  len     Length of the format string
+ *  @param  err_idx Receives the offset of the offending character on error
+ */
+int FmtCompile(fmt_template_t *t, const char *fmt, uint32_t len, uint32_t *err_idx)
+{
+  fmt_segment_t *seg;
+  uint32_t i = 0, start, width;
+
+  memset(t, 0, sizeof(fmt_template_t));
+  while (i < len) {
+    if (t->nsegments == FMT_MAX_SEGMENTS) {
+      *err_idx = i;
+      return rFAILURE;
+    }
+    seg = &t->segments[t->nsegments++];
+
+    if (fmt[i] != '%' || (i + 1 < len && fmt[i + 1] == '%')) {
+      // Literal text, up to the next field. A "%%" contributes one '%'.
+      start = i;
+      if (fmt[i] == '%') {
+        start = ++i;
+      }
+      for (i++; i < len && fmt[i] != '%'; i++) {
+      }
+      seg->offs = start;
+      seg->len = i - start;
+      continue;
+    }
+
+    // Field
+    start = i++;
+    for (; i < len && (fmt[i] == '-' || fmt[i] == '0'); i++) {
+      seg->flags |= (fmt[i] == '-' ? FMT_FLAG_LEFT : FMT_FLAG_ZERO);
+    }
+    for (width = 0; i < len && fmt[i] >= '0' && fmt[i] <= '9'; i++) {
+      width = width * 10 + fmt[i] - '0';
+      if (width > FMT_MAX_WIDTH) {
+        *err_idx = i;
+        return rFAILURE;
+      }
+    }
+    if (i == len || !strchr("duxXbcs", fmt[i])) {
+      *err_idx = (i < len ? i : start);
+      return rFAILURE;
+    }
+    seg->conv = fmt[i++];
+    seg->width = width;
+    t->nfields++;
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Write the decimal digits of v, two digits per step.
+ *  @return Number of characters written (no NUL terminator).
+ */
+uint32_t FmtUnsigned(char *out, uint32_t v)
+{
+  char buf[10], *p = buf + sizeof(buf);
+  uint32_t q, len;
+
+  while (v >= 100) {
+    q = v / 100;
+    p -= 2;
+    memcpy(p, digit_pairs + (v - q * 100) * 2, 2);
+    v = q;
+  }
+  if (v >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + v * 2, 2);
+  } else {
+    *--p = '0' + v;
+  }
+
+  len = buf + sizeof(buf) - p;
+  memcpy(out, p, len);
+  return len;
+}
+
+uint32_t FmtSigned(char *out, int32_t v)
+{
+  if (v < 0) {
+    *out = '-';
+    return 1 + FmtUnsigned(out + 1, 0u - (uint32_t)v);
+  }
+
+  return FmtUnsigned(out, v);
+}
+
+/**
+ *  @brief  FmtUnsigned() for 64-bit values: the low digits are peeled off
+ *          in pairs until the rest fits 32 bits.
+ */
+uint32_t FmtUnsigned64(char *out, uint64_t v)
+{
+  char buf[20], *p = buf + sizeof(buf);
+  uint64_t q;
+  uint32_t len;
+
+  while (v > UINT32_MAX) {
+    q = v / 100;
+    p -= 2;
+    memcpy(p, digit_pairs + (v - q * 100) * 2, 2);
+    v = q;
+  }
+
+  len = FmtUnsigned(out, (uint32_t)v);
+  memcpy(out + len, p, buf + sizeof(buf) - p);
+  return len + (buf + sizeof(buf) - p);
+}
+
+uint32_t FmtSigned64(char *out, int64_t v)
+{
+  if (v < 0) {
+    *out = '-';
+    return 1 + FmtUnsigned64(out + 1, 0u - (uint64_t)v);
+  }
+
+  return FmtUnsigned64(out, v);
+}
+
+/**
+ *  @brief  Write v as %g with the fewest digits, from 15 up to 17 (6 up to
+ *          9 if single), that read back as v; e.g. 0.1 prints as 0.1. out
+ *          must have room for FMT_INT_MAX_LEN characters and a NUL.
+ *  @return Number of characters written (the NUL not counted).
+ */
+uint32_t FmtFloat(char *out, double v, int single)
+{
+  int prec = (single ? 6 : 15), last = (single ? 9 : 17), len;
+
+  for (;; prec++) {
+    len = snprintf(out, FMT_INT_MAX_LEN + 1, "%.*g", prec, v);
+    if (prec == last || (single ? (float)strtod(out, NULL) == (float)v
+                                : strtod(out, NULL) == v)) {
+      return len;
+    }
+  }
+}
+
+uint32_t FmtHex(char *out, uint32_t v, int upper)
+{
+  const char *digits = (upper ? hex_upper : hex_lower);
+  uint32_t len = (v ? (35 - __builtin_clz(v)) >> 2 : 1), i;
+
+  for (i = len; i--; v >>= 4) {
+    out[i] = digits[v & 0xF];
+  }
+  return len;
+}
+
+uint32_t FmtBin(char *out, uint32_t v)
+{
+  uint32_t len = (v ? 32 - __builtin_clz(v) : 1), i;
+
+  for (i = len; i--; v >>= 1) {
+    out[i] = '0' + (v & 1);
+  }
+  return len;
+}
+
+/**
+ *  @brief  Write len characters justified in the segment's field width.
+ *          Zero padding goes after a leading minus sign.
+ *  @return Number of characters written.
+ */
+uint32_t FmtPad(char *out, const char *digits, uint32_t len, const fmt_segment_t *seg)
+{
+  uint32_t pad = (seg->width > len ? seg->width - len : 0);
+  char *p = out;
+
+  if (seg->flags & FMT_FLAG_LEFT) {
+    memcpy(p, digits, len);
+    memset(p + len, ' ', pad);
+  } else if ((seg->flags & FMT_FLAG_ZERO) && seg->conv != 's' && seg->conv != 'c') {
+    if (len && *digits == '-') {
+      *p++ = *digits++;
+      len--;
+    }
+    memset(p, '0', pad);
+    memcpy(p + pad, digits, len);
+  } else {
+    memset(p, ' ', pad);
+    memcpy(p + pad, digits, len);
+  }
+
+  return (p - out) + pad + len;
+}
+
+/**
+ *  @brief  Format up to 16 bytes as one hexdump line, e.g.
+ *          "00000200  48 65 6c 6c 6f 00 ...  |Hello.|\n"
+ *  @param  addr  Address of the first byte
+ *  @return Number of characters written (at most FMT_HEXDUMP_LINE_LEN).
+ */
+uint32_t FmtHexDumpLine(char *out, uint32_t addr, const uint8_t *bytes, uint32_t n)
+{
+  char *p = out;
+  uint32_t i;
+
+  for (i = 8; i--; addr >>= 4) {
+    p[i] = hex_lower[addr & 0xF];
+  }
+  p += 8;
+  *p++ = ' ';
+  for (i = 0; i < 16; i++) {
+    *p++ = ' ';
+    if (i == 8) {
+      *p++ = ' ';
+    }
+    if (i < n) {
+      *p++ = hex_lower[bytes[i] >> 4];
+      *p++ = hex_lower[bytes[i] & 0xF];
+    } else {
+      *p++ = ' ';
+      *p++ = ' ';
+    }
+  }
+  *p++ = ' ';
+  *p++ = ' ';
+  *p++ = '|';
+  for (i = 0; i < n; i++) {
+    *p++ = (bytes[i] >= 0x20 && bytes[i] < 0x7F ? bytes[i] : '.');
+  }
+  *p++ = '|';
+  *p++ = '\n';
+
+  return p - out;
+}
+
+/**************************************************************** END OF FILE */
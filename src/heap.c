@@ -0,0 +1,149 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+#include <string.h>
+#include "basic.h"
+#include "heap.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define HDR_READ(h, a) \
+  ((uint16_t)((h)->mem[(a)] | ((h)->mem[(a) + 1] << 8)))
+
+#define HDR_WRITE(h, a, v) \
+  do { \
+    (h)->mem[(a)] = (v) & 0xFF; \
+    (h)->mem[(a) + 1] = ((v) >> 8) & 0xFF; \
+  } while (0);
+
+// Bit of the live map for the block at heap offset o (a granule multiple)
+#define LIVE_BYTE(h, o)       ((h)->live[(o) / HEAP_MIN_BLOCK / 8])
+#define LIVE_BIT(o)           (1u << ((o) / HEAP_MIN_BLOCK % 8))
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Set up an empty heap over mem[base, base + size).
+ *  @param  h     Heap to initialize
+ *  @param  mem   Base of the interpreter's memory
+ *  @param  base  First address owned by the heap (must be non-zero)
+ *  @param  size  Number of bytes owned by the heap
+ */
+void HeapInit(heap_t *h, uint8_t *mem, uint16_t base, uint16_t size)
+{
+  memset(h, 0, sizeof(heap_t));
+  h->mem = mem;
+  h->base = base;
+  h->end = base + size;
+  h->brk = base;
+}
+
+/**
+ *  @brief  Size class that holds a payload of nbytes, or -1 if too large.
+ *          Classes are powers of two, so this is a single bit scan.
+ *  @param  nbytes  Requested payload size
+ */
+int HeapClassOf(uint16_t nbytes)
+{
+  uint32_t total = (uint32_t)nbytes + HEAP_HDR_SIZE;
+  int c;
+
+  if (total <= HEAP_MIN_BLOCK) {
+    return 0;
+  }
+
+  // Index of the highest set bit of (total - 1), rebased to HEAP_MIN_BLOCK
+  c = 32 - __builtin_clz(total - 1) - __builtin_ctz(HEAP_MIN_BLOCK);
+  return (c < HEAP_NUM_CLASSES ? c : -1);
+}
+
+/**
+ *  @brief  Block size (header included) of the given size class.
+ */
+uint16_t HeapClassSize(int c)
+{
+  return HEAP_MIN_BLOCK << c;
+}
+
+/**
+ *  @brief  Allocate nbytes from the heap.
+ *          Reuses the head of the size class free list when possible,
+ *          otherwise carves a fresh block from the untouched region.
+ *  @param  h       Heap to allocate from
+ *  @param  nbytes  Requested payload size
+ *  @return Address of the payload, or 0 when out of memory.
+ */
+uint16_t HeapAlloc(heap_t *h, uint16_t nbytes)
+{
+  heap_class_t *hc;
+  uint16_t block;
+  int c;
+
+  if (nbytes == 0 || (c = HeapClassOf(nbytes)) < 0) {
+    h->fail_count++;
+    return 0;
+  }
+  hc = &h->classes[c];
+
+  if (hc->free_head) {
+    // Pop the free list; the link lives in the old payload.
+    block = hc->free_head;
+    hc->free_head = HDR_READ(h, block + HEAP_HDR_SIZE);
+  } else if ((uint32_t)h->brk + HeapClassSize(c) <= h->end) {
+    block = h->brk;
+    h->brk += HeapClassSize(c);
+    hc->carved++;
+  } else {
+    h->fail_count++;
+    return 0;
+  }
+
+  HDR_WRITE(h, block, nbytes | HEAP_HDR_ALLOCATED);
+  LIVE_BYTE(h, block - h->base) |= LIVE_BIT(block - h->base);
+  hc->in_use++;
+  hc->requested += nbytes;
+  h->alloc_count++;
+
+  return block + HEAP_HDR_SIZE;
+}
+
+/**
+ *  @brief  Return a block to its size class free list.
+ *  @param  h     Heap the block was allocated from
+ *  @param  addr  Payload address returned by HeapAlloc()
+ *  @return rFAILURE if addr is not a live heap block.
+ */
+int HeapFree(heap_t *h, uint16_t addr)
+{
+  heap_class_t *hc;
+  uint16_t block, hdr, offs;
+
+  if (addr < h->base + HEAP_HDR_SIZE || addr >= h->brk) {
+    return rFAILURE;
+  }
+
+  // Only the live map says where blocks start: a payload byte can look
+  // like an allocated header
+  block = addr - HEAP_HDR_SIZE;
+  offs = block - h->base;
+  if (offs % HEAP_MIN_BLOCK != 0 || !(LIVE_BYTE(h, offs) & LIVE_BIT(offs))) {
+    return rFAILURE;
+  }
+  hdr = HDR_READ(h, block);
+  if (!(hdr & HEAP_HDR_ALLOCATED)) {
+    return rFAILURE;
+  }
+  hdr &= ~HEAP_HDR_ALLOCATED;
+  LIVE_BYTE(h, offs) &= ~LIVE_BIT(offs);
+  hc = &h->classes[HeapClassOf(hdr)];
+
+  // Push onto the free list
+  HDR_WRITE(h, block, 0);
+  HDR_WRITE(h, addr, hc->free_head);
+  hc->free_head = block;
+  hc->in_use--;
+  hc->requested -= hdr;
+  h->free_count++;
+
+  return rSUCCESS;
+}
+
+/**************************************************************** END OF FILE */
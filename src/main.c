@@ -1,38 +1,182 @@
 
 /* Includes ----------------------------------------------------------------- */
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "basic.h"
+#include "profile.h"
+#include "serve.h"
+#include "rowmap.h"
 
 /* Defines ------------------------------------------------------------------ */
 /* Variables ---------------------------------------------------------------- */
 /* Constants ---------------------------------------------------------------- */
 /* Private Function Prototypes ---------------------------------------------- */
 static void PrintErrorMessage(void);
+static void Usage(void);
+static int OptionCount(const char *option, const char *arg, uint64_t min, uint64_t max,
+                       uint64_t *value);
+static int WriteProfile(const char *path, const char *root);
+static int Schedule(char **paths, int n, uint64_t slice);
+static int Map(const char *script_path, const char *in_path, uint32_t jobs);
+static int EmitC(const char *script_path, const char *c_path, int check);
+static int CheckC(FILE *script, const char *c_path);
 
 /* Main code ---------------------------------------------------------------- */
 int main(int argc, char *argv[])
 {
   FILE *fp;
-  int result;
+  int result, argi = 1, bounds_report = 0, schedule = 0, status = EXIT_SUCCESS;
+  int check = 0, failed = 0;
+  const char *profile_path = NULL, *serve_path = NULL, *submit_path = NULL;
+  const char *map_path = NULL, *in_path = NULL, *emit_path = NULL;
+  uint32_t profile_hz = PROF_DEFAULT_HZ, jobs = 1;
+  uint64_t quota_statements = 0, slice = SCHED_DEFAULT_SLICE, value;
+  uint32_t quota_memory = 0, quota_time_ms = 0;
+
+  BasicInit();
+
+  // Options
+  while (argi < argc && (strncmp(argv[argi], "--", 2) == 0
+                         || strcmp(argv[argi], "-j") == 0)) {
+    if (strcmp(argv[argi], "--max-call-depth") == 0 && argi + 1 < argc) {
+      if (OptionCount(argv[argi], argv[argi + 1], 0, UINT32_MAX, &value) != rSUCCESS) {
+        return EXIT_FAILURE;
+      }
+      BasicSetMaxCallDepth((uint32_t)value);
+      argi += 2;
+    } else if (strcmp(argv[argi], "--bounds-report") == 0) {
+      bounds_report = 1;
+      argi++;
+    } else if (strcmp(argv[argi], "--max-statements") == 0 && argi + 1 < argc) {
+      if (OptionCount(argv[argi], argv[argi + 1], 0, UINT64_MAX, &quota_statements)
+            != rSUCCESS) {
+        return EXIT_FAILURE;
+      }
+      argi += 2;
+    } else if (strcmp(argv[argi], "--max-memory") == 0 && argi + 1 < argc) {
+      if (OptionCount(argv[argi], argv[argi + 1], 0, UINT32_MAX, &value) != rSUCCESS) {
+        return EXIT_FAILURE;
+      }
+      quota_memory = (uint32_t)value;
+      argi += 2;
+    } else if (strcmp(argv[argi], "--max-time") == 0 && argi + 1 < argc) {
+      if (OptionCount(argv[argi], argv[argi + 1], 0, UINT32_MAX, &value) != rSUCCESS) {
+        return EXIT_FAILURE;
+      }
+      quota_time_ms = (uint32_t)value;
+      argi += 2;
+    } else if (strcmp(argv[argi], "--schedule") == 0) {
+      schedule = 1;
+      argi++;
+    } else if (strcmp(argv[argi], "--serve") == 0 && argi + 1 < argc) {
+      serve_path = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--submit") == 0 && argi + 1 < argc) {
+      submit_path = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--map") == 0 && argi + 1 < argc) {
+      map_path = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--in") == 0 && argi + 1 < argc) {
+      in_path = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--emit-c") == 0 && argi + 1 < argc) {
+      emit_path = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--check") == 0) {
+      check = 1;
+      argi++;
+    } else if (strcmp(argv[argi], "-j") == 0 && argi + 1 < argc) {
+      if (OptionCount(argv[argi], argv[argi + 1], 1, UINT32_MAX, &value) != rSUCCESS) {
+        return EXIT_FAILURE;
+      }
+      jobs = (uint32_t)value;
+      argi += 2;
+    } else if (strcmp(argv[argi], "--slice") == 0 && argi + 1 < argc) {
+      if (OptionCount(argv[argi], argv[argi + 1], 0, UINT64_MAX, &slice) != rSUCCESS) {
+        return EXIT_FAILURE;
+      }
+      argi += 2;
+    } else if (strcmp(argv[argi], "--sample-profile") == 0 && argi + 1 < argc) {
+      profile_path = argv[argi + 1];
+      argi += 2;
+    } else if (strcmp(argv[argi], "--sample-rate") == 0 && argi + 1 < argc) {
+      if (OptionCount(argv[argi], argv[argi + 1], 1, UINT32_MAX, &value) != rSUCCESS) {
+        return EXIT_FAILURE;
+      }
+      profile_hz = (uint32_t)value;
+      argi += 2;
+    } else {
+      Usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ((schedule && (argi == argc || slice == 0)) || (!schedule && argi + 1 < argc)
+        || (serve_path && (schedule || submit_path || argi < argc))
+        || (!map_path != !in_path)
+        || (map_path && (schedule || serve_path || submit_path || argi < argc))
+        || (check && !emit_path)
+        || (emit_path && (schedule || serve_path || submit_path || map_path
+                          || argi + 1 != argc))) {
+    Usage();
+    return EXIT_FAILURE;
+  }
+  BasicSetQuotas(quota_statements, quota_memory, quota_time_ms);
+  if (profile_path && ProfileStart(profile_hz, BasicLineCounter()) != rSUCCESS) {
+    printf("Could not start the profiler (rate %u)\n", profile_hz);
+    return EXIT_FAILURE;
+  }
 
   // Make sure we are using the executable correctly.
-  if (argc == 1) {
-    while ((result = BasicCommandLine()) == rSUCCESS) {
+  if (emit_path) {
+    status = EmitC(argv[argi], emit_path, check);
+  } else if (map_path) {
+    status = Map(map_path, in_path, jobs);
+  } else if (submit_path) {
+    // Client: the server runs the script
+    fp = (argi < argc ? fopen(argv[argi], "r") : stdin);
+    if (!fp) {
+      printf("Could not open file %s!\r\n", argv[argi]);
+      return EXIT_FAILURE;
     }
-    if (result == rFAILURE) {
-      PrintErrorMessage();
+    if (ServeSubmit(submit_path, fp, &failed) != rSUCCESS) {
+      printf("Could not submit to %s\n", submit_path);
+      status = EXIT_FAILURE;
+    } else if (failed) {
+      status = EXIT_FAILURE;
+    }
+    if (fp != stdin) {
+      fclose(fp);
     }
-  } else if (argc == 2) {
+  } else if (serve_path) {
+    printf("Serving BASIC scripts on %s\n", serve_path);
+    ServeRun(serve_path, slice);
+    printf("Could not serve on %s\n", serve_path);
+    status = EXIT_FAILURE;
+  } else if (schedule) {
+    status = Schedule(argv + argi, argc - argi, slice);
+  } else if (argi == argc) {
+    // Report errors and keep going; the program is still there to fix.
+    while ((result = BasicCommandLine()) != rEOF) {
+      if (result == rFAILURE) {
+        PrintErrorMessage();
+      }
+    }
+  } else if (argi + 1 == argc) {
     // Open the provided file.
-    fp = fopen(argv[1], "r");
+    fp = fopen(argv[argi], "r");
     if (!fp) {
-      printf("Could not open file %s!\r\n", argv[1]);
+      printf("Could not open file %s!\r\n", argv[argi]);
       return EXIT_FAILURE;
     }
 
     // Let user know we are running the file now.
-    printf("Running BASIC script %s\r\n", argv[1]);
+    printf("Running BASIC script %s\r\n", argv[argi]);
 
     if (BasicInterpret(fp) != rSUCCESS) {
       printf("Error: Line: %d, Column: %d", LexGetCurrentLineCount(), LexGetCurrentColumnCount());
@@ -45,18 +189,307 @@ int main(int argc, char *argv[])
       }
       puts("^");
       puts(LexGetErrorMessage());
+      // A script stopped by a quota exits with the quota's own code
+      status = BasicQuotaExceeded();
+    }
+    if (bounds_report) {
+      BasicBoundsReport(stdout);
     }
 
     // Done! Close file.
     fclose(fp);
     puts("");
-    puts("BASIC test program exited successfully.");
-  } else {
-    puts("Usage: ./basic [filename]");
+    if (status == QUOTA_NONE) {
+      puts("BASIC test program exited successfully.");
+    }
+  }
+
+  if (profile_path) {
+    ProfileStop();
+    if (WriteProfile(profile_path, argi < argc ? argv[argi] : "basic") != rSUCCESS) {
+      printf("Could not write profile %s\n", profile_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  return status;
+}
+
+/**
+ *  @brief  Save the profiler's samples as folded stacks rooted at root.
+ */
+static int WriteProfile(const char *path, const char *root)
+{
+  FILE *f;
+
+  if ((f = fopen(path, "w")) == NULL) {
+    return rFAILURE;
+  }
+  ProfileWrite(f, root);
+  return (fclose(f) == 0 ? rSUCCESS : rFAILURE);
+}
+
+/**
+ *  @brief  Run the n scripts at paths in turns on this thread, each one
+ *          until it YIELDs or has run slice statements.
+ */
+static int Schedule(char **paths, int n, uint64_t slice)
+{
+  basic_task_t **tasks;
+  char **names;
+  int i, live = 0, next, result, status = EXIT_SUCCESS;
+  FILE *fp;
+
+  tasks = malloc(n * sizeof(basic_task_t *));
+  names = malloc(n * sizeof(char *));
+  if (!tasks || !names) {
+    puts("Out of memory");
+    free(tasks);
+    free(names);
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < n; i++) {
+    if ((fp = fopen(paths[i], "r")) == NULL) {
+      printf("Could not open file %s!\r\n", paths[i]);
+      status = EXIT_FAILURE;
+      continue;
+    }
+    if ((tasks[live] = BasicTaskLoad(fp)) == NULL) {
+      printf("%s: ", paths[i]);
+      PrintErrorMessage();
+      status = EXIT_FAILURE;
+    } else {
+      names[live++] = paths[i];
+    }
+    fclose(fp);
+  }
+
+  // Round robin; scripts that are done drop out and the rest keep their order
+  while (live > 0) {
+    for (i = next = 0; i < live; i++) {
+      if ((result = BasicTaskRun(tasks[i], slice)) == rSUCCESS) {
+        tasks[next] = tasks[i];
+        names[next++] = names[i];
+        continue;
+      }
+      if (result == rFAILURE) {
+        printf("%s: ", names[i]);
+        PrintErrorMessage();
+        status = EXIT_FAILURE;
+      }
+      BasicTaskFree(tasks[i]);
+    }
+    live = next;
+  }
+
+  free(tasks);
+  free(names);
+  return status;
+}
+
+/**
+ *  @brief  Run the script at script_path once per row of the CSV file at
+ *          in_path, on jobs threads.
+ */
+static int Map(const char *script_path, const char *in_path, uint32_t jobs)
+{
+  FILE *script, *csv;
+  int status = EXIT_SUCCESS;
+
+  if ((script = fopen(script_path, "r")) == NULL) {
+    printf("Could not open file %s!\r\n", script_path);
     return EXIT_FAILURE;
   }
+  if ((csv = fopen(in_path, "r")) == NULL) {
+    printf("Could not open file %s!\r\n", in_path);
+    fclose(script);
+    return EXIT_FAILURE;
+  }
+
+  if (RowMapRun(script, csv, jobs, PrintErrorMessage) != rSUCCESS) {
+    status = EXIT_FAILURE;
+  }
 
-  return EXIT_SUCCESS;
+  fclose(script);
+  fclose(csv);
+  return status;
+}
+
+/**
+ *  @brief  Translate the script at script_path to C source at c_path and,
+ *          if check is set, make sure the compiled program's output is the
+ *          interpreter's.
+ */
+static int EmitC(const char *script_path, const char *c_path, int check)
+{
+  FILE *script, *out;
+  int status = EXIT_SUCCESS;
+
+  if ((script = fopen(script_path, "r")) == NULL) {
+    printf("Could not open file %s!\r\n", script_path);
+    return EXIT_FAILURE;
+  }
+  if ((out = fopen(c_path, "w")) == NULL) {
+    printf("Could not open file %s!\r\n", c_path);
+    fclose(script);
+    return EXIT_FAILURE;
+  }
+
+  if (BasicEmitC(script, out) != rSUCCESS) {
+    PrintErrorMessage();
+    status = EXIT_FAILURE;
+  }
+  if (fclose(out) != 0 && status == EXIT_SUCCESS) {
+    printf("Could not write %s\n", c_path);
+    status = EXIT_FAILURE;
+  }
+  if (status == EXIT_SUCCESS && check) {
+    rewind(script);
+    status = CheckC(script, c_path);
+  }
+
+  fclose(script);
+  return status;
+}
+
+/**
+ *  @brief  Compile the C at c_path with $CC (cc by default) into an
+ *          executable named after it (less .c), run it, and compare what
+ *          it prints, and whether it fails, with the interpreter running
+ *          script.
+ */
+static int CheckC(FILE *script, const char *c_path)
+{
+  FILE *expect, *actual;
+  const char *cc = getenv("CC");
+  size_t len = strlen(c_path);
+  char *exe, *cmd;
+  long offs = 0;
+  int a, b, failed, status = EXIT_FAILURE;
+
+  if (strchr(c_path, '\'') != NULL) {
+    printf("Can't check %s: its name has a quote\n", c_path);
+    return EXIT_FAILURE;
+  }
+  if (cc == NULL || cc[0] == '\0') {
+    cc = "cc";
+  }
+  exe = malloc(len + 5);
+  cmd = malloc(strlen(cc) + 2 * len + 32);
+  if (!exe || !cmd || (expect = tmpfile()) == NULL) {
+    puts("Out of memory");
+    free(exe);
+    free(cmd);
+    return EXIT_FAILURE;
+  }
+  strcpy(exe, c_path);
+  if (len > 2 && strcmp(exe + len - 2, ".c") == 0) {
+    exe[len - 2] = '\0';
+  } else {
+    strcat(exe, ".out");
+  }
+
+  // What the interpreter prints
+  BasicSetOutput(expect);
+  failed = (BasicInterpret(script) != rSUCCESS);
+  BasicSetOutput(stdout);
+  rewind(expect);
+
+  sprintf(cmd, "%s -O2 -o '%s' '%s'", cc, exe, c_path);
+  if (system(cmd) != 0) {
+    printf("Could not compile %s\n", c_path);
+  } else {
+    sprintf(cmd, "'%s%s'", strchr(exe, '/') ? "" : "./", exe);
+    if ((actual = popen(cmd, "r")) == NULL) {
+      printf("Could not run %s\n", exe);
+    } else {
+      // Up to the first byte that differs (or the end)
+      do {
+        a = getc(expect);
+        b = getc(actual);
+        offs++;
+      } while (a == b && a != EOF);
+      while (b != EOF) {
+        b = getc(actual);
+      }
+      if ((pclose(actual) != 0) != failed) {
+        printf("%s %s but the interpreter %s\n", exe, failed ? "succeeded" : "failed",
+               failed ? "failed" : "succeeded");
+      } else if (a != b) {
+        printf("%s output differs from the interpreter's at byte %ld\n", exe, offs);
+      } else {
+        printf("%s output matches the interpreter's (%ld bytes)\n", exe, offs - 1);
+        status = EXIT_SUCCESS;
+      }
+    }
+  }
+
+  fclose(expect);
+  free(exe);
+  free(cmd);
+  return status;
+}
+
+/**
+ *  @brief  Read the number given to a command line option. Limits are
+ *          enforced, so it must be a whole number in [min, max]: a bad
+ *          quota must not mean no quota.
+ *  @return rFAILURE, after saying so and showing the usage, if it isn't.
+ */
+static int OptionCount(const char *option, const char *arg, uint64_t min, uint64_t max,
+                       uint64_t *value)
+{
+  char *end;
+
+  errno = 0;
+  if (isdigit((unsigned char)arg[0])) {
+    *value = strtoull(arg, &end, 0);
+    if (errno == 0 && *end == '\0' && *value >= min && *value <= max) {
+      return rSUCCESS;
+    }
+  }
+
+  printf("Invalid value for %s: '%s'\n", option, arg);
+  Usage();
+  return rFAILURE;
+}
+
+static void Usage(void)
+{
+  puts("Usage: ./basic [options] [filename]");
+  puts("       ./basic --schedule [options] filename...");
+  puts("       ./basic --serve SOCK [options]");
+  puts("       ./basic --submit SOCK [filename]");
+  puts("       ./basic --map SCRIPT --in CSV [-j N] [options]");
+  puts("       ./basic --emit-c FILE [--check] filename");
+  puts("Options:");
+  printf("  --max-call-depth N   Nested SUB calls allowed (default %d)\n",
+         DEFAULT_CALL_DEPTH);
+  puts("  --bounds-report      Show how many array index checks were removed");
+  puts("  --sample-profile F   Sample the running line and interpreter phase,");
+  puts("                       and write folded stacks (for flame graphs) to F");
+  printf("  --sample-rate HZ     Samples per CPU second (default %d)\n",
+         PROF_DEFAULT_HZ);
+  puts("  --schedule           Run every file given in turns on one thread,");
+  puts("                       switching at YIELD or after a time slice");
+  printf("  --slice N            Statements per time slice (default %d)\n",
+         SCHED_DEFAULT_SLICE);
+  puts("  --serve SOCK         Run scripts sent to the Unix socket SOCK, in");
+  puts("                       turns, streaming their output back");
+  puts("  --submit SOCK        Send the script (or stdin) to a server and");
+  puts("                       print its output");
+  puts("  --map SCRIPT         Run SCRIPT once per row of the CSV file given");
+  puts("  --in CSV             with --in, its header naming the variables the");
+  puts("                       columns are bound to; output is in row order");
+  puts("  -j N                 Worker threads for --map (default 1)");
+  puts("  --emit-c FILE        Translate the script to C source in FILE");
+  puts("  --check              With --emit-c, compile FILE with $CC (or cc),");
+  puts("                       run it and compare its output with the");
+  puts("                       interpreter's");
+  puts("  --max-statements N   Stop a run after N statements (exit code 3)");
+  puts("  --max-memory BYTES   Stop a run whose stack use passes BYTES (exit 4)");
+  puts("  --max-time MS        Stop a run after MS milliseconds (exit code 5)");
 }
 
 static void PrintErrorMessage(void)
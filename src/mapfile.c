@@ -0,0 +1,83 @@
+
+/* Includes ----------------------------------------------------------------- */
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "basic.h"
+#include "mapfile.h"
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Map the first len bytes of a file. A read-only mapping needs
+ *          the file to be at least len bytes; a writable (shared) one
+ *          grows the file to len bytes if it is shorter.
+ *  @param  m         Receives the mapping (vaddr is left to the caller)
+ *  @param  path      File to map
+ *  @param  len       Bytes to map (non-zero)
+ *  @param  writable  Map shared and writable instead of read-only
+ *  @return rFAILURE if the file can't be opened, sized or mapped.
+ */
+int MapFileOpen(mapfile_t *m, const char *path, uint32_t len, int writable)
+{
+  struct stat st;
+  void *base;
+  int fd;
+
+  memset(m, 0, sizeof(mapfile_t));
+  if ((fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644)) < 0) {
+    return rFAILURE;
+  }
+  if (fstat(fd, &st) != 0
+        || (st.st_size < len && (!writable || ftruncate(fd, len) != 0))) {
+    close(fd);
+    return rFAILURE;
+  }
+
+  base = mmap(NULL, len, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+              writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if (base == MAP_FAILED) {
+    return rFAILURE;
+  }
+
+  m->base = base;
+  m->len = len;
+  m->writable = writable;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Unmap m. Stores to a shared mapping are left for the kernel to
+ *          write back.
+ */
+void MapFileClose(mapfile_t *m)
+{
+  if (m->base) {
+    munmap(m->base, m->len);
+    m->base = NULL;
+  }
+}
+
+/**
+ *  @brief  Tell the kernel how the mapping is about to be accessed.
+ */
+int MapFileAdvise(mapfile_t *m, map_advice_t advice)
+{
+  static const int advices[] = {
+    POSIX_MADV_NORMAL,
+    POSIX_MADV_SEQUENTIAL,
+    POSIX_MADV_RANDOM,
+    POSIX_MADV_WILLNEED
+  };
+
+  if (!m->base) {
+    return rFAILURE;
+  }
+  return (posix_madvise(m->base, m->len, advices[advice]) == 0 ? rSUCCESS : rFAILURE);
+}
+
+/**************************************************************** END OF FILE */
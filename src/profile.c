@@ -0,0 +1,137 @@
+
+/* Includes ----------------------------------------------------------------- */
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include "basic.h"
+#include "profile.h"
+
+/* Local Types -------------------------------------------------------------- */
+// Samples taken on one line with one phase stack
+typedef struct {
+  uint32_t      line;
+  uint32_t      stack;
+  uint32_t      count;      // 0 = empty slot
+} prof_entry_t;
+
+/* Local Variables ---------------------------------------------------------- */
+BASIC_TLS volatile uint32_t prof_stack = 0;
+// Filled by the SIGPROF handler, so it can't allocate
+static prof_entry_t prof_table[PROF_TABLE_SIZE];
+static volatile uint32_t prof_dropped = 0;
+static const volatile uint32_t *prof_line = NULL;
+
+/* Constants ---------------------------------------------------------------- */
+static const char *phase_names[] = {
+  "",
+  "lexer",
+  "parser",
+  "evaluator",
+  "print",
+  "analysis"
+};
+
+/* Local Function Definitions ----------------------------------------------- */
+/**
+ *  @brief  SIGPROF handler: count a sample for the current line and
+ *          phase stack.
+ */
+static void ProfileSample(int sig)
+{
+  uint32_t line = *prof_line, stack = prof_stack, h, i;
+  prof_entry_t *e;
+
+  (void)sig;
+  h = (line * 0x9E3779B1u) ^ (stack * 0x85EBCA6Bu);
+  for (i = 0; i < PROF_TABLE_SIZE; i++) {
+    e = &prof_table[(h + i) & (PROF_TABLE_SIZE - 1)];
+    if (e->count == 0) {
+      e->line = line;
+      e->stack = stack;
+      e->count = 1;
+      return;
+    }
+    if (e->line == line && e->stack == stack) {
+      e->count++;
+      return;
+    }
+  }
+  prof_dropped++;
+}
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Start sampling hz times per second of CPU time.
+ *  @param  line  Number of the line being run, read at every sample
+ *  @return rFAILURE if the timer can't be set up.
+ */
+int ProfileStart(uint32_t hz, const volatile uint32_t *line)
+{
+  struct sigaction sa;
+  struct itimerval it;
+
+  if (hz == 0 || hz > 1000000) {
+    return rFAILURE;
+  }
+  memset(prof_table, 0, sizeof(prof_table));
+  prof_dropped = 0;
+  prof_line = line;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = ProfileSample;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, NULL) != 0) {
+    return rFAILURE;
+  }
+
+  it.it_interval.tv_sec = 0;
+  it.it_interval.tv_usec = 1000000 / hz;
+  it.it_value = it.it_interval;
+  return (setitimer(ITIMER_PROF, &it, NULL) == 0 ? rSUCCESS : rFAILURE);
+}
+
+void ProfileStop(void)
+{
+  struct itimerval it;
+
+  memset(&it, 0, sizeof(it));
+  setitimer(ITIMER_PROF, &it, NULL);
+  signal(SIGPROF, SIG_IGN);
+}
+
+/**
+ *  @brief  Write the samples as folded stacks, one line per distinct
+ *          stack: "root;line 12;parser;print;evaluator 37". Flame graph
+ *          tools take this as is.
+ *  @return Number of samples written.
+ */
+uint32_t ProfileWrite(FILE *f, const char *root)
+{
+  uint32_t i, n, total = 0, stack;
+  uint8_t phases[8];
+
+  for (i = 0; i < PROF_TABLE_SIZE; i++) {
+    if (prof_table[i].count == 0) {
+      continue;
+    }
+    fprintf(f, "%s;line %u", root, prof_table[i].line);
+    for (n = 0, stack = prof_table[i].stack; stack && n < 8; stack >>= 4) {
+      phases[n++] = stack & 0xF;
+    }
+    while (n-- > 0) {
+      fprintf(f, ";%s", phase_names[phases[n]]);
+    }
+    fprintf(f, " %u\n", prof_table[i].count);
+    total += prof_table[i].count;
+  }
+  if (prof_dropped) {
+    fprintf(f, "%s;(dropped) %u\n", root, prof_dropped);
+    total += prof_dropped;
+  }
+
+  return total;
+}
+
+/**************************************************************** END OF FILE */
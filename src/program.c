@@ -0,0 +1,141 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "program.h"
+
+/* Private Function Prototypes ---------------------------------------------- */
+static void ProgFreeLine(prog_line_t *line);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Create an empty program.
+ */
+void ProgInit(program_t *p)
+{
+  memset(p, 0, sizeof(program_t));
+}
+
+/**
+ *  @brief  Delete every line of the program.
+ */
+void ProgClear(program_t *p)
+{
+  uint32_t i;
+
+  for (i = 0; i < p->count; i++) {
+    ProgFreeLine(&p->lines[i]);
+  }
+  free(p->lines);
+  ProgInit(p);
+}
+
+/**
+ *  @brief  Find a line by number (binary search).
+ *  @param  pos   Receives the line's index, or where it would be inserted
+ *  @return The line, NULL if there is no such line.
+ */
+prog_line_t *ProgFindLine(const program_t *p, uint32_t number, uint32_t *pos)
+{
+  uint32_t lo = 0, hi = p->count, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (p->lines[mid].number < number) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  *pos = lo;
+  return (lo < p->count && p->lines[lo].number == number ? &p->lines[lo] : NULL);
+}
+
+/**
+ *  @brief  Add or replace a line. Only this line's cached tokens change;
+ *          every other line keeps its lexer output.
+ *  @param  text  Source of the line (copied)
+ *  @param  toks  Lexer output for text (copied)
+ */
+int ProgSetLine(program_t *p, uint32_t number, const char *text, uint32_t len,
+                const token_t *toks, uint32_t ntoks)
+{
+  prog_line_t line, *old;
+  uint32_t pos;
+
+  line.number = number;
+  line.len = len;
+  line.ntoks = ntoks;
+  line.jump = 0;
+  line.text = malloc(len + 1);
+  line.toks = malloc(ntoks * sizeof(token_t) + 1);
+  if (!line.text || !line.toks) {
+    ProgFreeLine(&line);
+    return rFAILURE;
+  }
+  memcpy(line.text, text, len);
+  line.text[len] = '\0';
+  memcpy(line.toks, toks, ntoks * sizeof(token_t));
+
+  // Appending in order (e.g. loading a file) is the common case.
+  if (p->count && p->lines[p->count - 1].number < number) {
+    pos = p->count;
+    old = NULL;
+  } else {
+    old = ProgFindLine(p, number, &pos);
+  }
+
+  if (old) {
+    ProgFreeLine(old);
+    *old = line;
+    return rSUCCESS;
+  }
+
+  if (p->count == p->cap) {
+    uint32_t cap = (p->cap ? p->cap * 2 : PROG_INIT_LINES);
+    prog_line_t *lines = realloc(p->lines, cap * sizeof(prog_line_t));
+    if (!lines) {
+      ProgFreeLine(&line);
+      return rFAILURE;
+    }
+    p->lines = lines;
+    p->cap = cap;
+  }
+
+  memmove(&p->lines[pos + 1], &p->lines[pos], (p->count - pos) * sizeof(prog_line_t));
+  p->lines[pos] = line;
+  p->count++;
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Remove a line.
+ *  @return rFAILURE if there is no such line.
+ */
+int ProgDeleteLine(program_t *p, uint32_t number)
+{
+  prog_line_t *line;
+  uint32_t pos;
+
+  if ((line = ProgFindLine(p, number, &pos)) == NULL) {
+    return rFAILURE;
+  }
+
+  ProgFreeLine(line);
+  memmove(&p->lines[pos], &p->lines[pos + 1], (p->count - pos - 1) * sizeof(prog_line_t));
+  p->count--;
+
+  return rSUCCESS;
+}
+
+/* Local Function Definitions ----------------------------------------------- */
+static void ProgFreeLine(prog_line_t *line)
+{
+  free(line->text);
+  free(line->toks);
+}
+
+/**************************************************************** END OF FILE */
@@ -0,0 +1,593 @@
+
+/* Includes ----------------------------------------------------------------- */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "basic.h"
+#include "rowmap.h"
+
+/* Local Types -------------------------------------------------------------- */
+// Whole rows of the input, run by one worker. Its output is written once
+// every earlier batch's has been, so rows come out in input order.
+typedef struct {
+  char         *data;
+  size_t        len;
+  uint64_t      line;       // Input line the batch starts on
+  char         *out;        // Output of its rows
+  size_t        out_len;
+  int           failed;     // A row ended in an error
+  int           done;
+} rowmap_batch_t;
+
+/* Local Variables ---------------------------------------------------------- */
+static basic_image_t *image = NULL;
+// One variable per column, named by the header row (names point into it)
+static basic_bind_t columns[ROWMAP_MAX_COLUMNS];
+static uint32_t ncolumns = 0;
+static char *header = NULL;
+// Batches in flight: a ring indexed by sequence number
+static rowmap_batch_t *batches = NULL;
+static uint32_t nbatches = 0;
+// Batches handed to the workers, and taken by them
+static uint64_t filled = 0, taken = 0;
+static int input_done = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER;     // Filled or ended
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;  // A batch is done
+
+/* Private Function Prototypes ---------------------------------------------- */
+static int RowMapHeader(FILE *csv, char **buf, size_t *len, size_t *cap,
+                        int *eof, uint64_t *line);
+static int RowMapRead(FILE *csv, char **buf, size_t *len, size_t *cap, int *eof);
+static size_t RowMapRowEnd(const char *buf, size_t len, int last);
+static uint64_t RowMapCountLines(const char *buf, size_t len);
+static uint32_t RowMapSplit(char **p, char *end, char **fields, uint32_t *lens,
+                            uint64_t *lines);
+static int RowMapIsName(const char *s, uint32_t len);
+static int RowMapInteger(const char *s, uint32_t len, int32_t *value);
+static void *RowMapWorker(void *arg);
+static void RowMapBatch(rowmap_batch_t *b);
+static int RowMapFlush(rowmap_batch_t *b);
+static void RowMapReport(FILE *out, uint64_t line);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Run script once for every row of the CSV file csv, on jobs
+ *          worker threads, and print each row's output in input order.
+ *          The header row names the script's input variables: a column is
+ *          bound as an INT32 if the first row has an integer in it, else
+ *          as a STRING. Rows that fail are reported (by input line) and
+ *          the rest still run.
+ *  @param  report  Prints the interpreter's error message to stdout
+ *  @return rFAILURE if the script could not be loaded or a row failed.
+ */
+int RowMapRun(FILE *script, FILE *csv, uint32_t jobs, void (*report)(void))
+{
+  pthread_t workers[ROWMAP_MAX_JOBS];
+  char *buf = NULL, *rest;
+  size_t len = 0, cap = 0, end;
+  uint64_t line = 1, written = 0;
+  uint32_t started;
+  int eof = 0, status = rSUCCESS;
+  rowmap_batch_t *b;
+
+  if (jobs == 0 || jobs > ROWMAP_MAX_JOBS) {
+    printf("Worker threads must be 1 to %d\n", ROWMAP_MAX_JOBS);
+    return rFAILURE;
+  }
+  if ((image = BasicImageLoad(script)) == NULL) {
+    report();
+    return rFAILURE;
+  }
+  nbatches = jobs * ROWMAP_BATCHES_PER_JOB;
+  if (RowMapHeader(csv, &buf, &len, &cap, &eof, &line) != rSUCCESS
+        || (batches = calloc(nbatches, sizeof(rowmap_batch_t))) == NULL) {
+    free(buf);
+    free(header);
+    BasicImageFree(image);
+    return rFAILURE;
+  }
+
+  filled = taken = 0;
+  input_done = 0;
+  for (started = 0; started < jobs; started++) {
+    if (pthread_create(&workers[started], NULL, RowMapWorker, NULL) != 0) {
+      break;
+    }
+  }
+  if (started == 0) {
+    puts("Could not start worker threads");
+    status = rFAILURE;
+  }
+
+  while (started > 0) {
+    // Read a chunk's worth of whole rows (more for a row longer than that)
+    for (end = 0; ; ) {
+      if (eof || len >= ROWMAP_CHUNK_SIZE) {
+        end = (eof ? len : RowMapRowEnd(buf, len, 1));
+      }
+      if (end > 0 || eof) {
+        break;
+      }
+      if (RowMapRead(csv, &buf, &len, &cap, &eof) != rSUCCESS) {
+        status = rFAILURE;
+        break;
+      }
+    }
+    if (end == 0) {
+      break;
+    }
+    if ((rest = malloc(len - end + ROWMAP_CHUNK_SIZE)) == NULL) {
+      puts("Out of memory");
+      status = rFAILURE;
+      break;
+    }
+    memcpy(rest, buf + end, len - end);
+
+    // The batch that had this slot must be written out first
+    b = &batches[filled % nbatches];
+    if (filled - written == nbatches
+          && RowMapFlush(&batches[written++ % nbatches]) != rSUCCESS) {
+      status = rFAILURE;
+    }
+    b->data = buf;
+    b->len = end;
+    b->line = line;
+    b->out = NULL;
+    b->out_len = 0;
+    b->failed = 0;
+    b->done = 0;
+    line += RowMapCountLines(buf, end);
+    buf = rest;
+    len -= end;
+    cap = len + ROWMAP_CHUNK_SIZE;
+
+    pthread_mutex_lock(&lock);
+    filled++;
+    pthread_cond_signal(&ready);
+    pthread_mutex_unlock(&lock);
+  }
+
+  pthread_mutex_lock(&lock);
+  input_done = 1;
+  pthread_cond_broadcast(&ready);
+  pthread_mutex_unlock(&lock);
+  while (written < filled) {
+    if (RowMapFlush(&batches[written++ % nbatches]) != rSUCCESS) {
+      status = rFAILURE;
+    }
+  }
+  while (started > 0) {
+    pthread_join(workers[--started], NULL);
+  }
+
+  fflush(stdout);
+  free(buf);
+  free(batches);
+  free(header);
+  BasicImageFree(image);
+  batches = NULL;
+  header = NULL;
+  image = NULL;
+  return status;
+}
+
+/* Local Function Definitions ----------------------------------------------- */
+/**
+ *  @brief  Read the header row into columns, and type each column by the
+ *          first data row. buf is left holding the input past the header.
+ *  @param  line  Receives the input line the data starts on
+ */
+static int RowMapHeader(FILE *csv, char **buf, size_t *len, size_t *cap,
+                        int *eof, uint64_t *line)
+{
+  char *fields[ROWMAP_MAX_COLUMNS], *row, *p;
+  uint32_t lens[ROWMAP_MAX_COLUMNS], i, j, n;
+  size_t end, pos;
+  uint64_t lines = 0;
+  int32_t value;
+
+  while ((end = RowMapRowEnd(*buf, *len, 0)) == 0 && !*eof) {
+    if (RowMapRead(csv, buf, len, cap, eof) != rSUCCESS) {
+      return rFAILURE;
+    }
+  }
+  if ((end = (end ? end : *len)) == 0) {
+    puts("Input has no header row");
+    return rFAILURE;
+  }
+  if ((header = malloc(end)) == NULL) {
+    puts("Out of memory");
+    return rFAILURE;
+  }
+  memcpy(header, *buf, end);
+  memmove(*buf, *buf + end, *len - end);
+  *len -= end;
+
+  p = header;
+  if ((n = RowMapSplit(&p, header + end, fields, lens, &lines)) > ROWMAP_MAX_COLUMNS) {
+    printf("Input has more than %d columns\n", ROWMAP_MAX_COLUMNS);
+    return rFAILURE;
+  }
+  for (i = 0; i < n; i++) {
+    if (!RowMapIsName(fields[i], lens[i])) {
+      printf("Column %u: \"%.*s\" is not a variable name\n", i + 1,
+             (int)lens[i], fields[i]);
+      return rFAILURE;
+    }
+    // Either would fail every row, so they're caught once here
+    if (LexFindKeyword(fields[i], lens[i]) >= 0) {
+      printf("Column %u: \"%.*s\" is a keyword\n", i + 1, (int)lens[i], fields[i]);
+      return rFAILURE;
+    }
+    for (j = 0; j < i; j++) {
+      if (lens[j] == lens[i] && memcmp(fields[j], fields[i], lens[i]) == 0) {
+        printf("Column %u: \"%.*s\" is also column %u\n", i + 1,
+               (int)lens[i], fields[i], j + 1);
+        return rFAILURE;
+      }
+    }
+    columns[i].name = fields[i];
+    columns[i].name_len = lens[i];
+    columns[i].var_type = VAR_STRING;
+  }
+  ncolumns = n;
+  *line += lines;
+
+  // First data row, split from a copy (the batch splits it again)
+  for (pos = 0; ; pos += end) {
+    while ((end = RowMapRowEnd(*buf + pos, *len - pos, 0)) == 0 && !*eof) {
+      if (RowMapRead(csv, buf, len, cap, eof) != rSUCCESS) {
+        return rFAILURE;
+      }
+    }
+    if ((end = (end ? end : *len - pos)) == 0) {
+      // No data at all
+      return rSUCCESS;
+    }
+    if ((*buf)[pos] != '\n'
+          && (end < 2 || (*buf)[pos] != '\r' || (*buf)[pos + 1] != '\n')) {
+      break;
+    }
+  }
+  if ((row = malloc(end)) == NULL) {
+    puts("Out of memory");
+    return rFAILURE;
+  }
+  memcpy(row, *buf + pos, end);
+  p = row;
+  n = RowMapSplit(&p, row + end, fields, lens, &lines);
+  for (i = 0; i < n && i < ncolumns; i++) {
+    if (RowMapInteger(fields[i], lens[i], &value) == rSUCCESS) {
+      columns[i].var_type = VAR_INT32;
+    }
+  }
+  free(row);
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Append up to a chunk of input to buf.
+ */
+static int RowMapRead(FILE *csv, char **buf, size_t *len, size_t *cap, int *eof)
+{
+  char *grown;
+  size_t n;
+
+  if (*cap - *len < ROWMAP_CHUNK_SIZE) {
+    if ((grown = realloc(*buf, *len + ROWMAP_CHUNK_SIZE)) == NULL) {
+      puts("Out of memory");
+      return rFAILURE;
+    }
+    *buf = grown;
+    *cap = *len + ROWMAP_CHUNK_SIZE;
+  }
+
+  n = fread(*buf + *len, 1, ROWMAP_CHUNK_SIZE, csv);
+  *len += n;
+  if (n < ROWMAP_CHUNK_SIZE) {
+    if (ferror(csv)) {
+      puts("Could not read the input");
+      return rFAILURE;
+    }
+    *eof = 1;
+  }
+
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  End (just past the newline) of the first or last whole row in
+ *          buf, which starts at a row. Newlines in quoted fields don't end
+ *          a row.
+ *  @return 0 if there is no whole row.
+ */
+static size_t RowMapRowEnd(const char *buf, size_t len, int last)
+{
+  const char *nl;
+  size_t i, end = 0;
+  int quoted = 0;
+
+  if (len == 0) {
+    return 0;
+  }
+  // Without quotes every newline ends a row
+  if (memchr(buf, '"', len) == NULL) {
+    if (!last) {
+      nl = memchr(buf, '\n', len);
+      return (nl ? nl - buf + 1 : 0);
+    }
+    for (i = len; i > 0 && buf[i - 1] != '\n'; i--) {
+    }
+    return i;
+  }
+
+  // A doubled quote inside a quoted field toggles twice
+  for (i = 0; i < len; i++) {
+    if (buf[i] == '"') {
+      quoted = !quoted;
+    } else if (buf[i] == '\n' && !quoted) {
+      end = i + 1;
+      if (!last) {
+        break;
+      }
+    }
+  }
+  return end;
+}
+
+static uint64_t RowMapCountLines(const char *buf, size_t len)
+{
+  const char *end = buf + len;
+  uint64_t n = 0;
+
+  while ((buf = memchr(buf, '\n', end - buf)) != NULL) {
+    buf++;
+    n++;
+  }
+  return n;
+}
+
+/**
+ *  @brief  Split the row at *p into fields, unquoting quoted ones in
+ *          place, and move *p past the row. Fields past
+ *          ROWMAP_MAX_COLUMNS are counted but not kept.
+ *  @param  lines  Counts the newlines passed
+ *  @return The number of fields.
+ */
+static uint32_t RowMapSplit(char **p, char *end, char **fields, uint32_t *lens,
+                            uint64_t *lines)
+{
+  char *s = *p, *start, *dst;
+  uint32_t n = 0, len;
+
+  for (;;) {
+    if (s < end && *s == '"') {
+      start = dst = ++s;
+      while (s < end) {
+        if (*s != '"') {
+          *lines += (*s == '\n');
+          *dst++ = *s++;
+        } else if (s + 1 < end && s[1] == '"') {
+          *dst++ = '"';
+          s += 2;
+        } else {
+          s++;
+          break;
+        }
+      }
+      len = dst - start;
+      // Anything between the closing quote and the separator is dropped
+      while (s < end && *s != ',' && *s != '\n') {
+        s++;
+      }
+    } else {
+      for (start = s; s < end && *s != ',' && *s != '\n'; s++) {
+      }
+      len = s - start;
+      if (len > 0 && start[len - 1] == '\r' && (s == end || *s == '\n')) {
+        len--;
+      }
+    }
+
+    if (n < ROWMAP_MAX_COLUMNS) {
+      fields[n] = start;
+      lens[n] = len;
+    }
+    n++;
+    if (s < end && *s == ',') {
+      s++;
+      continue;
+    }
+    if (s < end) {
+      s++;
+      (*lines)++;
+    }
+    break;
+  }
+
+  *p = s;
+  return n;
+}
+
+static int RowMapIsName(const char *s, uint32_t len)
+{
+  uint32_t i;
+
+  if (len == 0 || len >= VAR_NAME_LEN || !LexIsAlpha(s[0])) {
+    return 0;
+  }
+  for (i = 1; i < len; i++) {
+    if (!LexIsAlpha(s[i]) && !LexIsDigit(s[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ *  @brief  Parse a whole field as a (decimal) INT32.
+ */
+static int RowMapInteger(const char *s, uint32_t len, int32_t *value)
+{
+  uint32_t i = (len > 0 && (s[0] == '-' || s[0] == '+'));
+  int64_t v = 0;
+
+  if (i == len) {
+    return rFAILURE;
+  }
+  for (; i < len; i++) {
+    if (!LexIsDigit(s[i]) || (v = v * 10 + (s[i] - '0')) > (int64_t)INT32_MAX + 1) {
+      return rFAILURE;
+    }
+  }
+  v = (s[0] == '-' ? -v : v);
+  if (v > INT32_MAX) {
+    return rFAILURE;
+  }
+
+  *value = (int32_t)v;
+  return rSUCCESS;
+}
+
+/**
+ *  @brief  Worker thread: run batches as they're filled until the input
+ *          ends.
+ */
+static void *RowMapWorker(void *arg)
+{
+  rowmap_batch_t *b;
+
+  BasicInit();
+  for (;;) {
+    pthread_mutex_lock(&lock);
+    while (taken == filled && !input_done) {
+      pthread_cond_wait(&ready, &lock);
+    }
+    if (taken == filled) {
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+    b = &batches[taken++ % nbatches];
+    pthread_mutex_unlock(&lock);
+
+    RowMapBatch(b);
+
+    pthread_mutex_lock(&lock);
+    b->done = 1;
+    pthread_cond_broadcast(&finished);
+    pthread_mutex_unlock(&lock);
+  }
+
+  BasicExit();
+  return NULL;
+}
+
+/**
+ *  @brief  Run the script for each row of b, collecting the output.
+ */
+static void RowMapBatch(rowmap_batch_t *b)
+{
+  basic_bind_t binds[ROWMAP_MAX_COLUMNS];
+  char *fields[ROWMAP_MAX_COLUMNS];
+  uint32_t lens[ROWMAP_MAX_COLUMNS], i, n;
+  char *p = b->data, *end = b->data + b->len;
+  uint64_t line = b->line, row_line;
+  FILE *out;
+
+  if ((out = open_memstream(&b->out, &b->out_len)) == NULL) {
+    b->failed = 1;
+    return;
+  }
+  BasicSetOutput(out);
+  memcpy(binds, columns, ncolumns * sizeof(basic_bind_t));
+
+  while (p < end) {
+    row_line = line;
+    // Blank lines are skipped
+    if (*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n')) {
+      p += (*p == '\r') + 1;
+      line++;
+      continue;
+    }
+
+    if ((n = RowMapSplit(&p, end, fields, lens, &line)) != ncolumns) {
+      fprintf(out, "Error: Input line: %llu\n%u columns, expected %u\n",
+              (unsigned long long)row_line, n, ncolumns);
+      b->failed = 1;
+      continue;
+    }
+    for (i = 0; i < n; i++) {
+      if (binds[i].var_type == VAR_STRING) {
+        binds[i].str = fields[i];
+        binds[i].len = lens[i];
+      } else if (RowMapInteger(fields[i], lens[i], &binds[i].value) != rSUCCESS) {
+        break;
+      }
+    }
+    if (i < n) {
+      fprintf(out, "Error: Input line: %llu\nColumn %.*s is not a number\n",
+              (unsigned long long)row_line, (int)binds[i].name_len, binds[i].name);
+      b->failed = 1;
+      continue;
+    }
+
+    if (BasicImageRun(image, binds, n) != rSUCCESS) {
+      RowMapReport(out, row_line);
+      b->failed = 1;
+    }
+  }
+
+  BasicSetOutput(stdout);
+  fclose(out);
+}
+
+/**
+ *  @brief  Wait for b to be done, write its output and release it.
+ *  @return rFAILURE if one of its rows failed.
+ */
+static int RowMapFlush(rowmap_batch_t *b)
+{
+  int failed;
+
+  pthread_mutex_lock(&lock);
+  while (!b->done) {
+    pthread_cond_wait(&finished, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+
+  fwrite(b->out, 1, b->out_len, stdout);
+  failed = b->failed;
+  free(b->data);
+  free(b->out);
+  b->data = b->out = NULL;
+
+  return (failed ? rFAILURE : rSUCCESS);
+}
+
+/**
+ *  @brief  Report the interpreter's error for the row on input line to out.
+ */
+static void RowMapReport(FILE *out, uint64_t line)
+{
+  int i;
+
+  if (LexGetCurrentLineCount() == 0) {
+    // Binding the row's values failed, before the script ran
+    fprintf(out, "Error: Input line: %llu\n%s\n", (unsigned long long)line,
+            LexGetErrorMessage());
+    return;
+  }
+  fprintf(out, "Error: Input line: %llu, Line: %d, Column: %d\n",
+          (unsigned long long)line, LexGetCurrentLineCount(),
+          LexGetCurrentColumnCount());
+  fprintf(out, "%s", LexGetCurrentLine());
+  for (i = 0; i < LexGetCurrentColumnCount() - 1; i++) {
+    fputc(' ', out);
+  }
+  fprintf(out, "^ %s\n", LexGetErrorMessage());
+}
+
+/**************************************************************** END OF FILE */
@@ -0,0 +1,430 @@
+
+/* Includes ----------------------------------------------------------------- */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "basic.h"
+#include "serve.h"
+
+/* Local Types -------------------------------------------------------------- */
+// Client connection: its script is received first, then run as a task.
+// The script's output is buffered in out and sent as the (non-blocking)
+// connection takes it; the connection is closed once the task is done
+// and all of it is sent.
+typedef struct {
+  int           fd;         // -1 = free slot
+  char         *buf;        // Script received so far
+  uint32_t      len;
+  uint32_t      cap;
+  uint64_t      deadline;   // When receiving gives up (see ServeNow())
+  basic_task_t *task;       // NULL while receiving and once done
+  FILE         *out;        // NULL while receiving (open_memstream())
+  char         *out_buf;
+  size_t        out_len;    // As of the last fflush() of out
+  size_t        out_sent;
+} serve_conn_t;
+
+/* Local Variables ---------------------------------------------------------- */
+static serve_conn_t conns[SERVE_MAX_JOBS];
+
+/* Private Function Prototypes ---------------------------------------------- */
+static int ServeSocket(const char *path, int listening);
+static void ServeAccept(int lfd);
+static void ServeReceive(serve_conn_t *c);
+static void ServeStep(serve_conn_t *c, uint64_t slice);
+static void ServeSend(serve_conn_t *c);
+static void ServeClose(serve_conn_t *c);
+static void ServeReport(FILE *out);
+static uint64_t ServeNow(void);
+static int ServeWriteAll(int fd, const char *buf, size_t n);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Serve scripts on the Unix socket at path until an error. Each
+ *          client sends a script and closes its end for writing, within
+ *          SERVE_RECV_TIMEOUT; the script's output (errors included) is
+ *          streamed back, followed by a SERVE_STATUS_* byte, and the
+ *          connection is closed when it ends. A job whose client hangs
+ *          up is stopped.
+ *          Scripts run as tasks in turns (see BasicTaskRun()), slice
+ *          statements at a time. A job whose client has SERVE_MAX_OUTPUT
+ *          bytes of output waiting sits out its turns until it reads them.
+ */
+int ServeRun(const char *path, uint64_t slice)
+{
+  struct pollfd fds[SERVE_MAX_JOBS + 1];
+  serve_conn_t *c;
+  uint64_t now;
+  int lfd, i, running, room, timeout;
+
+  if ((lfd = ServeSocket(path, 1)) < 0) {
+    return rFAILURE;
+  }
+  // A client that goes away early must not take the server with it
+  signal(SIGPIPE, SIG_IGN);
+  for (i = 0; i < SERVE_MAX_JOBS; i++) {
+    conns[i].fd = -1;
+  }
+
+  for (;;) {
+    // Wait for clients, scripts and room to send output, but not while
+    // there are jobs to run
+    now = ServeNow();
+    timeout = -1;
+    for (i = running = room = 0; i < SERVE_MAX_JOBS; i++) {
+      c = &conns[i];
+      fds[i + 1].fd = -1;
+      fds[i + 1].events = 0;
+      if (c->fd >= 0 && !c->out && now >= c->deadline) {
+        ServeClose(c);
+      }
+      if (c->fd < 0) {
+        room++;
+        continue;
+      }
+      if (!c->out) {
+        fds[i + 1].events = POLLIN;
+        if (timeout < 0 || c->deadline - now < (uint64_t)timeout) {
+          timeout = (int)(c->deadline - now);
+        }
+      } else if (c->out_sent < c->out_len) {
+        fds[i + 1].events = POLLOUT;
+      }
+      // Hang-ups are reported even with no events asked for
+      fds[i + 1].fd = c->fd;
+      running += (c->task && c->out_len - c->out_sent < SERVE_MAX_OUTPUT);
+    }
+    fds[0].fd = (room ? lfd : -1);
+    fds[0].events = POLLIN;
+    if (poll(fds, SERVE_MAX_JOBS + 1, running ? 0 : timeout) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      ServeAccept(lfd);
+    }
+    for (i = 0; i < SERVE_MAX_JOBS; i++) {
+      if (fds[i + 1].fd < 0 || !fds[i + 1].revents) {
+        continue;
+      }
+      if (!conns[i].out) {
+        ServeReceive(&conns[i]);
+      } else if (fds[i + 1].revents & (POLLHUP | POLLERR)) {
+        // The client is gone; nobody is left to run the job for
+        ServeClose(&conns[i]);
+      } else {
+        ServeSend(&conns[i]);
+      }
+    }
+    for (i = 0; i < SERVE_MAX_JOBS; i++) {
+      c = &conns[i];
+      if (c->task && c->out_len - c->out_sent < SERVE_MAX_OUTPUT) {
+        ServeStep(c, slice);
+      }
+    }
+  }
+
+  close(lfd);
+  return rFAILURE;
+}
+
+/**
+ *  @brief  Send script to the server at path and copy what comes back to
+ *          stdout.
+ *  @param  failed  Set if the script ended in an error
+ *  @return rFAILURE if the script could not be run on the server.
+ */
+int ServeSubmit(const char *path, FILE *script, int *failed)
+{
+  char buf[SERVE_READ_CHUNK];
+  size_t n;
+  ssize_t got;
+  int fd, last = -1;
+  char held;
+
+  if ((fd = ServeSocket(path, 0)) < 0) {
+    return rFAILURE;
+  }
+
+  while ((n = fread(buf, 1, sizeof(buf), script)) > 0) {
+    if (ServeWriteAll(fd, buf, n) != rSUCCESS) {
+      close(fd);
+      return rFAILURE;
+    }
+  }
+  shutdown(fd, SHUT_WR);
+
+  fflush(stdout);
+  while ((got = read(fd, buf, sizeof(buf))) != 0) {
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      close(fd);
+      return rFAILURE;
+    }
+    // The last byte is held back: it may be the status
+    held = (char)last;
+    if ((last >= 0 && ServeWriteAll(STDOUT_FILENO, &held, 1) != rSUCCESS)
+          || ServeWriteAll(STDOUT_FILENO, buf, got - 1) != rSUCCESS) {
+      close(fd);
+      return rFAILURE;
+    }
+    last = (unsigned char)buf[got - 1];
+  }
+
+  close(fd);
+  if (last != SERVE_STATUS_OK && last != SERVE_STATUS_FAILED) {
+    // Closed before the job ended
+    return rFAILURE;
+  }
+  *failed = (last == SERVE_STATUS_FAILED);
+  return rSUCCESS;
+}
+
+/* Local Function Definitions ----------------------------------------------- */
+/**
+ *  @brief  Open a Unix stream socket at path: listening (replacing a stale
+ *          socket file) or connected to a server.
+ *  @return The socket, -1 on failure.
+ */
+static int ServeSocket(const char *path, int listening)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    return -1;
+  }
+  if (listening) {
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+          || listen(fd, SOMAXCONN) < 0) {
+      close(fd);
+      return -1;
+    }
+  } else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static void ServeAccept(int lfd)
+{
+  int i, fd, flags;
+
+  if ((fd = accept(lfd, NULL, NULL)) < 0) {
+    return;
+  }
+  // A client that stops reading must only hold up its own job
+  if ((flags = fcntl(fd, F_GETFL)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    close(fd);
+    return;
+  }
+  for (i = 0; i < SERVE_MAX_JOBS; i++) {
+    if (conns[i].fd < 0) {
+      conns[i].fd = fd;
+      conns[i].buf = NULL;
+      conns[i].len = conns[i].cap = 0;
+      conns[i].deadline = ServeNow() + SERVE_RECV_TIMEOUT;
+      conns[i].task = NULL;
+      conns[i].out = NULL;
+      conns[i].out_buf = NULL;
+      conns[i].out_len = conns[i].out_sent = 0;
+      return;
+    }
+  }
+  close(fd);
+}
+
+/**
+ *  @brief  Read more of c's script; at the end of it, load the script.
+ */
+static void ServeReceive(serve_conn_t *c)
+{
+  ssize_t n;
+  char *buf;
+  FILE *f;
+
+  if (c->cap - c->len < SERVE_READ_CHUNK) {
+    if (c->cap + SERVE_READ_CHUNK > SERVE_MAX_SCRIPT
+          || (buf = realloc(c->buf, c->cap + SERVE_READ_CHUNK)) == NULL) {
+      ServeWriteAll(c->fd, "Script too large\n" SERVE_STATUS_FAILED_STR, 18);
+      ServeClose(c);
+      return;
+    }
+    c->buf = buf;
+    c->cap += SERVE_READ_CHUNK;
+  }
+
+  if ((n = read(c->fd, c->buf + c->len, c->cap - c->len)) > 0) {
+    c->len += n;
+    return;
+  }
+  if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  }
+  if (n < 0 || c->len == 0) {
+    ServeClose(c);
+    return;
+  }
+  if ((f = fmemopen(c->buf, c->len, "r")) == NULL
+        || (c->out = open_memstream(&c->out_buf, &c->out_len)) == NULL) {
+    if (f) {
+      fclose(f);
+    }
+    ServeClose(c);
+    return;
+  }
+
+  BasicSetOutput(c->out);
+  if ((c->task = BasicTaskLoad(f)) == NULL) {
+    ServeReport(c->out);
+    fputc(SERVE_STATUS_FAILED, c->out);
+  }
+  BasicSetOutput(stdout);
+  fclose(f);
+  free(c->buf);
+  c->buf = NULL;
+  fflush(c->out);
+  ServeSend(c);
+}
+
+/**
+ *  @brief  Run c's script for a time slice, with its output going to c.
+ */
+static void ServeStep(serve_conn_t *c, uint64_t slice)
+{
+  int result;
+
+  BasicSetOutput(c->out);
+  if ((result = BasicTaskRun(c->task, slice)) == rFAILURE) {
+    ServeReport(c->out);
+  }
+  BasicSetOutput(stdout);
+  fflush(c->out);
+
+  if (result != rSUCCESS) {
+    fputc(result == rFAILURE ? SERVE_STATUS_FAILED : SERVE_STATUS_OK, c->out);
+    fflush(c->out);
+    BasicTaskFree(c->task);
+    c->task = NULL;
+  }
+  ServeSend(c);
+}
+
+/**
+ *  @brief  Send as much of c's buffered output as the connection takes
+ *          without blocking. Once the task is done and everything is
+ *          sent, the connection is closed.
+ */
+static void ServeSend(serve_conn_t *c)
+{
+  ssize_t n;
+
+  while (c->out_sent < c->out_len) {
+    if ((n = write(c->fd, c->out_buf + c->out_sent, c->out_len - c->out_sent)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        ServeClose(c);
+      }
+      return;
+    }
+    c->out_sent += n;
+  }
+
+  // All sent; the buffer is written over from the start
+  rewind(c->out);
+  c->out_len = c->out_sent = 0;
+  if (!c->task) {
+    ServeClose(c);
+  }
+}
+
+static void ServeClose(serve_conn_t *c)
+{
+  if (c->task) {
+    BasicTaskFree(c->task);
+    c->task = NULL;
+  }
+  if (c->out) {
+    fclose(c->out);
+    c->out = NULL;
+  }
+  close(c->fd);
+  free(c->buf);
+  free(c->out_buf);
+  c->fd = -1;
+  c->buf = NULL;
+  c->out_buf = NULL;
+}
+
+/**
+ *  @brief  Report the interpreter's error to out (as the command line
+ *          does on stdout).
+ */
+static void ServeReport(FILE *out)
+{
+  int i;
+
+  fprintf(out, "Error: Line: %d, Column: %d\n", LexGetCurrentLineCount(),
+          LexGetCurrentColumnCount());
+  fprintf(out, "%s", LexGetCurrentLine());
+  for (i = 0; i < LexGetCurrentColumnCount() - 1; i++) {
+    fputc(' ', out);
+  }
+  fprintf(out, "^ %s\n", LexGetErrorMessage());
+}
+
+/**
+ *  @brief  Milliseconds on the monotonic clock.
+ */
+static uint64_t ServeNow(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int ServeWriteAll(int fd, const char *buf, size_t n)
+{
+  ssize_t done;
+
+  while (n > 0) {
+    if ((done = write(fd, buf, n)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return rFAILURE;
+    }
+    buf += done;
+    n -= done;
+  }
+
+  return rSUCCESS;
+}
+
+/**************************************************************** END OF FILE */
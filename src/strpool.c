@@ -0,0 +1,147 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdlib.h>
+#include <string.h>
+#include "strpool.h"
+
+/* Private Function Prototypes ---------------------------------------------- */
+static uint32_t StrPoolHash(const char *s, uint32_t len);
+static int StrPoolGrowTable(strpool_t *pool);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Create an empty literal pool.
+ */
+void StrPoolInit(strpool_t *pool)
+{
+  memset(pool, 0, sizeof(strpool_t));
+}
+
+/**
+ *  @brief  Release everything owned by the pool.
+ */
+void StrPoolFree(strpool_t *pool)
+{
+  free(pool->buf);
+  free(pool->offs);
+  free(pool->lens);
+  free(pool->table);
+  StrPoolInit(pool);
+}
+
+/**
+ *  @brief  Return the id of the literal s[0, len), adding it if needed.
+ *          Identical literals always share one id (and one copy).
+ *  @return Literal id, or -1 when out of memory.
+ */
+int32_t StrPoolIntern(strpool_t *pool, const char *s, uint32_t len)
+{
+  uint32_t h, slot, id;
+
+  if (2 * (pool->count + 1) >= pool->table_cap
+        && StrPoolGrowTable(pool) != 0) {
+    return -1;
+  }
+
+  // Look for an existing copy
+  h = StrPoolHash(s, len);
+  for (slot = h & (pool->table_cap - 1); pool->table[slot];
+       slot = (slot + 1) & (pool->table_cap - 1)) {
+    id = pool->table[slot] - 1;
+    if (pool->lens[id] == len
+          && memcmp(pool->buf + pool->offs[id], s, len) == 0) {
+      return id;
+    }
+  }
+
+  // Make room for a new literal
+  if (pool->count == pool->cap) {
+    uint32_t cap = pool->cap ? pool->cap * 2 : STRPOOL_INIT_COUNT;
+    uint32_t *offs = realloc(pool->offs, cap * sizeof(uint32_t));
+    if (offs) {
+      pool->offs = offs;
+    }
+    uint32_t *lens = realloc(pool->lens, cap * sizeof(uint32_t));
+    if (lens) {
+      pool->lens = lens;
+    }
+    if (!offs || !lens) {
+      return -1;
+    }
+    pool->cap = cap;
+  }
+
+  if (pool->buf_len + len + 1 > pool->buf_cap) {
+    uint32_t cap = pool->buf_cap ? pool->buf_cap : STRPOOL_INIT_BUF;
+    while (pool->buf_len + len + 1 > cap) {
+      cap *= 2;
+    }
+    char *buf = realloc(pool->buf, cap);
+    if (!buf) {
+      return -1;
+    }
+    pool->buf = buf;
+    pool->buf_cap = cap;
+  }
+
+  // Store it, NUL terminated for convenience
+  id = pool->count++;
+  pool->offs[id] = pool->buf_len;
+  pool->lens[id] = len;
+  memcpy(pool->buf + pool->buf_len, s, len);
+  pool->buf[pool->buf_len + len] = '\0';
+  pool->buf_len += len + 1;
+  pool->table[slot] = id + 1;
+
+  return id;
+}
+
+/**
+ *  @brief  Look up a literal by id.
+ *  @param  len   Receives the literal's length
+ *  @return Pointer to the literal; valid until the next StrPoolIntern().
+ */
+const char *StrPoolGet(const strpool_t *pool, int32_t id, uint32_t *len)
+{
+  *len = pool->lens[id];
+  return pool->buf + pool->offs[id];
+}
+
+/* Local Function Definitions ----------------------------------------------- */
+static uint32_t StrPoolHash(const char *s, uint32_t len)
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  while (len--) {
+    h = (h ^ (uint8_t)*s++) * 16777619u;
+  }
+  return h;
+}
+
+static int StrPoolGrowTable(strpool_t *pool)
+{
+  uint32_t cap = pool->table_cap ? pool->table_cap * 2 : 2 * STRPOOL_INIT_COUNT;
+  uint32_t *table = calloc(cap, sizeof(uint32_t));
+  uint32_t i, id, slot;
+
+  if (!table) {
+    return -1;
+  }
+
+  // Rehash existing literals
+  for (i = 0; i < pool->table_cap; i++) {
+    if ((id = pool->table[i]) != 0) {
+      slot = StrPoolHash(pool->buf + pool->offs[id - 1], pool->lens[id - 1]);
+      for (slot &= cap - 1; table[slot]; slot = (slot + 1) & (cap - 1)) {
+      }
+      table[slot] = id;
+    }
+  }
+
+  free(pool->table);
+  pool->table = table;
+  pool->table_cap = cap;
+  return 0;
+}
+
+/**************************************************************** END OF FILE */
@@ -0,0 +1,155 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "utf8.h"
+
+/* Private Function Prototypes ---------------------------------------------- */
+static uint32_t Utf8AsciiPrefix(const uint8_t *p, uint32_t len);
+static uint32_t Utf8Sequence(const uint8_t *p, uint32_t len);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Check that s is well-formed UTF-8: no stray continuation
+ *          bytes, truncated or overlong sequences, surrogates, or code
+ *          points past U+10FFFF. ASCII runs are checked a block at a time.
+ *  @return len if it is, else the offset of the first bad byte.
+ */
+uint32_t Utf8Validate(const char *s, uint32_t len)
+{
+  const uint8_t *p = (const uint8_t *)s;
+  uint32_t i = 0, n;
+
+  while ((i += Utf8AsciiPrefix(p + i, len - i)) < len) {
+    if ((n = Utf8Sequence(p + i, len - i)) == 0) {
+      return i;
+    }
+    i += n;
+  }
+
+  return len;
+}
+
+/**
+ *  @brief  Number of characters in s: its bytes that aren't continuation
+ *          bytes (10xxxxxx).
+ */
+uint32_t Utf8Length(const char *s, uint32_t len)
+{
+  uint32_t i = 0, cont = 0;
+#if defined(__SSE2__)
+  // Continuation bytes are the signed bytes below (int8_t)0xC0
+  const __m128i limit = _mm_set1_epi8((char)0xC0);
+  __m128i v;
+
+  for (; i + UTF8_BLOCK_SIZE <= len; i += UTF8_BLOCK_SIZE) {
+    v = _mm_loadu_si128((const __m128i *)(s + i));
+    cont += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(v, limit)));
+  }
+#endif
+  for (; i < len; i++) {
+    cont += ((s[i] & 0xC0) == 0x80);
+  }
+
+  return len - cont;
+}
+
+/**
+ *  @brief  Byte offset of character n (0 based) of s, len if s is shorter.
+ */
+uint32_t Utf8Offset(const char *s, uint32_t len, uint32_t n)
+{
+  const uint8_t *p = (const uint8_t *)s;
+  uint32_t i = 0, ascii;
+
+  for (;;) {
+    // Every byte of an ASCII run is a character
+    ascii = Utf8AsciiPrefix(p + i, len - i);
+    if (ascii > n) {
+      return i + n;
+    }
+    i += ascii;
+    n -= ascii;
+    for (; i < len && p[i] >= 0x80; i++) {
+      if ((p[i] & 0xC0) != 0x80 && n-- == 0) {
+        return i;
+      }
+    }
+    if (i == len) {
+      return len;
+    }
+  }
+}
+
+/* Local Function Definitions ----------------------------------------------- */
+/**
+ *  @brief  Length of the ASCII run p starts with, found a block at a time.
+ */
+static uint32_t Utf8AsciiPrefix(const uint8_t *p, uint32_t len)
+{
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  int mask;
+
+  for (; i + UTF8_BLOCK_SIZE <= len; i += UTF8_BLOCK_SIZE) {
+    if ((mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i)))) != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#else
+  uint64_t w;
+
+  for (; i + sizeof(w) <= len; i += sizeof(w)) {
+    memcpy(&w, p + i, sizeof(w));
+    if (w & 0x8080808080808080ULL) {
+      break;
+    }
+  }
+#endif
+  while (i < len && p[i] < 0x80) {
+    i++;
+  }
+
+  return i;
+}
+
+/**
+ *  @brief  Length of the well-formed multibyte sequence p starts with.
+ *  @return 0 if it isn't one.
+ */
+static uint32_t Utf8Sequence(const uint8_t *p, uint32_t len)
+{
+  // Allowed range of the second byte, which rules out overlong forms,
+  // surrogates and code points past U+10FFFF
+  uint8_t lo = 0x80, hi = 0xBF;
+  uint32_t n, i;
+
+  if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+    n = 2;
+  } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+    n = 3;
+    lo = (p[0] == 0xE0 ? 0xA0 : lo);
+    hi = (p[0] == 0xED ? 0x9F : hi);
+  } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+    n = 4;
+    lo = (p[0] == 0xF0 ? 0x90 : lo);
+    hi = (p[0] == 0xF4 ? 0x8F : hi);
+  } else {
+    return 0;
+  }
+
+  if (len < n || p[1] < lo || p[1] > hi) {
+    return 0;
+  }
+  for (i = 2; i < n; i++) {
+    if ((p[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+  }
+
+  return n;
+}
+
+/**************************************************************** END OF FILE */
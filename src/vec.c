@@ -0,0 +1,806 @@
+
+/* Includes ----------------------------------------------------------------- */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "basic.h"
+#include "vec.h"
+
+/* Private Function Prototypes ---------------------------------------------- */
+static int64_t VecSum8(const uint8_t *p, uint32_t n, int sign);
+static int64_t VecSum16(const uint8_t *p, uint32_t n, int sign);
+static int64_t VecSum32(const uint8_t *p, uint32_t n, int sign);
+static uint64_t VecSum64(const uint8_t *p, uint32_t n);
+static double VecSumFloat(const uint8_t *p, uint32_t n, uint32_t width);
+static uint32_t VecMinMaxBlocks(const uint8_t *p, uint32_t n, uint32_t width,
+                                int sign, int max, uint64_t *best);
+static void VecMinMaxFloat(const uint8_t *p, uint32_t n, uint32_t width, int max,
+                           vec_value_t *out);
+static int64_t VecDotInt(const uint8_t *a, const uint8_t *b, uint32_t n,
+                         uint32_t width, int sign);
+static double VecDotFloat(const uint8_t *a, const uint8_t *b, uint32_t n,
+                          uint32_t width);
+static int VecRadixSort(uint8_t *p, uint32_t n, uint32_t width, int sign);
+static int VecCompareInt64(const void *a, const void *b);
+static int VecCompareUint64(const void *a, const void *b);
+static int VecCompareFloat32(const void *a, const void *b);
+static int VecCompareFloat64(const void *a, const void *b);
+static inline uint64_t VecLoad(const uint8_t *p, uint32_t i, uint32_t width);
+static inline int64_t VecSignExtend(uint64_t bits, uint32_t width);
+static double VecFloat(uint64_t bits, uint32_t width);
+static uint32_t VecWidth(int type);
+static int VecIsSigned(int type);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ *  @brief  Sum of the n elements at mem. Integers are summed exactly in 64
+ *          bits (wrapping only past that), floats in double precision.
+ */
+void VecSum(const uint8_t *mem, uint32_t n, int type, vec_value_t *sum)
+{
+  int sign = VecIsSigned(type);
+
+  switch (type) {
+    case VAR_FLOAT32:
+    case VAR_FLOAT64:
+      sum->f64 = VecSumFloat(mem, n, VecWidth(type));
+      break;
+    case VAR_INT64:
+    case VAR_UINT64:
+      sum->u64 = VecSum64(mem, n);
+      break;
+    default:
+      switch (VecWidth(type)) {
+        case 1:
+          sum->i64 = VecSum8(mem, n, sign);
+          break;
+        case 2:
+          sum->i64 = VecSum16(mem, n, sign);
+          break;
+        default:
+          sum->i64 = VecSum32(mem, n, sign);
+          break;
+      }
+      break;
+  }
+}
+
+/**
+ *  @brief  Smallest (or largest, if max) of the n > 0 elements at mem. A
+ *          float array with a NaN in it gives NaN.
+ */
+void VecMinMax(const uint8_t *mem, uint32_t n, int type, int max, vec_value_t *out)
+{
+  uint32_t width = VecWidth(type), i;
+  int sign = VecIsSigned(type);
+  // Compared as unsigned numbers once the sign bit is flipped
+  uint64_t bias = (sign ? 1ULL << (width * 8 - 1) : 0), best, k;
+
+  if (type == VAR_FLOAT32 || type == VAR_FLOAT64) {
+    VecMinMaxFloat(mem, n, width, max, out);
+    return;
+  }
+
+  best = VecLoad(mem, 0, width) ^ bias;
+  if (width == 8) {
+    // SSE2 can't compare 64-bit lanes; whole-word loads at least
+    for (i = 1; i < n; i++) {
+      k = VecLoad(mem, i, 8) ^ bias;
+      if (max ? k > best : k < best) {
+        best = k;
+      }
+    }
+  } else {
+    for (i = VecMinMaxBlocks(mem, n, width, sign, max, &best); i < n; i++) {
+      k = VecLoad(mem, i, width) ^ bias;
+      if (max ? k > best : k < best) {
+        best = k;
+      }
+    }
+  }
+
+  best ^= bias;
+  if (sign) {
+    out->i64 = VecSignExtend(best, width);
+  } else {
+    out->u64 = best;
+  }
+}
+
+/**
+ *  @brief  Number of the n elements at mem equal to key: for integers the
+ *          element's bits (key->u64, low bytes), for floats key->f64.
+ */
+uint32_t VecCount(const uint8_t *mem, uint32_t n, int type, const vec_value_t *key)
+{
+  uint32_t width = VecWidth(type), i = 0, count = 0;
+  uint64_t bits = key->u64;
+  float f32 = (float)key->f64;
+  double f64 = key->f64;
+
+  if (type == VAR_FLOAT32 || type == VAR_FLOAT64) {
+#if defined(__SSE2__)
+    if (type == VAR_FLOAT32) {
+      const __m128 k = _mm_set1_ps(f32);
+      for (; i + 4 <= n; i += 4) {
+        count += __builtin_popcount(_mm_movemask_ps(
+                   _mm_cmpeq_ps(_mm_loadu_ps((const float *)(mem + i * 4)), k)));
+      }
+    } else {
+      const __m128d k = _mm_set1_pd(f64);
+      for (; i + 2 <= n; i += 2) {
+        count += __builtin_popcount(_mm_movemask_pd(
+                   _mm_cmpeq_pd(_mm_loadu_pd((const double *)(mem + i * 8)), k)));
+      }
+    }
+#endif
+    for (; i < n; i++) {
+      if (type == VAR_FLOAT32 ? (float)VecFloat(VecLoad(mem, i, 4), 4) == f32
+                              : VecFloat(VecLoad(mem, i, 8), 8) == f64) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  if (width < 8) {
+    bits &= (1ULL << (width * 8)) - 1;
+  }
+#if defined(__SSE2__)
+  {
+    // Matching lanes are all ones; count their bytes
+    __m128i k, eq;
+    uint32_t bytes = 0;
+
+    switch (width) {
+      case 1:
+        k = _mm_set1_epi8((char)bits);
+        break;
+      case 2:
+        k = _mm_set1_epi16((short)bits);
+        break;
+      case 4:
+        k = _mm_set1_epi32((int)bits);
+        break;
+      default:
+        k = _mm_set_epi32((int)(bits >> 32), (int)bits, (int)(bits >> 32), (int)bits);
+        break;
+    }
+    for (; (i + 16 / width) <= n; i += 16 / width) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(mem + i * width));
+      switch (width) {
+        case 1:
+          eq = _mm_cmpeq_epi8(v, k);
+          break;
+        case 2:
+          eq = _mm_cmpeq_epi16(v, k);
+          break;
+        case 4:
+          eq = _mm_cmpeq_epi32(v, k);
+          break;
+        default:
+          // Both halves of a 64-bit lane have to match
+          eq = _mm_cmpeq_epi32(v, k);
+          eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+          break;
+      }
+      bytes += __builtin_popcount(_mm_movemask_epi8(eq));
+    }
+    count = bytes / width;
+  }
+#endif
+  for (; i < n; i++) {
+    count += (VecLoad(mem, i, width) == bits);
+  }
+
+  return count;
+}
+
+/**
+ *  @brief  Sum of the products of the n elements at a and b (both of the
+ *          given type). Integer products and their sum wrap modulo 2^64,
+ *          which 32-bit elements can reach; floats are in double precision.
+ */
+void VecDot(const uint8_t *a, const uint8_t *b, uint32_t n, int type, vec_value_t *dot)
+{
+  if (type == VAR_FLOAT32 || type == VAR_FLOAT64) {
+    dot->f64 = VecDotFloat(a, b, n, VecWidth(type));
+  } else {
+    dot->i64 = VecDotInt(a, b, n, VecWidth(type), VecIsSigned(type));
+  }
+}
+
+/**
+ *  @brief  Sort the n elements at mem in place, in ascending order. 8, 16
+ *          and 32-bit integers are radix sorted; wider types are compared,
+ *          and NaNs sort last.
+ *  @return rFAILURE if there's no memory for the radix sort's copy.
+ */
+int VecSort(uint8_t *mem, uint32_t n, int type)
+{
+  int (*compare)(const void *, const void *);
+
+  switch (type) {
+    case VAR_INT64:
+      compare = VecCompareInt64;
+      break;
+    case VAR_UINT64:
+      compare = VecCompareUint64;
+      break;
+    case VAR_FLOAT32:
+      compare = VecCompareFloat32;
+      break;
+    case VAR_FLOAT64:
+      compare = VecCompareFloat64;
+      break;
+    default:
+      return VecRadixSort(mem, n, VecWidth(type), VecIsSigned(type));
+  }
+
+  qsort(mem, n, VecWidth(type), compare);
+  return rSUCCESS;
+}
+
+/* Local Function Definitions ----------------------------------------------- */
+/**
+ *  @brief  Bytes are summed 16 at a time with SAD against zero; signed ones
+ *          are first biased by 128.
+ */
+static int64_t VecSum8(const uint8_t *p, uint32_t n, int sign)
+{
+  uint64_t total = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  const __m128i bias = _mm_set1_epi8(sign ? (char)0x80 : 0);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  uint64_t lanes[2];
+
+  for (; i + 16 <= n; i += 16) {
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(
+            _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)), bias), zero));
+  }
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  total = lanes[0] + lanes[1] - (sign ? 128 * (uint64_t)i : 0);
+#endif
+  for (; i < n; i++) {
+    total += (sign ? (int8_t)p[i] : p[i]);
+  }
+
+  return total;
+}
+
+/**
+ *  @brief  Pairs of 16-bit elements are added into 32-bit lanes with a
+ *          multiply-add by one; unsigned ones are biased by -32768 first.
+ */
+static int64_t VecSum16(const uint8_t *p, uint32_t n, int sign)
+{
+  int64_t total = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  const __m128i bias = _mm_set1_epi16(sign ? 0 : (short)0x8000);
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i acc = _mm_setzero_si128(), acc32, s;
+  uint32_t blocks;
+  int64_t lanes[2];
+
+  while (i + 8 <= n) {
+    acc32 = _mm_setzero_si128();
+    for (blocks = 0; blocks < VEC_FOLD_BLOCKS && i + 8 <= n; blocks++, i += 8) {
+      acc32 = _mm_add_epi32(acc32, _mm_madd_epi16(
+                _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i * 2)), bias),
+                ones));
+    }
+    s = _mm_srai_epi32(acc32, 31);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(acc32, s));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(acc32, s));
+  }
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  total = lanes[0] + lanes[1] + (sign ? 0 : 32768 * (int64_t)i);
+#endif
+  for (; i < n; i++) {
+    total += (sign ? VecSignExtend(VecLoad(p, i, 2), 2) : (int64_t)VecLoad(p, i, 2));
+  }
+
+  return total;
+}
+
+/**
+ *  @brief  32-bit elements are widened to 64-bit lanes (sign or zero
+ *          extended) and added.
+ */
+static int64_t VecSum32(const uint8_t *p, uint32_t n, int sign)
+{
+  uint64_t total = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero, v, s;
+  uint64_t lanes[2];
+
+  for (; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(p + i * 4));
+    s = (sign ? _mm_srai_epi32(v, 31) : zero);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, s));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, s));
+  }
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  total = lanes[0] + lanes[1];
+#endif
+  for (; i < n; i++) {
+    total += (sign ? (uint64_t)VecSignExtend(VecLoad(p, i, 4), 4) : VecLoad(p, i, 4));
+  }
+
+  return total;
+}
+
+static uint64_t VecSum64(const uint8_t *p, uint32_t n)
+{
+  uint64_t total = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  __m128i acc = _mm_setzero_si128();
+  uint64_t lanes[2];
+
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_add_epi64(acc, _mm_loadu_si128((const __m128i *)(p + i * 8)));
+  }
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  total = lanes[0] + lanes[1];
+#endif
+  for (; i < n; i++) {
+    total += VecLoad(p, i, 8);
+  }
+
+  return total;
+}
+
+/**
+ *  @brief  Floats are summed in double precision, four lanes at a time (so
+ *          the result may differ in the last bits from a sum in order).
+ */
+static double VecSumFloat(const uint8_t *p, uint32_t n, uint32_t width)
+{
+  double total = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+  __m128 v;
+  double lanes[2];
+
+  if (width == 4) {
+    for (; i + 4 <= n; i += 4) {
+      v = _mm_loadu_ps((const float *)(p + i * 4));
+      acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(v));
+      acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+  } else {
+    for (; i + 4 <= n; i += 4) {
+      acc0 = _mm_add_pd(acc0, _mm_loadu_pd((const double *)(p + i * 8)));
+      acc1 = _mm_add_pd(acc1, _mm_loadu_pd((const double *)(p + i * 8 + 16)));
+    }
+  }
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  total = lanes[0] + lanes[1];
+#endif
+  for (; i < n; i++) {
+    total += VecFloat(VecLoad(p, i, width), width);
+  }
+
+  return total;
+}
+
+/**
+ *  @brief  Fold whole blocks of 8, 16 or 32-bit integers into best (as
+ *          VecMinMax() compares them: unsigned, sign bit flipped if sign).
+ *  @return Elements folded in.
+ */
+static uint32_t VecMinMaxBlocks(const uint8_t *p, uint32_t n, uint32_t width,
+                                int sign, int max, uint64_t *best)
+{
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  // 8-bit lanes compare unsigned, wider ones signed: flip the sign bit of
+  // the ones that aren't that already
+  const __m128i flip = (width == 1 ? _mm_set1_epi8(sign ? (char)0x80 : 0)
+                        : width == 2 ? _mm_set1_epi16(sign ? 0 : (short)0x8000)
+                        : _mm_set1_epi32(sign ? 0 : (int)0x80000000));
+  uint64_t bias = 1ULL << (width * 8 - 1), k;
+  uint32_t per = 16 / width, j;
+  __m128i acc, v, gt;
+  uint8_t lanes[16];
+
+  if (width > 4 || n < per) {
+    return 0;
+  }
+
+  acc = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p), flip);
+  for (i = per; i + per <= n; i += per) {
+    v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i * width)), flip);
+    switch (width) {
+      case 1:
+        acc = (max ? _mm_max_epu8(acc, v) : _mm_min_epu8(acc, v));
+        break;
+      case 2:
+        acc = (max ? _mm_max_epi16(acc, v) : _mm_min_epi16(acc, v));
+        break;
+      default:
+        gt = _mm_cmpgt_epi32(acc, v);
+        if (max) {
+          acc = _mm_or_si128(_mm_and_si128(gt, acc), _mm_andnot_si128(gt, v));
+        } else {
+          acc = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, acc));
+        }
+        break;
+    }
+  }
+
+  // Back to the element's bits, then to VecMinMax()'s order
+  _mm_storeu_si128((__m128i *)lanes, _mm_xor_si128(acc, flip));
+  for (j = 0; j < per; j++) {
+    k = VecLoad(lanes, j, width) ^ (sign ? bias : 0);
+    if (max ? k > *best : k < *best) {
+      *best = k;
+    }
+  }
+#endif
+
+  return i;
+}
+
+static void VecMinMaxFloat(const uint8_t *p, uint32_t n, uint32_t width, int max,
+                           vec_value_t *out)
+{
+  double best = VecFloat(VecLoad(p, 0, width), width), x;
+  uint32_t i = 0, j;
+  int nan = 0;
+#if defined(__SSE2__)
+  double lanes[4];
+
+  if (width == 4 && n >= 4) {
+    __m128 acc = _mm_loadu_ps((const float *)p), v, unord = _mm_setzero_ps();
+    float f[4];
+    for (i = 4; i + 4 <= n; i += 4) {
+      v = _mm_loadu_ps((const float *)(p + i * 4));
+      unord = _mm_or_ps(unord, _mm_cmpunord_ps(v, v));
+      acc = (max ? _mm_max_ps(acc, v) : _mm_min_ps(acc, v));
+    }
+    unord = _mm_or_ps(unord, _mm_cmpunord_ps(acc, acc));
+    nan = (_mm_movemask_ps(unord) != 0);
+    _mm_storeu_ps(f, acc);
+    for (j = 0; j < 4; j++) {
+      lanes[j] = f[j];
+    }
+  } else if (width == 8 && n >= 2) {
+    __m128d acc = _mm_loadu_pd((const double *)p), v, unord = _mm_setzero_pd();
+    for (i = 2; i + 2 <= n; i += 2) {
+      v = _mm_loadu_pd((const double *)(p + i * 8));
+      unord = _mm_or_pd(unord, _mm_cmpunord_pd(v, v));
+      acc = (max ? _mm_max_pd(acc, v) : _mm_min_pd(acc, v));
+    }
+    unord = _mm_or_pd(unord, _mm_cmpunord_pd(acc, acc));
+    nan = (_mm_movemask_pd(unord) != 0);
+    _mm_storeu_pd(lanes, acc);
+    lanes[2] = lanes[3] = lanes[0];
+  }
+  for (j = 0; i > 0 && j < 4; j++) {
+    if (max ? lanes[j] > best : lanes[j] < best) {
+      best = lanes[j];
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    x = VecFloat(VecLoad(p, i, width), width);
+    if (x != x) {
+      nan = 1;
+    } else if (max ? x > best : x < best) {
+      best = x;
+    }
+  }
+
+  out->f64 = (nan || best != best ? NAN : best);
+}
+
+/**
+ *  @brief  Integer dot product, wrapping in 64 bits. 8, 16 and 32-bit
+ *          elements are multiplied a vector at a time; SSE2 has no 64-bit
+ *          multiply to do the same for wider ones.
+ */
+static int64_t VecDotInt(const uint8_t *a, const uint8_t *b, uint32_t n,
+                         uint32_t width, int sign)
+{
+  uint64_t total = 0, x, y;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero, acc32, va, vb, lo, hi, s;
+  uint32_t blocks;
+  uint64_t lanes[2];
+
+  if (width == 1) {
+    // Widened to 16 bits, pairs of products add into 32-bit lanes
+    while (i + 16 <= n) {
+      acc32 = zero;
+      for (blocks = 0; blocks < VEC_FOLD_BLOCKS && i + 16 <= n; blocks++, i += 16) {
+        va = _mm_loadu_si128((const __m128i *)(a + i));
+        vb = _mm_loadu_si128((const __m128i *)(b + i));
+        if (sign) {
+          lo = _mm_madd_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8),
+                              _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8));
+          hi = _mm_madd_epi16(_mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8),
+                              _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8));
+        } else {
+          lo = _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+          hi = _mm_madd_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        }
+        acc32 = _mm_add_epi32(acc32, _mm_add_epi32(lo, hi));
+      }
+      s = (sign ? _mm_srai_epi32(acc32, 31) : zero);
+      acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(acc32, s));
+      acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(acc32, s));
+    }
+  } else if (width == 2) {
+    // Full 32-bit products from their low and high halves
+    for (; i + 8 <= n; i += 8) {
+      va = _mm_loadu_si128((const __m128i *)(a + i * 2));
+      vb = _mm_loadu_si128((const __m128i *)(b + i * 2));
+      lo = _mm_mullo_epi16(va, vb);
+      hi = (sign ? _mm_mulhi_epi16(va, vb) : _mm_mulhi_epu16(va, vb));
+      va = _mm_unpacklo_epi16(lo, hi);
+      vb = _mm_unpackhi_epi16(lo, hi);
+      s = (sign ? _mm_srai_epi32(va, 31) : zero);
+      acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(va, s));
+      acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(va, s));
+      s = (sign ? _mm_srai_epi32(vb, 31) : zero);
+      acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(vb, s));
+      acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(vb, s));
+    }
+  } else if (width == 4) {
+    // Unsigned 64-bit products of the even and odd lanes; a signed one
+    // differs by the other factor for each negative one, shifted up 32
+    const __m128i odd = _mm_set_epi32(-1, 0, -1, 0);
+    __m128i fix;
+    for (; i + 4 <= n; i += 4) {
+      va = _mm_loadu_si128((const __m128i *)(a + i * 4));
+      vb = _mm_loadu_si128((const __m128i *)(b + i * 4));
+      lo = _mm_mul_epu32(va, vb);
+      hi = _mm_mul_epu32(_mm_srli_epi64(va, 32), _mm_srli_epi64(vb, 32));
+      if (sign) {
+        fix = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(va, 31), vb),
+                            _mm_and_si128(_mm_srai_epi32(vb, 31), va));
+        lo = _mm_sub_epi64(lo, _mm_slli_epi64(fix, 32));
+        hi = _mm_sub_epi64(hi, _mm_and_si128(fix, odd));
+      }
+      acc = _mm_add_epi64(acc, _mm_add_epi64(lo, hi));
+    }
+  }
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  total = lanes[0] + lanes[1];
+#endif
+  if (width == 8) {
+    // The low 64 bits of a product don't depend on the sign
+    for (; i < n; i++) {
+      total += VecLoad(a, i, 8) * VecLoad(b, i, 8);
+    }
+  }
+  for (; i < n; i++) {
+    x = VecLoad(a, i, width);
+    y = VecLoad(b, i, width);
+    if (sign) {
+      x = VecSignExtend(x, width);
+      y = VecSignExtend(y, width);
+    }
+    total += x * y;
+  }
+
+  return total;
+}
+
+static double VecDotFloat(const uint8_t *a, const uint8_t *b, uint32_t n,
+                          uint32_t width)
+{
+  double total = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+  __m128 va, vb;
+  double lanes[2];
+
+  if (width == 4) {
+    for (; i + 4 <= n; i += 4) {
+      va = _mm_loadu_ps((const float *)(a + i * 4));
+      vb = _mm_loadu_ps((const float *)(b + i * 4));
+      acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_cvtps_pd(va), _mm_cvtps_pd(vb)));
+      acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(va, va)),
+                                         _mm_cvtps_pd(_mm_movehl_ps(vb, vb))));
+    }
+  } else {
+    for (; i + 4 <= n; i += 4) {
+      acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd((const double *)(a + i * 8)),
+                                         _mm_loadu_pd((const double *)(b + i * 8))));
+      acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd((const double *)(a + i * 8 + 16)),
+                                         _mm_loadu_pd((const double *)(b + i * 8 + 16))));
+    }
+  }
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  total = lanes[0] + lanes[1];
+#endif
+  for (; i < n; i++) {
+    total += VecFloat(VecLoad(a, i, width), width) * VecFloat(VecLoad(b, i, width), width);
+  }
+
+  return total;
+}
+
+/**
+ *  @brief  LSD radix sort, a byte per pass. All the passes' counts are
+ *          taken in one read, and a pass whose byte is the same in every
+ *          element is skipped. The sign bit is flipped in the top byte of
+ *          signed elements.
+ */
+static int VecRadixSort(uint8_t *p, uint32_t n, uint32_t width, int sign)
+{
+  uint32_t (*counts)[256], i, d, k, sum, c;
+  uint8_t *tmp = NULL, *src = p, *dst, top = (sign ? 0x80 : 0);
+
+  if (n < 2) {
+    return rSUCCESS;
+  }
+  if ((counts = calloc(width, sizeof(*counts))) == NULL
+        || (width > 1 && (tmp = malloc((size_t)n * width)) == NULL)) {
+    free(counts);
+    return rFAILURE;
+  }
+
+  for (i = 0; i < n; i++) {
+    for (d = 0; d < width; d++) {
+      counts[d][p[i * width + d] ^ (d == width - 1 ? top : 0)]++;
+    }
+  }
+
+  if (width == 1) {
+    // The counts are the sorted array
+    for (k = 0, i = 0; k < 256; k++) {
+      memset(p + i, (int)(k ^ top), counts[0][k]);
+      i += counts[0][k];
+    }
+    free(counts);
+    return rSUCCESS;
+  }
+
+  dst = tmp;
+  for (d = 0; d < width; d++) {
+    uint8_t flip = (d == width - 1 ? top : 0);
+    if (counts[d][src[d] ^ flip] == n) {
+      continue;
+    }
+    for (k = 0, sum = 0; k < 256; k++) {
+      c = counts[d][k];
+      counts[d][k] = sum;
+      sum += c;
+    }
+    if (width == 2) {
+      for (i = 0; i < n; i++) {
+        memcpy(dst + counts[d][src[i * 2 + d] ^ flip]++ * 2, src + i * 2, 2);
+      }
+    } else {
+      for (i = 0; i < n; i++) {
+        memcpy(dst + counts[d][src[i * 4 + d] ^ flip]++ * 4, src + i * 4, 4);
+      }
+    }
+    dst = src;
+    src = (src == p ? tmp : p);
+  }
+  if (src != p) {
+    memcpy(p, src, (size_t)n * width);
+  }
+
+  free(counts);
+  free(tmp);
+  return rSUCCESS;
+}
+
+static int VecCompareInt64(const void *a, const void *b)
+{
+  int64_t x = VecLoad(a, 0, 8), y = VecLoad(b, 0, 8);
+
+  return (x > y) - (x < y);
+}
+
+static int VecCompareUint64(const void *a, const void *b)
+{
+  uint64_t x = VecLoad(a, 0, 8), y = VecLoad(b, 0, 8);
+
+  return (x > y) - (x < y);
+}
+
+static int VecCompareFloat32(const void *a, const void *b)
+{
+  double x = VecFloat(VecLoad(a, 0, 4), 4), y = VecFloat(VecLoad(b, 0, 4), 4);
+
+  if (x != x || y != y) {
+    return (x != x) - (y != y);
+  }
+  return (x > y) - (x < y);
+}
+
+static int VecCompareFloat64(const void *a, const void *b)
+{
+  double x = VecFloat(VecLoad(a, 0, 8), 8), y = VecFloat(VecLoad(b, 0, 8), 8);
+
+  if (x != x || y != y) {
+    return (x != x) - (y != y);
+  }
+  return (x > y) - (x < y);
+}
+
+/**
+ *  @brief  Element i of a width-byte little endian array, zero extended.
+ */
+static inline uint64_t VecLoad(const uint8_t *p, uint32_t i, uint32_t width)
+{
+  uint64_t bits = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  memcpy(&bits, p + i * width, width);
+#else
+  uint32_t b;
+
+  p += i * width;
+  for (b = 0; b < width; b++) {
+    bits |= (uint64_t)p[b] << (b * 8);
+  }
+#endif
+  return bits;
+}
+
+static inline int64_t VecSignExtend(uint64_t bits, uint32_t width)
+{
+  uint32_t shift = 64 - width * 8;
+
+  return (int64_t)(bits << shift) >> shift;
+}
+
+static double VecFloat(uint64_t bits, uint32_t width)
+{
+  uint32_t bits32 = (uint32_t)bits;
+  float f32;
+  double f64;
+
+  if (width == 4) {
+    memcpy(&f32, &bits32, sizeof(f32));
+    return f32;
+  }
+  memcpy(&f64, &bits, sizeof(f64));
+  return f64;
+}
+
+static uint32_t VecWidth(int type)
+{
+  switch (type) {
+    case VAR_INT16:
+    case VAR_UINT16:
+      return 2;
+    case VAR_INT32:
+    case VAR_UINT32:
+    case VAR_FLOAT32:
+      return 4;
+    case VAR_INT64:
+    case VAR_UINT64:
+    case VAR_FLOAT64:
+      return 8;
+    default:
+      return 1;
+  }
+}
+
+static int VecIsSigned(int type)
+{
+  return (type == VAR_INT8 || type == VAR_INT16 || type == VAR_INT32
+          || type == VAR_INT64);
+}
+
+/**************************************************************** END OF FILE */